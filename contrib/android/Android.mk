@@ -40,6 +40,7 @@ libarchive_src_files := libarchive/archive_acl.c \
 						libarchive/archive_getdate.c \
 						libarchive/archive_hmac.c \
 						libarchive/archive_match.c \
+						libarchive/archive_name_cache.c \
 						libarchive/archive_options.c \
 						libarchive/archive_pack_dev.c \
 						libarchive/archive_pathmatch.c \
@@ -55,6 +56,7 @@ libarchive_src_files := libarchive/archive_acl.c \
 						libarchive/archive_read_disk_set_standard_lookup.c \
 						libarchive/archive_read_extract.c \
 						libarchive/archive_read_extract2.c \
+						libarchive/archive_read_extract_parallel.c \
 						libarchive/archive_read_open_fd.c \
 						libarchive/archive_read_open_file.c \
 						libarchive/archive_read_open_filename.c \
@@ -91,8 +93,12 @@ libarchive_src_files := libarchive/archive_acl.c \
 						libarchive/archive_read_support_format_warc.c \
 						libarchive/archive_read_support_format_xar.c \
 						libarchive/archive_read_support_format_zip.c \
+						libarchive/archive_stats.c \
 						libarchive/archive_string.c \
 						libarchive/archive_string_sprintf.c \
+						libarchive/archive_tar_header.c \
+						libarchive/archive_tar_index.c \
+						libarchive/archive_thread.c \
 						libarchive/archive_util.c \
 						libarchive/archive_version_details.c \
 						libarchive/archive_virtual.c \
@@ -160,6 +166,7 @@ bsdtar_src_files := tar/bsdtar.c \
 					tar/cmdline.c \
 					tar/creation_set.c \
 					tar/read.c \
+					tar/snapshot.c \
 					tar/subst.c \
 					tar/util.c \
 					tar/write.c
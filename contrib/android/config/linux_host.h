@@ -63,9 +63,11 @@
 #define HAVE_FUTIMES 1
 #define HAVE_FUTIMESAT 1
 #define HAVE_GETEUID 1
+#define HAVE_GETGRENT 1
 #define HAVE_GETGRGID_R 1
 #define HAVE_GETGRNAM_R 1
 #define HAVE_GETPID 1
+#define HAVE_GETPWENT 1
 #define HAVE_GETPWNAM_R 1
 #define HAVE_GETPWUID_R 1
 #define HAVE_GETXATTR 1
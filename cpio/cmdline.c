@@ -73,6 +73,7 @@ static const struct option {
 	{ "help",			0, 'h' },
 	{ "insecure",			0, OPTION_INSECURE },
 	{ "link",			0, 'l' },
+	{ "link-memory-limit",		1, OPTION_LINK_MEMORY_LIMIT },
 	{ "list",			0, 't' },
 	{ "lrzip",			0, OPTION_LRZIP },
 	{ "lz4",			0, OPTION_LZ4 },
@@ -89,6 +90,7 @@ static const struct option {
 	{ "preserve-owner",		0, OPTION_PRESERVE_OWNER },
 	{ "pwb",			0, '6' },
 	{ "quiet",			0, OPTION_QUIET },
+	{ "threads",			1, OPTION_THREADS },
 	{ "unconditional",		0, 'u' },
 	{ "uuencode",			0, OPTION_UUENCODE },
 	{ "verbose",			0, 'v' },
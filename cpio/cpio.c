@@ -50,9 +50,15 @@ __FBSDID("$FreeBSD: src/usr.bin/cpio/cpio.c,v 1.15 2008/12/06 07:30:40 kientzle
 #ifdef HAVE_GRP_H
 #include <grp.h>
 #endif
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
 #ifdef HAVE_LOCALE_H
 #include <locale.h>
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 #ifdef HAVE_PWD_H
 #include <pwd.h>
 #endif
@@ -91,6 +97,13 @@ __FBSDID("$FreeBSD: src/usr.bin/cpio/cpio.c,v 1.15 2008/12/06 07:30:40 kientzle
 #define O_BINARY 0
 #endif
 
+/* Size of the buffer used to read files in out mode. */
+#define	CPIO_BUFF_SIZE	(1024 * 1024)
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#define	CPIO_PASS_THREADS
+#endif
+
 struct name_cache {
 	int	probes;
 	int	hits;
@@ -126,11 +139,19 @@ static void	usage(void) __LA_DEAD;
 static void	version(void) __LA_DEAD;
 static const char * passphrase_callback(struct archive *, void *);
 static void	passphrase_free(char *);
+static struct archive *pass_disk_new(struct cpio *);
+static void	write_entry(struct cpio *, struct archive *,
+		    struct archive_entry *, int);
+#ifdef CPIO_PASS_THREADS
+static struct pass_pool *pass_pool_new(struct cpio *, int);
+static void	pass_pool_add(struct pass_pool *, struct archive_entry *, int);
+static void	pass_pool_drain(struct pass_pool *);
+static int64_t	pass_pool_free(struct pass_pool *);
+#endif
 
 int
 main(int argc, char *argv[])
 {
-	static char buff[16384];
 	struct cpio _cpio; /* Allocated on stack. */
 	struct cpio *cpio;
 	const char *errmsg;
@@ -140,8 +161,10 @@ main(int argc, char *argv[])
 
 	cpio = &_cpio;
 	memset(cpio, 0, sizeof(*cpio));
-	cpio->buff = buff;
-	cpio->buff_size = sizeof(buff);
+	cpio->buff_size = CPIO_BUFF_SIZE;
+	cpio->buff = malloc(cpio->buff_size);
+	if (cpio->buff == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate data buffer");
 
 #if defined(HAVE_SIGACTION) && defined(SIGPIPE)
 	{ /* Ignore SIGPIPE signals. */
@@ -182,6 +205,7 @@ main(int argc, char *argv[])
 #endif
 	cpio->bytes_per_block = 512;
 	cpio->filename = NULL;
+	cpio->threads = 1;
 
 	cpio->matching = archive_match_new();
 	if (cpio->matching == NULL)
@@ -278,6 +302,19 @@ main(int argc, char *argv[])
 		case 'l': /* POSIX 1997 */
 			cpio->option_link = 1;
 			break;
+		case OPTION_LINK_MEMORY_LIMIT:
+			errno = 0;
+			tptr = NULL;
+			t = (int)strtol(cpio->argument, &tptr, 10);
+			if (errno || t < 0 || *(cpio->argument) == '\0' ||
+			    tptr == NULL || *tptr != '\0' ||
+			    (size_t)t > ((size_t)-1) >> 20) {
+				lafe_errc(1, 0, "Invalid link memory limit: %s",
+				    cpio->argument);
+			}
+			/* Given in megabytes. */
+			cpio->link_memory_limit = (size_t)t << 20;
+			break;
 		case OPTION_LRZIP:
 		case OPTION_LZ4:
 		case OPTION_LZMA: /* GNU tar, others */
@@ -308,6 +345,7 @@ main(int argc, char *argv[])
 				lafe_errc(1, 0,
 				    "Cannot use both -p and -%c", cpio->mode);
 			cpio->mode = opt;
+			cpio->extract_flags |= ARCHIVE_EXTRACT_CLONE;
 			cpio->extract_flags &= ~ARCHIVE_EXTRACT_SECURE_NODOTDOT;
 			cpio->extract_flags &= ~ARCHIVE_EXTRACT_SECURE_NOABSOLUTEPATHS;
 			break;
@@ -343,6 +381,17 @@ main(int argc, char *argv[])
 		case 't': /* POSIX 1997 */
 			cpio->option_list = 1;
 			break;
+		case OPTION_THREADS:
+			errno = 0;
+			tptr = NULL;
+			t = (int)strtol(cpio->argument, &tptr, 10);
+			if (errno || t < 0 || *(cpio->argument) == '\0' ||
+			    tptr == NULL || *tptr != '\0') {
+				lafe_errc(1, 0, "Invalid number of threads: %s",
+				    cpio->argument);
+			}
+			cpio->threads = t;
+			break;
 		case 'u': /* POSIX 1997 */
 			cpio->extract_flags
 			    &= ~ARCHIVE_EXTRACT_NO_OVERWRITE_NEWER;
@@ -399,6 +448,13 @@ main(int argc, char *argv[])
 	/* -l requires -p */
 	if (cpio->option_link && cpio->mode != 'p')
 		lafe_errc(1, 0, "Option -l requires -p");
+	/* --link-memory-limit requires -o or -p */
+	if (cpio->link_memory_limit != 0 && cpio->mode != 'o' &&
+	    cpio->mode != 'p')
+		lafe_errc(1, 0, "Option --link-memory-limit requires -o or -p");
+	/* --threads requires -p */
+	if (cpio->threads != 1 && cpio->mode != 'p')
+		lafe_errc(1, 0, "Option --threads requires -p");
 	/* -v overrides -V */
 	if (cpio->dot && cpio->verbose)
 		cpio->dot = 0;
@@ -443,6 +499,7 @@ main(int argc, char *argv[])
 	free_cache(cpio->gname_cache);
 	free_cache(cpio->uname_cache);
 	free(cpio->destdir);
+	free(cpio->buff);
 	passphrase_free(cpio->ppbuff);
 	return (cpio->return_value);
 }
@@ -599,6 +656,8 @@ mode_out(struct cpio *cpio)
 	cpio->linkresolver = archive_entry_linkresolver_new();
 	archive_entry_linkresolver_set_strategy(cpio->linkresolver,
 	    archive_format(cpio->archive));
+	archive_entry_linkresolver_set_memory_limit(cpio->linkresolver,
+	    cpio->link_memory_limit);
 	if (cpio->passphrase != NULL)
 		r = archive_write_set_passphrase(cpio->archive,
 			cpio->passphrase);
@@ -795,7 +854,6 @@ entry_to_archive(struct cpio *cpio, struct archive_entry *entry)
 	const char *destpath = archive_entry_pathname(entry);
 	const char *srcpath = archive_entry_sourcepath(entry);
 	int fd = -1;
-	ssize_t bytes_read;
 	int r;
 
 	/* Print out the destination name to the user. */
@@ -856,40 +914,39 @@ entry_to_archive(struct cpio *cpio, struct archive_entry *entry)
 				    "%s: could not open file", srcpath);
 				goto cleanup;
 			}
+			/* Let write_disk clone the data. */
+			if (cpio->mode == 'p')
+				archive_entry_set_source_fd(entry, fd);
 		}
 	} else {
 		archive_entry_set_size(entry, 0);
 	}
 
-	r = archive_write_header(cpio->archive, entry);
-
-	if (r != ARCHIVE_OK)
-		lafe_warnc(archive_errno(cpio->archive),
-		    "%s: %s",
-		    srcpath,
-		    archive_error_string(cpio->archive));
-
-	if (r == ARCHIVE_FATAL)
-		exit(1);
-
-	if (r >= ARCHIVE_WARN && archive_entry_size(entry) > 0 && fd >= 0) {
-		bytes_read = read(fd, cpio->buff, (unsigned)cpio->buff_size);
-		while (bytes_read > 0) {
-			ssize_t bytes_write;
-			bytes_write = archive_write_data(cpio->archive,
-			    cpio->buff, bytes_read);
-			if (bytes_write < 0)
-				lafe_errc(1, archive_errno(cpio->archive),
-				    "%s", archive_error_string(cpio->archive));
-			if (bytes_write < bytes_read) {
-				lafe_warnc(0,
-				    "Truncated write; file may have "
-				    "grown while being archived.");
-			}
-			bytes_read = read(fd, cpio->buff,
-			    (unsigned)cpio->buff_size);
+#ifdef CPIO_PASS_THREADS
+	if (cpio->pass_pool != NULL) {
+		/*
+		 * A hardlink needs the file it points to, which
+		 * may still be on its way.  For a name of PATH_MAX
+		 * or more, write_disk changes the working directory
+		 * of the process, so nothing else may be written
+		 * meanwhile.  Any other plain file is left to the
+		 * workers together with its descriptor.
+		 */
+		if (archive_entry_hardlink(entry) != NULL
+#ifdef PATH_MAX
+		    || strlen(destpath) >= PATH_MAX
+#endif
+		    )
+			pass_pool_drain(cpio->pass_pool);
+		else if (fd >= 0) {
+			pass_pool_add(cpio->pass_pool, entry, fd);
+			fd = -1;
+			goto cleanup;
 		}
 	}
+#endif
+
+	write_entry(cpio, cpio->archive, entry, fd);
 
 	fd = restore_time(cpio, entry, srcpath, fd);
 
@@ -901,6 +958,60 @@ cleanup:
 	return (0);
 }
 
+/*
+ * Write the header of an entry and, if its source is open on `fd',
+ * its data.  In pass mode the data is handed to write_disk, which
+ * can copy it without passing through our buffer.
+ */
+static void
+write_entry(struct cpio *cpio, struct archive *a,
+    struct archive_entry *entry, int fd)
+{
+	const char *srcpath = archive_entry_sourcepath(entry);
+	ssize_t bytes_read;
+	int64_t copied;
+	int r;
+
+	r = archive_write_header(a, entry);
+
+	if (r != ARCHIVE_OK)
+		lafe_warnc(archive_errno(a),
+		    "%s: %s",
+		    srcpath,
+		    archive_error_string(a));
+
+	if (r == ARCHIVE_FATAL)
+		exit(1);
+
+	if (r < ARCHIVE_WARN || archive_entry_size(entry) <= 0 || fd < 0)
+		return;
+
+	if (cpio->mode == 'p') {
+		copied = archive_write_disk_data_from_fd(a, fd);
+		if (copied < 0)
+			lafe_warnc(archive_errno(a),
+			    "%s: %s", srcpath, archive_error_string(a));
+		if (copied == ARCHIVE_FATAL)
+			exit(1);
+		return;
+	}
+
+	bytes_read = read(fd, cpio->buff, (unsigned)cpio->buff_size);
+	while (bytes_read > 0) {
+		ssize_t bytes_write;
+		bytes_write = archive_write_data(a, cpio->buff, bytes_read);
+		if (bytes_write < 0)
+			lafe_errc(1, archive_errno(a),
+			    "%s", archive_error_string(a));
+		if (bytes_write < bytes_read) {
+			lafe_warnc(0,
+			    "Truncated write; file may have "
+			    "grown while being archived.");
+		}
+		bytes_read = read(fd, cpio->buff, (unsigned)cpio->buff_size);
+	}
+}
+
 static int
 restore_time(struct cpio *cpio, struct archive_entry *entry,
     const char *name, int fd)
@@ -1233,11 +1344,281 @@ list_item_verbose(struct cpio *cpio, struct archive_entry *entry)
 	fprintf(out, "\n");
 }
 
+static struct archive *
+pass_disk_new(struct cpio *cpio)
+{
+	struct archive *a;
+	int r;
+
+	a = archive_write_disk_new();
+	if (a == NULL)
+		lafe_errc(1, 0, "Failed to allocate archive object");
+	r = archive_write_disk_set_options(a, cpio->extract_flags);
+	if (r != ARCHIVE_OK)
+		lafe_errc(1, 0, "%s", archive_error_string(a));
+	archive_write_disk_set_standard_lookup(a);
+	return (a);
+}
+
+#ifdef CPIO_PASS_THREADS
+/*
+ * With --threads, the data of plain files is copied by worker
+ * threads, each with its own archive_write_disk object.  The main
+ * thread still reads the names, creates directories, links and
+ * special files in order, and passes every plain file, with its
+ * source already open, through a short queue.  The workers hand
+ * finished files back; the main thread reports their errors and
+ * restores their access times.
+ */
+struct pass_job {
+	struct pass_job		*next;
+	struct archive_entry	*entry;
+	int			 fd;
+	/* The outcome, for the main thread to report. */
+	int			 status;
+	int			 error;
+	char			*message;
+};
+
+struct pass_worker {
+	struct pass_pool	*pool;
+	struct archive		*archive;
+	pthread_t		 thread;
+};
+
+struct pass_pool {
+	struct cpio		*cpio;
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 work;	/* A job was queued, or done. */
+	pthread_cond_t		 idle;	/* A job was finished. */
+	struct pass_job		*head;
+	struct pass_job		**tail;
+	struct pass_job		*finished;
+	int			 queued;
+	int			 busy;
+	int			 done;
+	int			 nworkers;
+	struct pass_worker	*workers;
+};
+
+/* Note the last error of `a' in the job. */
+static void
+pass_job_error(struct pass_job *job, struct archive *a)
+{
+	job->error = archive_errno(a);
+	free(job->message);
+	job->message = strdup(archive_error_string(a) != NULL ?
+	    archive_error_string(a) : "Unknown error");
+}
+
+/*
+ * The part of write_entry() done on a worker: it must not print or
+ * exit, so it leaves that to pass_pool_report().
+ */
+static void
+pass_job_copy(struct archive *a, struct pass_job *job)
+{
+	int64_t copied;
+
+	job->status = archive_write_header(a, job->entry);
+	if (job->status != ARCHIVE_OK)
+		pass_job_error(job, a);
+	if (job->status < ARCHIVE_WARN || archive_entry_size(job->entry) <= 0)
+		return;
+	copied = archive_write_disk_data_from_fd(a, job->fd);
+	if (copied < 0) {
+		job->status = (int)copied;
+		pass_job_error(job, a);
+	}
+}
+
+/*
+ * Report the files the workers have finished, as write_entry()
+ * would have, and close their sources.
+ */
+static void
+pass_pool_report(struct pass_pool *pool)
+{
+	struct pass_job *job, *next, *list = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+	/* Turn the list around, into the order they finished in. */
+	for (job = pool->finished; job != NULL; job = next) {
+		next = job->next;
+		job->next = list;
+		list = job;
+	}
+	pool->finished = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	for (job = list; job != NULL; job = next) {
+		next = job->next;
+		if (job->message != NULL)
+			lafe_warnc(job->error, "%s: %s",
+			    archive_entry_sourcepath(job->entry),
+			    job->message);
+		if (job->status == ARCHIVE_FATAL)
+			exit(1);
+		job->fd = restore_time(pool->cpio, job->entry,
+		    archive_entry_sourcepath(job->entry), job->fd);
+		if (job->fd >= 0)
+			close(job->fd);
+		archive_entry_free(job->entry);
+		free(job->message);
+		free(job);
+	}
+}
+
+static void *
+pass_worker_main(void *arg)
+{
+	struct pass_worker *w = arg;
+	struct pass_pool *pool = w->pool;
+	struct pass_job *job;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (pool->head == NULL && !pool->done)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		if ((job = pool->head) == NULL)
+			break;
+		if ((pool->head = job->next) == NULL)
+			pool->tail = &pool->head;
+		pool->queued--;
+		pool->busy++;
+		pthread_mutex_unlock(&pool->lock);
+
+		pass_job_copy(w->archive, job);
+
+		pthread_mutex_lock(&pool->lock);
+		job->next = pool->finished;
+		pool->finished = job;
+		pool->busy--;
+		pthread_cond_broadcast(&pool->idle);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return (NULL);
+}
+
+static struct pass_pool *
+pass_pool_new(struct cpio *cpio, int nworkers)
+{
+	struct pass_pool *pool;
+	int i;
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate thread pool");
+	pool->workers = calloc(nworkers, sizeof(*pool->workers));
+	if (pool->workers == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate thread pool");
+	pool->cpio = cpio;
+	pool->tail = &pool->head;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	/* Create every archive first: write_disk_new() changes umask. */
+	for (i = 0; i < nworkers; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].archive = pass_disk_new(cpio);
+	}
+	for (i = 0; i < nworkers; i++) {
+		if (pthread_create(&pool->workers[i].thread, NULL,
+		    pass_worker_main, &pool->workers[i]) != 0)
+			break;
+	}
+	pool->nworkers = i;
+	for (; i < nworkers; i++)
+		archive_write_free(pool->workers[i].archive);
+	if (pool->nworkers == 0) {
+		/* No threads after all; copy everything in order. */
+		pass_pool_free(pool);
+		return (NULL);
+	}
+	return (pool);
+}
+
+/*
+ * Queue a plain file; the worker that takes it closes `fd'.  Waits
+ * while a couple of files per worker are already waiting.
+ */
+static void
+pass_pool_add(struct pass_pool *pool, struct archive_entry *entry, int fd)
+{
+	struct pass_job *job;
+
+	pass_pool_report(pool);
+	job = calloc(1, sizeof(*job));
+	if (job == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate thread pool");
+	job->entry = archive_entry_clone(entry);
+	if (job->entry == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate thread pool");
+	/* The clone leaves the descriptor out; it is ours to pass on. */
+	archive_entry_set_source_fd(job->entry, fd);
+	job->fd = fd;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->queued >= 2 * pool->nworkers)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	*pool->tail = job;
+	pool->tail = &job->next;
+	pool->queued++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/* Wait until every queued file has been copied. */
+static void
+pass_pool_drain(struct pass_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->queued > 0 || pool->busy > 0)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+	pass_pool_report(pool);
+}
+
+/*
+ * Finish the queue, stop the workers and close their archives.
+ * Returns the bytes they wrote.
+ */
+static int64_t
+pass_pool_free(struct pass_pool *pool)
+{
+	struct archive *a;
+	int64_t bytes = 0;
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->done = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	for (i = 0; i < pool->nworkers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	pass_pool_report(pool);
+	for (i = 0; i < pool->nworkers; i++) {
+		a = pool->workers[i].archive;
+		if (archive_write_close(a) != ARCHIVE_OK)
+			lafe_errc(1, 0, "%s", archive_error_string(a));
+		bytes += archive_filter_bytes(a, 0);
+		archive_write_free(a);
+	}
+	pthread_cond_destroy(&pool->idle);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+	free(pool);
+	return (bytes);
+}
+#endif
+
 static void
 mode_pass(struct cpio *cpio, const char *destdir)
 {
 	struct lafe_line_reader *lr;
 	const char *p;
+	int64_t bytes = 0;
 	int r;
 
 	/* Ensure target dir has a trailing '/' to simplify path surgery. */
@@ -1248,14 +1629,10 @@ mode_pass(struct cpio *cpio, const char *destdir)
 		cpio->destdir[cpio->destdir_len++] = '/';
 	cpio->destdir[cpio->destdir_len] = '\0';
 
-	cpio->archive = archive_write_disk_new();
-	if (cpio->archive == NULL)
-		lafe_errc(1, 0, "Failed to allocate archive object");
-	r = archive_write_disk_set_options(cpio->archive, cpio->extract_flags);
-	if (r != ARCHIVE_OK)
-		lafe_errc(1, 0, "%s", archive_error_string(cpio->archive));
+	cpio->archive = pass_disk_new(cpio);
 	cpio->linkresolver = archive_entry_linkresolver_new();
-	archive_write_disk_set_standard_lookup(cpio->archive);
+	archive_entry_linkresolver_set_memory_limit(cpio->linkresolver,
+	    cpio->link_memory_limit);
 
 	cpio->archive_read_disk = archive_read_disk_new();
 	if (cpio->archive_read_disk == NULL)
@@ -1266,11 +1643,28 @@ mode_pass(struct cpio *cpio, const char *destdir)
 		archive_read_disk_set_symlink_physical(cpio->archive_read_disk);
 	archive_read_disk_set_standard_lookup(cpio->archive_read_disk);
 
+#ifdef CPIO_PASS_THREADS
+	if (cpio->threads == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+		cpio->threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		if (cpio->threads < 1)
+			cpio->threads = 1;
+	}
+	if (cpio->threads > 1)
+		cpio->pass_pool = pass_pool_new(cpio, cpio->threads);
+#endif
+
 	lr = lafe_line_reader("-", cpio->option_null);
 	while ((p = lafe_line_reader_next(lr)) != NULL)
 		file_to_archive(cpio, p);
 	lafe_line_reader_free(lr);
 
+#ifdef CPIO_PASS_THREADS
+	/* Close the workers first, so directories are fixed up last. */
+	if (cpio->pass_pool != NULL)
+		bytes = pass_pool_free(cpio->pass_pool);
+#endif
 	archive_entry_linkresolver_free(cpio->linkresolver);
 	r = archive_write_close(cpio->archive);
 	if (cpio->dot)
@@ -1280,7 +1674,7 @@ mode_pass(struct cpio *cpio, const char *destdir)
 
 	if (!cpio->quiet) {
 		int64_t blocks =
-			(archive_filter_bytes(cpio->archive, 0) + 511)
+			(archive_filter_bytes(cpio->archive, 0) + bytes + 511)
 			/ 512;
 		fprintf(stderr, "%lu %s\n", (unsigned long)blocks,
 		    blocks == 1 ? "block" : "blocks");
@@ -64,6 +64,8 @@ struct cpio {
 	int		  option_numeric_uid_gid; /* -n */
 	int		  option_pwb; /* -6 */
 	int		  option_rename; /* -r */
+	int		  threads; /* --threads */
+	size_t		  link_memory_limit; /* --link-memory-limit */
 	char		 *destdir;
 	size_t		  destdir_len;
 	size_t		  pass_destpath_alloc;
@@ -85,6 +87,7 @@ struct cpio {
 	char		**argv;
 	int		  return_value; /* Value returned by main() */
 	struct archive_entry_linkresolver *linkresolver;
+	struct pass_pool *pass_pool; /* Workers for -p --threads */
 
 	struct name_cache *uname_cache;
 	struct name_cache *gname_cache;
@@ -104,6 +107,7 @@ enum {
 	OPTION_B64ENCODE = 1,
 	OPTION_GRZIP,
 	OPTION_INSECURE,
+	OPTION_LINK_MEMORY_LIMIT,
 	OPTION_LRZIP,
 	OPTION_LZ4,
 	OPTION_LZMA,
@@ -112,6 +116,7 @@ enum {
 	OPTION_NO_PRESERVE_OWNER,
 	OPTION_PRESERVE_OWNER,
 	OPTION_QUIET,
+	OPTION_THREADS,
 	OPTION_UUENCODE,
 	OPTION_VERSION,
 	OPTION_ZSTD,
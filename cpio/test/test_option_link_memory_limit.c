@@ -0,0 +1,63 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+DEFINE_TEST(test_option_link_memory_limit)
+{
+	int r;
+
+	assertMakeDir("in", 0755);
+	assertMakeFile("in/a", 0644, "aaa");
+	assertMakeHardlink("in/b", "in/a");
+	assertMakeHardlink("in/c", "in/a");
+	assertMakeFile("filelist", 0644, "in/a\nin/b\nin/c\n");
+
+	/* Links are still matched up with a limit, writing newc... */
+	r = systemf("%s -o -H newc --link-memory-limit 1 <filelist "
+	    ">t.cpio 2>o.err", testprog);
+	assertEqualInt(r, 0);
+	assertMakeDir("out", 0755);
+	r = systemf("cd out && %s -id <../t.cpio >i.out 2>i.err", testprog);
+	assertEqualInt(r, 0);
+	assertTextFileContents("aaa", "out/in/a");
+	assertIsHardlink("out/in/a", "out/in/b");
+	assertIsHardlink("out/in/a", "out/in/c");
+
+	/* ... and copying. */
+	r = systemf("%s -pd --link-memory-limit 1 copy <filelist "
+	    ">p.out 2>p.err", testprog);
+	assertEqualInt(r, 0);
+	assertTextFileContents("aaa", "copy/in/a");
+	assertIsHardlink("copy/in/a", "copy/in/b");
+	assertIsHardlink("copy/in/a", "copy/in/c");
+
+	/* Other modes and bad sizes are rejected. */
+	r = systemf("%s -i --link-memory-limit 1 <t.cpio >e.out 2>e.err",
+	    testprog);
+	assert(r != 0);
+	r = systemf("%s -o --link-memory-limit x <filelist >e.out 2>e.err",
+	    testprog);
+	assert(r != 0);
+}
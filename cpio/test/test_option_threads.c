@@ -0,0 +1,156 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+DEFINE_TEST(test_option_threads)
+{
+	char name[64], *buff;
+	size_t i, size;
+	FILE *list;
+	int r;
+
+	/* A tree with files of many sizes, a hardlink and a symlink. */
+	size = 300000;
+	buff = malloc(size);
+	assert(buff != NULL);
+	if (buff == NULL)
+		return;
+	for (i = 0; i < size; i++)
+		buff[i] = (char)(i * 7 + i / 256);
+	assertMakeDir("in", 0755);
+	assertMakeDir("in/d", 0755);
+	list = fopen("filelist", "w");
+	assert(list != NULL);
+	if (list == NULL) {
+		free(buff);
+		return;
+	}
+	fprintf(list, "in\nin/d\n");
+	for (i = 0; i < 40; i++) {
+		snprintf(name, sizeof(name), "in/d/f%d", (int)i);
+		assertMakeBinFile(name, 0644, i * i * 150, buff);
+		fprintf(list, "%s\n", name);
+	}
+	assertMakeHardlink("in/link", "in/d/f39");
+	assertMakeSymlink("in/sym", "d/f1", 0);
+	assertMakeFile("in/empty", 0644, "");
+	fprintf(list, "in/link\nin/sym\nin/empty\n");
+	fclose(list);
+
+	/* Copy it with four workers. */
+	r = systemf("%s -pd --threads 4 out <filelist >copy.out 2>copy.err",
+	    testprog);
+	assertEqualInt(r, 0);
+	assertEmptyFile("copy.out");
+	assertIsDir("out/in/d", 0755);
+	for (i = 0; i < 40; i++) {
+		snprintf(name, sizeof(name), "out/in/d/f%d", (int)i);
+		assertEqualFile(name, name + 4);
+	}
+	assertIsHardlink("out/in/link", "out/in/d/f39");
+	assertIsSymlink("out/in/sym", "d/f1", 0);
+	assertFileSize("out/in/empty", 0);
+
+	/* Zero workers means one per processor. */
+	r = systemf("%s -pd --threads 0 out0 <filelist >copy0.out 2>copy0.err",
+	    testprog);
+	assertEqualInt(r, 0);
+	assertEqualFile("out0/in/d/f39", "in/d/f39");
+	assertIsHardlink("out0/in/link", "out0/in/d/f39");
+
+#if defined(PATH_MAX) && !defined(_WIN32)
+	{
+		/*
+		 * Destination names past PATH_MAX make write_disk change
+		 * the working directory; the files copied meanwhile must
+		 * still land in the right place.
+		 */
+		char comp[201], *deep, *dest;
+		size_t len;
+		int cwd, j;
+
+		memset(comp, 'c', sizeof(comp) - 1);
+		comp[sizeof(comp) - 1] = '\0';
+		deep = malloc(PATH_MAX);
+		dest = malloc(PATH_MAX);
+		assert(deep != NULL && dest != NULL);
+		strcpy(deep, "deep");
+		assertMakeDir(deep, 0755);
+		while (strlen(deep) + sizeof(comp) < PATH_MAX - 300) {
+			strcat(deep, "/");
+			strcat(deep, comp);
+			assertMakeDir(deep, 0755);
+		}
+		list = fopen("deeplist", "w");
+		assert(list != NULL);
+		for (j = 0; j < 40; j++) {
+			len = strlen(deep);
+			snprintf(deep + len, PATH_MAX - len, "/f%d", j);
+			assertMakeFile(deep, 0644, deep + len + 1);
+			fprintf(list, "%s\n", deep);
+			deep[len] = '\0';
+			snprintf(name, sizeof(name), "in/d/f%d", j);
+			fprintf(list, "%s\n", name);
+		}
+		fclose(list);
+		/* A destination that takes the copies past PATH_MAX. */
+		snprintf(dest, PATH_MAX, "%s/%s/%s", comp, comp, comp);
+		r = systemf("%s -pd --threads 4 %s <deeplist "
+		    ">deep.out 2>deep.err", testprog, dest);
+		assertEqualInt(r, 0);
+		assertEmptyFile("deep.out");
+		for (j = 0; j < 40; j++) {
+			snprintf(dest, PATH_MAX, "%s/%s/%s/in/d/f%d",
+			    comp, comp, comp, j);
+			failure("%s", dest + 3 * sizeof(comp));
+			assertEqualFile(dest, dest + 3 * sizeof(comp));
+		}
+		/* Walk down to the deep copies to check them. */
+		cwd = open(".", O_RDONLY);
+		assert(cwd >= 0);
+		assertChdir(comp);
+		assertChdir(comp);
+		assertChdir(comp);
+		assertChdir(deep);
+		for (j = 0; j < 40; j++) {
+			snprintf(name, sizeof(name), "f%d", j);
+			assertTextFileContents(name, name);
+		}
+		assertEqualInt(0, fchdir(cwd));
+		close(cwd);
+		free(deep);
+		free(dest);
+	}
+#endif
+
+	/* Other modes and bad counts are rejected. */
+	r = systemf("%s -o --threads 2 <filelist >o.out 2>o.err", testprog);
+	assert(r != 0);
+	r = systemf("%s -pd --threads x bad <filelist >x.out 2>x.err",
+	    testprog);
+	assert(r != 0);
+
+	free(buff);
+}
@@ -563,6 +563,22 @@ __LA_DECL int archive_read_next_header2(struct archive *,
  */
 __LA_DECL la_int64_t		 archive_read_header_position(struct archive *);
 
+/*
+ * Index of tar members.  With the "tar:index" read option set, the tar
+ * reader records where each member starts as headers are read; the
+ * index can be saved to a sidecar file and loaded again later, or
+ * loaded from the index the pax writer embeds at the end of an archive
+ * (pass a NULL filename).  With a seekable input,
+ * archive_read_tar_seek_entry() positions the reader so that the next
+ * archive_read_next_header() returns the named member.
+ */
+__LA_DECL int archive_read_tar_index_save(struct archive *,
+		    const char *_filename);
+__LA_DECL int archive_read_tar_index_load(struct archive *,
+		    const char *_filename);
+__LA_DECL int archive_read_tar_seek_entry(struct archive *,
+		    const char *_pathname);
+
 /*
  * Returns 1 if the archive contains at least one encrypted entry.
  * If the archive format not support encryption at all
@@ -699,6 +715,10 @@ __LA_DECL int archive_read_set_passphrase_callback(struct archive *,
 #define	ARCHIVE_EXTRACT_CLEAR_NOCHANGE_FFLAGS	(0x20000)
 /* Default: Do not extract atomically (using rename) */
 #define	ARCHIVE_EXTRACT_SAFE_WRITES		(0x40000)
+/* Default: Do not preallocate space; write data as it arrives. */
+#define	ARCHIVE_EXTRACT_PREALLOCATE		(0x80000)
+/* Default: Do not clone data from the source file of an entry. */
+#define	ARCHIVE_EXTRACT_CLONE			(0x100000)
 
 __LA_DECL int archive_read_extract(struct archive *, struct archive_entry *,
 		     int flags);
@@ -707,6 +727,22 @@ __LA_DECL int archive_read_extract2(struct archive *, struct archive_entry *,
 __LA_DECL void	 archive_read_extract_set_progress_callback(struct archive *,
 		     void (*_progress_func)(void *), void *_user_data);
 
+/*
+ * Extract every entry of an archive opened on `a', on up to _threads
+ * threads (0 for one per processor).  The callback extracts an entry
+ * read from the given reader into the given archive_write_disk object;
+ * it is called concurrently, and NULL means archive_read_extract2().
+ * Additional readers are set up and opened by the open callback.  Only
+ * seekable Zip archives are extracted in parallel.
+ */
+typedef int archive_extract_entry_callback(struct archive *,
+		     void *_client_data, struct archive_entry *,
+		     struct archive * /* dest */);
+__LA_DECL int archive_read_extract_parallel(struct archive *,
+		     struct archive * /* dest */, int _threads,
+		     archive_open_callback *, archive_extract_entry_callback *,
+		     void *_client_data);
+
 /* Record the dev/ino of a file that will not be written.  This is
  * generally set to the dev/ino of the archive being read. */
 __LA_DECL void		archive_read_extract_set_skip_file(struct archive *,
@@ -939,6 +975,9 @@ __LA_DECL int		 archive_write_disk_set_options(struct archive *,
  * POSIX "tar".
  */
 __LA_DECL int	 archive_write_disk_set_standard_lookup(struct archive *);
+/* Fill the cache of the standard lookups from the whole passwd and
+ * group databases, which pays off for many different owners. */
+__LA_DECL int	 archive_write_disk_preload_standard_lookup(struct archive *);
 /*
  * If neither the default (naive) nor the standard (big) functions suit
  * your needs, you can write your own and register them.  Be sure to
@@ -954,6 +993,14 @@ __LA_DECL int archive_write_disk_set_user_lookup(struct archive *,
     void (* /* cleanup */)(void *));
 __LA_DECL la_int64_t archive_write_disk_gid(struct archive *, const char *, la_int64_t);
 __LA_DECL la_int64_t archive_write_disk_uid(struct archive *, const char *, la_int64_t);
+/*
+ * Copy the data of the current entry from an open file, from its
+ * current position up to end-of-file or the size of the entry.  Where
+ * the system allows, the data is cloned or copied inside the kernel
+ * rather than passing through user memory.  Returns the number of
+ * bytes copied or an ARCHIVE_XXX status.
+ */
+__LA_DECL la_int64_t archive_write_disk_data_from_fd(struct archive *, int);
 
 /*
  * ARCHIVE_READ_DISK API
@@ -979,6 +1026,7 @@ __LA_DECL const char *archive_read_disk_uname(struct archive *, la_int64_t);
 /* "Standard" implementation uses getpwuid_r, getgrgid_r and caches the
  * results for performance. */
 __LA_DECL int	archive_read_disk_set_standard_lookup(struct archive *);
+__LA_DECL int	archive_read_disk_preload_standard_lookup(struct archive *);
 /* You can install your own lookups if you like. */
 __LA_DECL int	archive_read_disk_set_gname_lookup(struct archive *,
     void * /* private_data */,
@@ -1026,6 +1074,8 @@ __LA_DECL int  archive_read_disk_set_atime_restored(struct archive *);
 #define	ARCHIVE_READDISK_NO_FFLAGS		(0x0040)
 /* Default: Sparse file information is read from disk. */
 #define	ARCHIVE_READDISK_NO_SPARSE		(0x0080)
+/* Default: Do not open regular files before their data is read. */
+#define	ARCHIVE_READDISK_SOURCE_FD		(0x0100)
 
 __LA_DECL int  archive_read_disk_set_behavior(struct archive *,
 		    int flags);
@@ -1090,6 +1140,22 @@ __LA_DECL void		 archive_copy_error(struct archive *dest,
 			    struct archive *src);
 __LA_DECL int		 archive_file_count(struct archive *);
 
+/*
+ * Statistics of where the time goes, per stage: the client callbacks,
+ * each filter, the format, character-set conversion and, for
+ * archive_write_disk objects, the kinds of file system operations.
+ * Collecting them costs next to nothing until archive_stats_enable()
+ * is called.  Stages are numbered from 0 in the order they were
+ * first used; the times are in nanoseconds.
+ */
+__LA_DECL int		 archive_stats_enable(struct archive *);
+__LA_DECL int		 archive_stats_count(struct archive *);
+__LA_DECL const char	*archive_stats_name(struct archive *, int);
+__LA_DECL la_int64_t	 archive_stats_calls(struct archive *, int);
+__LA_DECL la_int64_t	 archive_stats_bytes(struct archive *, int);
+__LA_DECL la_int64_t	 archive_stats_wall_nsec(struct archive *, int);
+__LA_DECL la_int64_t	 archive_stats_cpu_nsec(struct archive *, int);
+
 /*
  * ARCHIVE_MATCH API
  */
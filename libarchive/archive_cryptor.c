@@ -169,14 +169,14 @@ aes_ctr_init(archive_crypto_ctx *ctx, const uint8_t *key, size_t key_len)
 	ctx->key_len = key_len;
 	memcpy(ctx->key, key, key_len);
 	memset(ctx->nonce, 0, sizeof(ctx->nonce));
-	ctx->encr_pos = AES_BLOCK_SIZE;
+	ctx->encr_pos = sizeof(ctx->encr_buf);
 	r = CCCryptorCreateWithMode(kCCEncrypt, kCCModeECB, kCCAlgorithmAES,
 	    ccNoPadding, NULL, key, key_len, NULL, 0, 0, 0, &ctx->ctx);
 	return (r == kCCSuccess)? 0: -1;
 }
 
 static int
-aes_ctr_encrypt_counter(archive_crypto_ctx *ctx)
+aes_ctr_encrypt_counters(archive_crypto_ctx *ctx)
 {
 	CCCryptorRef ref = ctx->ctx;
 	CCCryptorStatus r;
@@ -184,8 +184,8 @@ aes_ctr_encrypt_counter(archive_crypto_ctx *ctx)
 	r = CCCryptorReset(ref, NULL);
 	if (r != kCCSuccess && r != kCCUnimplemented)
 		return -1;
-	r = CCCryptorUpdate(ref, ctx->nonce, AES_BLOCK_SIZE, ctx->encr_buf,
-	    AES_BLOCK_SIZE, NULL);
+	r = CCCryptorUpdate(ref, ctx->encr_buf, sizeof(ctx->encr_buf),
+	    ctx->encr_buf, sizeof(ctx->encr_buf), NULL);
 	return (r == kCCSuccess)? 0: -1;
 }
 
@@ -265,20 +265,20 @@ aes_ctr_init(archive_crypto_ctx *ctx, const uint8_t *key, size_t key_len)
 	ctx->hKey = hKey;
 	ctx->keyObj = keyObj;
 	ctx->keyObj_len = keyObj_len;
-	ctx->encr_pos = AES_BLOCK_SIZE;
+	ctx->encr_pos = sizeof(ctx->encr_buf);
 
 	return 0;
 }
 
 static int
-aes_ctr_encrypt_counter(archive_crypto_ctx *ctx)
+aes_ctr_encrypt_counters(archive_crypto_ctx *ctx)
 {
 	NTSTATUS status;
 	ULONG result;
 
-	status = BCryptEncrypt(ctx->hKey, (PUCHAR)ctx->nonce, AES_BLOCK_SIZE,
-		NULL, NULL, 0, (PUCHAR)ctx->encr_buf, AES_BLOCK_SIZE,
-		&result, 0);
+	status = BCryptEncrypt(ctx->hKey, (PUCHAR)ctx->encr_buf,
+		sizeof(ctx->encr_buf), NULL, NULL, 0, (PUCHAR)ctx->encr_buf,
+		sizeof(ctx->encr_buf), &result, 0);
 	return BCRYPT_SUCCESS(status) ? 0 : -1;
 }
 
@@ -307,19 +307,24 @@ aes_ctr_init(archive_crypto_ctx *ctx, const uint8_t *key, size_t key_len)
 	ctx->key_len = key_len;
 	memcpy(ctx->key, key, key_len);
 	memset(ctx->nonce, 0, sizeof(ctx->nonce));
-	ctx->encr_pos = AES_BLOCK_SIZE;
+	ctx->encr_pos = sizeof(ctx->encr_buf);
+	if (mbedtls_aes_setkey_enc(&ctx->ctx, ctx->key,
+	    ctx->key_len * 8) != 0)
+		return (-1);
 	return 0;
 }
 
 static int
-aes_ctr_encrypt_counter(archive_crypto_ctx *ctx)
+aes_ctr_encrypt_counters(archive_crypto_ctx *ctx)
 {
-	if (mbedtls_aes_setkey_enc(&ctx->ctx, ctx->key,
-	    ctx->key_len * 8) != 0)
-		return (-1);
-	if (mbedtls_aes_crypt_ecb(&ctx->ctx, MBEDTLS_AES_ENCRYPT, ctx->nonce,
-	    ctx->encr_buf) != 0)
-		return (-1);
+	uint8_t *p;
+
+	for (p = ctx->encr_buf; p < ctx->encr_buf + sizeof(ctx->encr_buf);
+	    p += AES_BLOCK_SIZE) {
+		if (mbedtls_aes_crypt_ecb(&ctx->ctx, MBEDTLS_AES_ENCRYPT,
+		    p, p) != 0)
+			return (-1);
+	}
 	return 0;
 }
 
@@ -339,33 +344,48 @@ aes_ctr_init(archive_crypto_ctx *ctx, const uint8_t *key, size_t key_len)
 	ctx->key_len = key_len;
 	memcpy(ctx->key, key, key_len);
 	memset(ctx->nonce, 0, sizeof(ctx->nonce));
-	ctx->encr_pos = AES_BLOCK_SIZE;
+	ctx->encr_pos = sizeof(ctx->encr_buf);
 	memset(&ctx->ctx, 0, sizeof(ctx->ctx));
+#if NETTLE_VERSION_MAJOR < 3
+	aes_set_encrypt_key(&ctx->ctx, ctx->key_len, ctx->key);
+#else
+	switch(ctx->key_len) {
+	case AES128_KEY_SIZE:
+		aes128_set_encrypt_key(&ctx->ctx.c128, ctx->key);
+		break;
+	case AES192_KEY_SIZE:
+		aes192_set_encrypt_key(&ctx->ctx.c192, ctx->key);
+		break;
+	case AES256_KEY_SIZE:
+		aes256_set_encrypt_key(&ctx->ctx.c256, ctx->key);
+		break;
+	default:
+		return -1;
+		break;
+	}
+#endif
 	return 0;
 }
 
 static int
-aes_ctr_encrypt_counter(archive_crypto_ctx *ctx)
+aes_ctr_encrypt_counters(archive_crypto_ctx *ctx)
 {
 #if NETTLE_VERSION_MAJOR < 3
-	aes_set_encrypt_key(&ctx->ctx, ctx->key_len, ctx->key);
-	aes_encrypt(&ctx->ctx, AES_BLOCK_SIZE, ctx->encr_buf, ctx->nonce);
+	aes_encrypt(&ctx->ctx, sizeof(ctx->encr_buf), ctx->encr_buf,
+	    ctx->encr_buf);
 #else
 	switch(ctx->key_len) {
 	case AES128_KEY_SIZE:
-		aes128_set_encrypt_key(&ctx->ctx.c128, ctx->key);
-		aes128_encrypt(&ctx->ctx.c128, AES_BLOCK_SIZE, ctx->encr_buf,
-		    ctx->nonce);
+		aes128_encrypt(&ctx->ctx.c128, sizeof(ctx->encr_buf),
+		    ctx->encr_buf, ctx->encr_buf);
 		break;
 	case AES192_KEY_SIZE:
-		aes192_set_encrypt_key(&ctx->ctx.c192, ctx->key);
-		aes192_encrypt(&ctx->ctx.c192, AES_BLOCK_SIZE, ctx->encr_buf,
-		    ctx->nonce);
+		aes192_encrypt(&ctx->ctx.c192, sizeof(ctx->encr_buf),
+		    ctx->encr_buf, ctx->encr_buf);
 		break;
 	case AES256_KEY_SIZE:
-		aes256_set_encrypt_key(&ctx->ctx.c256, ctx->key);
-		aes256_encrypt(&ctx->ctx.c256, AES_BLOCK_SIZE, ctx->encr_buf,
-		    ctx->nonce);
+		aes256_encrypt(&ctx->ctx.c256, sizeof(ctx->encr_buf),
+		    ctx->encr_buf, ctx->encr_buf);
 		break;
 	default:
 		return -1;
@@ -400,22 +420,23 @@ aes_ctr_init(archive_crypto_ctx *ctx, const uint8_t *key, size_t key_len)
 	ctx->key_len = key_len;
 	memcpy(ctx->key, key, key_len);
 	memset(ctx->nonce, 0, sizeof(ctx->nonce));
-	ctx->encr_pos = AES_BLOCK_SIZE;
+	ctx->encr_pos = sizeof(ctx->encr_buf);
+	/* The key schedule is set up once for the whole stream. */
+	if (EVP_EncryptInit_ex(ctx->ctx, ctx->type, NULL, ctx->key, NULL) == 0)
+		return -1;
+	EVP_CIPHER_CTX_set_padding(ctx->ctx, 0);
 	return 0;
 }
 
 static int
-aes_ctr_encrypt_counter(archive_crypto_ctx *ctx)
+aes_ctr_encrypt_counters(archive_crypto_ctx *ctx)
 {
 	int outl = 0;
 	int r;
 
-	r = EVP_EncryptInit_ex(ctx->ctx, ctx->type, NULL, ctx->key, NULL);
-	if (r == 0)
-		return -1;
-	r = EVP_EncryptUpdate(ctx->ctx, ctx->encr_buf, &outl, ctx->nonce,
-	    AES_BLOCK_SIZE);
-	if (r == 0 || outl != AES_BLOCK_SIZE)
+	r = EVP_EncryptUpdate(ctx->ctx, ctx->encr_buf, &outl, ctx->encr_buf,
+	    sizeof(ctx->encr_buf));
+	if (r == 0 || outl != (int)sizeof(ctx->encr_buf))
 		return -1;
 	return 0;
 }
@@ -443,7 +464,7 @@ aes_ctr_init(archive_crypto_ctx *ctx, const uint8_t *key, size_t key_len)
 }
 
 static int
-aes_ctr_encrypt_counter(archive_crypto_ctx *ctx)
+aes_ctr_encrypt_counters(archive_crypto_ctx *ctx)
 {
 	(void)ctx; /* UNUSED */
 	return -1;
@@ -468,7 +489,7 @@ aes_ctr_update(archive_crypto_ctx *ctx, const uint8_t * const in,
 	(void)in_len; /* UNUSED */
 	(void)out; /* UNUSED */
 	(void)out_len; /* UNUSED */
-	aes_ctr_encrypt_counter(ctx); /* UNUSED */ /* Fix unused function warning */
+	aes_ctr_encrypt_counters(ctx); /* UNUSED */ /* Fix unused function warning */
 	return -1;
 }
 
@@ -485,36 +506,56 @@ aes_ctr_increase_counter(archive_crypto_ctx *ctx)
 	}
 }
 
+/*
+ * Make the next AES_CTR_BLOCKS blocks of the key stream.
+ */
+static int
+aes_ctr_fill_key_stream(archive_crypto_ctx *ctx)
+{
+	uint8_t *p;
+
+	for (p = ctx->encr_buf; p < ctx->encr_buf + sizeof(ctx->encr_buf);
+	    p += AES_BLOCK_SIZE) {
+		aes_ctr_increase_counter(ctx);
+		memcpy(p, ctx->nonce, AES_BLOCK_SIZE);
+	}
+	if (aes_ctr_encrypt_counters(ctx) != 0)
+		return -1;
+	ctx->encr_pos = 0;
+	return 0;
+}
+
 static int
 aes_ctr_update(archive_crypto_ctx *ctx, const uint8_t * const in,
     size_t in_len, uint8_t * const out, size_t *out_len)
 {
-	uint8_t *const ebuf = ctx->encr_buf;
-	unsigned pos = ctx->encr_pos;
-	unsigned max = (unsigned)((in_len < *out_len)? in_len: *out_len);
-	unsigned i;
+	const size_t max = (in_len < *out_len)? in_len: *out_len;
+	const uint8_t *ks;
+	uint64_t w, k;
+	size_t i, n;
 
 	for (i = 0; i < max; ) {
-		if (pos == AES_BLOCK_SIZE) {
-			aes_ctr_increase_counter(ctx);
-			if (aes_ctr_encrypt_counter(ctx) != 0)
-				return -1;
-			while (max -i >= AES_BLOCK_SIZE) {
-				for (pos = 0; pos < AES_BLOCK_SIZE; pos++)
-					out[i+pos] = in[i+pos] ^ ebuf[pos];
-				i += AES_BLOCK_SIZE;
-				aes_ctr_increase_counter(ctx);
-				if (aes_ctr_encrypt_counter(ctx) != 0)
-					return -1;
-			}
-			pos = 0;
-			if (i >= max)
-				break;
+		if (ctx->encr_pos == sizeof(ctx->encr_buf) &&
+		    aes_ctr_fill_key_stream(ctx) != 0)
+			return -1;
+		n = sizeof(ctx->encr_buf) - ctx->encr_pos;
+		if (n > max - i)
+			n = max - i;
+		ks = ctx->encr_buf + ctx->encr_pos;
+		ctx->encr_pos += (unsigned)n;
+		/* XOR eight bytes at a time; memcpy() copes with any
+		 * alignment and compiles to plain loads and stores. */
+		for (; n >= sizeof(w); n -= sizeof(w)) {
+			memcpy(&w, in + i, sizeof(w));
+			memcpy(&k, ks, sizeof(k));
+			w ^= k;
+			memcpy(out + i, &w, sizeof(w));
+			i += sizeof(w);
+			ks += sizeof(k);
 		}
-		out[i] = in[i] ^ ebuf[pos++];
-		i++;
+		for (; n > 0; n--, i++)
+			out[i] = in[i] ^ *ks++;
 	}
-	ctx->encr_pos = pos;
 	*out_len = i;
 
 	return 0;
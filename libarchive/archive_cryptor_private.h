@@ -47,6 +47,12 @@ int __libarchive_cryptor_build_hack(void);
 # endif
 #endif
 
+/*
+ * Number of counter blocks encrypted at once; the key stream is
+ * made in batches so the backend can pipeline them.
+ */
+#define AES_CTR_BLOCKS	256
+
 #ifdef ARCHIVE_CRYPTOR_USE_Apple_CommonCrypto
 #include <CommonCrypto/CommonCryptor.h>
 #include <CommonCrypto/CommonKeyDerivation.h>
@@ -58,7 +64,7 @@ typedef struct {
 	uint8_t		key[AES_MAX_KEY_SIZE];
 	unsigned	key_len;
 	uint8_t		nonce[AES_BLOCK_SIZE];
-	uint8_t		encr_buf[AES_BLOCK_SIZE];
+	uint8_t		encr_buf[AES_BLOCK_SIZE * AES_CTR_BLOCKS];
 	unsigned	encr_pos;
 } archive_crypto_ctx;
 
@@ -78,7 +84,7 @@ typedef struct {
 	PBYTE		keyObj;
 	DWORD		keyObj_len;
 	uint8_t		nonce[AES_BLOCK_SIZE];
-	uint8_t		encr_buf[AES_BLOCK_SIZE];
+	uint8_t		encr_buf[AES_BLOCK_SIZE * AES_CTR_BLOCKS];
 	unsigned	encr_pos;
 } archive_crypto_ctx;
 
@@ -95,7 +101,7 @@ typedef struct {
 	uint8_t		key[AES_MAX_KEY_SIZE];
 	unsigned	key_len;
 	uint8_t		nonce[AES_BLOCK_SIZE];
-	uint8_t		encr_buf[AES_BLOCK_SIZE];
+	uint8_t		encr_buf[AES_BLOCK_SIZE * AES_CTR_BLOCKS];
 	unsigned	encr_pos;
 } archive_crypto_ctx;
 
@@ -119,7 +125,7 @@ typedef struct {
 	uint8_t		key[AES_MAX_KEY_SIZE];
 	unsigned	key_len;
 	uint8_t		nonce[AES_BLOCK_SIZE];
-	uint8_t		encr_buf[AES_BLOCK_SIZE];
+	uint8_t		encr_buf[AES_BLOCK_SIZE * AES_CTR_BLOCKS];
 	unsigned	encr_pos;
 } archive_crypto_ctx;
 
@@ -134,7 +140,7 @@ typedef struct {
 	uint8_t		key[AES_MAX_KEY_SIZE];
 	unsigned	key_len;
 	uint8_t		nonce[AES_BLOCK_SIZE];
-	uint8_t		encr_buf[AES_BLOCK_SIZE];
+	uint8_t		encr_buf[AES_BLOCK_SIZE * AES_CTR_BLOCKS];
 	unsigned	encr_pos;
 } archive_crypto_ctx;
 
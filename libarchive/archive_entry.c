@@ -200,7 +200,8 @@ archive_entry_clone(struct archive_entry *entry)
 	archive_mstring_copy(&entry2->ae_pathname, &entry->ae_pathname);
 	archive_mstring_copy(&entry2->ae_sourcepath, &entry->ae_sourcepath);
 	archive_mstring_copy(&entry2->ae_symlink, &entry->ae_symlink);
-	entry2->ae_set = entry->ae_set;
+	/* The source descriptor is not ours; a clone may outlive it. */
+	entry2->ae_set = entry->ae_set & ~AE_SET_SOURCE_FD;
 	archive_mstring_copy(&entry2->ae_uname, &entry->ae_uname);
 
 	/* Copy symlink type */
@@ -679,6 +680,14 @@ archive_entry_sourcepath_w(struct archive_entry *entry)
 	return (NULL);
 }
 
+int
+archive_entry_source_fd(struct archive_entry *entry)
+{
+	if (entry->ae_set & AE_SET_SOURCE_FD)
+		return (entry->ae_source_fd);
+	return (-1);
+}
+
 const char *
 archive_entry_symlink(struct archive_entry *entry)
 {
@@ -1259,6 +1268,16 @@ archive_entry_copy_sourcepath_w(struct archive_entry *entry, const wchar_t *path
 	archive_mstring_copy_wcs(&entry->ae_sourcepath, path);
 }
 
+void
+archive_entry_set_source_fd(struct archive_entry *entry, int fd)
+{
+	if (fd >= 0) {
+		entry->ae_source_fd = fd;
+		entry->ae_set |= AE_SET_SOURCE_FD;
+	} else
+		entry->ae_set &= ~AE_SET_SOURCE_FD;
+}
+
 void
 archive_entry_set_symlink(struct archive_entry *entry, const char *linkname)
 {
@@ -277,6 +277,7 @@ __LA_DECL dev_t		 archive_entry_rdevmajor(struct archive_entry *);
 __LA_DECL dev_t		 archive_entry_rdevminor(struct archive_entry *);
 __LA_DECL const char	*archive_entry_sourcepath(struct archive_entry *);
 __LA_DECL const wchar_t	*archive_entry_sourcepath_w(struct archive_entry *);
+__LA_DECL int		 archive_entry_source_fd(struct archive_entry *);
 __LA_DECL la_int64_t	 archive_entry_size(struct archive_entry *);
 __LA_DECL int		 archive_entry_size_is_set(struct archive_entry *);
 __LA_DECL const char	*archive_entry_strmode(struct archive_entry *);
@@ -357,6 +358,7 @@ __LA_DECL void	archive_entry_set_size(struct archive_entry *, la_int64_t);
 __LA_DECL void	archive_entry_unset_size(struct archive_entry *);
 __LA_DECL void	archive_entry_copy_sourcepath(struct archive_entry *, const char *);
 __LA_DECL void	archive_entry_copy_sourcepath_w(struct archive_entry *, const wchar_t *);
+__LA_DECL void	archive_entry_set_source_fd(struct archive_entry *, int);
 __LA_DECL void	archive_entry_set_symlink(struct archive_entry *, const char *);
 __LA_DECL void	archive_entry_set_symlink_type(struct archive_entry *, int);
 __LA_DECL void	archive_entry_set_symlink_utf8(struct archive_entry *, const char *);
@@ -657,6 +659,13 @@ __LA_DECL int	archive_entry_sparse_next(struct archive_entry *,
  * nlinks value.  The hardlink cache uses this to track when all links
  * have been found.  If the nlinks value is zero, it will keep every
  * name in the cache indefinitely, which can use a lot of memory.
+ * archive_entry_linkresolver_set_memory_limit() bounds that memory by
+ * moving the cached names and a large table to temporary files; with
+ * new cpio, entries that don't fit are stored with their bodies.
+ *
+ * archive_entry_partial_links() returns the files some of whose links
+ * were not seen.  Only the first pathname, device and inode of each
+ * are kept, so the entries it returns hold nothing else.
  *
  * Note that archive_entry_size() is reset to zero if the file
  * body should not be written to the archive.  Pay attention!
@@ -706,6 +715,8 @@ struct archive_entry_linkresolver;
 __LA_DECL struct archive_entry_linkresolver *archive_entry_linkresolver_new(void);
 __LA_DECL void archive_entry_linkresolver_set_strategy(
 	struct archive_entry_linkresolver *, int /* format_code */);
+__LA_DECL int archive_entry_linkresolver_set_memory_limit(
+	struct archive_entry_linkresolver *, size_t /* bytes */);
 __LA_DECL void archive_entry_linkresolver_free(struct archive_entry_linkresolver *);
 __LA_DECL void archive_entry_linkify(struct archive_entry_linkresolver *,
     struct archive_entry **, struct archive_entry **);
@@ -32,6 +32,9 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_entry_link_resolver.c 201100 200
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
 #include <stdio.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -39,9 +42,15 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_entry_link_resolver.c 201100 200
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #include "archive.h"
 #include "archive_entry.h"
+#include "archive_entry_private.h"
+#include "archive_private.h"
+#include "archive_string.h"
 
 /*
  * This is mostly a pretty straightforward hash table implementation.
@@ -56,6 +65,19 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_entry_link_resolver.c 201100 200
  *   new cpio - New cpio only stores body with last link, match-ups
  *       are implicit.  This is actually quite tricky; see the notes
  *       below.
+ *
+ * A tree may hold millions of files with several links, so the table
+ * keeps only what the strategies need: the device and inode, the
+ * number of links still to come, the first pathname and, for new
+ * cpio, the deferred entry.  It uses open addressing with linear
+ * probing; the pathnames are packed into a separate buffer.
+ *
+ * If a memory limit is set, the pathnames that would not fit are
+ * moved out to a temporary file, and a table that would take more
+ * than half the limit is kept in another one, of which only a quarter
+ * of the limit is held in memory.  New cpio can't send its deferred
+ * entries to a file; past the limit it stops deferring them and
+ * stores each link with its body, as old cpio does.
  */
 
 /* Users pass us a format code, we translate that into a strategy here. */
@@ -66,35 +88,91 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_entry_link_resolver.c 201100 200
 
 /* Initial size of link cache. */
 #define	links_cache_initial_size 1024
+/* Initial size of the pathname buffer. */
+#define	names_initial_size	(16 * 1024)
+/* Slots in each page of a table kept in a file. */
+#define	SLOTS_PER_PAGE		128
+#define	PAGE_BYTES		(SLOTS_PER_PAGE * sizeof(struct links_entry))
 
+/* A slot of the link cache; it is free if name_len is zero. */
 struct links_entry {
-	struct links_entry	*next;
-	struct links_entry	*previous;
-	struct archive_entry	*canonical;
-	struct archive_entry	*entry;
-	size_t			 hash;
+	int64_t			 dev;
+	int64_t			 ino;
+	struct archive_entry	*entry;	/* deferred entry (new cpio) */
+	uint64_t		 name;	/* offset of the first pathname */
+	unsigned int		 name_len; /* including the NUL */
 	unsigned int		 links; /* # links not yet seen */
 };
 
+/*
+ * The slots, either all in memory or in pages of a temporary file,
+ * of which at most max_resident are in memory at a time.
+ */
+struct links_table {
+	struct links_entry	*slots;		/* NULL if paged */
+	size_t			 number_slots;
+	struct links_entry	**pages;	/* NULL if not resident */
+	unsigned char		*dirty;
+	size_t			*resident;	/* numbers of resident pages */
+	size_t			 number_resident;
+	size_t			 max_resident;
+	size_t			 hand;		/* next place to evict */
+	size_t			 last;		/* page of the last slot */
+	int			 fd;
+	/* Stands in for a slot whose page can't be had. */
+	struct links_entry	 scratch;
+};
+
 struct archive_entry_linkresolver {
-	struct links_entry	**buckets;
-	struct links_entry	 *spare;
-	unsigned long		  number_entries;
-	size_t			  number_buckets;
-	int			  strategy;
+	struct links_table	 table;
+	size_t			 number_entries;
+	/* Where next_entry() resumes its scans. */
+	size_t			 next_deferred;
+	size_t			 next_partial;
+	int			 strategy;
+
+	/* Entries held back for new cpio, and about what they take. */
+	size_t			 number_deferred;
+	size_t			 deferred_size;
+
+	/*
+	 * The first pathname of each entry, packed.  Offsets below
+	 * spill_size are in spill_fd, the rest in names.
+	 */
+	char			*names;
+	size_t			 names_size;
+	size_t			 names_used;
+	size_t			 names_live;
+
+	/* 0 means no limit. */
+	size_t			 memory_limit;
+	int			 spill_fd;
+	int			 spill_failed;
+	int64_t			 spill_size;
+	struct archive_string	 name_buff;
 };
 
 #define	NEXT_ENTRY_DEFERRED	1
 #define	NEXT_ENTRY_PARTIAL	2
-#define	NEXT_ENTRY_ALL		(NEXT_ENTRY_DEFERRED | NEXT_ENTRY_PARTIAL)
 
-static struct links_entry *find_entry(struct archive_entry_linkresolver *,
+static const char *entry_name(struct archive_entry_linkresolver *,
+		    const struct links_entry *);
+static int find_entry(struct archive_entry_linkresolver *,
+		    struct archive_entry *, size_t *);
+static int grow_hash(struct archive_entry_linkresolver *);
+static int insert_entry(struct archive_entry_linkresolver *,
+		    struct archive_entry *, size_t *);
+static int next_entry(struct archive_entry_linkresolver *, int, size_t *);
+static int over_limit(struct archive_entry_linkresolver *,
 		    struct archive_entry *);
-static void grow_hash(struct archive_entry_linkresolver *);
-static struct links_entry *insert_entry(struct archive_entry_linkresolver *,
+static void remove_entry(struct archive_entry_linkresolver *, size_t);
+static void table_free(struct links_table *);
+static int table_init(struct links_table *, size_t, size_t);
+static struct links_entry *table_slot(struct links_table *, size_t, int);
+static struct archive_entry *take_deferred(struct archive_entry_linkresolver *,
+		    struct links_entry *);
+static void defer(struct archive_entry_linkresolver *, struct links_entry *,
 		    struct archive_entry *);
-static struct links_entry *next_entry(struct archive_entry_linkresolver *,
-    int);
 
 struct archive_entry_linkresolver *
 archive_entry_linkresolver_new(void)
@@ -109,12 +187,11 @@ archive_entry_linkresolver_new(void)
 	res = calloc(1, sizeof(struct archive_entry_linkresolver));
 	if (res == NULL)
 		return (NULL);
-	res->number_buckets = links_cache_initial_size;
-	res->buckets = calloc(res->number_buckets, sizeof(res->buckets[0]));
-	if (res->buckets == NULL) {
+	if (table_init(&res->table, links_cache_initial_size, 0) != 0) {
 		free(res);
 		return (NULL);
 	}
+	res->spill_fd = -1;
 	return (res);
 }
 
@@ -156,17 +233,38 @@ archive_entry_linkresolver_set_strategy(struct archive_entry_linkresolver *res,
 	}
 }
 
+
+/*
+ * Limit the memory used by the link cache: the table, the first
+ * pathnames and, for new cpio, the deferred entries.  Past it the
+ * pathnames and a large table are kept in temporary files, and new
+ * cpio stops deferring entries.
+ */
+int
+archive_entry_linkresolver_set_memory_limit(
+    struct archive_entry_linkresolver *res, size_t limit)
+{
+	res->memory_limit = limit;
+	return (ARCHIVE_OK);
+}
+
 void
 archive_entry_linkresolver_free(struct archive_entry_linkresolver *res)
 {
-	struct links_entry *le;
+	size_t i;
 
 	if (res == NULL)
 		return;
 
-	while ((le = next_entry(res, NEXT_ENTRY_ALL)) != NULL)
-		archive_entry_free(le->entry);
-	free(res->buckets);
+	for (i = 0; res->number_deferred > 0 &&
+	    i < res->table.number_slots; i++)
+		archive_entry_free(take_deferred(res,
+		    table_slot(&res->table, i, 1)));
+	table_free(&res->table);
+	free(res->names);
+	if (res->spill_fd >= 0)
+		close(res->spill_fd);
+	archive_string_free(&res->name_buff);
 	free(res);
 }
 
@@ -176,14 +274,15 @@ archive_entry_linkify(struct archive_entry_linkresolver *res,
 {
 	struct links_entry *le;
 	struct archive_entry *t;
+	const char *name;
+	size_t i;
 
 	*f = NULL; /* Default: Don't return a second entry. */
 
 	if (*e == NULL) {
-		le = next_entry(res, NEXT_ENTRY_DEFERRED);
-		if (le != NULL) {
-			*e = le->entry;
-			le->entry = NULL;
+		if (next_entry(res, NEXT_ENTRY_DEFERRED, &i)) {
+			*e = take_deferred(res, table_slot(&res->table, i, 1));
+			remove_entry(res, i);
 		}
 		return;
 	}
@@ -199,55 +298,69 @@ archive_entry_linkify(struct archive_entry_linkresolver *res,
 
 	switch (res->strategy) {
 	case ARCHIVE_ENTRY_LINKIFY_LIKE_TAR:
-		le = find_entry(res, *e);
-		if (le != NULL) {
-			archive_entry_unset_size(*e);
-			archive_entry_copy_hardlink(*e,
-			    archive_entry_pathname(le->canonical));
-		} else
-			insert_entry(res, *e);
-		return;
 	case ARCHIVE_ENTRY_LINKIFY_LIKE_MTREE:
-		le = find_entry(res, *e);
-		if (le != NULL) {
-			archive_entry_copy_hardlink(*e,
-			    archive_entry_pathname(le->canonical));
+		if (find_entry(res, *e, &i)) {
+			le = table_slot(&res->table, i, 1);
+			/*
+			 * If the first pathname can't be read back,
+			 * store the body again rather than a bad link.
+			 */
+			name = entry_name(res, le);
+			if (name != NULL) {
+				if (res->strategy ==
+				    ARCHIVE_ENTRY_LINKIFY_LIKE_TAR)
+					archive_entry_unset_size(*e);
+				archive_entry_copy_hardlink(*e, name);
+			}
+			/*
+			 * Decrement link count each time and release
+			 * the entry if it hits zero.  This saves
+			 * memory and is necessary for detecting
+			 * missed links.
+			 */
+			if (--le->links == 0)
+				remove_entry(res, i);
 		} else
-			insert_entry(res, *e);
+			insert_entry(res, *e, &i);
 		return;
 	case ARCHIVE_ENTRY_LINKIFY_LIKE_OLD_CPIO:
 		/* This one is trivial. */
 		return;
 	case ARCHIVE_ENTRY_LINKIFY_LIKE_NEW_CPIO:
-		le = find_entry(res, *e);
-		if (le != NULL) {
+		if (find_entry(res, *e, &i)) {
+			le = table_slot(&res->table, i, 1);
 			/*
 			 * Put the new entry in le, return the
 			 * old entry from le.
 			 */
 			t = *e;
-			*e = le->entry;
-			le->entry = t;
+			*e = take_deferred(res, le);
+			defer(res, le, t);
 			/* Make the old entry into a hardlink. */
-			archive_entry_unset_size(*e);
-			archive_entry_copy_hardlink(*e,
-			    archive_entry_pathname(le->canonical));
+			name = entry_name(res, le);
+			if (name != NULL) {
+				archive_entry_unset_size(*e);
+				archive_entry_copy_hardlink(*e, name);
+			}
 			/* If we ran out of links, return the
 			 * final entry as well. */
-			if (le->links == 0) {
-				*f = le->entry;
-				le->entry = NULL;
+			if (--le->links == 0) {
+				*f = take_deferred(res, le);
+				remove_entry(res, i);
 			}
 		} else {
 			/*
 			 * If we haven't seen it, tuck it away
-			 * for future use.
+			 * for future use.  If that would go past
+			 * the memory limit, it goes out now with
+			 * its body, as old cpio stores it.
 			 */
-			le = insert_entry(res, *e);
-			if (le == NULL)
+			if (over_limit(res, *e))
+				return;
+			if (insert_entry(res, *e, &i) != 0)
 				/* XXX We should return an error code XXX */
 				return;
-			le->entry = *e;
+			defer(res, table_slot(&res->table, i, 1), *e);
 			*e = NULL;
 		}
 		return;
@@ -257,191 +370,546 @@ archive_entry_linkify(struct archive_entry_linkresolver *res,
 	return;
 }
 
-static struct links_entry *
-find_entry(struct archive_entry_linkresolver *res,
+/* About how much memory a deferred entry takes. */
+static size_t
+entry_cost(struct archive_entry *entry)
+{
+	const char *name;
+
+	name = archive_entry_pathname(entry);
+	return (sizeof(struct archive_entry) +
+	    (name == NULL ? 0 : strlen(name) + 1));
+}
+
+static void
+defer(struct archive_entry_linkresolver *res, struct links_entry *le,
     struct archive_entry *entry)
 {
-	struct links_entry	*le;
-	size_t			 hash, bucket;
-	dev_t			 dev;
-	int64_t			 ino;
+	le->entry = entry;
+	res->number_deferred++;
+	res->deferred_size += entry_cost(entry);
+}
+
+static struct archive_entry *
+take_deferred(struct archive_entry_linkresolver *res, struct links_entry *le)
+{
+	struct archive_entry *entry;
 
-	/* Free a held entry. */
-	if (res->spare != NULL) {
-		archive_entry_free(res->spare->canonical);
-		archive_entry_free(res->spare->entry);
-		free(res->spare);
-		res->spare = NULL;
+	entry = le->entry;
+	if (entry != NULL) {
+		le->entry = NULL;
+		res->number_deferred--;
+		res->deferred_size -= entry_cost(entry);
 	}
+	return (entry);
+}
 
-	dev = archive_entry_dev(entry);
-	ino = archive_entry_ino64(entry);
-	hash = (size_t)(dev ^ ino);
+/* Memory taken by the slots. */
+static size_t
+table_memory(const struct links_table *t)
+{
+	if (t->slots != NULL)
+		return (t->number_slots * sizeof(t->slots[0]));
+	return (t->max_resident * (PAGE_BYTES + sizeof(t->resident[0])) +
+	    t->number_slots / SLOTS_PER_PAGE * (sizeof(t->pages[0]) + 1));
+}
 
-	/* Try to locate this entry in the links cache. */
-	bucket = hash & (res->number_buckets - 1);
-	for (le = res->buckets[bucket]; le != NULL; le = le->next) {
-		if (le->hash == hash
-		    && dev == archive_entry_dev(le->canonical)
-		    && ino == archive_entry_ino64(le->canonical)) {
-			/*
-			 * Decrement link count each time and release
-			 * the entry if it hits zero.  This saves
-			 * memory and is necessary for detecting
-			 * missed links.
-			 */
-			--le->links;
-			if (le->links > 0)
-				return (le);
-			/* Remove it from this hash bucket. */
-			if (le->previous != NULL)
-				le->previous->next = le->next;
-			if (le->next != NULL)
-				le->next->previous = le->previous;
-			if (res->buckets[bucket] == le)
-				res->buckets[bucket] = le->next;
-			res->number_entries--;
-			/* Defer freeing this entry. */
-			res->spare = le;
-			return (le);
+/* Whether deferring one more entry would go past the memory limit. */
+static int
+over_limit(struct archive_entry_linkresolver *res, struct archive_entry *entry)
+{
+	size_t used;
+
+	if (res->memory_limit == 0)
+		return (0);
+	used = table_memory(&res->table) + res->names_size +
+	    res->deferred_size + entry_cost(entry);
+	/* Count the doubled table if this entry would make it grow. */
+	if ((res->number_entries + 1) * 4 > res->table.number_slots * 3)
+		used += table_memory(&res->table);
+	return (used > res->memory_limit);
+}
+
+static int
+table_init(struct links_table *t, size_t number_slots, size_t max_resident)
+{
+	size_t number_pages;
+
+	memset(t, 0, sizeof(*t));
+	t->number_slots = number_slots;
+	t->fd = -1;
+	if (max_resident == 0) {
+		t->slots = calloc(number_slots, sizeof(t->slots[0]));
+		return (t->slots == NULL ? -1 : 0);
+	}
+	number_pages = number_slots / SLOTS_PER_PAGE;
+	t->pages = calloc(number_pages, sizeof(t->pages[0]));
+	t->dirty = calloc(number_pages, 1);
+	t->resident = calloc(max_resident, sizeof(t->resident[0]));
+	t->max_resident = max_resident;
+	t->last = number_pages;
+	if (t->pages == NULL || t->dirty == NULL || t->resident == NULL ||
+	    (t->fd = __archive_mktemp(NULL)) < 0) {
+		table_free(t);
+		return (-1);
+	}
+	return (0);
+}
+
+static void
+table_free(struct links_table *t)
+{
+	size_t i;
+
+	if (t->pages != NULL)
+		for (i = 0; i < t->number_resident; i++)
+			free(t->pages[t->resident[i]]);
+	free(t->pages);
+	free(t->dirty);
+	free(t->resident);
+	free(t->slots);
+	if (t->fd >= 0)
+		close(t->fd);
+	memset(t, 0, sizeof(*t));
+	t->fd = -1;
+}
+
+/* Read or write a page; a page never written reads back empty. */
+static int
+table_io(struct links_table *t, size_t page, struct links_entry *p,
+    int writing)
+{
+	char *b = (char *)p;
+	size_t remaining;
+	ssize_t bytes;
+
+	if (lseek(t->fd, (int64_t)page * PAGE_BYTES, SEEK_SET) < 0)
+		return (-1);
+	for (remaining = PAGE_BYTES; remaining > 0; remaining -= bytes) {
+		if (writing)
+			bytes = write(t->fd, b, remaining);
+		else
+			bytes = read(t->fd, b, remaining);
+		if (bytes < 0 || (bytes == 0 && writing))
+			return (-1);
+		if (bytes == 0) {
+			memset(b, 0, remaining);
+			break;
 		}
+		b += bytes;
 	}
-	return (NULL);
+	return (0);
 }
 
+/*
+ * Return slot i, reading its page in if need be.  The pointer stays
+ * good across one more call: the page of the last slot returned is
+ * never the one evicted.  If a page can't be had, the slot reads as
+ * free and what is stored in it is lost, which only costs links.
+ */
 static struct links_entry *
-next_entry(struct archive_entry_linkresolver *res, int mode)
+table_slot(struct links_table *t, size_t i, int writing)
 {
-	struct links_entry	*le;
-	size_t			 bucket;
-
-	/* Free a held entry. */
-	if (res->spare != NULL) {
-		archive_entry_free(res->spare->canonical);
-		archive_entry_free(res->spare->entry);
-		free(res->spare);
-		res->spare = NULL;
+	struct links_entry *p;
+	size_t page, r, victim;
+
+	if (t->slots != NULL)
+		return (&t->slots[i]);
+	page = i / SLOTS_PER_PAGE;
+	p = t->pages[page];
+	if (p == NULL) {
+		if (t->number_resident < t->max_resident &&
+		    (p = malloc(PAGE_BYTES)) != NULL)
+			r = t->number_resident++;
+		else if (t->number_resident < 2) {
+			memset(&t->scratch, 0, sizeof(t->scratch));
+			return (&t->scratch);
+		} else {
+			r = t->hand;
+			if (t->resident[r] == t->last)
+				r = (r + 1) % t->number_resident;
+			t->hand = (r + 1) % t->number_resident;
+			victim = t->resident[r];
+			p = t->pages[victim];
+			t->pages[victim] = NULL;
+			if (t->dirty[victim])
+				(void)table_io(t, victim, p, 1);
+			t->dirty[victim] = 0;
+		}
+		if (table_io(t, page, p, 0) != 0)
+			memset(p, 0, PAGE_BYTES);
+		t->pages[page] = p;
+		t->resident[r] = page;
 	}
+	if (writing)
+		t->dirty[page] = 1;
+	t->last = page;
+	return (&p[i % SLOTS_PER_PAGE]);
+}
+
+static size_t
+hash_key(int64_t dev, int64_t ino)
+{
+	uint64_t h;
+
+	/* Inode numbers are often dense; spread them over the table. */
+	h = (uint64_t)ino ^ ((uint64_t)dev * 0x9E3779B97F4A7C15ULL);
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	return ((size_t)h);
+}
+
+static int
+find_entry(struct archive_entry_linkresolver *res,
+    struct archive_entry *entry, size_t *index)
+{
+	const struct links_entry *le;
+	size_t			 mask, i;
+	int64_t			 dev, ino;
+
+	dev = (int64_t)archive_entry_dev(entry);
+	ino = archive_entry_ino64(entry);
+	mask = res->table.number_slots - 1;
 
-	/* Look for next non-empty bucket in the links cache. */
-	for (bucket = 0; bucket < res->number_buckets; bucket++) {
-		for (le = res->buckets[bucket]; le != NULL; le = le->next) {
-			if (le->entry != NULL &&
-			    (mode & NEXT_ENTRY_DEFERRED) == 0)
-				continue;
-			if (le->entry == NULL &&
-			    (mode & NEXT_ENTRY_PARTIAL) == 0)
-				continue;
-			/* Remove it from this hash bucket. */
-			if (le->next != NULL)
-				le->next->previous = le->previous;
-			if (le->previous != NULL)
-				le->previous->next = le->next;
-			else
-				res->buckets[bucket] = le->next;
-			res->number_entries--;
-			/* Defer freeing this entry. */
-			res->spare = le;
-			return (le);
+	/* Try to locate this entry in the links cache. */
+	for (i = hash_key(dev, ino) & mask;; i = (i + 1) & mask) {
+		le = table_slot(&res->table, i, 0);
+		if (le->name_len == 0)
+			return (0);
+		if (le->dev == dev && le->ino == ino) {
+			*index = i;
+			return (1);
 		}
 	}
-	return (NULL);
 }
 
-static struct links_entry *
-insert_entry(struct archive_entry_linkresolver *res,
-    struct archive_entry *entry)
+/*
+ * Find a used slot holding a deferred entry, or one holding none.
+ * The caller removes it before asking for the next.
+ */
+static int
+next_entry(struct archive_entry_linkresolver *res, int mode, size_t *index)
 {
-	struct links_entry *le;
-	size_t hash, bucket;
+	const struct links_entry *le;
+	size_t			*next;
+
+	if (mode == NEXT_ENTRY_DEFERRED && res->number_deferred == 0)
+		return (0);
+	next = (mode == NEXT_ENTRY_DEFERRED) ?
+	    &res->next_deferred : &res->next_partial;
+	for (; *next < res->table.number_slots; (*next)++) {
+		le = table_slot(&res->table, *next, 0);
+		if (le->name_len == 0)
+			continue;
+		if ((le->entry != NULL) == (mode == NEXT_ENTRY_DEFERRED)) {
+			*index = *next;
+			return (1);
+		}
+	}
+	return (0);
+}
 
-	/* Add this entry to the links cache. */
-	le = calloc(1, sizeof(struct links_entry));
-	if (le == NULL)
-		return (NULL);
-	le->canonical = archive_entry_clone(entry);
+/*
+ * Empty a slot.  With linear probing, the entries that follow it have
+ * to move up so that lookups still find them.
+ */
+static void
+remove_entry(struct archive_entry_linkresolver *res, size_t i)
+{
+	struct links_entry	*le, moved;
+	size_t			 mask, j, k;
+
+	mask = res->table.number_slots - 1;
+	le = table_slot(&res->table, i, 1);
+	if (le->name >= (uint64_t)res->spill_size)
+		res->names_live -= le->name_len;
+	/* Restart the scans of next_entry() at the moved entries. */
+	if (res->next_deferred > i)
+		res->next_deferred = i;
+	if (res->next_partial > i)
+		res->next_partial = i;
+	for (j = i;;) {
+		j = (j + 1) & mask;
+		moved = *table_slot(&res->table, j, 0);
+		if (moved.name_len == 0)
+			break;
+		if (j == 0) {
+			res->next_deferred = 0;
+			res->next_partial = 0;
+		}
+		k = hash_key(moved.dev, moved.ino) & mask;
+		/* Leave the entry if its home lies in (i, j]. */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		*table_slot(&res->table, i, 1) = moved;
+		i = j;
+	}
+	le = table_slot(&res->table, i, 1);
+	le->entry = NULL;
+	le->name_len = 0;
+	res->number_entries--;
+}
 
-	/* If the links cache is getting too full, enlarge the hash table. */
-	if (res->number_entries > res->number_buckets * 2)
-		grow_hash(res);
+/*
+ * Append the packed pathnames to the spill file and empty the buffer.
+ * Their offsets carry on from those in the file, so no slot changes.
+ */
+static int
+spill_names(struct archive_entry_linkresolver *res)
+{
+	const char *p;
+	size_t remaining;
+	ssize_t bytes;
+
+	if (res->spill_fd < 0) {
+		res->spill_fd = __archive_mktemp(NULL);
+		if (res->spill_fd < 0)
+			return (-1);
+	}
+	if (lseek(res->spill_fd, res->spill_size, SEEK_SET) < 0)
+		return (-1);
+	p = res->names;
+	remaining = res->names_used;
+	while (remaining > 0) {
+		bytes = write(res->spill_fd, p, remaining);
+		if (bytes <= 0)
+			return (-1);
+		p += bytes;
+		remaining -= bytes;
+	}
+	res->spill_size += res->names_used;
+	res->names_used = 0;
+	res->names_live = 0;
+	return (0);
+}
 
-	hash = (size_t)(archive_entry_dev(entry) ^ archive_entry_ino64(entry));
-	bucket = hash & (res->number_buckets - 1);
+/* Make room for `len' more bytes of pathnames. */
+static int
+grow_names(struct archive_entry_linkresolver *res, size_t len)
+{
+	struct links_entry *le;
+	char *names;
+	size_t new_size, used, i;
+
+	if (res->memory_limit != 0 && !res->spill_failed &&
+	    res->names_used > 0 &&
+	    table_memory(&res->table) + res->deferred_size +
+	    res->names_size * 2 > res->memory_limit) {
+		if (spill_names(res) != 0)
+			/* The file won't take them; keep them here. */
+			res->spill_failed = 1;
+		else if (len <= res->names_size)
+			return (0);
+	}
 
-	/* If we could allocate the entry, record it. */
-	if (res->buckets[bucket] != NULL)
-		res->buckets[bucket]->previous = le;
-	res->number_entries++;
-	le->next = res->buckets[bucket];
-	le->previous = NULL;
-	res->buckets[bucket] = le;
-	le->hash = hash;
-	le->links = archive_entry_nlink(entry) - 1;
-	return (le);
+	new_size = res->names_size;
+	if (new_size < names_initial_size)
+		new_size = names_initial_size;
+	if (res->table.slots == NULL) {
+		/*
+		 * Reading a paged table through to drop the pathnames
+		 * of entries that are gone costs too much; just grow.
+		 */
+		while (new_size < res->names_used + len) {
+			if (new_size * 2 < new_size)
+				return (-1);
+			new_size *= 2;
+		}
+		names = realloc(res->names, new_size);
+		if (names == NULL)
+			return (-1);
+		res->names = names;
+		res->names_size = new_size;
+		return (0);
+	}
+
+	/* Drop the pathnames of entries that are gone. */
+	while (new_size < (res->names_live + len) * 2) {
+		if (new_size * 2 < new_size)
+			return (-1);
+		new_size *= 2;
+	}
+	names = malloc(new_size);
+	if (names == NULL)
+		return (-1);
+	used = 0;
+	for (i = 0; i < res->table.number_slots; i++) {
+		le = &res->table.slots[i];
+		if (le->name_len == 0 || le->name < (uint64_t)res->spill_size)
+			continue;
+		memcpy(names + used,
+		    res->names + (le->name - res->spill_size), le->name_len);
+		le->name = res->spill_size + used;
+		used += le->name_len;
+	}
+	free(res->names);
+	res->names = names;
+	res->names_size = new_size;
+	res->names_used = used;
+	return (0);
 }
 
-static void
-grow_hash(struct archive_entry_linkresolver *res)
+/* Return the first pathname of an entry. */
+static const char *
+entry_name(struct archive_entry_linkresolver *res,
+    const struct links_entry *le)
 {
-	struct links_entry *le, **new_buckets;
-	size_t new_size;
-	size_t i, bucket;
+	char *p;
+	size_t remaining;
+	ssize_t bytes;
 
-	/* Try to enlarge the bucket list. */
-	new_size = res->number_buckets * 2;
-	if (new_size < res->number_buckets)
-		return;
-	new_buckets = calloc(new_size, sizeof(struct links_entry *));
+	if (le->name >= (uint64_t)res->spill_size)
+		return (res->names + (le->name - res->spill_size));
 
-	if (new_buckets == NULL)
-		return;
+	if (archive_string_ensure(&res->name_buff, le->name_len) == NULL)
+		return (NULL);
+	if (lseek(res->spill_fd, (int64_t)le->name, SEEK_SET) < 0)
+		return (NULL);
+	p = res->name_buff.s;
+	remaining = le->name_len;
+	while (remaining > 0) {
+		bytes = read(res->spill_fd, p, remaining);
+		if (bytes <= 0)
+			return (NULL);
+		p += bytes;
+		remaining -= bytes;
+	}
+	return (res->name_buff.s);
+}
 
-	for (i = 0; i < res->number_buckets; i++) {
-		while (res->buckets[i] != NULL) {
-			/* Remove entry from old bucket. */
-			le = res->buckets[i];
-			res->buckets[i] = le->next;
+static int
+insert_entry(struct archive_entry_linkresolver *res,
+    struct archive_entry *entry, size_t *index)
+{
+	struct links_entry *le;
+	const char *name;
+	size_t len, mask, i;
+	int64_t dev, ino;
 
-			/* Add entry to new bucket. */
-			bucket = le->hash & (new_size - 1);
+	/* If the links cache is getting too full, enlarge the hash table. */
+	if ((res->number_entries + 1) * 4 > res->table.number_slots * 3 &&
+	    grow_hash(res) != 0 &&
+	    res->number_entries + 1 >= res->table.number_slots)
+		return (-1);
+
+	name = archive_entry_pathname(entry);
+	if (name == NULL)
+		name = "";
+	len = strlen(name) + 1;
+	if (len > UINT_MAX)
+		return (-1);
+	if (res->names_used + len > res->names_size &&
+	    grow_names(res, len) != 0)
+		return (-1);
+
+	dev = (int64_t)archive_entry_dev(entry);
+	ino = archive_entry_ino64(entry);
+	mask = res->table.number_slots - 1;
+	for (i = hash_key(dev, ino) & mask;
+	    table_slot(&res->table, i, 0)->name_len != 0; i = (i + 1) & mask)
+		;
+	le = table_slot(&res->table, i, 1);
+	le->dev = dev;
+	le->ino = ino;
+	le->entry = NULL;
+	le->links = archive_entry_nlink(entry) - 1;
+	memcpy(res->names + res->names_used, name, len);
+	le->name = res->spill_size + res->names_used;
+	le->name_len = (unsigned int)len;
+	res->names_used += len;
+	res->names_live += len;
+	res->number_entries++;
+	/* Slots may have been filled behind a scan in progress. */
+	res->next_deferred = 0;
+	res->next_partial = 0;
+	*index = i;
+	return (0);
+}
 
-			if (new_buckets[bucket] != NULL)
-				new_buckets[bucket]->previous = le;
-			le->next = new_buckets[bucket];
-			le->previous = NULL;
-			new_buckets[bucket] = le;
-		}
+static int
+grow_hash(struct archive_entry_linkresolver *res)
+{
+	struct links_table new_table;
+	struct links_entry le;
+	size_t new_size, max_resident, mask;
+	size_t i, j;
+
+	/* Try to enlarge the slot array. */
+	new_size = res->table.number_slots * 2;
+	if (new_size < res->table.number_slots ||
+	    new_size * sizeof(le) / sizeof(le) != new_size)
+		return (-1);
+
+	/*
+	 * Past half the memory limit the table goes to a file, with a
+	 * quarter of the limit for the pages in memory.  New cpio keeps
+	 * it here: its deferred entries are in the slots, and it stops
+	 * deferring before the table could outgrow the limit.
+	 */
+	max_resident = 0;
+	if (res->memory_limit != 0 &&
+	    res->strategy != ARCHIVE_ENTRY_LINKIFY_LIKE_NEW_CPIO &&
+	    new_size * sizeof(le) > res->memory_limit / 2) {
+		max_resident = res->memory_limit / 4 / PAGE_BYTES;
+		if (max_resident < 2)
+			max_resident = 2;
+	}
+	if (table_init(&new_table, new_size, max_resident) != 0 &&
+	    (max_resident == 0 || table_init(&new_table, new_size, 0) != 0))
+		return (-1);
+
+	/*
+	 * Each entry lands at its old home or at that plus the old
+	 * size, so walking the old table in order fills the new one
+	 * in two runs, a page at a time.
+	 */
+	mask = new_size - 1;
+	for (i = 0; i < res->table.number_slots; i++) {
+		le = *table_slot(&res->table, i, 0);
+		if (le.name_len == 0)
+			continue;
+		for (j = hash_key(le.dev, le.ino) & mask;
+		    table_slot(&new_table, j, 0)->name_len != 0;
+		    j = (j + 1) & mask)
+			;
+		*table_slot(&new_table, j, 1) = le;
 	}
-	free(res->buckets);
-	res->buckets = new_buckets;
-	res->number_buckets = new_size;
+	table_free(&res->table);
+	res->table = new_table;
+	return (0);
 }
 
+/*
+ * Return the files of which some links were not seen.  Only the first
+ * pathname, the device and the inode are kept for each, so that is
+ * all the returned entry holds.
+ */
 struct archive_entry *
 archive_entry_partial_links(struct archive_entry_linkresolver *res,
     unsigned int *links)
 {
 	struct archive_entry	*e;
 	struct links_entry	*le;
-
-	/* Free a held entry. */
-	if (res->spare != NULL) {
-		archive_entry_free(res->spare->canonical);
-		archive_entry_free(res->spare->entry);
-		free(res->spare);
-		res->spare = NULL;
-	}
-
-	le = next_entry(res, NEXT_ENTRY_PARTIAL);
-	if (le != NULL) {
-		e = le->canonical;
+	const char		*name;
+	size_t			 i;
+
+	e = NULL;
+	if (links != NULL)
+		*links = 0;
+	if (next_entry(res, NEXT_ENTRY_PARTIAL, &i)) {
+		e = archive_entry_new();
+		if (e == NULL)
+			return (NULL);
+		le = table_slot(&res->table, i, 0);
+		name = entry_name(res, le);
+		if (name != NULL)
+			archive_entry_copy_pathname(e, name);
+		archive_entry_set_dev(e, (dev_t)le->dev);
+		archive_entry_set_ino64(e, le->ino);
 		if (links != NULL)
 			*links = le->links;
-		le->canonical = NULL;
-	} else {
-		e = NULL;
-		if (links != NULL)
-			*links = 0;
+		remove_entry(res, i);
 	}
 	return (e);
 }
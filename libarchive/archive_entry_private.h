@@ -147,6 +147,7 @@ struct archive_entry {
 #define	AE_SET_SIZE	64
 #define	AE_SET_INO	128
 #define	AE_SET_DEV	256
+#define	AE_SET_SOURCE_FD 512
 
 	/*
 	 * Use aes here so that we get transparent mbs<->wcs conversions.
@@ -162,6 +163,7 @@ struct archive_entry {
 
 	/* Not used within libarchive; useful for some clients. */
 	struct archive_mstring ae_sourcepath;	/* Path this entry is sourced from. */
+	int ae_source_fd;			/* Open file with its data. */
 
 #define AE_ENCRYPTION_NONE 0
 #define AE_ENCRYPTION_DATA 1
@@ -46,9 +46,16 @@ __FBSDID("$FreeBSD$");
 #include "archive_string.h"
 
 struct match {
+	struct archive_rb_node	 node;	/* For the pattern index. */
 	struct match		*next;
 	int			 matches;
 	struct archive_mstring	 pattern;
+	/* Index key, and the next pattern with the same key. */
+	char			*key;
+	size_t			 key_len;
+	struct match		*same;
+	/* Last lookup that picked this pattern. */
+	unsigned		 seen;
 };
 
 struct match_list {
@@ -58,6 +65,12 @@ struct match_list {
 	int			 unmatched_count;
 	struct match		*unmatched_next;
 	int			 unmatched_eof;
+	/* Index of the multibyte patterns; see match_list_index(). */
+	struct match		*indexed;	/* Last pattern indexed. */
+	struct archive_rb_tree	 literals;
+	size_t			 literal_max;
+	struct archive_rb_tree	 prefixes;
+	struct match		*others;
 };
 
 struct match_file {
@@ -131,6 +144,26 @@ struct archive_match {
 	struct id_array 	 inclusion_gids;
 	struct match_list	 inclusion_unames;
 	struct match_list	 inclusion_gnames;
+
+	/*
+	 * Scratch space for pattern index lookups: the normalized
+	 * path, the start and end of each of its elements, and the
+	 * patterns found.
+	 */
+	struct archive_string	 norm;
+	size_t			*elems;
+	int			 elems_size;
+	int			 nelems;
+	struct match		**candidates;
+	int			 candidates_size;
+	int			 ncandidates;
+	unsigned		 lookup;
+};
+
+/* Key for the pattern index trees. */
+struct pattern_key {
+	const char		*s;
+	size_t			 len;
 };
 
 static int	add_pattern_from_file(struct archive_match *,
@@ -147,10 +180,13 @@ static int	add_pattern_wcs(struct archive_match *, struct match_list *,
 		    const wchar_t *);
 static int	cmp_key_mbs(const struct archive_rb_node *, const void *);
 static int	cmp_key_wcs(const struct archive_rb_node *, const void *);
+static int	cmp_key_pattern(const struct archive_rb_node *, const void *);
 static int	cmp_node_mbs(const struct archive_rb_node *,
 		    const struct archive_rb_node *);
 static int	cmp_node_wcs(const struct archive_rb_node *,
 		    const struct archive_rb_node *);
+static int	cmp_node_pattern(const struct archive_rb_node *,
+		    const struct archive_rb_node *);
 static void	entry_list_add(struct entry_list *, struct match_file *);
 static void	entry_list_free(struct entry_list *);
 static void	entry_list_init(struct entry_list *);
@@ -158,6 +194,9 @@ static int	error_nomem(struct archive_match *);
 static void	match_list_add(struct match_list *, struct match *);
 static void	match_list_free(struct match_list *);
 static void	match_list_init(struct match_list *);
+static int	match_list_candidates(struct archive_match *,
+		    struct match_list *, int);
+static int	match_list_index(struct archive_match *, struct match_list *);
 static int	match_list_unmatched_inclusions_next(struct archive_match *,
 		    struct match_list *, int, const void **);
 static int	match_owner_id(struct id_array *, int64_t);
@@ -174,7 +213,9 @@ static int	match_path_inclusion(struct archive_match *,
 		    struct match *, int, const void *);
 static int	owner_excluded(struct archive_match *,
 		    struct archive_entry *);
+static int	normalize_path(struct archive_match *, const char *);
 static int	path_excluded(struct archive_match *, int, const void *);
+static int	path_excluded_mbs(struct archive_match *, const char *);
 static int	set_timefilter(struct archive_match *, int, time_t, long,
 		    time_t, long);
 static int	set_timefilter_pathname_mbs(struct archive_match *,
@@ -198,6 +239,10 @@ static const struct archive_rb_tree_ops rb_ops_wcs = {
 	cmp_node_wcs, cmp_key_wcs
 };
 
+static const struct archive_rb_tree_ops rb_ops_pattern = {
+	cmp_node_pattern, cmp_key_pattern
+};
+
 /*
  * The matching logic here needs to be re-thought.  I started out to
  * try to mimic gtar's matching logic, but it's not entirely
@@ -257,6 +302,9 @@ archive_match_free(struct archive *_a)
 	free(a->inclusion_gids.ids);
 	match_list_free(&(a->inclusion_unames));
 	match_list_free(&(a->inclusion_gnames));
+	archive_string_free(&(a->norm));
+	free(a->elems);
+	free(a->candidates);
 	free(a);
 	return (ARCHIVE_OK);
 }
@@ -716,6 +764,8 @@ path_excluded(struct archive_match *a, int mbs, const void *pathname)
 
 	if (a == NULL)
 		return (0);
+	if (mbs)
+		return (path_excluded_mbs(a, (const char *)pathname));
 
 	/* Mark off any unmatched inclusions. */
 	/* In particular, if a filename does appear in the archive and
@@ -830,12 +880,280 @@ match_path_inclusion(struct archive_match *a, struct match *m,
 	return (0);
 }
 
+/*
+ * Multibyte paths are matched through the pattern index, which finds
+ * the few patterns that can match a path without trying all of them.
+ * The outcome, including which inclusions are marked as matched, is
+ * the same as for the loops in path_excluded().
+ */
+static int
+path_excluded_mbs(struct archive_match *a, const char *pathname)
+{
+	struct match *match;
+	struct match *matched, *included;
+	int i, r;
+
+	if (match_list_index(a, &(a->inclusions)) != ARCHIVE_OK ||
+	    match_list_index(a, &(a->exclusions)) != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
+	if (normalize_path(a, pathname) != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
+
+	matched = included = NULL;
+	if (a->inclusions.first != NULL) {
+		if (match_list_candidates(a, &(a->inclusions), 1)
+		    != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+		for (i = 0; i < a->ncandidates; i++) {
+			match = a->candidates[i];
+			r = match_path_inclusion(a, match, 1, pathname);
+			if (r < 0)
+				return (r);
+			if (r == 0)
+				continue;
+			if (match->matches == 0) {
+				a->inclusions.unmatched_count--;
+				match->matches++;
+				matched = match;
+			} else if (included == NULL)
+				included = match;
+		}
+	}
+
+	/* Exclusions take priority */
+	if (a->exclusions.first != NULL) {
+		if (match_list_candidates(a, &(a->exclusions), 0)
+		    != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+		for (i = 0; i < a->ncandidates; i++) {
+			r = match_path_exclusion(a, a->candidates[i], 1,
+			    pathname);
+			if (r)
+				return (r);
+		}
+	}
+
+	if (matched != NULL)
+		return (0);
+	if (included != NULL) {
+		included->matches++;
+		return (0);
+	}
+
+	/* If there were inclusions, default is to exclude. */
+	return (a->inclusions.first != NULL);
+}
+
+/*
+ * Normalize a path into a->norm the way archive_pathmatch() compares
+ * paths: runs of slashes and "." elements are dropped, but a leading
+ * slash is kept.  The start and end of each element are recorded in
+ * a->elems.
+ */
+static int
+normalize_path(struct archive_match *a, const char *p)
+{
+	const char *e;
+	size_t *elems;
+	int size;
+
+	archive_string_empty(&(a->norm));
+	a->nelems = 0;
+	if (*p == '/')
+		archive_strappend_char(&(a->norm), '/');
+	for (;;) {
+		while (*p == '/')
+			p++;
+		if (*p == '\0')
+			break;
+		for (e = p; *e != '\0' && *e != '/'; e++)
+			;
+		if (e - p == 1 && *p == '.') {
+			p = e;
+			continue;
+		}
+		if (a->nelems >= a->elems_size) {
+			size = a->elems_size ? a->elems_size * 2 : 32;
+			elems = realloc(a->elems, size * 2 * sizeof(*elems));
+			if (elems == NULL)
+				return (error_nomem(a));
+			a->elems = elems;
+			a->elems_size = size;
+		}
+		if (a->nelems > 0)
+			archive_strappend_char(&(a->norm), '/');
+		a->elems[a->nelems * 2] = archive_strlen(&(a->norm));
+		archive_strncat(&(a->norm), p, e - p);
+		a->elems[a->nelems * 2 + 1] = archive_strlen(&(a->norm));
+		a->nelems++;
+		p = e;
+	}
+	/* Even an empty path needs a buffer. */
+	if (a->norm.s == NULL)
+		archive_strcat(&(a->norm), "");
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Add each pattern not yet in the index.  A pattern without wildcards
+ * is keyed by its normalized form in `literals'; a pattern whose first
+ * element has no wildcards is keyed by that element in `prefixes';
+ * anything else goes on the `others' list, which is always checked.
+ */
+static int
+match_list_index(struct archive_match *a, struct match_list *list)
+{
+	struct match *m, *n;
+	struct archive_rb_tree *tree;
+	struct pattern_key key;
+	const char *p, *e;
+	size_t len;
+	int r;
+
+	for (m = list->indexed ? list->indexed->next : list->first;
+	    m != NULL; list->indexed = m, m = m->next) {
+		r = archive_mstring_get_mbs(&(a->archive), &(m->pattern), &p);
+		if (r != 0) {
+			if (errno == ENOMEM)
+				return (error_nomem(a));
+			/* It can never match a multibyte path. */
+			continue;
+		}
+		if (p == NULL)
+			p = "";
+		len = strlen(p);
+		tree = NULL;
+		if (p[0] != '^' && (len == 0 || p[len - 1] != '$') &&
+		    strpbrk(p, "*?[\\") == NULL) {
+			if (normalize_path(a, p) != ARCHIVE_OK)
+				return (ARCHIVE_FATAL);
+			if (a->nelems > 0) {
+				tree = &(list->literals);
+				p = a->norm.s;
+				len = archive_strlen(&(a->norm));
+				if (len > list->literal_max)
+					list->literal_max = len;
+			}
+		} else if (p[0] != '^' && p[0] != '*' && p[0] != '/') {
+			/* Skip a leading "./" as archive_pathmatch() does. */
+			if (p[0] == '.' && p[1] == '/')
+				while (p[0] == '/' || (p[0] == '.' && p[1] == '/'))
+					p++;
+			e = strchr(p, '/');
+			len = (e == NULL) ? 0 : (size_t)(e - p);
+			if (len > 0 && strcspn(p, "*?[\\") > len &&
+			    !(len == 1 && p[0] == '.'))
+				tree = &(list->prefixes);
+		}
+		if (tree == NULL) {
+			m->same = list->others;
+			list->others = m;
+			continue;
+		}
+		m->key = malloc(len + 1);
+		if (m->key == NULL)
+			return (error_nomem(a));
+		memcpy(m->key, p, len);
+		m->key[len] = '\0';
+		m->key_len = len;
+		if (!__archive_rb_tree_insert_node(tree, &(m->node))) {
+			/* Chain it to the pattern already there. */
+			key.s = m->key;
+			key.len = m->key_len;
+			n = (struct match *)__archive_rb_tree_find_node(tree,
+			    &key);
+			m->same = n->same;
+			n->same = m;
+		}
+	}
+	return (ARCHIVE_OK);
+}
+
+static int
+add_candidates(struct archive_match *a, struct match *m)
+{
+	struct match **c;
+	int size;
+
+	for (; m != NULL; m = m->same) {
+		if (m->seen == a->lookup)
+			continue;
+		m->seen = a->lookup;
+		if (a->ncandidates >= a->candidates_size) {
+			size = a->candidates_size ? a->candidates_size * 2 : 32;
+			c = realloc(a->candidates, size * sizeof(*c));
+			if (c == NULL)
+				return (error_nomem(a));
+			a->candidates = c;
+			a->candidates_size = size;
+		}
+		a->candidates[a->ncandidates++] = m;
+	}
+	return (ARCHIVE_OK);
+}
+
+static int
+add_key_candidates(struct archive_match *a, struct archive_rb_tree *tree,
+    size_t start, size_t end)
+{
+	struct pattern_key key;
+
+	key.s = a->norm.s + start;
+	key.len = end - start;
+	return (add_candidates(a, (struct match *)
+	    __archive_rb_tree_find_node(tree, &key)));
+}
+
+/*
+ * Collect the patterns in the list that might match the path in
+ * a->norm.  Inclusions are anchored at the start of the path, and
+ * match a whole path unless recursive inclusion is on, in which case
+ * they also match any leading part.  Exclusions may match any run of
+ * elements.
+ */
+static int
+match_list_candidates(struct archive_match *a, struct match_list *list,
+    int inclusion)
+{
+	size_t *el = a->elems;
+	int i, j, n = a->nelems, r = ARCHIVE_OK;
+
+	if (++a->lookup == 0)
+		a->lookup = 1;
+	a->ncandidates = 0;
+	for (i = 0; i < n && r == ARCHIVE_OK; i++) {
+		if (inclusion && i > 0)
+			break;
+		for (j = (inclusion && !a->recursive_include) ? n - 1 : i;
+		    j < n && r == ARCHIVE_OK; j++) {
+			if (el[j * 2 + 1] - el[i * 2] > list->literal_max)
+				break;
+			/* Absolute patterns only match from the start. */
+			if (i == 0 && a->norm.s[0] == '/')
+				r = add_key_candidates(a, &(list->literals),
+				    0, el[j * 2 + 1]);
+			if (r == ARCHIVE_OK &&
+			    (!inclusion || a->norm.s[0] != '/'))
+				r = add_key_candidates(a, &(list->literals),
+				    el[i * 2], el[j * 2 + 1]);
+		}
+		if (r == ARCHIVE_OK && (!inclusion || a->norm.s[0] != '/'))
+			r = add_key_candidates(a, &(list->prefixes),
+			    el[i * 2], el[i * 2 + 1]);
+	}
+	if (r == ARCHIVE_OK)
+		r = add_candidates(a, list->others);
+	return (r);
+}
+
 static void
 match_list_init(struct match_list *list)
 {
 	list->first = NULL;
 	list->last = &(list->first);
 	list->count = 0;
+	__archive_rb_tree_init(&(list->literals), &rb_ops_pattern);
+	__archive_rb_tree_init(&(list->prefixes), &rb_ops_pattern);
 }
 
 static void
@@ -847,6 +1165,7 @@ match_list_free(struct match_list *list)
 		q = p;
 		p = p->next;
 		archive_mstring_clean(&(q->pattern));
+		free(q->key);
 		free(q);
 	}
 }
@@ -1359,6 +1678,36 @@ cmp_key_wcs(const struct archive_rb_node *n, const void *key)
 	return (wcscmp(p, (const wchar_t *)key));
 }
 
+static int
+cmp_pattern_key(const char *k1, size_t l1, const char *k2, size_t l2)
+{
+	int r;
+
+	r = memcmp(k1, k2, l1 < l2 ? l1 : l2);
+	if (r != 0)
+		return (r);
+	return (l1 < l2 ? -1 : l1 > l2);
+}
+
+static int
+cmp_node_pattern(const struct archive_rb_node *n1,
+    const struct archive_rb_node *n2)
+{
+	const struct match *m1 = (const struct match *)n1;
+	const struct match *m2 = (const struct match *)n2;
+
+	return (cmp_pattern_key(m1->key, m1->key_len, m2->key, m2->key_len));
+}
+
+static int
+cmp_key_pattern(const struct archive_rb_node *n, const void *key)
+{
+	const struct match *m = (const struct match *)n;
+	const struct pattern_key *k = (const struct pattern_key *)key;
+
+	return (cmp_pattern_key(m->key, m->key_len, k->s, k->len));
+}
+
 static void
 entry_list_init(struct entry_list *list)
 {
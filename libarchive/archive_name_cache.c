@@ -0,0 +1,647 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_GRP_H
+#include <grp.h>
+#endif
+#ifdef HAVE_PWD_H
+#include <pwd.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#include <pthread.h>
+#define ARCHIVE_HAVE_THREADS	1
+#endif
+
+#include "archive_name_cache_private.h"
+
+/*
+ * Each of the four maps is a chained hash table that doubles in size
+ * whenever it holds as many entries as it has buckets.  Nodes are
+ * never changed or removed once they are in a map, so a name may be
+ * handed out and read without holding the lock.
+ *
+ * The system lookups themselves run without the lock; for a directory
+ * service they can take milliseconds each.  If two threads miss on the
+ * same key at once, both look it up and the first to finish wins.
+ * A lookup that fails with an error is not cached, so that it is
+ * tried again next time.
+ */
+
+/* Stop preloading a database after this many entries. */
+#define	PRELOAD_MAX	65536
+
+struct name_node {
+	struct name_node	*next;
+	int64_t			 id;
+	unsigned		 hash;
+	/* For id maps, whether name is set; for name maps, id. */
+	int			 found;
+	char			 name[1];
+};
+
+struct name_map {
+	struct name_node	**buckets;
+	size_t			 nbuckets;
+	size_t			 count;
+};
+
+struct archive_name_cache {
+	int			 refs;
+	int			 preloaded;
+	struct name_map		 unames;	/* uid to user name */
+	struct name_map		 gnames;	/* gid to group name */
+	struct name_map		 uids;		/* user name to uid */
+	struct name_map		 gids;		/* group name to gid */
+};
+
+typedef struct name_node *id_lookup_fn(int64_t, int *);
+typedef struct name_node *name_lookup_fn(const char *, int *);
+
+static struct archive_name_cache the_cache;
+#ifdef ARCHIVE_HAVE_THREADS
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Serializes the preloads, which use getpwent() and getgrent(). */
+static pthread_mutex_t preload_lock = PTHREAD_MUTEX_INITIALIZER;
+#define	lock_cache()	pthread_mutex_lock(&cache_lock)
+#define	unlock_cache()	pthread_mutex_unlock(&cache_lock)
+#define	lock_preload()	pthread_mutex_lock(&preload_lock)
+#define	unlock_preload()	pthread_mutex_unlock(&preload_lock)
+#else
+#define	lock_cache()	do {} while (0)
+#define	unlock_cache()	do {} while (0)
+#define	lock_preload()	do {} while (0)
+#define	unlock_preload()	do {} while (0)
+#endif
+
+static unsigned
+hash_id(int64_t id)
+{
+	return (((unsigned)id ^ (unsigned)((uint64_t)id >> 32)) *
+	    2654435761U);
+}
+
+static unsigned
+hash_name(const char *p)
+{
+	/* 32-bit FNV-1a. */
+	unsigned h = 2166136261U;
+
+	while (*p != '\0') {
+		h ^= (unsigned char)*p++;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+static struct name_node *
+node_new(int64_t id, const char *name, int found)
+{
+	struct name_node *n;
+	size_t len;
+
+	len = (name == NULL) ? 0 : strlen(name);
+	n = malloc(sizeof(*n) + len);
+	if (n == NULL)
+		return (NULL);
+	n->next = NULL;
+	n->id = id;
+	n->hash = 0;
+	n->found = found;
+	if (len > 0)
+		memcpy(n->name, name, len);
+	n->name[len] = '\0';
+	return (n);
+}
+
+static struct name_node *
+map_find_id(struct name_map *m, int64_t id, unsigned h)
+{
+	struct name_node *n;
+
+	if (m->nbuckets == 0)
+		return (NULL);
+	for (n = m->buckets[h & (m->nbuckets - 1)]; n != NULL; n = n->next)
+		if (n->id == id)
+			return (n);
+	return (NULL);
+}
+
+static struct name_node *
+map_find_name(struct name_map *m, const char *name, unsigned h)
+{
+	struct name_node *n;
+
+	if (m->nbuckets == 0)
+		return (NULL);
+	for (n = m->buckets[h & (m->nbuckets - 1)]; n != NULL; n = n->next)
+		if (n->hash == h && strcmp(n->name, name) == 0)
+			return (n);
+	return (NULL);
+}
+
+/*
+ * Add a node that is not in the map yet.  Returns -1 if the map had
+ * to grow and could not, in which case the caller still owns `n'.
+ */
+static int
+map_insert(struct name_map *m, struct name_node *n)
+{
+	struct name_node **buckets, *p, *next;
+	size_t i, nbuckets;
+
+	if (m->count >= m->nbuckets) {
+		nbuckets = (m->nbuckets == 0) ? 64 : m->nbuckets * 2;
+		buckets = calloc(nbuckets, sizeof(*buckets));
+		if (buckets == NULL) {
+			if (m->nbuckets == 0)
+				return (-1);
+		} else {
+			for (i = 0; i < m->nbuckets; i++) {
+				for (p = m->buckets[i]; p != NULL; p = next) {
+					next = p->next;
+					p->next =
+					    buckets[p->hash & (nbuckets - 1)];
+					buckets[p->hash & (nbuckets - 1)] = p;
+				}
+			}
+			free(m->buckets);
+			m->buckets = buckets;
+			m->nbuckets = nbuckets;
+		}
+	}
+	i = n->hash & (m->nbuckets - 1);
+	n->next = m->buckets[i];
+	m->buckets[i] = n;
+	m->count++;
+	return (0);
+}
+
+static void
+map_free(struct name_map *m)
+{
+	struct name_node *n, *next;
+	size_t i;
+
+	for (i = 0; i < m->nbuckets; i++) {
+		for (n = m->buckets[i]; n != NULL; n = next) {
+			next = n->next;
+			free(n);
+		}
+	}
+	free(m->buckets);
+	m->buckets = NULL;
+	m->nbuckets = 0;
+	m->count = 0;
+}
+
+/*
+ * Record an entry read from the passwd or group database in both of
+ * its maps, unless an earlier entry or lookup already took the id or
+ * the name.  Each entry is added under the lock on its own, so that
+ * other lookups are not held up while the databases are read.
+ */
+static void
+preload_entry(struct name_map *ids, struct name_map *names, int64_t id,
+    const char *name)
+{
+	struct name_node *n;
+	unsigned h;
+
+	lock_cache();
+	h = hash_id(id);
+	if (map_find_id(ids, id, h) == NULL &&
+	    (n = node_new(id, name, 1)) != NULL) {
+		n->hash = h;
+		if (map_insert(ids, n) != 0)
+			free(n);
+	}
+	h = hash_name(name);
+	if (map_find_name(names, name, h) == NULL &&
+	    (n = node_new(id, name, 1)) != NULL) {
+		n->hash = h;
+		if (map_insert(names, n) != 0)
+			free(n);
+	}
+	unlock_cache();
+}
+
+static const char *
+lookup_id(struct name_map *m, int64_t id, int *error, id_lookup_fn *fn)
+{
+	struct name_node *n, *old;
+	unsigned h;
+
+	h = hash_id(id);
+	lock_cache();
+	n = map_find_id(m, id, h);
+	unlock_cache();
+	if (n == NULL) {
+		int r = 0;
+
+		n = (*fn)(id, &r);
+		if (n == NULL)
+			return (NULL);
+		if (r != 0) {
+			/* Not found because of an error: don't remember
+			 * that, the next lookup may succeed. */
+			*error = r;
+			free(n);
+			return (NULL);
+		}
+		n->hash = h;
+		lock_cache();
+		old = map_find_id(m, id, h);
+		if (old != NULL) {
+			free(n);
+			n = old;
+		} else if (map_insert(m, n) != 0) {
+			free(n);
+			n = NULL;
+		}
+		unlock_cache();
+		if (n == NULL)
+			return (NULL);
+	}
+	return (n->found ? n->name : NULL);
+}
+
+static int64_t
+lookup_name(struct name_map *m, const char *name, int64_t id,
+    name_lookup_fn *fn)
+{
+	struct name_node *n, *old;
+	unsigned h;
+
+	h = hash_name(name);
+	lock_cache();
+	n = map_find_name(m, name, h);
+	unlock_cache();
+	if (n == NULL) {
+		int r = 0;
+
+		n = (*fn)(name, &r);
+		if (n == NULL)
+			return (id);
+		if (r != 0) {
+			/* As for lookup_id(), an error is not cached. */
+			free(n);
+			return (id);
+		}
+		n->hash = h;
+		lock_cache();
+		old = map_find_name(m, name, h);
+		if (old != NULL) {
+			free(n);
+			n = old;
+		} else if (map_insert(m, n) != 0) {
+			/* Not cached, but the answer is still good. */
+			if (n->found)
+				id = n->id;
+			free(n);
+			n = NULL;
+		}
+		unlock_cache();
+		if (n == NULL)
+			return (id);
+	}
+	return (n->found ? n->id : id);
+}
+
+/*
+ * The system lookups.  Each returns a new node holding the answer,
+ * or NULL if it ran out of memory.  If the lookup failed with an
+ * error, rather than finding nothing, *error is set to its number.
+ */
+
+static struct name_node *
+system_uname(int64_t id, int *error)
+{
+#if defined(HAVE_PWD_H) && HAVE_GETPWUID_R
+	char _buffer[256];
+	size_t bufsize = sizeof(_buffer);
+	char *buffer = _buffer;
+	char *allocated = NULL;
+	struct passwd pwent, *result;
+	struct name_node *n;
+	int r;
+
+	for (;;) {
+		result = &pwent; /* Old getpwuid_r ignores last arg. */
+		r = getpwuid_r((uid_t)id, &pwent, buffer, bufsize, &result);
+		if (r != ERANGE)
+			break;
+		/* ERANGE means our buffer was too small, but POSIX
+		 * doesn't tell us how big the buffer should be, so
+		 * we just double it and try again. */
+		bufsize *= 2;
+		free(allocated);
+		allocated = malloc(bufsize);
+		if (allocated == NULL)
+			break;
+		buffer = allocated;
+	}
+	if (r != 0) {
+		*error = r;
+		result = NULL;
+	}
+	n = node_new(id, result != NULL ? result->pw_name : NULL,
+	    result != NULL);
+	free(allocated);
+	return (n);
+#elif defined(HAVE_PWD_H)
+	struct passwd *result;
+
+	errno = 0;
+	result = getpwuid((uid_t)id);
+	if (result == NULL)
+		*error = errno;
+	return (node_new(id, result != NULL ? result->pw_name : NULL,
+	    result != NULL));
+#else
+	(void)error; /* UNUSED */
+	return (node_new(id, NULL, 0));
+#endif
+}
+
+static struct name_node *
+system_gname(int64_t id, int *error)
+{
+#if defined(HAVE_GRP_H) && HAVE_GETGRGID_R
+	char _buffer[256];
+	size_t bufsize = sizeof(_buffer);
+	char *buffer = _buffer;
+	char *allocated = NULL;
+	struct group grent, *result;
+	struct name_node *n;
+	int r;
+
+	for (;;) {
+		result = &grent; /* Old getgrgid_r ignores last arg. */
+		r = getgrgid_r((gid_t)id, &grent, buffer, bufsize, &result);
+		if (r != ERANGE)
+			break;
+		bufsize *= 2;
+		free(allocated);
+		allocated = malloc(bufsize);
+		if (allocated == NULL)
+			break;
+		buffer = allocated;
+	}
+	if (r != 0) {
+		*error = r;
+		result = NULL;
+	}
+	n = node_new(id, result != NULL ? result->gr_name : NULL,
+	    result != NULL);
+	free(allocated);
+	return (n);
+#elif defined(HAVE_GRP_H)
+	struct group *result;
+
+	errno = 0;
+	result = getgrgid((gid_t)id);
+	if (result == NULL)
+		*error = errno;
+	return (node_new(id, result != NULL ? result->gr_name : NULL,
+	    result != NULL));
+#else
+	(void)error; /* UNUSED */
+	return (node_new(id, NULL, 0));
+#endif
+}
+
+static struct name_node *
+system_uid(const char *name, int *error)
+{
+#if defined(HAVE_PWD_H) && HAVE_GETPWNAM_R
+	char _buffer[256];
+	size_t bufsize = sizeof(_buffer);
+	char *buffer = _buffer;
+	char *allocated = NULL;
+	struct passwd pwent, *result;
+	struct name_node *n;
+	int r;
+
+	for (;;) {
+		result = &pwent; /* Old getpwnam_r ignores last arg. */
+		r = getpwnam_r(name, &pwent, buffer, bufsize, &result);
+		if (r != ERANGE)
+			break;
+		bufsize *= 2;
+		free(allocated);
+		allocated = malloc(bufsize);
+		if (allocated == NULL)
+			break;
+		buffer = allocated;
+	}
+	if (r != 0) {
+		*error = r;
+		result = NULL;
+	}
+	n = node_new(result != NULL ? result->pw_uid : 0, name,
+	    result != NULL);
+	free(allocated);
+	return (n);
+#elif defined(HAVE_PWD_H)
+	struct passwd *result;
+
+	errno = 0;
+	result = getpwnam(name);
+	if (result == NULL)
+		*error = errno;
+	return (node_new(result != NULL ? result->pw_uid : 0, name,
+	    result != NULL));
+#else
+	(void)error; /* UNUSED */
+	return (node_new(0, name, 0));
+#endif
+}
+
+static struct name_node *
+system_gid(const char *name, int *error)
+{
+#if defined(HAVE_GRP_H) && HAVE_GETGRNAM_R
+	char _buffer[256];
+	size_t bufsize = sizeof(_buffer);
+	char *buffer = _buffer;
+	char *allocated = NULL;
+	struct group grent, *result;
+	struct name_node *n;
+	int r;
+
+	for (;;) {
+		result = &grent; /* Old getgrnam_r ignores last arg. */
+		r = getgrnam_r(name, &grent, buffer, bufsize, &result);
+		if (r != ERANGE)
+			break;
+		bufsize *= 2;
+		free(allocated);
+		allocated = malloc(bufsize);
+		if (allocated == NULL)
+			break;
+		buffer = allocated;
+	}
+	if (r != 0) {
+		*error = r;
+		result = NULL;
+	}
+	n = node_new(result != NULL ? result->gr_gid : 0, name,
+	    result != NULL);
+	free(allocated);
+	return (n);
+#elif defined(HAVE_GRP_H)
+	struct group *result;
+
+	errno = 0;
+	result = getgrnam(name);
+	if (result == NULL)
+		*error = errno;
+	return (node_new(result != NULL ? result->gr_gid : 0, name,
+	    result != NULL));
+#else
+	(void)error; /* UNUSED */
+	return (node_new(0, name, 0));
+#endif
+}
+
+struct archive_name_cache *
+__archive_name_cache_get(void)
+{
+	lock_cache();
+	the_cache.refs++;
+	unlock_cache();
+	return (&the_cache);
+}
+
+/*
+ * Drop a reference; the cache empties when the last one goes, so that
+ * later archive objects see any changes to the databases.
+ */
+void
+__archive_name_cache_release(struct archive_name_cache *c)
+{
+	if (c == NULL)
+		return;
+	lock_cache();
+	if (--c->refs == 0) {
+		map_free(&c->unames);
+		map_free(&c->gnames);
+		map_free(&c->uids);
+		map_free(&c->gids);
+		c->preloaded = 0;
+	}
+	unlock_cache();
+}
+
+/*
+ * Fill the cache from the passwd and group databases, unless that was
+ * done already.  Only one thread reads them at a time, and none of
+ * our own lookups use getpwent() or getgrent(), but the application's
+ * may: their position in the databases is lost.
+ */
+void
+__archive_name_cache_preload(struct archive_name_cache *c)
+{
+	int done, i;
+
+	lock_preload();
+	lock_cache();
+	done = c->preloaded;
+	unlock_cache();
+	if (done) {
+		unlock_preload();
+		return;
+	}
+#if defined(HAVE_PWD_H) && defined(HAVE_GETPWENT)
+	{
+		struct passwd *pw;
+
+		setpwent();
+		for (i = 0; i < PRELOAD_MAX && (pw = getpwent()) != NULL; i++)
+			preload_entry(&c->unames, &c->uids, pw->pw_uid,
+			    pw->pw_name);
+		endpwent();
+	}
+#endif
+#if defined(HAVE_GRP_H) && defined(HAVE_GETGRENT)
+	{
+		struct group *gr;
+
+		setgrent();
+		for (i = 0; i < PRELOAD_MAX && (gr = getgrent()) != NULL; i++)
+			preload_entry(&c->gnames, &c->gids, gr->gr_gid,
+			    gr->gr_name);
+		endgrent();
+	}
+#endif
+	(void)i; /* UNUSED */
+	lock_cache();
+	c->preloaded = 1;
+	unlock_cache();
+	unlock_preload();
+}
+
+const char *
+__archive_name_cache_uname(struct archive_name_cache *c, int64_t uid,
+    int *error)
+{
+	return (lookup_id(&c->unames, uid, error, system_uname));
+}
+
+const char *
+__archive_name_cache_gname(struct archive_name_cache *c, int64_t gid,
+    int *error)
+{
+	return (lookup_id(&c->gnames, gid, error, system_gname));
+}
+
+int64_t
+__archive_name_cache_uid(struct archive_name_cache *c, const char *uname,
+    int64_t id)
+{
+	return (lookup_name(&c->uids, uname, id, system_uid));
+}
+
+int64_t
+__archive_name_cache_gid(struct archive_name_cache *c, const char *gname,
+    int64_t id)
+{
+	return (lookup_name(&c->gids, gname, id, system_gid));
+}
@@ -0,0 +1,70 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ARCHIVE_NAME_CACHE_PRIVATE_H_INCLUDED
+#define ARCHIVE_NAME_CACHE_PRIVATE_H_INCLUDED
+
+#ifndef __LIBARCHIVE_BUILD
+#error This header is only to be used internally to libarchive.
+#endif
+
+/*
+ * The user and group name cache behind the standard lookup functions
+ * of archive_read_disk and archive_write_disk.
+ *
+ * There is one cache per process, shared by every archive object and
+ * safe to use from any thread.  Each object holds a reference from
+ * __archive_name_cache_get() until it is done with it.  A name
+ * returned by the cache stays valid as long as the caller holds its
+ * reference.  Lookups that find nothing are cached as well, but not
+ * those that fail with an error.
+ */
+struct archive_name_cache;
+
+struct archive_name_cache *__archive_name_cache_get(void);
+void	__archive_name_cache_release(struct archive_name_cache *);
+
+/*
+ * Read the whole passwd and group databases into the cache, once.
+ * This uses getpwent() and getgrent(), so it is only done when asked.
+ */
+void	__archive_name_cache_preload(struct archive_name_cache *);
+
+/*
+ * Map an id to its name; NULL if there is none.  If the system lookup
+ * failed, *error is set to its error number.
+ */
+const char *__archive_name_cache_uname(struct archive_name_cache *,
+	    int64_t uid, int *error);
+const char *__archive_name_cache_gname(struct archive_name_cache *,
+	    int64_t gid, int *error);
+
+/* Map a name to its id; `id' is returned if there is none. */
+int64_t	__archive_name_cache_uid(struct archive_name_cache *,
+	    const char *uname, int64_t id);
+int64_t	__archive_name_cache_gid(struct archive_name_cache *,
+	    const char *gname, int64_t id);
+
+#endif /* ARCHIVE_NAME_CACHE_PRIVATE_H_INCLUDED */
@@ -92,6 +92,7 @@ struct archive_vtable {
 };
 
 struct archive_string_conv;
+struct archive_stats;
 
 struct archive {
 	/*
@@ -140,6 +141,9 @@ struct archive {
 	 */
 	char		  read_data_is_posix_read;
 	size_t		  read_data_requested;
+
+	/* Per-stage statistics; NULL unless archive_stats_enable(). */
+	struct archive_stats *stats;
 };
 
 /* Check magic value and state; return(ARCHIVE_FATAL) if it isn't valid. */
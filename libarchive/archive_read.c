@@ -52,6 +52,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read.c 201157 2009-12-29 05:30:2
 #include "archive_entry.h"
 #include "archive_private.h"
 #include "archive_read_private.h"
+#include "archive_stats_private.h"
 
 #define minimum(a, b) (a < b ? a : b)
 
@@ -162,9 +163,15 @@ archive_read_open2(struct archive *a, void *client_data,
 static ssize_t
 client_read_proxy(struct archive_read_filter *self, const void **buff)
 {
+	struct archive *a = &self->archive->archive;
 	ssize_t r;
-	r = (self->archive->client.reader)(&self->archive->archive,
-	    self->data, buff);
+	int prev = 0;
+
+	if (a->stats != NULL)
+		prev = __archive_stats_enter(a, ARCHIVE_STATS_CLIENT);
+	r = (self->archive->client.reader)(a, self->data, buff);
+	if (a->stats != NULL)
+		__archive_stats_leave(a, prev, r);
 	return (r);
 }
 
@@ -221,6 +228,10 @@ client_skip_proxy(struct archive_read_filter *self, int64_t request)
 static int64_t
 client_seek_proxy(struct archive_read_filter *self, int64_t offset, int whence)
 {
+	struct archive *a = &self->archive->archive;
+	int64_t r;
+	int prev = 0;
+
 	/* DO NOT use the skipper here!  If we transparently handled
 	 * forward seek here by using the skipper, that will break
 	 * other libarchive code that assumes a successful forward
@@ -231,8 +242,12 @@ client_seek_proxy(struct archive_read_filter *self, int64_t offset, int whence)
 		    "Current client reader does not support seeking a device");
 		return (ARCHIVE_FAILED);
 	}
-	return (self->archive->client.seeker)(&self->archive->archive,
-	    self->data, offset, whence);
+	if (a->stats != NULL)
+		prev = __archive_stats_enter(a, ARCHIVE_STATS_CLIENT);
+	r = (self->archive->client.seeker)(a, self->data, offset, whence);
+	if (a->stats != NULL)
+		__archive_stats_leave(a, prev, 0);
+	return (r);
 }
 
 static int
@@ -616,7 +631,7 @@ static int
 _archive_read_next_header2(struct archive *_a, struct archive_entry *entry)
 {
 	struct archive_read *a = (struct archive_read *)_a;
-	int r1 = ARCHIVE_OK, r2;
+	int r1 = ARCHIVE_OK, r2, prev;
 
 	archive_check_magic(_a, ARCHIVE_READ_MAGIC,
 	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA,
@@ -644,7 +659,12 @@ _archive_read_next_header2(struct archive *_a, struct archive_entry *entry)
 	a->header_position = a->filter->position;
 
 	++_a->file_count;
-	r2 = (a->format->read_header)(a, entry);
+	if (_a->stats != NULL) {
+		prev = __archive_stats_enter(_a, ARCHIVE_STATS_FORMAT);
+		r2 = (a->format->read_header)(a, entry);
+		__archive_stats_leave(_a, prev, 0);
+	} else
+		r2 = (a->format->read_header)(a, entry);
 
 	/*
 	 * EOF and FATAL are persistent at this layer.  By
@@ -920,7 +940,7 @@ int
 archive_read_data_skip(struct archive *_a)
 {
 	struct archive_read *a = (struct archive_read *)_a;
-	int r;
+	int r, prev;
 	const void *buff;
 	size_t size;
 	int64_t offset;
@@ -928,9 +948,14 @@ archive_read_data_skip(struct archive *_a)
 	archive_check_magic(_a, ARCHIVE_READ_MAGIC, ARCHIVE_STATE_DATA,
 	    "archive_read_data_skip");
 
-	if (a->format->read_data_skip != NULL)
-		r = (a->format->read_data_skip)(a);
-	else {
+	if (a->format->read_data_skip != NULL) {
+		if (_a->stats != NULL) {
+			prev = __archive_stats_enter(_a, ARCHIVE_STATS_FORMAT);
+			r = (a->format->read_data_skip)(a);
+			__archive_stats_leave(_a, prev, 0);
+		} else
+			r = (a->format->read_data_skip)(a);
+	} else {
 		while ((r = archive_read_data_block(&a->archive,
 			    &buff, &size, &offset))
 		    == ARCHIVE_OK)
@@ -974,6 +999,8 @@ _archive_read_data_block(struct archive *_a,
     const void **buff, size_t *size, int64_t *offset)
 {
 	struct archive_read *a = (struct archive_read *)_a;
+	int r, prev;
+
 	archive_check_magic(_a, ARCHIVE_READ_MAGIC, ARCHIVE_STATE_DATA,
 	    "archive_read_data_block");
 
@@ -984,7 +1011,12 @@ _archive_read_data_block(struct archive *_a,
 		return (ARCHIVE_FATAL);
 	}
 
-	return (a->format->read_data)(a, buff, size, offset);
+	if (_a->stats == NULL)
+		return (a->format->read_data)(a, buff, size, offset);
+	prev = __archive_stats_enter(_a, ARCHIVE_STATS_FORMAT);
+	r = (a->format->read_data)(a, buff, size, offset);
+	__archive_stats_leave(_a, prev, r == ARCHIVE_OK ? *size : 0);
+	return (r);
 }
 
 static int
@@ -1322,6 +1354,26 @@ __archive_read_ahead(struct archive_read *a, size_t min, ssize_t *avail)
 	return (__archive_read_filter_ahead(a->filter, min, avail));
 }
 
+/*
+ * Have a filter produce its next block of data.  The bottom of the
+ * pipeline is the client, which its proxies time themselves.
+ */
+static ssize_t
+read_filter_read(struct archive_read_filter *filter, const void **buff)
+{
+	struct archive *a = &filter->archive->archive;
+	ssize_t r;
+	int prev;
+
+	if (a->stats == NULL || filter->upstream == NULL)
+		return ((filter->vtable->read)(filter, buff));
+	prev = __archive_stats_enter_filter(a, &filter->stats_stage,
+	    filter->name);
+	r = (filter->vtable->read)(filter, buff);
+	__archive_stats_leave(a, prev, r);
+	return (r);
+}
+
 const void *
 __archive_read_filter_ahead(struct archive_read_filter *filter,
     size_t min, ssize_t *avail)
@@ -1386,7 +1438,7 @@ __archive_read_filter_ahead(struct archive_read_filter *filter,
 					*avail = 0;
 				return (NULL);
 			}
-			bytes_read = (filter->vtable->read)(filter,
+			bytes_read = read_filter_read(filter,
 			    &filter->client_buff);
 			if (bytes_read < 0) {		/* Read error. */
 				filter->client_total = filter->client_avail = 0;
@@ -1564,9 +1616,35 @@ advance_file_pointer(struct archive_read_filter *filter, int64_t request)
 	if (request == 0)
 		return (total_bytes_skipped);
 
+	/* A filter that can seek its output can skip without decoding. */
+	if (filter->upstream != NULL && filter->can_seek != 0 &&
+	    filter->vtable->seek != NULL) {
+		bytes_skipped = (filter->vtable->seek)(filter,
+		    filter->position + request, SEEK_SET);
+		if (bytes_skipped < 0) {	/* error */
+			filter->fatal = 1;
+			return (bytes_skipped);
+		}
+		bytes_skipped -= filter->position;
+		filter->client_buff = NULL;
+		filter->position += bytes_skipped;
+		total_bytes_skipped += bytes_skipped;
+		if (bytes_skipped < request)
+			filter->end_of_file = 1;
+		return (total_bytes_skipped);
+	}
+
 	/* If there's an optimized skip function, use it. */
 	if (filter->can_skip != 0) {
-		bytes_skipped = client_skip_proxy(filter, request);
+		if (filter->archive->archive.stats != NULL) {
+			struct archive *a = &filter->archive->archive;
+			int prev;
+
+			prev = __archive_stats_enter(a, ARCHIVE_STATS_CLIENT);
+			bytes_skipped = client_skip_proxy(filter, request);
+			__archive_stats_leave(a, prev, 0);
+		} else
+			bytes_skipped = client_skip_proxy(filter, request);
 		if (bytes_skipped < 0) {	/* error */
 			filter->fatal = 1;
 			return (bytes_skipped);
@@ -1580,7 +1658,7 @@ advance_file_pointer(struct archive_read_filter *filter, int64_t request)
 
 	/* Use ordinary reads as necessary to complete the request. */
 	for (;;) {
-		bytes_read = (filter->vtable->read)(filter, &filter->client_buff);
+		bytes_read = read_filter_read(filter, &filter->client_buff);
 		if (bytes_read < 0) {
 			filter->client_buff = NULL;
 			filter->fatal = 1;
@@ -1638,6 +1716,25 @@ __archive_read_filter_seek(struct archive_read_filter *filter, int64_t offset,
 	if (filter->can_seek == 0)
 		return (ARCHIVE_FAILED);
 
+	if (filter->upstream != NULL) {
+		/* A filter seeks within its own decoded output. */
+		if (filter->vtable->seek == NULL)
+			return (ARCHIVE_FAILED);
+		if (whence == SEEK_CUR) {
+			offset += filter->position;
+			whence = SEEK_SET;
+		}
+		r = (filter->vtable->seek)(filter, offset, whence);
+		if (r < 0)
+			return (r);
+		filter->avail = filter->client_avail = 0;
+		filter->next = filter->buffer;
+		filter->client_buff = NULL;
+		filter->position = r;
+		filter->end_of_file = 0;
+		return (r);
+	}
+
 	client = &(filter->archive->client);
 	switch (whence) {
 	case SEEK_CUR:
@@ -108,7 +108,8 @@ static int setup_xattrs_namespace(struct archive_read_disk *,
     struct archive_entry *, int *, int);
 #endif
 static int setup_xattrs(struct archive_read_disk *,
-    struct archive_entry *, int *fd);
+    struct archive_entry *, int *fd, int *acl_xattrs);
+static int may_be_sparse(const struct stat *);
 static int setup_sparse(struct archive_read_disk *,
     struct archive_entry *, int *fd);
 #if defined(HAVE_LINUX_FIEMAP_H)
@@ -165,7 +166,7 @@ archive_read_disk_entry_from_file(struct archive *_a,
 	const char *path, *name;
 	struct stat s;
 	int initial_fd = fd;
-	int r, r1;
+	int acl_xattrs, r, r1;
 
 	archive_check_magic(_a, ARCHIVE_READ_DISK_MAGIC, ARCHIVE_STATE_ANY,
 		"archive_read_disk_entry_from_file");
@@ -290,11 +291,16 @@ archive_read_disk_entry_from_file(struct archive *_a,
 	}
 #endif /* HAVE_READLINK || HAVE_READLINKAT */
 
+	/*
+	 * Extended attributes go first: on some systems the list tells
+	 * us whether there can be any ACLs to look up.
+	 */
 	r = 0;
-	if ((a->flags & ARCHIVE_READDISK_NO_ACL) == 0)
-		r = archive_read_disk_entry_setup_acls(a, entry, &fd);
-	if ((a->flags & ARCHIVE_READDISK_NO_XATTR) == 0) {
-		r1 = setup_xattrs(a, entry, &fd);
+	acl_xattrs = 1;
+	if ((a->flags & ARCHIVE_READDISK_NO_XATTR) == 0)
+		r = setup_xattrs(a, entry, &fd, &acl_xattrs);
+	if ((a->flags & ARCHIVE_READDISK_NO_ACL) == 0 && acl_xattrs) {
+		r1 = archive_read_disk_entry_setup_acls(a, entry, &fd);
 		if (r1 < r)
 			r = r1;
 	}
@@ -303,7 +309,8 @@ archive_read_disk_entry_from_file(struct archive *_a,
 		if (r1 < r)
 			r = r1;
 	}
-	if ((a->flags & ARCHIVE_READDISK_NO_SPARSE) == 0) {
+	if ((a->flags & ARCHIVE_READDISK_NO_SPARSE) == 0 &&
+	    may_be_sparse(st)) {
 		r1 = setup_sparse(a, entry, &fd);
 		if (r1 < r)
 			r = r1;
@@ -530,9 +537,13 @@ setup_xattr(struct archive_read_disk *a,
 	return (ARCHIVE_OK);
 }
 
+/*
+ * On Linux, ACLs are stored as extended attributes; *acl_xattrs is
+ * cleared when the list shows that there are none.
+ */
 static int
 setup_xattrs(struct archive_read_disk *a,
-    struct archive_entry *entry, int *fd)
+    struct archive_entry *entry, int *fd, int *acl_xattrs)
 {
 	char *list, *p;
 	const char *path;
@@ -573,15 +584,23 @@ setup_xattrs(struct archive_read_disk *a,
 	}
 
 	if (list_size == -1) {
-		if (errno == ENOTSUP || errno == ENOSYS)
+		if (errno == ENOTSUP || errno == ENOSYS) {
+#if ARCHIVE_XATTR_LINUX
+			*acl_xattrs = 0;
+#endif
 			return (ARCHIVE_OK);
+		}
 		archive_set_error(&a->archive, errno,
 			"Couldn't list extended attributes");
 		return (ARCHIVE_WARN);
 	}
 
-	if (list_size == 0)
+	if (list_size == 0) {
+#if ARCHIVE_XATTR_LINUX
+		*acl_xattrs = 0;
+#endif
 		return (ARCHIVE_OK);
+	}
 
 	if ((list = malloc(list_size)) == NULL) {
 		archive_set_error(&a->archive, errno, "Out of memory");
@@ -621,6 +640,18 @@ setup_xattrs(struct archive_read_disk *a,
 		return (ARCHIVE_WARN);
 	}
 
+#if ARCHIVE_XATTR_LINUX
+	/* Only the "system" and "trusted" namespaces can hold ACLs. */
+	*acl_xattrs = 0;
+	for (p = list; (p - list) < list_size; p += strlen(p) + 1) {
+		if (strncmp(p, "system.", 7) == 0 ||
+		    strncmp(p, "trusted.SGI_", 12) == 0)
+			*acl_xattrs = 1;
+	}
+#else
+	(void)acl_xattrs; /* UNUSED */
+#endif
+
 	for (p = list; (p - list) < list_size; p += strlen(p) + 1) {
 #if ARCHIVE_XATTR_LINUX
 		/* Linux: skip POSIX.1e ACL extended attributes */
@@ -791,11 +822,13 @@ setup_xattrs_namespace(struct archive_read_disk *a,
 
 static int
 setup_xattrs(struct archive_read_disk *a,
-    struct archive_entry *entry, int *fd)
+    struct archive_entry *entry, int *fd, int *acl_xattrs)
 {
 	int namespaces[2];
 	int i, res;
 
+	(void)acl_xattrs; /* UNUSED */
+
 	namespaces[0] = EXTATTR_NAMESPACE_USER;
 	namespaces[1] = EXTATTR_NAMESPACE_SYSTEM;
 
@@ -821,16 +854,38 @@ setup_xattrs(struct archive_read_disk *a,
  */
 static int
 setup_xattrs(struct archive_read_disk *a,
-    struct archive_entry *entry, int *fd)
+    struct archive_entry *entry, int *fd, int *acl_xattrs)
 {
 	(void)a;     /* UNUSED */
 	(void)entry; /* UNUSED */
 	(void)fd;    /* UNUSED */
+	(void)acl_xattrs; /* UNUSED */
 	return (ARCHIVE_OK);
 }
 
 #endif
 
+/*
+ * Looking for holes costs several system calls, which is most of the
+ * work for a small file.  A file whose allocated blocks cover all of
+ * its data cannot have any.  (Space reserved past the end of a file
+ * can hide a hole; such a file is stored without a sparse map, which
+ * costs space in the archive but loses nothing.)
+ */
+static int
+may_be_sparse(const struct stat *st)
+{
+#if defined(__linux__)
+	/* Linux counts st_blocks in 512-byte units. */
+	if (S_ISREG(st->st_mode) &&
+	    (int64_t)st->st_blocks * 512 >= (int64_t)st->st_size)
+		return (0);
+#else
+	(void)st; /* UNUSED */
+#endif
+	return (1);
+}
+
 #if defined(HAVE_LINUX_FIEMAP_H)
 
 /*
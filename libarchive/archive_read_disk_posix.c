@@ -683,6 +683,60 @@ setup_suitable_read_buffer(struct archive_read_disk *a)
 	return (ARCHIVE_OK);
 }
 
+/*
+ * Open the current file for reading its data.
+ */
+static int
+open_entry_fd(struct archive_read_disk *a)
+{
+	struct tree *t = a->tree;
+	int flags = O_RDONLY | O_BINARY | O_CLOEXEC;
+
+	/*
+	 * Eliminate or reduce cache effects if we can.
+	 *
+	 * Carefully consider this to be enabled.
+	 */
+#if defined(O_DIRECT) && 0/* Disabled for now */
+	if (t->current_filesystem->xfer_align != -1 &&
+	    t->nlink == 1)
+		flags |= O_DIRECT;
+#endif
+#if defined(O_NOATIME)
+	/*
+	 * Linux has O_NOATIME flag; use it if we need.
+	 */
+	if ((t->flags & needsRestoreTimes) != 0 &&
+	    t->restore_time.noatime == 0)
+		flags |= O_NOATIME;
+#endif
+	t->entry_fd = open_on_current_dir(t,
+	    tree_current_access_path(t), flags);
+	__archive_ensure_cloexec_flag(t->entry_fd);
+#if defined(O_NOATIME)
+	/*
+	 * When we did open the file with O_NOATIME flag,
+	 * if successful, set 1 to t->restore_time.noatime
+	 * not to restore an atime of the file later.
+	 * if failed by EPERM, retry it without O_NOATIME flag.
+	 */
+	if (flags & O_NOATIME) {
+		if (t->entry_fd >= 0)
+			t->restore_time.noatime = 1;
+		else if (errno == EPERM)
+			flags &= ~O_NOATIME;
+	}
+#endif
+	if (t->entry_fd < 0) {
+		archive_set_error(&a->archive, errno,
+		    "Couldn't open %s", tree_current_path(t));
+		tree_enter_initial_dir(t);
+		return (ARCHIVE_FAILED);
+	}
+	tree_enter_initial_dir(t);
+	return (ARCHIVE_OK);
+}
+
 static int
 _archive_read_data_block(struct archive *_a, const void **buff,
     size_t *size, int64_t *offset)
@@ -706,53 +760,8 @@ _archive_read_data_block(struct archive *_a, const void **buff,
 	/*
 	 * Open the current file.
 	 */
-	if (t->entry_fd < 0) {
-		int flags = O_RDONLY | O_BINARY | O_CLOEXEC;
-
-		/*
-		 * Eliminate or reduce cache effects if we can.
-		 *
-		 * Carefully consider this to be enabled.
-		 */
-#if defined(O_DIRECT) && 0/* Disabled for now */
-		if (t->current_filesystem->xfer_align != -1 &&
-		    t->nlink == 1)
-			flags |= O_DIRECT;
-#endif
-#if defined(O_NOATIME)
-		/*
-		 * Linux has O_NOATIME flag; use it if we need.
-		 */
-		if ((t->flags & needsRestoreTimes) != 0 &&
-		    t->restore_time.noatime == 0)
-			flags |= O_NOATIME;
-#endif
-		t->entry_fd = open_on_current_dir(t,
-		    tree_current_access_path(t), flags);
-		__archive_ensure_cloexec_flag(t->entry_fd);
-#if defined(O_NOATIME)
-		/*
-		 * When we did open the file with O_NOATIME flag,
-		 * if successful, set 1 to t->restore_time.noatime
-		 * not to restore an atime of the file later.
-		 * if failed by EPERM, retry it without O_NOATIME flag.
-		 */
-		if (flags & O_NOATIME) {
-			if (t->entry_fd >= 0)
-				t->restore_time.noatime = 1;
-			else if (errno == EPERM)
-				flags &= ~O_NOATIME;
-		}
-#endif
-		if (t->entry_fd < 0) {
-			archive_set_error(&a->archive, errno,
-			    "Couldn't open %s", tree_current_path(t));
-			r = ARCHIVE_FAILED;
-			tree_enter_initial_dir(t);
-			goto abort_read_data;
-		}
-		tree_enter_initial_dir(t);
-	}
+	if (t->entry_fd < 0 && (r = open_entry_fd(a)) != ARCHIVE_OK)
+		goto abort_read_data;
 
 	/*
 	 * Allocate read buffer if not allocated.
@@ -1176,6 +1185,12 @@ _archive_read_next_header2(struct archive *_a, struct archive_entry *entry)
 			if (!t->entry_eof &&
 			    setup_sparse(a, entry) != ARCHIVE_OK)
 				return (ARCHIVE_FATAL);
+			/* Let the consumer get at the data directly. */
+			if (!t->entry_eof &&
+			    (a->flags & ARCHIVE_READDISK_SOURCE_FD) &&
+			    open_entry_fd(a) == ARCHIVE_OK)
+				archive_entry_set_source_fd(entry,
+				    t->entry_fd);
 		} else {
 			t->entry_remaining_bytes = 0;
 			t->entry_eof = 1;
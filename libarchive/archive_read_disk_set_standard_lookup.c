@@ -32,12 +32,6 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_disk_set_standard_lookup.c
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
-#ifdef HAVE_GRP_H
-#include <grp.h>
-#endif
-#ifdef HAVE_PWD_H
-#include <pwd.h>
-#endif
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -46,6 +40,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_disk_set_standard_lookup.c
 #endif
 
 #include "archive.h"
+#include "archive_name_cache_private.h"
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
 int
@@ -54,37 +49,32 @@ archive_read_disk_set_standard_lookup(struct archive *a)
 	archive_set_error(a, -1, "Standard lookups not available on Windows");
 	return (ARCHIVE_FATAL);
 }
-#else /* ! (_WIN32 && !__CYGWIN__) */
-#define	name_cache_size 127
 
-static const char * const NO_NAME = "(noname)";
+int
+archive_read_disk_preload_standard_lookup(struct archive *a)
+{
+	archive_set_error(a, -1, "Standard lookups not available on Windows");
+	return (ARCHIVE_FATAL);
+}
+#else /* ! (_WIN32 && !__CYGWIN__) */
 
-struct name_cache {
+struct name_lookup {
 	struct archive *archive;
-	char   *buff;
-	size_t  buff_size;
-	int	probes;
-	int	hits;
-	size_t	size;
-	struct {
-		id_t id;
-		const char *name;
-	} cache[name_cache_size];
+	struct archive_name_cache *cache;
 };
 
 static const char *	lookup_gname(void *, int64_t);
 static const char *	lookup_uname(void *, int64_t);
 static void	cleanup(void *);
-static const char *	lookup_gname_helper(struct name_cache *, id_t gid);
-static const char *	lookup_uname_helper(struct name_cache *, id_t uid);
 
 /*
  * Installs functions that use getpwuid()/getgrgid()---along with
- * a simple cache to accelerate such lookups---into the archive_read_disk
- * object.  This is in a separate file because getpwuid()/getgrgid()
- * can pull in a LOT of library code (including NIS/LDAP functions, which
- * pull in DNS resolvers, etc).  This can easily top 500kB, which makes
- * it inappropriate for some space-constrained applications.
+ * a cache shared by all archive objects to accelerate such lookups---into
+ * the archive_read_disk object.  This is in a separate file because
+ * getpwuid()/getgrgid() can pull in a LOT of library code (including
+ * NIS/LDAP functions, which pull in DNS resolvers, etc).  This can easily
+ * top 500kB, which makes it inappropriate for some space-constrained
+ * applications.
  *
  * Applications that are size-sensitive may want to just use the
  * real default functions (defined in archive_read_disk.c) that just
@@ -94,8 +84,8 @@ static const char *	lookup_uname_helper(struct name_cache *, id_t uid);
 int
 archive_read_disk_set_standard_lookup(struct archive *a)
 {
-	struct name_cache *ucache = malloc(sizeof(struct name_cache));
-	struct name_cache *gcache = malloc(sizeof(struct name_cache));
+	struct name_lookup *ucache = malloc(sizeof(struct name_lookup));
+	struct name_lookup *gcache = malloc(sizeof(struct name_lookup));
 
 	if (ucache == NULL || gcache == NULL) {
 		archive_set_error(a, ENOMEM,
@@ -105,12 +95,10 @@ archive_read_disk_set_standard_lookup(struct archive *a)
 		return (ARCHIVE_FATAL);
 	}
 
-	memset(ucache, 0, sizeof(*ucache));
 	ucache->archive = a;
-	ucache->size = name_cache_size;
-	memset(gcache, 0, sizeof(*gcache));
+	ucache->cache = __archive_name_cache_get();
 	gcache->archive = a;
-	gcache->size = name_cache_size;
+	gcache->cache = __archive_name_cache_get();
 
 	archive_read_disk_set_gname_lookup(a, gcache, lookup_gname, cleanup);
 	archive_read_disk_set_uname_lookup(a, ucache, lookup_uname, cleanup);
@@ -118,196 +106,60 @@ archive_read_disk_set_standard_lookup(struct archive *a)
 	return (ARCHIVE_OK);
 }
 
-static void
-cleanup(void *data)
-{
-	struct name_cache *cache = (struct name_cache *)data;
-	size_t i;
-
-	if (cache != NULL) {
-		for (i = 0; i < cache->size; i++) {
-			if (cache->cache[i].name != NULL &&
-			    cache->cache[i].name != NO_NAME)
-				free((void *)(uintptr_t)cache->cache[i].name);
-		}
-		free(cache->buff);
-		free(cache);
-	}
-}
-
 /*
- * Lookup uid/gid from uname/gname, return NULL if no match.
+ * Reads the passwd and group databases into the cache behind the
+ * standard lookups.  The cache only lasts while an archive object uses
+ * it, so this is only useful after archive_read_disk_set_standard_lookup().
  */
-static const char *
-lookup_name(struct name_cache *cache,
-    const char * (*lookup_fn)(struct name_cache *, id_t), id_t id)
+int
+archive_read_disk_preload_standard_lookup(struct archive *a)
 {
-	const char *name;
-	int slot;
-
-
-	cache->probes++;
-
-	slot = id % cache->size;
-	if (cache->cache[slot].name != NULL) {
-		if (cache->cache[slot].id == id) {
-			cache->hits++;
-			if (cache->cache[slot].name == NO_NAME)
-				return (NULL);
-			return (cache->cache[slot].name);
-		}
-		if (cache->cache[slot].name != NO_NAME)
-			free((void *)(uintptr_t)cache->cache[slot].name);
-		cache->cache[slot].name = NULL;
-	}
+	struct archive_name_cache *cache;
 
-	name = (lookup_fn)(cache, id);
-	if (name == NULL) {
-		/* Cache and return the negative response. */
-		cache->cache[slot].name = NO_NAME;
-		cache->cache[slot].id = id;
-		return (NULL);
-	}
-
-	cache->cache[slot].name = name;
-	cache->cache[slot].id = id;
-	return (cache->cache[slot].name);
-}
-
-static const char *
-lookup_uname(void *data, int64_t uid)
-{
-	struct name_cache *uname_cache = (struct name_cache *)data;
-	return (lookup_name(uname_cache,
-		    &lookup_uname_helper, (id_t)uid));
+	(void)a; /* UNUSED */
+	cache = __archive_name_cache_get();
+	__archive_name_cache_preload(cache);
+	__archive_name_cache_release(cache);
+	return (ARCHIVE_OK);
 }
 
-#if HAVE_GETPWUID_R
-static const char *
-lookup_uname_helper(struct name_cache *cache, id_t id)
+static void
+cleanup(void *data)
 {
-	struct passwd	pwent, *result;
-	char * nbuff;
-	size_t nbuff_size;
-	int r;
+	struct name_lookup *lookup = (struct name_lookup *)data;
 
-	if (cache->buff_size == 0) {
-		cache->buff_size = 256;
-		cache->buff = malloc(cache->buff_size);
+	if (lookup != NULL) {
+		__archive_name_cache_release(lookup->cache);
+		free(lookup);
 	}
-	if (cache->buff == NULL)
-		return (NULL);
-	for (;;) {
-		result = &pwent; /* Old getpwuid_r ignores last arg. */
-		r = getpwuid_r((uid_t)id, &pwent,
-			       cache->buff, cache->buff_size, &result);
-		if (r == 0)
-			break;
-		if (r != ERANGE)
-			break;
-		/* ERANGE means our buffer was too small, but POSIX
-		 * doesn't tell us how big the buffer should be, so
-		 * we just double it and try again.  Because the buffer
-		 * is kept around in the cache object, we shouldn't
-		 * have to do this very often. */
-		nbuff_size = cache->buff_size * 2;
-		nbuff = realloc(cache->buff, nbuff_size);
-		if (nbuff == NULL)
-			break;
-		cache->buff = nbuff;
-		cache->buff_size = nbuff_size;
-	}
-	if (r != 0) {
-		archive_set_error(cache->archive, errno,
-		    "Can't lookup user for id %d", (int)id);
-		return (NULL);
-	}
-	if (result == NULL)
-		return (NULL);
-
-	return strdup(result->pw_name);
 }
-#else
+
 static const char *
-lookup_uname_helper(struct name_cache *cache, id_t id)
+lookup_uname(void *data, int64_t uid)
 {
-	struct passwd	*result;
-	(void)cache; /* UNUSED */
-
-	result = getpwuid((uid_t)id);
-
-	if (result == NULL)
-		return (NULL);
+	struct name_lookup *lookup = (struct name_lookup *)data;
+	const char *name;
+	int error = 0;
 
-	return strdup(result->pw_name);
+	name = __archive_name_cache_uname(lookup->cache, uid, &error);
+	if (error != 0)
+		archive_set_error(lookup->archive, error,
+		    "Can't lookup user for id %d", (int)uid);
+	return (name);
 }
-#endif
 
 static const char *
 lookup_gname(void *data, int64_t gid)
 {
-	struct name_cache *gname_cache = (struct name_cache *)data;
-	return (lookup_name(gname_cache,
-		    &lookup_gname_helper, (id_t)gid));
-}
-
-#if HAVE_GETGRGID_R
-static const char *
-lookup_gname_helper(struct name_cache *cache, id_t id)
-{
-	struct group	grent, *result;
-	char * nbuff;
-	size_t nbuff_size;
-	int r;
-
-	if (cache->buff_size == 0) {
-		cache->buff_size = 256;
-		cache->buff = malloc(cache->buff_size);
-	}
-	if (cache->buff == NULL)
-		return (NULL);
-	for (;;) {
-		result = &grent; /* Old getgrgid_r ignores last arg. */
-		r = getgrgid_r((gid_t)id, &grent,
-			       cache->buff, cache->buff_size, &result);
-		if (r == 0)
-			break;
-		if (r != ERANGE)
-			break;
-		/* ERANGE means our buffer was too small, but POSIX
-		 * doesn't tell us how big the buffer should be, so
-		 * we just double it and try again. */
-		nbuff_size = cache->buff_size * 2;
-		nbuff = realloc(cache->buff, nbuff_size);
-		if (nbuff == NULL)
-			break;
-		cache->buff = nbuff;
-		cache->buff_size = nbuff_size;
-	}
-	if (r != 0) {
-		archive_set_error(cache->archive, errno,
-		    "Can't lookup group for id %d", (int)id);
-		return (NULL);
-	}
-	if (result == NULL)
-		return (NULL);
-
-	return strdup(result->gr_name);
-}
-#else
-static const char *
-lookup_gname_helper(struct name_cache *cache, id_t id)
-{
-	struct group	*result;
-	(void)cache; /* UNUSED */
-
-	result = getgrgid((gid_t)id);
-
-	if (result == NULL)
-		return (NULL);
+	struct name_lookup *lookup = (struct name_lookup *)data;
+	const char *name;
+	int error = 0;
 
-	return strdup(result->gr_name);
+	name = __archive_name_cache_gname(lookup->cache, gid, &error);
+	if (error != 0)
+		archive_set_error(lookup->archive, error,
+		    "Can't lookup group for id %d", (int)gid);
+	return (name);
 }
-#endif
 
 #endif /* ! (_WIN32 && !__CYGWIN__) */
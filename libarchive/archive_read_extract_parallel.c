@@ -0,0 +1,435 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#include <pthread.h>
+#define ARCHIVE_HAVE_THREADS	1
+#endif
+
+#include "archive.h"
+#include "archive_entry.h"
+#include "archive_private.h"
+#include "archive_read_private.h"
+#include "archive_stats_private.h"
+#include "archive_string.h"
+#include "archive_thread_private.h"
+#include "archive_write_disk_private.h"
+
+/*
+ * Parallel extraction of a seekable Zip archive.
+ *
+ * The central directory lets any number of readers of the same file
+ * see every entry, so reader k of n is restricted to the entries whose
+ * number in archive order is k modulo n, and each reader runs on its
+ * own thread with its own archive_write_disk object.  Only regular
+ * files are written there.  Directories, links and other entries are
+ * set aside and written in archive order on the caller's write_disk
+ * object once every worker is done, so that their metadata, and the
+ * fixups the caller's object applies when it is closed, come last.
+ * An entry whose name has come before is left out of every partition;
+ * a fresh reader returns those afterwards, and they are written in
+ * archive order along with the entries set aside, so the last copy of
+ * a name still wins.
+ *
+ * The write_disk objects share the working directory; an entry whose
+ * name is too long to use from there is written while the others
+ * wait, as archive_write_disk changes directory for it.  The
+ * statistics of the extra readers and write_disk objects are added to
+ * those of the caller's objects.
+ */
+
+struct deferred_entry {
+	struct archive_entry	*entry;
+	int64_t			 number;
+};
+
+struct extract_worker {
+	struct archive		*a;
+	struct archive		*ad;
+};
+
+struct extract_parallel {
+	archive_extract_entry_callback *extract;
+	void			*client_data;
+	struct extract_worker	*workers;
+	int			 count;
+	int			 repeats;
+	struct archive_entry	*first;
+	int			 first_status;
+#ifdef ARCHIVE_HAVE_THREADS
+	pthread_mutex_t		 lock;
+#endif
+	/* The fields below are protected by the lock. */
+	int			 status;
+	int			 error_number;
+	struct archive_string	 error_string;
+	int			 abort;
+	struct deferred_entry	*deferred;
+	size_t			 deferred_count;
+	size_t			 deferred_size;
+};
+
+#ifdef ARCHIVE_HAVE_THREADS
+#define	lock_ep(ep)	pthread_mutex_lock(&(ep)->lock)
+#define	unlock_ep(ep)	pthread_mutex_unlock(&(ep)->lock)
+#else
+#define	lock_ep(ep)	do {} while (0)
+#define	unlock_ep(ep)	do {} while (0)
+#endif
+
+static int
+extract_one(struct extract_parallel *ep, struct archive *a,
+    struct archive_entry *entry, struct archive *ad)
+{
+	if (ep->extract == NULL)
+		return (archive_read_extract2(a, entry, ad));
+	return ((ep->extract)(a, ep->client_data, entry, ad));
+}
+
+/*
+ * Keep the worst status and the error that came with it.  A fatal
+ * status stops every worker.
+ */
+static void
+record_status(struct extract_parallel *ep, struct archive *a, int r)
+{
+	if (r == ARCHIVE_OK)
+		return;
+	lock_ep(ep);
+	if (r < ep->status) {
+		ep->status = r;
+		ep->error_number = archive_errno(a);
+		archive_strcpy(&ep->error_string,
+		    archive_error_string(a) != NULL ?
+		    archive_error_string(a) : "Extraction failed");
+	}
+	if (r == ARCHIVE_FATAL)
+		ep->abort = 1;
+	unlock_ep(ep);
+}
+
+static int
+defer_entry(struct extract_parallel *ep, struct archive *a,
+    struct archive_entry *entry, int64_t number)
+{
+	struct deferred_entry *d;
+	struct archive_entry *e;
+
+	if ((e = archive_entry_clone(entry)) == NULL) {
+		archive_set_error(a, ENOMEM, "Can't allocate entry");
+		return (ARCHIVE_FATAL);
+	}
+	/* Whatever data the entry had has been read by now. */
+	archive_entry_set_size(e, 0);
+	lock_ep(ep);
+	if (ep->deferred_count == ep->deferred_size) {
+		size_t size = ep->deferred_size ? ep->deferred_size * 2 : 64;
+
+		d = realloc(ep->deferred, size * sizeof(*d));
+		if (d == NULL) {
+			unlock_ep(ep);
+			archive_entry_free(e);
+			archive_set_error(a, ENOMEM, "Can't allocate entry");
+			return (ARCHIVE_FATAL);
+		}
+		ep->deferred = d;
+		ep->deferred_size = size;
+	}
+	d = &ep->deferred[ep->deferred_count++];
+	d->entry = e;
+	d->number = number;
+	unlock_ep(ep);
+	return (ARCHIVE_OK);
+}
+
+static void
+extract_job(void *arg, int job)
+{
+	struct extract_parallel *ep = (struct extract_parallel *)arg;
+	struct extract_worker *w = &ep->workers[job];
+	struct archive_entry *entry;
+	int stop, r;
+
+	/* Entry 0 was read by the first reader before partitioning. */
+	if (job == 0) {
+		entry = ep->first;
+		r = ep->first_status;
+	} else
+		r = archive_read_next_header(w->a, &entry);
+	for (;;) {
+		if (r == ARCHIVE_EOF)
+			break;
+		record_status(ep, w->a, r);
+		if (r < ARCHIVE_WARN)
+			break;
+		lock_ep(ep);
+		stop = ep->abort;
+		unlock_ep(ep);
+		if (stop)
+			break;
+		if (archive_entry_filetype(entry) != AE_IFREG ||
+		    archive_entry_hardlink(entry) != NULL)
+			r = defer_entry(ep, w->a, entry,
+			    __archive_read_zip_entry_number(w->a));
+		else
+			r = extract_one(ep, w->a, entry, w->ad);
+		record_status(ep, w->a, r);
+		if (r == ARCHIVE_FATAL)
+			break;
+		r = archive_read_next_header(w->a, &entry);
+	}
+}
+
+static int
+cmp_deferred(const void *p1, const void *p2)
+{
+	const struct deferred_entry *d1 = (const struct deferred_entry *)p1;
+	const struct deferred_entry *d2 = (const struct deferred_entry *)p2;
+
+	return (d1->number < d2->number ? -1 : d1->number > d2->number);
+}
+
+/*
+ * Open a reader that returns only the entries left out of every
+ * partition because their name came before.
+ */
+static struct archive *
+open_repeats(struct extract_parallel *ep, struct archive *a,
+    archive_open_callback *opener, void *client_data)
+{
+	struct archive *ra;
+	struct archive_entry *e;
+
+	ra = archive_read_new();
+	if (ra == NULL || (opener)(ra, client_data) != ARCHIVE_OK ||
+	    archive_read_next_header(ra, &e) != ARCHIVE_OK ||
+	    __archive_read_zip_set_partition(ra, -1, 1) < ARCHIVE_WARN) {
+		if (ra != NULL)
+			archive_read_free(ra);
+		archive_set_error(a, ARCHIVE_ERRNO_MISC,
+		    "Can't reopen the archive for its repeated entries");
+		record_status(ep, a, ARCHIVE_FATAL);
+		return (NULL);
+	}
+	return (ra);
+}
+
+static struct archive_entry *
+next_repeat(struct extract_parallel *ep, struct archive *ra)
+{
+	struct archive_entry *entry;
+	int r;
+
+	if (ra == NULL)
+		return (NULL);
+	r = archive_read_next_header(ra, &entry);
+	if (r == ARCHIVE_EOF)
+		return (NULL);
+	record_status(ep, ra, r);
+	return (r < ARCHIVE_WARN ? NULL : entry);
+}
+
+/*
+ * Extract every entry serially; this is what the parallel path falls
+ * back to for anything but a seekable Zip archive.
+ */
+static int
+extract_serial(struct extract_parallel *ep, struct archive *a,
+    struct archive *ad, struct archive_entry *entry, int r)
+{
+	int ret = ARCHIVE_OK;
+
+	for (;;) {
+		if (r == ARCHIVE_EOF)
+			break;
+		if (r < ret)
+			ret = r;
+		if (r < ARCHIVE_WARN)
+			break;
+		r = extract_one(ep, a, entry, ad);
+		if (r < ret)
+			ret = r;
+		if (r == ARCHIVE_FATAL)
+			break;
+		r = archive_read_next_header(a, &entry);
+	}
+	return (ret);
+}
+
+int
+archive_read_extract_parallel(struct archive *a, struct archive *ad,
+    int threads, archive_open_callback *opener,
+    archive_extract_entry_callback *extract, void *client_data)
+{
+	struct extract_parallel ep;
+	struct archive_thread_pool *pool;
+	struct extract_worker *w;
+	struct archive_entry *entry;
+	struct archive *ra;
+	size_t i;
+	int k, n, r, rp;
+
+	archive_check_magic(a, ARCHIVE_READ_MAGIC, ARCHIVE_STATE_HEADER,
+	    "archive_read_extract_parallel");
+
+	memset(&ep, 0, sizeof(ep));
+	ep.extract = extract;
+	ep.client_data = client_data;
+
+	r = archive_read_next_header(a, &entry);
+	if (r < ARCHIVE_WARN)
+		return (r);
+	n = threads > 0 ? threads : __archive_cpu_count();
+	/* A single partition holds every entry, as if there were none. */
+	if (r == ARCHIVE_EOF || n <= 1 || opener == NULL ||
+	    (rp = __archive_read_zip_set_partition(a, 0, 1)) < ARCHIVE_WARN)
+		return (extract_serial(&ep, a, ad, entry, r));
+	ep.repeats = (rp == ARCHIVE_WARN);
+
+	pool = __archive_thread_pool_new(n);
+	if (pool == NULL)
+		return (extract_serial(&ep, a, ad, entry, r));
+	n = __archive_thread_pool_threads(pool);
+	ep.workers = calloc(n, sizeof(*ep.workers));
+	if (ep.workers == NULL) {
+		__archive_thread_pool_free(pool);
+		return (extract_serial(&ep, a, ad, entry, r));
+	}
+#ifdef ARCHIVE_HAVE_THREADS
+	if (pthread_mutex_init(&ep.lock, NULL) != 0) {
+		free(ep.workers);
+		__archive_thread_pool_free(pool);
+		return (extract_serial(&ep, a, ad, entry, r));
+	}
+#endif
+
+	/*
+	 * Open a reader and a write_disk object for each partition; if
+	 * one cannot be had, make do with fewer partitions.  Each new
+	 * reader reads entry 0 to load the central directory, which also
+	 * tells whether it is a seekable Zip reader at all.
+	 */
+	ep.workers[0].a = a;
+	ep.workers[0].ad = ad;
+	ep.count = 1;
+	while (ep.count < n) {
+		struct archive_entry *e;
+
+		w = &ep.workers[ep.count];
+		w->a = archive_read_new();
+		w->ad = __archive_write_disk_clone(ad);
+		if (w->a == NULL || w->ad == NULL ||
+		    (opener)(w->a, client_data) != ARCHIVE_OK ||
+		    archive_read_next_header(w->a, &e) != ARCHIVE_OK ||
+		    __archive_read_zip_set_partition(w->a, 0, 1)
+		    < ARCHIVE_WARN) {
+			if (w->a != NULL)
+				archive_read_free(w->a);
+			if (w->ad != NULL)
+				archive_write_free(w->ad);
+			w->a = w->ad = NULL;
+			break;
+		}
+		ep.count++;
+	}
+	if (ep.count == 1) {
+#ifdef ARCHIVE_HAVE_THREADS
+		pthread_mutex_destroy(&ep.lock);
+#endif
+		free(ep.workers);
+		__archive_thread_pool_free(pool);
+		return (extract_serial(&ep, a, ad, entry, r));
+	}
+	for (k = 0; k < ep.count; k++)
+		__archive_read_zip_set_partition(ep.workers[k].a, k,
+		    ep.count);
+
+	ep.first = entry;
+	ep.first_status = r;
+	__archive_thread_pool_run(pool, extract_job, &ep, ep.count);
+	__archive_thread_pool_free(pool);
+
+	for (k = 1; k < ep.count; k++) {
+		w = &ep.workers[k];
+		record_status(&ep, w->ad, archive_write_close(w->ad));
+		__archive_stats_merge(ad, w->ad);
+		__archive_stats_merge(a, w->a);
+		archive_write_free(w->ad);
+		archive_read_free(w->a);
+	}
+	free(ep.workers);
+
+	/*
+	 * Write the entries that were set aside and the repeated names
+	 * together, in archive order.
+	 */
+	qsort(ep.deferred, ep.deferred_count, sizeof(ep.deferred[0]),
+	    cmp_deferred);
+	ra = NULL;
+	if (ep.repeats && !ep.abort)
+		ra = open_repeats(&ep, a, opener, client_data);
+	entry = next_repeat(&ep, ra);
+	i = 0;
+	while (!ep.abort && (entry != NULL || i < ep.deferred_count)) {
+		if (entry != NULL && (i == ep.deferred_count ||
+		    __archive_read_zip_entry_number(ra) <
+		    ep.deferred[i].number)) {
+			record_status(&ep, ra,
+			    extract_one(&ep, ra, entry, ad));
+			entry = next_repeat(&ep, ra);
+		} else {
+			record_status(&ep, a,
+			    extract_one(&ep, a, ep.deferred[i].entry, ad));
+			i++;
+		}
+	}
+	if (ra != NULL) {
+		__archive_stats_merge(a, ra);
+		archive_read_free(ra);
+	}
+	for (i = 0; i < ep.deferred_count; i++)
+		archive_entry_free(ep.deferred[i].entry);
+	free(ep.deferred);
+
+#ifdef ARCHIVE_HAVE_THREADS
+	pthread_mutex_destroy(&ep.lock);
+#endif
+	if (ep.status < ARCHIVE_OK && ep.error_string.length > 0)
+		archive_set_error(a, ep.error_number, "%s",
+		    ep.error_string.s);
+	archive_string_free(&ep.error_string);
+	return (ep.status);
+}
@@ -50,6 +50,9 @@ struct archive_read_filter_bidder_vtable {
 	int (*init)(struct archive_read_filter *);
 	/* Release the bidder's configuration data. */
 	void (*free)(struct archive_read_filter_bidder *);
+	/* Set an option for filters created by this bidder. */
+	int (*options)(struct archive_read_filter_bidder *,
+	    const char *key, const char *value);
 };
 
 /*
@@ -82,6 +85,10 @@ struct archive_read_filter_vtable {
 	int (*close)(struct archive_read_filter *self);
 	/* Read any header metadata if available. */
 	int (*read_header)(struct archive_read_filter *self, struct archive_entry *entry);
+	/* Reposition the decoded stream; only used while can_seek is set.
+	 * whence is SEEK_SET or SEEK_END; returns the new position. */
+	int64_t (*seek)(struct archive_read_filter *self, int64_t offset,
+	    int whence);
 };
 
 /*
@@ -117,6 +124,7 @@ struct archive_read_filter {
 	char		 end_of_file;
 	char		 closed;
 	char		 fatal;
+	int		 stats_stage;	/* See archive_stats_private.h. */
 };
 
 /*
@@ -257,6 +265,8 @@ int __archive_read_header(struct archive_read *, struct archive_entry *);
 int __archive_read_program(struct archive_read_filter *, const char *);
 void __archive_read_free_filters(struct archive_read *);
 struct archive_read_extract *__archive_read_get_extract(struct archive_read *);
+int __archive_read_zip_set_partition(struct archive *, int, int);
+int64_t __archive_read_zip_entry_number(struct archive *);
 
 
 /*
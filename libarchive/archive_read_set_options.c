@@ -112,15 +112,36 @@ static int
 archive_set_filter_option(struct archive *_a, const char *m, const char *o,
     const char *v)
 {
-	(void)_a; /* UNUSED */
-	(void)o; /* UNUSED */
-	(void)v; /* UNUSED */
+	struct archive_read *a = (struct archive_read *)_a;
+	size_t i;
+	int r, rv = ARCHIVE_WARN, matched_modules = 0;
+
+	for (i = 0; i < sizeof(a->bidders)/sizeof(a->bidders[0]); i++) {
+		struct archive_read_filter_bidder *bidder = &a->bidders[i];
+
+		if (bidder->vtable == NULL || bidder->vtable->options == NULL
+		    || bidder->name == NULL)
+			/* This filter does not support option. */
+			continue;
+		if (m != NULL) {
+			if (strcmp(bidder->name, m) != 0)
+				continue;
+			++matched_modules;
+		}
 
+		r = bidder->vtable->options(bidder, o, v);
+
+		if (r == ARCHIVE_FATAL)
+			return (ARCHIVE_FATAL);
+
+		if (r == ARCHIVE_OK)
+			rv = ARCHIVE_OK;
+	}
 	/* If the filter name didn't match, return a special code for
 	 * _archive_set_option[s]. */
-	if (m != NULL)
+	if (m != NULL && matched_modules == 0)
 		return ARCHIVE_WARN - 1;
-	return ARCHIVE_WARN;
+	return (rv);
 }
 
 static int
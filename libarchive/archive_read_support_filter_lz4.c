@@ -48,13 +48,32 @@ __FBSDID("$FreeBSD$");
 #include "archive_endian.h"
 #include "archive_private.h"
 #include "archive_read_private.h"
+#include "archive_thread_private.h"
 #include "archive_xxhash.h"
 
 #define LZ4_MAGICNUMBER		0x184d2204
 #define LZ4_SKIPPABLED		0x184d2a50
 #define LZ4_LEGACY		0x184c2102
 
+/* Options given to the bidder and passed to each new filter. */
+struct lz4_reader_config {
+	int		 threads;
+};
+
 #if defined(HAVE_LIBLZ4)
+/*
+ * One block of a batch decoded by the worker threads.
+ */
+struct lz4_block_job {
+	size_t		 offset;	/* Within the batch. */
+	const char	*in;
+	size_t		 compressed_size;
+	int		 uncompressed;	/* Stored as is. */
+	char		*out;
+	ssize_t		 out_size;	/* Negative on a decoding error. */
+	int		 bad_checksum;
+};
+
 struct private_data {
 	enum {  SELECT_STREAM,
 		READ_DEFAULT_STREAM,
@@ -80,6 +99,13 @@ struct private_data {
 	size_t		 decoded_size;
 	void		*xxh32_state;
 
+	/* Multi-threaded decoding of independent blocks. */
+	int		 threads;
+	struct archive_thread_pool *pool;
+	struct lz4_block_job *jobs;
+	int		 batch_count;
+	int		 batch_next;
+
 	char		 valid; /* True = decompressor is initialized */
 	char		 eof; /* True = found end of compressed data. */
 };
@@ -99,6 +125,9 @@ static int	lz4_filter_close(struct archive_read_filter *);
  */
 static int	lz4_reader_bid(struct archive_read_filter_bidder *, struct archive_read_filter *);
 static int	lz4_reader_init(struct archive_read_filter *);
+static int	lz4_reader_options(struct archive_read_filter_bidder *,
+		    const char *, const char *);
+static void	lz4_reader_free(struct archive_read_filter_bidder *);
 #if defined(HAVE_LIBLZ4)
 static ssize_t  lz4_filter_read_default_stream(struct archive_read_filter *,
 		    const void **);
@@ -110,16 +139,28 @@ static const struct archive_read_filter_bidder_vtable
 lz4_bidder_vtable = {
 	.bid = lz4_reader_bid,
 	.init = lz4_reader_init,
+	.free = lz4_reader_free,
+	.options = lz4_reader_options,
 };
 
 int
 archive_read_support_filter_lz4(struct archive *_a)
 {
 	struct archive_read *a = (struct archive_read *)_a;
+	struct lz4_reader_config *config;
 
-	if (__archive_read_register_bidder(a, NULL, "lz4",
-				&lz4_bidder_vtable) != ARCHIVE_OK)
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		archive_set_error(_a, ENOMEM,
+		    "Can't allocate data for lz4 decompression");
 		return (ARCHIVE_FATAL);
+	}
+	config->threads = 1;
+	if (__archive_read_register_bidder(a, config, "lz4",
+				&lz4_bidder_vtable) != ARCHIVE_OK) {
+		free(config);
+		return (ARCHIVE_FATAL);
+	}
 
 #if defined(HAVE_LIBLZ4)
 	return (ARCHIVE_OK);
@@ -130,6 +171,42 @@ archive_read_support_filter_lz4(struct archive *_a)
 #endif
 }
 
+static int
+lz4_reader_options(struct archive_read_filter_bidder *self,
+    const char *key, const char *value)
+{
+	struct lz4_reader_config *config =
+	    (struct lz4_reader_config *)self->data;
+
+	if (strcmp(key, "threads") == 0) {
+		char *endptr;
+
+		if (value == NULL)
+			return (ARCHIVE_WARN);
+		errno = 0;
+		config->threads = (int)strtoul(value, &endptr, 10);
+		if (errno != 0 || *endptr != '\0') {
+			config->threads = 1;
+			return (ARCHIVE_WARN);
+		}
+		if (config->threads == 0)
+			config->threads = __archive_cpu_count();
+		return (ARCHIVE_OK);
+	}
+
+	/* Note: The "warn" return is just to inform the options
+	 * supervisor that we didn't handle it.  It will generate
+	 * a suitable error if no one used this option. */
+	return (ARCHIVE_WARN);
+}
+
+static void
+lz4_reader_free(struct archive_read_filter_bidder *self)
+{
+	free(self->data);
+	self->data = NULL;
+}
+
 /*
  * Test whether we can handle this data.
  *
@@ -234,6 +311,8 @@ lz4_reader_init(struct archive_read_filter *self)
 
 	self->data = state;
 	state->stage = SELECT_STREAM;
+	state->threads =
+	    ((struct lz4_reader_config *)self->bidder->data)->threads;
 	self->vtable = &lz4_reader_vtable;
 
 	return (ARCHIVE_OK);
@@ -248,6 +327,31 @@ lz4_allocate_out_block(struct archive_read_filter *self)
 
 	if (!state->flags.block_independence)
 		out_block_size += 64 * 1024;
+	else if (state->threads > 1) {
+		/* Decode a batch of blocks, one per thread, at once. */
+		int n;
+
+		if (state->pool == NULL) {
+			state->pool = __archive_thread_pool_new(state->threads);
+			if (state->pool == NULL) {
+				archive_set_error(&self->archive->archive,
+				    ENOMEM,
+				    "Can't allocate data for lz4 decompression");
+				return (ARCHIVE_FATAL);
+			}
+			n = __archive_thread_pool_threads(state->pool);
+			state->jobs = calloc(n, sizeof(state->jobs[0]));
+			if (state->jobs == NULL) {
+				archive_set_error(&self->archive->archive,
+				    ENOMEM,
+				    "Can't allocate data for lz4 decompression");
+				return (ARCHIVE_FATAL);
+			}
+		}
+		out_block_size *=
+		    __archive_thread_pool_threads(state->pool);
+	}
+	state->batch_count = state->batch_next = 0;
 	if (state->out_block_size < out_block_size) {
 		free(state->out_block);
 		out_block = (unsigned char *)malloc(out_block_size);
@@ -469,6 +573,137 @@ malformed_error:
 	return (ARCHIVE_FATAL);
 }
 
+static void
+lz4_decode_job(void *arg, int i)
+{
+	struct private_data *state = (struct private_data *)arg;
+	struct lz4_block_job *job = &state->jobs[i];
+
+	if (state->flags.block_checksum) {
+		unsigned int chsum = __archive_xxhash.XXH32(
+			job->in, (int)job->compressed_size, 0);
+		if (chsum != archive_le32dec(job->in + job->compressed_size)) {
+			job->bad_checksum = 1;
+			return;
+		}
+	}
+	if (job->uncompressed) {
+		memcpy(job->out, job->in, job->compressed_size);
+		job->out_size = job->compressed_size;
+	} else
+		job->out_size = LZ4_decompress_safe(job->in, job->out,
+		    (int)job->compressed_size,
+		    state->flags.block_maximum_size);
+}
+
+/*
+ * Read as many whole blocks as there are threads and decode them
+ * concurrently; this is only possible if the blocks are independent.
+ * The decoded blocks are returned one at a time, in stream order.
+ */
+static ssize_t
+lz4_filter_read_data_blocks_parallel(struct archive_read_filter *self,
+    const void **p)
+{
+	struct private_data *state = (struct private_data *)self->data;
+	int nthreads = __archive_thread_pool_threads(state->pool);
+	const char *read_buf;
+	size_t total;
+	int count, i;
+
+	/* Hand out the rest of the current batch first. */
+	if (state->batch_next < state->batch_count) {
+		struct lz4_block_job *job = &state->jobs[state->batch_next++];
+		*p = job->out;
+		return (job->out_size);
+	}
+	state->batch_count = state->batch_next = 0;
+
+	/*
+	 * Collect the blocks.  A problem with anything but the first
+	 * block just ends the batch early; it gets reported when that
+	 * block is read again on the next call.
+	 */
+	total = 0;
+	for (count = 0; count < nthreads; count++) {
+		struct lz4_block_job *job = &state->jobs[count];
+		uint32_t compressed_size;
+
+		read_buf = __archive_read_filter_ahead(self->upstream,
+		    total + 4, NULL);
+		if (read_buf == NULL) {
+			if (count == 0)
+				goto truncated_error;
+			break;
+		}
+		compressed_size = archive_le32dec(read_buf + total);
+		if ((compressed_size & 0x7fffffff) >
+		    (uint32_t)state->flags.block_maximum_size) {
+			if (count == 0)
+				goto malformed_error;
+			break;
+		}
+		/* A compressed size == 0 means the end of stream blocks. */
+		if (compressed_size == 0) {
+			if (count == 0) {
+				__archive_read_filter_consume(
+				    self->upstream, 4);
+				return (0);
+			}
+			break;
+		}
+		job->uncompressed = (compressed_size & 0x80000000U) != 0;
+		job->compressed_size = compressed_size & 0x7fffffff;
+		job->bad_checksum = 0;
+		job->out = state->out_block +
+		    (size_t)count * state->flags.block_maximum_size;
+		job->offset = total + 4;
+		total += 4 + job->compressed_size +
+		    state->flags.block_checksum;
+		if (__archive_read_filter_ahead(self->upstream, total,
+		    NULL) == NULL) {
+			if (count == 0)
+				goto truncated_error;
+			total = job->offset - 4;
+			break;
+		}
+	}
+
+	/* The read-ahead buffer may have moved while it grew. */
+	read_buf = __archive_read_filter_ahead(self->upstream, total, NULL);
+	if (read_buf == NULL)
+		goto truncated_error;
+	for (i = 0; i < count; i++)
+		state->jobs[i].in = read_buf + state->jobs[i].offset;
+
+	__archive_thread_pool_run(state->pool, lz4_decode_job, state, count);
+
+	for (i = 0; i < count; i++) {
+		if (state->jobs[i].bad_checksum)
+			goto malformed_error;
+		if (state->jobs[i].out_size < 0) {
+			archive_set_error(&(self->archive->archive),
+			    ARCHIVE_ERRNO_MISC, "lz4 decompression failed");
+			return (ARCHIVE_FATAL);
+		}
+	}
+
+	state->unconsumed = total;
+	state->batch_count = count;
+	state->batch_next = 1;
+	*p = state->jobs[0].out;
+	return (state->jobs[0].out_size);
+
+malformed_error:
+	archive_set_error(&self->archive->archive, ARCHIVE_ERRNO_MISC,
+	    "malformed lz4 data");
+	return (ARCHIVE_FATAL);
+truncated_error:
+	archive_set_error(&self->archive->archive, ARCHIVE_ERRNO_MISC,
+	    "truncated lz4 input");
+	return (ARCHIVE_FATAL);
+}
+
 static ssize_t
 lz4_filter_read_data_block(struct archive_read_filter *self, const void **p)
 {
@@ -482,6 +717,9 @@ lz4_filter_read_data_block(struct archive_read_filter *self, const void **p)
 
 	*p = NULL;
 
+	if (state->pool != NULL && state->flags.block_independence)
+		return lz4_filter_read_data_blocks_parallel(self, p);
+
 	/* Make sure we have 4 bytes for a block size. */
 	read_buf = __archive_read_filter_ahead(self->upstream, 4,
 	    &bytes_remaining);
@@ -727,6 +965,8 @@ lz4_filter_close(struct archive_read_filter *self)
 	int ret = ARCHIVE_OK;
 
 	state = (struct private_data *)self->data;
+	__archive_thread_pool_free(state->pool);
+	free(state->jobs);
 	free(state->xxh32_state);
 	free(state->out_block);
 	free(state);
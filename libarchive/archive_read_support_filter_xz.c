@@ -60,6 +60,20 @@ struct private_data {
 	char		 eof; /* True = found end of compressed data. */
 	char		 in_stream;
 
+	/*
+	 * Following variables are used for random access to xz data.
+	 * The stream index is read up front when the input is seekable;
+	 * after the first seek, blocks are decoded one at a time.
+	 */
+	char		 index_checked;
+	lzma_index	*index;
+	int64_t		 stream_offset;	/* Where the xz data starts. */
+	lzma_index_iter	 block;		/* Block being decoded. */
+	lzma_block	 block_header;	/* liblzma keeps a pointer to this. */
+	lzma_filter	 filters[LZMA_FILTERS_MAX + 1];
+	char		 block_mode;
+	int64_t		 discard;	/* Output to drop before returning. */
+
 	/* Following variables are used for lzip only. */
 	char		 lzip_ver;
 	uint32_t	 crc32;
@@ -78,7 +92,10 @@ struct private_data {
 /* Combined lzip/lzma/xz filter */
 static ssize_t	xz_filter_read(struct archive_read_filter *, const void **);
 static int	xz_filter_close(struct archive_read_filter *);
+static int64_t	xz_filter_seek(struct archive_read_filter *, int64_t, int);
 static int	xz_lzma_bidder_init(struct archive_read_filter *);
+static void	xz_read_index(struct archive_read_filter *);
+static int	xz_start_block(struct archive_read_filter *);
 
 #endif
 
@@ -465,6 +482,7 @@ static const struct archive_read_filter_vtable
 xz_lzma_reader_vtable = {
 	.read = xz_filter_read,
 	.close = xz_filter_close,
+	.seek = xz_filter_seek,
 };
 
 /*
@@ -652,12 +670,20 @@ static ssize_t
 xz_filter_read(struct archive_read_filter *self, const void **p)
 {
 	struct private_data *state;
-	size_t decompressed;
+	size_t decompressed, skip;
 	ssize_t avail_in;
 	int ret;
 
 	state = (struct private_data *)self->data;
 
+	/* Look for the index before decoding anything. */
+	if (!state->index_checked) {
+		state->index_checked = 1;
+		if (self->code == ARCHIVE_FILTER_XZ)
+			xz_read_index(self);
+	}
+
+again:
 	/* Empty our output buffer. */
 	state->stream.next_out = state->out_block;
 	state->stream.avail_out = state->out_block_size;
@@ -700,15 +726,45 @@ xz_filter_read(struct archive_read_filter *self, const void **p)
 			set_error(self, ret);
 			return (ARCHIVE_FATAL);
 		}
+		/* In block mode, the end of a block is not the end of
+		 * the data; go on with the next block, if any. */
+		if (ret == LZMA_STREAM_END && state->block_mode &&
+		    !lzma_index_iter_next(&state->block,
+		      LZMA_INDEX_ITER_NONEMPTY_BLOCK)) {
+			state->eof = 0;
+			ret = xz_start_block(self);
+			if (ret != ARCHIVE_OK)
+				return (ret);
+			/* total_out now holds the offset of the new
+			 * block; the output of the previous block that
+			 * is still in out_block lies before it. */
+			state->total_out -=
+			    state->stream.next_out - state->out_block;
+		}
 	}
 
 	decompressed = state->stream.next_out - state->out_block;
 	state->total_out += decompressed;
 	state->member_out += decompressed;
+
+	/* Drop the output preceding a seek target. */
+	skip = 0;
+	if (state->discard > 0) {
+		if ((int64_t)decompressed <= state->discard) {
+			state->discard -= decompressed;
+			if (decompressed > 0)
+				goto again;
+			*p = NULL;
+			return (0);
+		}
+		skip = (size_t)state->discard;
+		state->discard = 0;
+	}
+
 	if (decompressed == 0)
 		*p = NULL;
 	else {
-		*p = state->out_block;
+		*p = state->out_block + skip;
 		if (self->code == ARCHIVE_FILTER_LZIP) {
 			state->crc32 = lzma_crc32(state->out_block,
 			    decompressed, state->crc32);
@@ -719,7 +775,257 @@ xz_filter_read(struct archive_read_filter *self, const void **p)
 			}
 		}
 	}
-	return (decompressed);
+	return (decompressed - skip);
+}
+
+/*
+ * Read a range of the compressed input for the index reader.
+ */
+static const unsigned char *
+xz_read_at(struct archive_read_filter *self, int64_t offset, size_t size)
+{
+	if (__archive_read_filter_seek(self->upstream, offset, SEEK_SET)
+	    != offset)
+		return (NULL);
+	return (__archive_read_filter_ahead(self->upstream, size, NULL));
+}
+
+/*
+ * Read the index of every stream, starting from the end of the input
+ * and working backwards over any stream padding, and combine them.
+ * This only works if the xz data extends to the end of the input.
+ * Any failure here just means we decode sequentially as usual.
+ */
+static void
+xz_read_index(struct archive_read_filter *self)
+{
+	struct private_data *state = (struct private_data *)self->data;
+	struct archive_read_filter *upstream = self->upstream;
+	lzma_index *index = NULL, *this_index;
+	lzma_stream_flags header_flags, footer_flags;
+	const unsigned char *p;
+	int64_t start, pos, padding, stream_size;
+	uint64_t memlimit;
+	size_t in_pos;
+
+	if (!upstream->can_seek ||
+	    (upstream->upstream == NULL &&
+	     self->archive->client.seeker == NULL))
+		return;
+	start = upstream->position;
+	pos = __archive_read_filter_seek(upstream, 0, SEEK_END);
+	if (pos < 0) {
+		archive_clear_error(&self->archive->archive);
+		return;
+	}
+
+	while (pos > start) {
+		/* Skip stream padding. */
+		padding = 0;
+		for (;;) {
+			if (pos - start < LZMA_STREAM_HEADER_SIZE * 2)
+				goto fail;
+			p = xz_read_at(self, pos - 4, 4);
+			if (p == NULL)
+				goto fail;
+			if (archive_le32dec(p) != 0)
+				break;
+			pos -= 4;
+			padding += 4;
+		}
+
+		/* Stream footer. */
+		p = xz_read_at(self, pos - LZMA_STREAM_HEADER_SIZE,
+		    LZMA_STREAM_HEADER_SIZE);
+		if (p == NULL ||
+		    lzma_stream_footer_decode(&footer_flags, p) != LZMA_OK)
+			goto fail;
+		/* An index this large is not worth the memory. */
+		if (footer_flags.backward_size > 64 * 1024 * 1024 ||
+		    (int64_t)footer_flags.backward_size >
+		      pos - start - 2 * LZMA_STREAM_HEADER_SIZE)
+			goto fail;
+
+		/* Stream index. */
+		p = xz_read_at(self, pos - LZMA_STREAM_HEADER_SIZE
+		    - footer_flags.backward_size,
+		    (size_t)footer_flags.backward_size);
+		if (p == NULL)
+			goto fail;
+		this_index = NULL;
+		memlimit = UINT64_MAX;
+		in_pos = 0;
+		if (lzma_index_buffer_decode(&this_index, &memlimit, NULL,
+		    p, &in_pos, (size_t)footer_flags.backward_size)
+		    != LZMA_OK)
+			goto fail;
+		stream_size = (int64_t)lzma_index_stream_size(this_index);
+		if (stream_size > pos - start) {
+			lzma_index_end(this_index, NULL);
+			goto fail;
+		}
+		pos -= stream_size;
+
+		/* Stream header must agree with the footer. */
+		p = xz_read_at(self, pos, LZMA_STREAM_HEADER_SIZE);
+		if (p == NULL ||
+		    lzma_stream_header_decode(&header_flags, p) != LZMA_OK ||
+		    lzma_stream_flags_compare(&header_flags, &footer_flags)
+		      != LZMA_OK ||
+		    lzma_index_stream_flags(this_index, &footer_flags)
+		      != LZMA_OK ||
+		    lzma_index_stream_padding(this_index, padding)
+		      != LZMA_OK) {
+			lzma_index_end(this_index, NULL);
+			goto fail;
+		}
+		if (index != NULL &&
+		    lzma_index_cat(this_index, index, NULL) != LZMA_OK) {
+			lzma_index_end(this_index, NULL);
+			goto fail;
+		}
+		index = this_index;
+	}
+	if (__archive_read_filter_seek(upstream, start, SEEK_SET) != start) {
+		lzma_index_end(index, NULL);
+		return;
+	}
+
+	/*
+	 * With a single block, seeking gains nothing over decoding
+	 * from the start, so don't advertise it; formats probing the
+	 * end of the data would otherwise decode everything.
+	 */
+	if (lzma_index_block_count(index) < 2) {
+		lzma_index_end(index, NULL);
+		return;
+	}
+	state->index = index;
+	state->stream_offset = start;
+	self->can_seek = 1;
+	return;
+fail:
+	lzma_index_end(index, NULL);
+	archive_clear_error(&self->archive->archive);
+	__archive_read_filter_seek(upstream, start, SEEK_SET);
+}
+
+/*
+ * Set up the decoder for the block state->block refers to.
+ */
+static int
+xz_start_block(struct archive_read_filter *self)
+{
+	struct private_data *state = (struct private_data *)self->data;
+	lzma_block *block = &state->block_header;
+	const unsigned char *p;
+	int64_t offset;
+	int i, ret;
+
+	offset = state->stream_offset +
+	    (int64_t)state->block.block.compressed_file_offset;
+	if (self->upstream->position != offset &&
+	    __archive_read_filter_seek(self->upstream, offset, SEEK_SET)
+	      != offset)
+		return (ARCHIVE_FATAL);
+
+	p = __archive_read_filter_ahead(self->upstream, 1, NULL);
+	if (p == NULL)
+		goto truncated;
+	memset(block, 0, sizeof(*block));
+	block->version = 0;
+	block->check = state->block.stream.flags->check;
+	block->filters = state->filters;
+	block->header_size = lzma_block_header_size_decode(p[0]);
+	p = __archive_read_filter_ahead(self->upstream, block->header_size,
+	    NULL);
+	if (p == NULL)
+		goto truncated;
+	ret = lzma_block_header_decode(block, NULL, p);
+	if (ret != LZMA_OK) {
+		set_error(self, ret);
+		return (ARCHIVE_FATAL);
+	}
+	ret = lzma_block_compressed_size(block,
+	    state->block.block.unpadded_size);
+	if (ret == LZMA_OK)
+		ret = lzma_block_decoder(&(state->stream), block);
+	for (i = 0; state->filters[i].id != LZMA_VLI_UNKNOWN; i++)
+		free(state->filters[i].options);
+	if (ret != LZMA_OK) {
+		set_error(self, ret);
+		return (ARCHIVE_FATAL);
+	}
+	__archive_read_filter_consume(self->upstream, block->header_size);
+	state->total_out =
+	    (int64_t)state->block.block.uncompressed_file_offset;
+	state->block_mode = 1;
+	state->eof = 0;
+	return (ARCHIVE_OK);
+truncated:
+	archive_set_error(&self->archive->archive, ARCHIVE_ERRNO_MISC,
+	    "truncated input");
+	return (ARCHIVE_FATAL);
+}
+
+/*
+ * Move to an offset in the uncompressed data.  A target ahead of us
+ * in the block being decoded is reached by decoding and discarding;
+ * anything else restarts decoding at the beginning of the block that
+ * holds the target.
+ */
+static int64_t
+xz_filter_seek(struct archive_read_filter *self, int64_t offset, int whence)
+{
+	struct private_data *state = (struct private_data *)self->data;
+	int64_t size, target;
+	lzma_index_iter iter;
+	int ret;
+
+	if (state->index == NULL)
+		return (ARCHIVE_FAILED);
+	size = (int64_t)lzma_index_uncompressed_size(state->index);
+	switch (whence) {
+	case SEEK_SET:
+		target = offset;
+		break;
+	case SEEK_END:
+		target = size + offset;
+		break;
+	default:
+		return (ARCHIVE_FATAL);
+	}
+	if (target < 0) {
+		archive_set_error(&self->archive->archive,
+		    ARCHIVE_ERRNO_MISC, "Seek before the start of xz data");
+		return (ARCHIVE_FATAL);
+	}
+	if (target >= size) {
+		state->eof = 1;
+		state->discard = 0;
+		state->total_out = size;
+		return (size);
+	}
+
+	/* Still in the block we are decoding? */
+	if (target >= state->total_out && !state->eof) {
+		lzma_index_iter_init(&iter, state->index);
+		if (!lzma_index_iter_locate(&iter, state->total_out) &&
+		    target < (int64_t)(iter.block.uncompressed_file_offset +
+		      iter.block.uncompressed_size)) {
+			state->discard = target - state->total_out;
+			return (target);
+		}
+	}
+
+	lzma_index_iter_init(&state->block, state->index);
+	if (lzma_index_iter_locate(&state->block, target))
+		return (ARCHIVE_FATAL);
+	ret = xz_start_block(self);
+	if (ret != ARCHIVE_OK)
+		return (ret);
+	state->discard = target - state->total_out;
+	return (target);
 }
 
 /*
@@ -732,6 +1038,8 @@ xz_filter_close(struct archive_read_filter *self)
 
 	state = (struct private_data *)self->data;
 	lzma_end(&(state->stream));
+	if (state->index != NULL)
+		lzma_index_end(state->index, NULL);
 	free(state->out_block);
 	free(state);
 	return (ARCHIVE_OK);
@@ -47,6 +47,7 @@
 #include "archive_private.h"
 #include "archive_read_private.h"
 #include "archive_endian.h"
+#include "archive_thread_private.h"
 
 
 struct lzx_dec {
@@ -223,6 +224,17 @@ struct cffolder {
 	int			 cfdata_index;
 	/* Flags to mark progress of decompression. */
 	char			 decompress_init;
+	/*
+	 * With more than one thread, the CFDATA of several folders is
+	 * read into ahead_in and decoded into ahead on the worker
+	 * threads; ahead_avail bytes of it are good, and ahead_error
+	 * tells why the rest is not.
+	 */
+	unsigned char		*ahead;
+	size_t			 ahead_avail;
+	unsigned char		*ahead_in;
+	int			 ahead_in_count;
+	struct archive_string	 ahead_error;
 };
 
 struct cffile {
@@ -301,8 +313,21 @@ struct cab {
 	char			 stream_valid;
 #endif
 	struct lzx_stream	 xstrm;
+
+	int			 threads;
+	struct archive_thread_pool *pool;
+};
+
+/* Folders decoded by one call of cab_decode_folders_ahead(). */
+struct cab_ahead_batch {
+	struct cffolder		*folders;
+	/* Size of a CFDATA header, including its reserved bytes. */
+	int			 cfdata_size;
 };
 
+/* Limit of the memory used to decode folders ahead. */
+#define CAB_AHEAD_MAX	(128 * 1024 * 1024)
+
 static int	archive_read_format_cab_bid(struct archive_read *, int);
 static int	archive_read_format_cab_options(struct archive_read *,
 		    const char *, const char *);
@@ -331,6 +356,10 @@ static const void *cab_read_ahead_cfdata_lzx(struct archive_read *,
 		    ssize_t *);
 static int64_t	cab_consume_cfdata(struct archive_read *, int64_t);
 static int64_t	cab_minimum_consume_cfdata(struct archive_read *, int64_t);
+static int	cab_decode_folders_ahead(struct archive_read *, int);
+static void	cab_decode_folder_job(void *, int);
+static int	cab_read_data_ahead(struct archive_read *, const void **,
+		    size_t *, int64_t *);
 static int	lzx_decode_init(struct lzx_stream *, int);
 static int	lzx_read_blocks(struct lzx_stream *, int);
 static int	lzx_decode_blocks(struct lzx_stream *, int);
@@ -475,6 +504,20 @@ archive_read_format_cab_options(struct archive_read *a,
 				ret = ARCHIVE_FATAL;
 		}
 		return (ret);
+	} else if (strcmp(key, "threads") == 0) {
+		char *endptr;
+
+		if (val == NULL)
+			return (ARCHIVE_WARN);
+		errno = 0;
+		cab->threads = (int)strtoul(val, &endptr, 10);
+		if (errno != 0 || *endptr != '\0') {
+			cab->threads = 1;
+			return (ARCHIVE_WARN);
+		}
+		if (cab->threads == 0)
+			cab->threads = __archive_cpu_count();
+		return (ARCHIVE_OK);
 	}
 
 	/* Note: The "warn" return is just to inform the options
@@ -931,8 +974,23 @@ archive_read_format_cab_read_header(struct archive_read *a,
 	}
 	/* If a cffolder of this file is changed, reset a cfdata to read
 	 * file contents from next cfdata. */
-	if (prev_folder != cab->entry_cffolder)
+	if (prev_folder != cab->entry_cffolder) {
 		cab->entry_cfdata = NULL;
+		/* Data skipped in the previous folder is not in this one. */
+		cab->bytes_skipped = 0;
+		if (prev_folder != NULL && prev_folder->ahead != NULL) {
+			free(prev_folder->ahead);
+			prev_folder->ahead = NULL;
+			prev_folder->ahead_avail = 0;
+		}
+		if (cab->threads > 1 && cab->entry_cffolder->ahead == NULL &&
+		    hd->cabinet == 0 &&
+		    (hd->flags & (PREV_CABINET | NEXT_CABINET)) == 0) {
+			r = cab_decode_folders_ahead(a, file->folder);
+			if (r < ARCHIVE_WARN)
+				return (r);
+		}
+	}
 
 	/* If a pathname is UTF-8, prepare a string conversion object
 	 * for UTF-8 and use it. */
@@ -1902,6 +1960,337 @@ cab_minimum_consume_cfdata(struct archive_read *a, int64_t consumed_bytes)
 	return (rbytes);
 }
 
+/*
+ * Read the CFDATA of the folder `first' and of the folders that follow
+ * it, then decode each of them on its own worker thread.  The folders
+ * are stored one after another, so they are read in order and no seek
+ * is needed; their entries are then served from memory.  If fewer
+ * than two folders can be decoded this way, nothing is done and the
+ * entries are decoded as they are read.
+ */
+static int
+cab_decode_folders_ahead(struct archive_read *a, int first)
+{
+	struct cab *cab = (struct cab *)(a->format->data);
+	struct cfheader *hd = &cab->cfheader;
+	struct cab_ahead_batch batch;
+	struct cffolder *folder;
+	const unsigned char *p;
+	int64_t offset, skip;
+	size_t bytes, total, used, usize;
+	uint16_t csize, u;
+	int count, i, j, l;
+
+	l = 8;
+	if (hd->flags & RESERVE_PRESENT)
+		l += hd->cfdata;
+
+	/* Choose the folders. */
+	total = 0;
+	offset = cab->cab_offset;
+	for (count = 0;
+	    count < cab->threads && first + count < hd->folder_count;
+	    count++) {
+		folder = &hd->folder_array[first + count];
+		if (folder->comptype == COMPTYPE_QUANTUM ||
+		    folder->comptype > COMPTYPE_LZX)
+			break;
+#ifndef HAVE_ZLIB_H
+		if (folder->comptype == COMPTYPE_MSZIP)
+			break;
+#endif
+		if (folder->ahead != NULL || folder->cfdata_count == 0 ||
+		    folder->cfdata_offset_in_cab < offset)
+			break;
+		/* Both the CFDATA and the data decoded from it. */
+		bytes = (size_t)folder->cfdata_count *
+		    (l + (0x8000 + 6144) + 0x8000);
+		if (total + bytes > CAB_AHEAD_MAX)
+			break;
+		total += bytes;
+		offset = folder->cfdata_offset_in_cab;
+	}
+	if (count < 2)
+		return (ARCHIVE_OK);
+
+	if (cab->pool == NULL) {
+		cab->pool = __archive_thread_pool_new(cab->threads);
+		if (cab->pool == NULL) {
+			archive_set_error(&a->archive, ENOMEM,
+			    "Can't allocate worker threads");
+			return (ARCHIVE_FATAL);
+		}
+	}
+
+	/*
+	 * Read the CFDATA.  A CFDATA which is truncated or invalid ends
+	 * its folder, whose error is reported once its entries reach
+	 * it, and the folders after it are left to be read as usual.
+	 */
+	for (i = 0; i < count; i++) {
+		folder = &hd->folder_array[first + i];
+		skip = folder->cfdata_offset_in_cab - cab->cab_offset;
+		if (skip < 0)
+			break;
+		if (skip > 0) {
+			if (__archive_read_consume(a, skip) < 0)
+				return (ARCHIVE_FATAL);
+			cab->cab_offset += skip;
+		}
+		folder->ahead_in = malloc((size_t)folder->cfdata_count *
+		    (l + 0x8000 + 6144));
+		if (folder->ahead_in == NULL)
+			goto nomem;
+		used = usize = 0;
+		for (j = 0; j < folder->cfdata_count; j++) {
+			if ((p = __archive_read_ahead(a, l, NULL)) == NULL)
+				break;
+			csize = archive_le16dec(p + CFDATA_cbData);
+			u = archive_le16dec(p + CFDATA_cbUncomp);
+			/* The same checks as cab_next_cfdata() does. */
+			if (csize == 0 || csize > (0x8000+6144) ||
+			    u == 0 || u > 0x8000 ||
+			    (j + 1 < folder->cfdata_count && u != 0x8000) ||
+			    (folder->comptype == COMPTYPE_NONE &&
+			     csize != u)) {
+				archive_strcpy(&(folder->ahead_error),
+				    "Invalid CFDATA");
+				break;
+			}
+			if ((p = __archive_read_ahead(a, l + csize, NULL))
+			    == NULL)
+				break;
+			memcpy(folder->ahead_in + used, p, l + csize);
+			__archive_read_consume(a, l + csize);
+			cab->cab_offset += l + csize;
+			used += l + csize;
+			usize += u;
+		}
+		folder->ahead_in_count = j;
+		folder->ahead = malloc(usize > 0 ? usize : 1);
+		if (folder->ahead == NULL)
+			goto nomem;
+		if (j < folder->cfdata_count) {
+			if (archive_strlen(&(folder->ahead_error)) == 0)
+				archive_strcpy(&(folder->ahead_error),
+				    "Truncated CAB file data");
+			i++;
+			break;
+		}
+	}
+	count = i;
+	if (count == 0)
+		return (ARCHIVE_OK);
+
+	batch.folders = &hd->folder_array[first];
+	batch.cfdata_size = l;
+	__archive_thread_pool_run(cab->pool, cab_decode_folder_job, &batch,
+	    count);
+	for (i = 0; i < count; i++) {
+		folder = &hd->folder_array[first + i];
+		free(folder->ahead_in);
+		folder->ahead_in = NULL;
+	}
+	return (ARCHIVE_OK);
+nomem:
+	archive_set_error(&a->archive, ENOMEM,
+	    "Can't allocate memory for CAB data");
+	return (ARCHIVE_FATAL);
+}
+
+/*
+ * Verify and decode the CFDATA of one folder read ahead; this runs
+ * on a worker thread, so errors are only recorded in the folder.
+ */
+static void
+cab_decode_folder_job(void *arg, int job)
+{
+	struct cab_ahead_batch *batch = (struct cab_ahead_batch *)arg;
+	struct cffolder *folder = &batch->folders[job];
+	struct archive_string *error = &(folder->ahead_error);
+	struct lzx_stream xstrm;
+#ifdef HAVE_ZLIB_H
+	z_stream stream;
+	char stream_valid = 0;
+#endif
+	const unsigned char *p;
+	unsigned char *out;
+	uint32_t sum, sum_calculated;
+	uint16_t csize, usize;
+	int i, l, r = 0;
+
+	memset(&xstrm, 0, sizeof(xstrm));
+	if (folder->comptype == COMPTYPE_LZX &&
+	    lzx_decode_init(&xstrm, folder->compdata) != ARCHIVE_OK) {
+		archive_string_empty(error);
+		archive_strcat(error, "Can't initialize LZX decompression.");
+		goto done;
+	}
+
+	l = batch->cfdata_size;
+	p = folder->ahead_in;
+	out = folder->ahead;
+	for (i = 0; i < folder->ahead_in_count; i++) {
+		sum = archive_le32dec(p + CFDATA_csum);
+		csize = archive_le16dec(p + CFDATA_cbData);
+		usize = archive_le16dec(p + CFDATA_cbUncomp);
+		if (sum != 0) {
+			sum_calculated = cab_checksum_cfdata(p + l, csize, 0);
+			sum_calculated = cab_checksum_cfdata(
+			    p + CFDATA_cbData, l - CFDATA_cbData,
+			    sum_calculated);
+			if (sum_calculated != sum) {
+				archive_string_empty(error);
+				archive_string_sprintf(error,
+				    "Checksum error CFDATA[%d] %" PRIx32
+				    ":%" PRIx32 " in %d bytes",
+				    i, sum, sum_calculated, csize);
+				break;
+			}
+		}
+
+		switch (folder->comptype) {
+		case COMPTYPE_NONE:
+			memcpy(out, p + l, usize);
+			break;
+#ifdef HAVE_ZLIB_H
+		case COMPTYPE_MSZIP:
+			if (csize < 2 || p[l] != 0x43 || p[l + 1] != 0x4b) {
+				archive_string_empty(error);
+				archive_strcat(error,
+				    "CFDATA incorrect(no MSZIP signature)");
+				goto done;
+			}
+			if (!stream_valid) {
+				memset(&stream, 0, sizeof(stream));
+				r = inflateInit2(&stream,
+				    -15 /* Don't check for zlib header */);
+				if (r != Z_OK) {
+					archive_string_empty(error);
+					archive_strcat(error, "Can't initialize"
+					    " deflate decompression.");
+					goto done;
+				}
+				stream_valid = 1;
+			} else {
+				/* The previous CFDATA, which always has
+				 * 0x8000 bytes, is the dictionary. */
+				r = inflateReset(&stream);
+				if (r == Z_OK)
+					r = inflateSetDictionary(&stream,
+					    out - 0x8000, 0x8000);
+				if (r != Z_OK)
+					goto zlibfailed;
+			}
+			stream.next_in = (Bytef *)(uintptr_t)(p + l + 2);
+			stream.avail_in = csize - 2;
+			stream.next_out = out;
+			stream.avail_out = usize;
+			r = Z_OK;
+			while (r != Z_STREAM_END && stream.total_out < usize) {
+				r = inflate(&stream, 0);
+				if (r != Z_OK && r != Z_STREAM_END)
+					goto zlibfailed;
+			}
+			if (stream.total_out < usize) {
+				archive_string_empty(error);
+				archive_string_sprintf(error,
+				    "Invalid uncompressed size (%d < %d)",
+				    (int)stream.total_out, usize);
+				goto done;
+			}
+			break;
+#endif
+		case COMPTYPE_LZX:
+			lzx_cleanup_bitstream(&xstrm);
+			xstrm.next_in = p + l;
+			xstrm.avail_in = csize;
+			xstrm.total_out = 0;
+			while (xstrm.total_out < usize) {
+				int64_t avail_in = xstrm.avail_in;
+				int64_t total_out = xstrm.total_out;
+
+				xstrm.next_out = out + xstrm.total_out;
+				xstrm.avail_out = usize - xstrm.total_out;
+				r = lzx_decode(&xstrm, 1);
+				if (r != ARCHIVE_OK && r != ARCHIVE_EOF) {
+					archive_string_empty(error);
+					archive_string_sprintf(error,
+					    "LZX decompression failed (%d)", r);
+					goto done;
+				}
+				if (xstrm.avail_in == avail_in &&
+				    xstrm.total_out == total_out) {
+					archive_string_empty(error);
+					archive_strcat(error,
+					    "Truncated CAB file data");
+					goto done;
+				}
+			}
+			/*
+			 * Translation reversal of x86 processor CALL byte
+			 * sequence(E8).
+			 */
+			lzx_translation(&xstrm, out, usize, i * 0x8000);
+			break;
+		}
+		p += l + csize;
+		out += usize;
+		folder->ahead_avail += usize;
+	}
+	goto done;
+#ifdef HAVE_ZLIB_H
+zlibfailed:
+	archive_string_empty(error);
+	if (r == Z_MEM_ERROR)
+		archive_strcat(error, "Out of memory for deflate decompression");
+	else
+		archive_string_sprintf(error,
+		    "Deflate decompression failed (%d)", r);
+#endif
+done:
+#ifdef HAVE_ZLIB_H
+	if (stream_valid)
+		inflateEnd(&stream);
+#endif
+	lzx_decode_free(&xstrm);
+}
+
+/*
+ * Return the rest of the current entry from its folder decoded ahead.
+ */
+static int
+cab_read_data_ahead(struct archive_read *a, const void **buff,
+    size_t *size, int64_t *offset)
+{
+	struct cab *cab = (struct cab *)(a->format->data);
+	struct cffolder *folder = cab->entry_cffolder;
+	int64_t start, bytes_avail;
+
+	start = (int64_t)cab->entry_cffile->offset + cab->entry_offset;
+	if (start >= (int64_t)folder->ahead_avail) {
+		*buff = NULL;
+		*size = 0;
+		*offset = 0;
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "%s", archive_strlen(&(folder->ahead_error)) > 0 ?
+		    folder->ahead_error.s : "Invalid CFDATA");
+		return (ARCHIVE_FATAL);
+	}
+	bytes_avail = folder->ahead_avail - start;
+	if (bytes_avail > cab->entry_bytes_remaining)
+		bytes_avail = cab->entry_bytes_remaining;
+
+	*buff = folder->ahead + start;
+	*size = (size_t)bytes_avail;
+	*offset = cab->entry_offset;
+	cab->entry_offset += bytes_avail;
+	cab->entry_bytes_remaining -= bytes_avail;
+	if (cab->entry_bytes_remaining == 0)
+		cab->end_of_entry = 1;
+	return (ARCHIVE_OK);
+}
+
 /*
  * Returns ARCHIVE_OK if successful, ARCHIVE_FATAL otherwise, sets
  * cab->end_of_entry if it consumes all of the data.
@@ -1920,6 +2309,8 @@ cab_read_data(struct archive_read *a, const void **buff,
 		cab->end_of_entry = 1;
 		return (ARCHIVE_OK);
 	}
+	if (cab->entry_cffolder->ahead != NULL)
+		return (cab_read_data_ahead(a, buff, size, offset));
 
 	*buff = cab_read_ahead_cfdata(a, &bytes_avail);
 	if (bytes_avail <= 0) {
@@ -1965,6 +2356,13 @@ archive_read_format_cab_read_data_skip(struct archive_read *a)
 	if (cab->end_of_archive)
 		return (ARCHIVE_EOF);
 
+	if (cab->entry_cffolder->ahead != NULL) {
+		/* The folder has been decoded; nothing to consume. */
+		cab->entry_bytes_remaining = 0;
+		cab->end_of_entry_cleanup = cab->end_of_entry = 1;
+		return (ARCHIVE_OK);
+	}
+
 	if (!cab->read_data_invoked) {
 		cab->bytes_skipped += cab->entry_bytes_remaining;
 		cab->entry_bytes_remaining = 0;
@@ -2016,8 +2414,12 @@ archive_read_format_cab_cleanup(struct archive_read *a)
 	int i;
 
 	if (hd->folder_array != NULL) {
-		for (i = 0; i < hd->folder_count; i++)
+		for (i = 0; i < hd->folder_count; i++) {
 			free(hd->folder_array[i].cfdata.memimage);
+			free(hd->folder_array[i].ahead);
+			free(hd->folder_array[i].ahead_in);
+			archive_string_free(&(hd->folder_array[i].ahead_error));
+		}
 		free(hd->folder_array);
 	}
 	if (hd->file_array != NULL) {
@@ -2030,6 +2432,8 @@ archive_read_format_cab_cleanup(struct archive_read *a)
 		inflateEnd(&cab->stream);
 #endif
 	lzx_decode_free(&cab->xstrm);
+	if (cab->pool != NULL)
+		__archive_thread_pool_free(cab->pool);
 	archive_wstring_free(&cab->ws);
 	free(cab->uncompressed_buffer);
 	free(cab);
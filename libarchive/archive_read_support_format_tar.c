@@ -31,6 +31,12 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_support_format_tar.c 201161
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_IO_H
+#include <io.h>
+#endif
 #include <stddef.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -38,6 +44,9 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_support_format_tar.c 201161
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 #include "archive.h"
 #include "archive_acl_private.h" /* For ACL parsing routines. */
@@ -45,6 +54,15 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_support_format_tar.c 201161
 #include "archive_entry_locale.h"
 #include "archive_private.h"
 #include "archive_read_private.h"
+#include "archive_tar_header_private.h"
+#include "archive_tar_index_private.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC	0
+#endif
 
 #define tar_min(a,b) ((a) < (b) ? (a) : (b))
 
@@ -128,7 +146,6 @@ struct tar {
 	struct archive_string	 longlink;
 	struct archive_string	 longname;
 	struct archive_string	 pax_header;
-	struct archive_string	 pax_global;
 	struct archive_string	 line;
 	int			 pax_hdrcharset_binary;
 	int			 header_recursion_depth;
@@ -156,6 +173,13 @@ struct tar {
 	int			 process_mac_extensions;
 	int			 read_concatenated_archives;
 	int			 realsize_override;
+
+	/* Member index; filled in as headers are read if index_enabled. */
+	int			 index_enabled;
+	struct archive_tar_index index;
+
+	/* Decode only what a listing needs from plain headers. */
+	int			 scan;
 };
 
 static int	archive_block_is_null(const char *p);
@@ -203,6 +227,9 @@ static int	archive_read_format_tar_read_data(struct archive_read *a,
 static int	archive_read_format_tar_skip(struct archive_read *a);
 static int	archive_read_format_tar_read_header(struct archive_read *,
 		    struct archive_entry *);
+static int	index_add_entry(struct archive_read *, struct tar *,
+		    struct archive_entry *, int64_t header_offset);
+static int	index_load_embedded(struct archive_read *, struct tar *);
 static int	checksum(struct archive_read *, const void *);
 static int 	pax_attribute(struct archive_read *, struct tar *,
 		    struct archive_entry *, const char *key, const char *value,
@@ -226,6 +253,8 @@ static int64_t	tar_atol256(const char *, size_t);
 static int64_t	tar_atol8(const char *, size_t);
 static int	tar_read_header(struct archive_read *, struct tar *,
 		    struct archive_entry *, size_t *);
+static int	tar_scan_header(struct archive_read *, struct tar *,
+		    struct archive_entry *, size_t *);
 static int	tohex(int c);
 static char	*url_decode(const char *);
 static void	tar_flush_unconsumed(struct archive_read *, size_t *);
@@ -260,6 +289,7 @@ archive_read_support_format_tar(struct archive *_a)
 	/* Set this by default on Mac OS. */
 	tar->process_mac_extensions = 1;
 #endif
+	__archive_tar_index_init(&tar->index);
 
 	r = __archive_read_register_format(a, tar, "tar",
 	    archive_read_format_tar_bid,
@@ -291,11 +321,11 @@ archive_read_format_tar_cleanup(struct archive_read *a)
 	archive_string_free(&tar->entry_uname);
 	archive_string_free(&tar->entry_gname);
 	archive_string_free(&tar->line);
-	archive_string_free(&tar->pax_global);
 	archive_string_free(&tar->pax_header);
 	archive_string_free(&tar->longname);
 	archive_string_free(&tar->longlink);
 	archive_string_free(&tar->localname);
+	__archive_tar_index_free(&tar->index);
 	free(tar);
 	(a->format->data) = NULL;
 	return (ARCHIVE_OK);
@@ -454,6 +484,12 @@ archive_read_format_tar_options(struct archive_read *a,
 	} else if (strcmp(key, "read_concatenated_archives") == 0) {
 		tar->read_concatenated_archives = (val != NULL && val[0] != 0);
 		return (ARCHIVE_OK);
+	} else if (strcmp(key, "index") == 0) {
+		tar->index_enabled = (val != NULL && val[0] != 0);
+		return (ARCHIVE_OK);
+	} else if (strcmp(key, "scan") == 0) {
+		tar->scan = (val != NULL && val[0] != 0);
+		return (ARCHIVE_OK);
 	}
 
 	/* Note: The "warn" return is just to inform the options
@@ -512,6 +548,7 @@ archive_read_format_tar_read_header(struct archive_read *a,
 	struct tar *tar;
 	const char *p;
 	const wchar_t *wp;
+	int64_t header_offset;
 	int r;
 	size_t l, unconsumed = 0;
 
@@ -541,7 +578,12 @@ archive_read_format_tar_read_header(struct archive_read *a,
 		tar->sconv = tar->sconv_default;
 	}
 
-	r = tar_read_header(a, tar, entry, &unconsumed);
+	header_offset = a->filter->position;
+	if (tar->scan && tar->sconv == NULL &&
+	    tar_scan_header(a, tar, entry, &unconsumed))
+		r = ARCHIVE_OK;
+	else
+		r = tar_read_header(a, tar, entry, &unconsumed);
 
 	tar_flush_unconsumed(a, &unconsumed);
 
@@ -585,9 +627,389 @@ archive_read_format_tar_read_header(struct archive_read *a,
 			}
 		}
 	}
+	if ((r == ARCHIVE_OK || r == ARCHIVE_WARN) && tar->index_enabled &&
+	    index_add_entry(a, tar, entry, header_offset) != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
+	return (r);
+}
+
+/*
+ * Record the entry just read in the member index.
+ */
+static int
+index_add_entry(struct archive_read *a, struct tar *tar,
+    struct archive_entry *entry, int64_t header_offset)
+{
+	const struct archive_tar_index_entry *e;
+	const char *path;
+	int64_t *sparse = NULL;
+	int i, n, r;
+
+	path = archive_entry_pathname(entry);
+	if (path == NULL)
+		return (ARCHIVE_OK);
+	/* Don't record a member twice when it is read again. */
+	e = __archive_tar_index_find(&tar->index, path);
+	if (e != NULL && e->header_offset == header_offset)
+		return (ARCHIVE_OK);
+	n = archive_entry_sparse_reset(entry);
+	if (n > 0) {
+		sparse = malloc(n * 2 * sizeof(sparse[0]));
+		if (sparse == NULL) {
+			archive_set_error(&a->archive, ENOMEM,
+			    "Can't allocate tar index");
+			return (ARCHIVE_FATAL);
+		}
+		for (i = 0; i < n; i++)
+			archive_entry_sparse_next(entry,
+			    &sparse[i * 2], &sparse[i * 2 + 1]);
+	}
+	r = __archive_tar_index_add(&tar->index, path, header_offset,
+	    a->filter->position, archive_entry_size(entry), n, sparse);
+	free(sparse);
+	if (r != ARCHIVE_OK) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate tar index");
+		return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Return the tar reader's state, or NULL if the archive isn't being
+ * read as a tar archive.
+ */
+static struct tar *
+get_tar(struct archive_read *a, const char *fn)
+{
+	if (a->format == NULL || a->format->name == NULL ||
+	    strcmp(a->format->name, "tar") != 0) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Can only use %s with tar format", fn);
+		return (NULL);
+	}
+	return ((struct tar *)(a->format->data));
+}
+
+/*
+ * Write the member index to a sidecar file.
+ */
+int
+archive_read_tar_index_save(struct archive *_a, const char *filename)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct archive_string buff;
+	struct tar *tar;
+	const char *p;
+	size_t i, len;
+	ssize_t bytes;
+	int fd, r = ARCHIVE_OK;
+
+	archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_tar_index_save");
+	if ((tar = get_tar(a, "archive_read_tar_index_save")) == NULL)
+		return (ARCHIVE_FATAL);
+
+	fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY | O_CLOEXEC,
+	    0666);
+	if (fd < 0) {
+		archive_set_error(&a->archive, errno,
+		    "Failed to open '%s'", filename);
+		return (ARCHIVE_FAILED);
+	}
+	__archive_ensure_cloexec_flag(fd);
+
+	archive_string_init(&buff);
+	archive_strcat(&buff, ARCHIVE_TAR_INDEX_MAGIC "\n");
+	for (i = 0; i <= tar->index.count && r == ARCHIVE_OK; i++) {
+		if (i < tar->index.count) {
+			__archive_tar_index_format(&buff,
+			    tar->index.entries[i]);
+			if (archive_strlen(&buff) < 65536)
+				continue;
+		}
+		/* Write out what we have. */
+		p = buff.s;
+		len = archive_strlen(&buff);
+		while (len > 0) {
+			bytes = write(fd, p, len);
+			if (bytes <= 0) {
+				archive_set_error(&a->archive, errno,
+				    "Write error on '%s'", filename);
+				r = ARCHIVE_FAILED;
+				break;
+			}
+			p += bytes;
+			len -= bytes;
+		}
+		archive_string_empty(&buff);
+	}
+	archive_string_free(&buff);
+	if (close(fd) != 0 && r == ARCHIVE_OK) {
+		archive_set_error(&a->archive, errno,
+		    "Write error on '%s'", filename);
+		r = ARCHIVE_FAILED;
+	}
 	return (r);
 }
 
+/*
+ * Add the members listed in a sidecar index file, or with a NULL
+ * filename, in the index embedded at the end of the archive.
+ */
+int
+archive_read_tar_index_load(struct archive *_a, const char *filename)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct tar *tar;
+	char buff[65536];
+	size_t magic_len = strlen(ARCHIVE_TAR_INDEX_MAGIC);
+	ssize_t bytes;
+	int fd, first = 1, r = ARCHIVE_OK;
+
+	archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_tar_index_load");
+	if ((tar = get_tar(a, "archive_read_tar_index_load")) == NULL)
+		return (ARCHIVE_FATAL);
+	if (filename == NULL)
+		return (index_load_embedded(a, tar));
+
+	fd = open(filename, O_RDONLY | O_BINARY | O_CLOEXEC);
+	if (fd < 0) {
+		archive_set_error(&a->archive, errno,
+		    "Failed to open '%s'", filename);
+		return (ARCHIVE_FAILED);
+	}
+	__archive_ensure_cloexec_flag(fd);
+	archive_string_empty(&tar->index.line);
+	while ((bytes = read(fd, buff, sizeof(buff))) > 0) {
+		if (first && ((size_t)bytes <= magic_len ||
+		    memcmp(buff, ARCHIVE_TAR_INDEX_MAGIC, magic_len) != 0 ||
+		    buff[magic_len] != '\n')) {
+			r = ARCHIVE_FAILED;
+			break;
+		}
+		first = 0;
+		r = __archive_tar_index_parse(&tar->index, buff, bytes, 0);
+		if (r != ARCHIVE_OK)
+			break;
+	}
+	if (bytes < 0) {
+		archive_set_error(&a->archive, errno,
+		    "Read error on '%s'", filename);
+		close(fd);
+		return (ARCHIVE_FAILED);
+	}
+	close(fd);
+	if (r == ARCHIVE_OK && first)
+		r = ARCHIVE_FAILED;
+	if (r == ARCHIVE_OK)
+		r = __archive_tar_index_parse(&tar->index, NULL, 0, 1);
+	if (r == ARCHIVE_FATAL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate tar index");
+		return (ARCHIVE_FATAL);
+	}
+	if (r != ARCHIVE_OK) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Invalid tar index file '%s'", filename);
+		return (ARCHIVE_FAILED);
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Read the index the pax writer leaves in a global header at the end
+ * of the archive.  The reader is returned to where it was afterwards.
+ */
+static int
+index_load_embedded(struct archive_read *a, struct tar *tar)
+{
+	const struct archive_entry_header_ustar *header;
+	const char *p, *q, *key;
+	int64_t end, pos, start, saved, size, reclen, vlen, n;
+	ssize_t avail;
+	size_t klen = strlen(ARCHIVE_TAR_INDEX_START_KEY "=");
+	int r = ARCHIVE_OK;
+
+	if (tar->entry_bytes_unconsumed) {
+		__archive_read_consume(a, tar->entry_bytes_unconsumed);
+		tar->entry_bytes_unconsumed = 0;
+	}
+	saved = a->filter->position;
+	end = __archive_read_seek(a, 0, SEEK_END);
+	if (end < 0) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Can't find an embedded index: archive is not seekable");
+		return (ARCHIVE_FAILED);
+	}
+
+	/*
+	 * Find the last block that isn't all zeros; it ends with the
+	 * record giving the offset of the index header.  Don't look
+	 * through more than 16 MiB of end-of-archive padding.
+	 */
+	start = -1;
+	for (pos = end & ~511; pos > 0 && end - pos < 16 * 1024 * 1024;
+	    pos -= n) {
+		n = tar_min(pos, 65536);
+		if (__archive_read_seek(a, pos - n, SEEK_SET) < 0 ||
+		    (p = __archive_read_ahead(a, (size_t)n, NULL)) == NULL)
+			goto fatal;
+		for (q = p + n - 512; q >= p; q -= 512)
+			if (!archive_block_is_null(q))
+				break;
+		if (q >= p) {
+			start = pos - n + (q - p);
+			break;
+		}
+	}
+	if (start >= 0) {
+		/* The record may straddle the previous block. */
+		pos = start >= 512 ? start - 512 : 0;
+		n = start + 512 - pos;
+		if (__archive_read_seek(a, pos, SEEK_SET) < 0 ||
+		    (p = __archive_read_ahead(a, (size_t)n, NULL)) == NULL)
+			goto fatal;
+		start = -1;
+		for (q = p + n - klen; q > p; q--) {
+			if (q[-1] == ' ' &&
+			    memcmp(q, ARCHIVE_TAR_INDEX_START_KEY "=", klen)
+			      == 0) {
+				start = tar_atol10(q + klen, p + n - (q + klen));
+				break;
+			}
+		}
+	}
+	if (start < 0 || start >= end - 512) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "No embedded index found");
+		r = ARCHIVE_FAILED;
+		goto done;
+	}
+
+	/* Check the global header holding the index. */
+	if (__archive_read_seek(a, start, SEEK_SET) < 0 ||
+	    (p = __archive_read_ahead(a, 512, NULL)) == NULL)
+		goto fatal;
+	header = (const struct archive_entry_header_ustar *)p;
+	if (header->typeflag[0] != 'g' || !checksum(a, p)) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Invalid embedded index");
+		r = ARCHIVE_FAILED;
+		goto done;
+	}
+	size = tar_atol(header->size, sizeof(header->size));
+	__archive_read_consume(a, 512);
+
+	/* Walk the pax records, feeding the index to the parser. */
+	archive_string_empty(&tar->index.line);
+	while (size > 0 && r == ARCHIVE_OK) {
+		p = __archive_read_ahead(a, 1, &avail);
+		if (p == NULL)
+			goto fatal;
+		n = tar_min(avail, tar_min(size, 128));
+		/* "<length> <key>=<value>\n" */
+		for (key = p; key < p + n && *key != ' '; key++)
+			continue;
+		reclen = tar_atol10(p, key - p);
+		for (q = ++key; q < p + n && *q != '='; q++)
+			continue;
+		if (q >= p + n || reclen <= q + 1 - p || reclen > size) {
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_FILE_FORMAT,
+			    "Invalid embedded index");
+			r = ARCHIVE_FAILED;
+			goto done;
+		}
+		vlen = reclen - (q + 1 - p) - 1;
+		size -= reclen;
+		if ((size_t)(q - key) == strlen(ARCHIVE_TAR_INDEX_KEY) &&
+		    memcmp(key, ARCHIVE_TAR_INDEX_KEY, q - key) == 0) {
+			__archive_read_consume(a, q + 1 - p);
+			while (vlen > 0 && r == ARCHIVE_OK) {
+				p = __archive_read_ahead(a, 1, &avail);
+				if (p == NULL)
+					goto fatal;
+				n = tar_min(avail, vlen);
+				r = __archive_tar_index_parse(&tar->index,
+				    p, (size_t)n, 0);
+				__archive_read_consume(a, n);
+				vlen -= n;
+			}
+			if (r == ARCHIVE_OK)
+				r = __archive_tar_index_parse(&tar->index,
+				    NULL, 0, 1);
+			__archive_read_consume(a, 1);
+		} else
+			__archive_read_consume(a, reclen);
+	}
+	if (r == ARCHIVE_FATAL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate tar index");
+		goto done;
+	}
+	if (r != ARCHIVE_OK) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_FILE_FORMAT,
+		    "Invalid embedded index");
+		r = ARCHIVE_FAILED;
+	}
+done:
+	if (__archive_read_seek(a, saved, SEEK_SET) < 0)
+		return (ARCHIVE_FATAL);
+	return (r);
+fatal:
+	a->archive.state = ARCHIVE_STATE_FATAL;
+	return (ARCHIVE_FATAL);
+}
+
+/*
+ * Use the member index to position the reader so that the next call
+ * to archive_read_next_header() returns the named member.
+ */
+int
+archive_read_tar_seek_entry(struct archive *_a, const char *pathname)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	const struct archive_tar_index_entry *e;
+	struct tar *tar;
+	int64_t r;
+
+	archive_check_magic(_a, ARCHIVE_READ_MAGIC,
+	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA | ARCHIVE_STATE_EOF,
+	    "archive_read_tar_seek_entry");
+	if ((tar = get_tar(a, "archive_read_tar_seek_entry")) == NULL)
+		return (ARCHIVE_FATAL);
+	e = __archive_tar_index_find(&tar->index, pathname);
+	if (e == NULL) {
+		archive_set_error(&a->archive, ENOENT,
+		    "%s: Not found in tar index", pathname);
+		return (ARCHIVE_FAILED);
+	}
+	r = __archive_read_seek(a, e->header_offset, SEEK_SET);
+	if (r == ARCHIVE_FAILED) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "Can't seek: archive is not seekable");
+		return (ARCHIVE_FAILED);
+	}
+	if (r < 0) {
+		a->archive.state = ARCHIVE_STATE_FATAL;
+		return (ARCHIVE_FATAL);
+	}
+
+	/* Forget about the entry we were in. */
+	gnu_clear_sparse_list(tar);
+	tar->entry_bytes_remaining = 0;
+	tar->entry_bytes_unconsumed = 0;
+	tar->entry_padding = 0;
+	tar->header_recursion_depth = 0;
+	tar->sparse_gnu_pending = 0;
+	a->archive.state = ARCHIVE_STATE_HEADER;
+	return (ARCHIVE_OK);
+}
+
 static int
 archive_read_format_tar_read_data(struct archive_read *a,
     const void **buff, size_t *size, int64_t *offset)
@@ -884,6 +1306,232 @@ tar_read_header(struct archive_read *a, struct tar *tar,
 	return (ARCHIVE_FATAL);
 }
 
+static int
+scan_key_is(const char *key, size_t len, const char *name)
+{
+	return (len == strlen(name) && memcmp(key, name, len) == 0);
+}
+
+/*
+ * Pick the pathname, link target and size out of a pax extended
+ * header body for tar_scan_header().  Returns zero if the body is
+ * malformed or holds an attribute that only the full parser handles.
+ */
+static int
+scan_pax(struct tar *tar, const char *p, size_t len, int64_t *size)
+{
+	const char *key, *value, *eq;
+	size_t n, line_length, key_length, value_length;
+
+	while (len > 0) {
+		line_length = 0;
+		for (n = 0; n < len && p[n] >= '0' && p[n] <= '9'; n++) {
+			line_length = line_length * 10 + (p[n] - '0');
+			if (line_length > 999999)
+				return (0);
+		}
+		if (n == 0 || n >= len || p[n] != ' ' ||
+		    line_length < n + 3 || line_length > len ||
+		    p[line_length - 1] != '\n')
+			return (0);
+		key = p + n + 1;
+		eq = memchr(key, '=', p + line_length - 1 - key);
+		if (eq == NULL || eq == key)
+			return (0);
+		key_length = eq - key;
+		value = eq + 1;
+		value_length = p + line_length - 1 - value;
+
+		if (scan_key_is(key, key_length, "path"))
+			archive_strncpy(&(tar->entry_pathname), value,
+			    value_length);
+		else if (scan_key_is(key, key_length, "linkpath"))
+			archive_strncpy(&(tar->entry_linkpath), value,
+			    value_length);
+		else if (scan_key_is(key, key_length, "size"))
+			*size = tar_atol10(value, value_length);
+		else if (scan_key_is(key, key_length, "hdrcharset") ||
+		    scan_key_is(key, key_length, "SCHILY.realsize") ||
+		    scan_key_is(key, key_length, "SUN.holesdata") ||
+		    (key_length > 11 && memcmp(key, "GNU.sparse.", 11) == 0))
+			return (0);
+		p += line_length;
+		len -= line_length;
+	}
+	return (1);
+}
+
+/*
+ * Fast path for the "scan" option.  The common cases -- a ustar, GNU
+ * or old-style header for an ordinary entry, optionally preceded by
+ * one pax 'x' or GNU 'L' header -- are read straight out of the
+ * read-ahead buffer, and only the pathname, link target, size and
+ * type are decoded.  Returns zero, having consumed nothing, if the
+ * headers need the full parser.
+ */
+static int
+tar_scan_header(struct archive_read *a, struct tar *tar,
+    struct archive_entry *entry, size_t *unconsumed)
+{
+	const struct archive_entry_header_ustar *header;
+	const struct archive_entry_header_gnutar *gnuheader;
+	const char *h, *ext = NULL, *p;
+	char exttype = 0;
+	int64_t size, extsize = 0;
+	size_t hlen = 0;
+	int utf8_path = 0, utf8_link = 0;
+
+	h = __archive_read_ahead(a, 512, NULL);
+	if (h == NULL || (h[0] == 0 && archive_block_is_null(h)))
+		return (0);
+	header = (const struct archive_entry_header_ustar *)h;
+	if (header->typeflag[0] == 'x' || header->typeflag[0] == 'L') {
+		if (!checksum(a, h))
+			return (0);
+		exttype = header->typeflag[0];
+		extsize = tar_atol(header->size, sizeof(header->size));
+		if (extsize <= 0 || extsize > 65536)
+			return (0);
+		hlen = 512 + (size_t)((extsize + 511) & ~511);
+		h = __archive_read_ahead(a, hlen + 512, NULL);
+		if (h == NULL)
+			return (0);
+		ext = h + 512;
+		h += hlen;
+		header = (const struct archive_entry_header_ustar *)h;
+	}
+	if (header->typeflag[0] != '\0' &&
+	    (header->typeflag[0] < '0' || header->typeflag[0] > '7'))
+		return (0);
+	if (!checksum(a, h))
+		return (0);
+	gnuheader = (const struct archive_entry_header_gnutar *)h;
+	if (memcmp(gnuheader->magic, "ustar  \0", 8) == 0 &&
+	    (gnuheader->realsize[0] != 0 ||
+	     gnuheader->sparse[0].offset[0] != 0))
+		return (0);
+	size = tar_atol(header->size, sizeof(header->size));
+
+	archive_string_empty(&(tar->entry_pathname));
+	archive_string_empty(&(tar->entry_linkpath));
+	if (exttype == 'L')
+		archive_strncpy(&(tar->entry_pathname), ext, (size_t)extsize);
+	else if (exttype == 'x' &&
+	    !scan_pax(tar, ext, (size_t)extsize, &size))
+		return (0);
+	if (size < 0 || size == INT64_MAX)
+		return (0);
+	/* Names from a pax header are UTF-8. */
+	if (exttype == 'x') {
+		utf8_path = archive_strlen(&(tar->entry_pathname)) > 0;
+		utf8_link = archive_strlen(&(tar->entry_linkpath)) > 0;
+	}
+	if (archive_strlen(&(tar->entry_pathname)) == 0) {
+		if (memcmp(header->magic, "ustar\0", 6) == 0 &&
+		    header->prefix[0]) {
+			archive_strncpy(&(tar->entry_pathname),
+			    header->prefix, sizeof(header->prefix));
+			if (tar->entry_pathname.s[
+			    archive_strlen(&(tar->entry_pathname)) - 1] != '/')
+				archive_strappend_char(&(tar->entry_pathname),
+				    '/');
+			archive_strncat(&(tar->entry_pathname),
+			    header->name, sizeof(header->name));
+		} else
+			archive_strncpy(&(tar->entry_pathname),
+			    header->name, sizeof(header->name));
+	}
+	if (archive_strlen(&(tar->entry_linkpath)) == 0)
+		archive_strncpy(&(tar->entry_linkpath),
+		    header->linkname, sizeof(header->linkname));
+
+	/* Mac metadata entries get merged by the full parser. */
+	if (tar->process_mac_extensions) {
+		p = strrchr(tar->entry_pathname.s, '/');
+		p = (p == NULL) ? tar->entry_pathname.s : p + 1;
+		if (p[0] == '.' && p[1] == '_')
+			return (0);
+	}
+
+	/* Set the format the same way tar_read_header() does. */
+	if (exttype == 'x') {
+		a->archive.archive_format = ARCHIVE_FORMAT_TAR_PAX_INTERCHANGE;
+		a->archive.archive_format_name = "POSIX pax interchange format";
+	} else if (memcmp(gnuheader->magic, "ustar  \0", 8) == 0) {
+		a->archive.archive_format = ARCHIVE_FORMAT_TAR_GNUTAR;
+		a->archive.archive_format_name = "GNU tar format";
+	} else if (memcmp(header->magic, "ustar", 5) == 0) {
+		if (a->archive.archive_format !=
+		    ARCHIVE_FORMAT_TAR_PAX_INTERCHANGE) {
+			a->archive.archive_format = ARCHIVE_FORMAT_TAR_USTAR;
+			a->archive.archive_format_name = "POSIX ustar format";
+		}
+	} else {
+		a->archive.archive_format = ARCHIVE_FORMAT_TAR;
+		a->archive.archive_format_name = "tar (non-POSIX)";
+	}
+
+	switch (header->typeflag[0]) {
+	case '1':
+		/* See header_common() for the hardlink size rules. */
+		if (size > 0 && a->archive.archive_format !=
+		    ARCHIVE_FORMAT_TAR_PAX_INTERCHANGE) {
+			if (a->archive.archive_format != ARCHIVE_FORMAT_TAR &&
+			    a->archive.archive_format !=
+			    ARCHIVE_FORMAT_TAR_GNUTAR)
+				return (0);
+			size = 0;
+		}
+		archive_entry_set_filetype(entry, size > 0 ? AE_IFREG : 0);
+		if (utf8_link)
+			archive_entry_set_hardlink_utf8(entry,
+			    tar->entry_linkpath.s);
+		else
+			archive_entry_copy_hardlink(entry,
+			    tar->entry_linkpath.s);
+		break;
+	case '2':
+		archive_entry_set_filetype(entry, AE_IFLNK);
+		if (utf8_link)
+			archive_entry_set_symlink_utf8(entry,
+			    tar->entry_linkpath.s);
+		else
+			archive_entry_copy_symlink(entry,
+			    tar->entry_linkpath.s);
+		size = 0;
+		break;
+	case '3':
+		archive_entry_set_filetype(entry, AE_IFCHR);
+		size = 0;
+		break;
+	case '4':
+		archive_entry_set_filetype(entry, AE_IFBLK);
+		size = 0;
+		break;
+	case '5':
+		archive_entry_set_filetype(entry, AE_IFDIR);
+		size = 0;
+		break;
+	case '6':
+		archive_entry_set_filetype(entry, AE_IFIFO);
+		size = 0;
+		break;
+	default:
+		archive_entry_set_filetype(entry, AE_IFREG);
+		break;
+	}
+	if (utf8_path)
+		archive_entry_set_pathname_utf8(entry, tar->entry_pathname.s);
+	else
+		archive_entry_copy_pathname(entry, tar->entry_pathname.s);
+	archive_entry_set_size(entry, size);
+	tar->entry_bytes_remaining = size;
+	tar->realsize = size;
+	tar->entry_padding = 0x1ff & (-size);
+	*unconsumed = hlen + 512;
+	return (1);
+}
+
 /*
  * Return true if block checksum is correct.
  */
@@ -892,7 +1540,7 @@ checksum(struct archive_read *a, const void *h)
 {
 	const unsigned char *bytes;
 	const struct archive_entry_header_ustar	*header;
-	int check, sum;
+	int check, high, sum;
 	size_t i;
 
 	(void)a; /* UNUSED */
@@ -908,31 +1556,24 @@ checksum(struct archive_read *a, const void *h)
 
 	/*
 	 * Test the checksum.  Note that POSIX specifies _unsigned_
-	 * bytes for this calculation.
+	 * bytes for this calculation.  The checksum field itself is
+	 * counted as eight spaces.
 	 */
 	sum = (int)tar_atol(header->checksum, sizeof(header->checksum));
-	check = 0;
-	for (i = 0; i < 148; i++)
-		check += (unsigned char)bytes[i];
-	for (; i < 156; i++)
-		check += 32;
-	for (; i < 512; i++)
-		check += (unsigned char)bytes[i];
+	__archive_tar_header_sum(bytes, &check, &high);
+	for (i = 148; i < 156; i++)
+		check += 32 - bytes[i];
 	if (sum == check)
 		return (1);
 
 	/*
 	 * Repeat test with _signed_ bytes, just in case this archive
 	 * was created by an old BSD, Solaris, or HP-UX tar with a
-	 * broken checksum calculation.
+	 * broken checksum calculation.  Each byte with the high bit
+	 * set counts 256 less.  (The checksum field was checked above
+	 * to hold only ASCII.)
 	 */
-	check = 0;
-	for (i = 0; i < 148; i++)
-		check += (signed char)bytes[i];
-	for (; i < 156; i++)
-		check += 32;
-	for (; i < 512; i++)
-		check += (signed char)bytes[i];
+	check -= 256 * high;
 	if (sum == check)
 		return (1);
 
@@ -1475,13 +2116,24 @@ static int
 header_pax_global(struct archive_read *a, struct tar *tar,
     struct archive_entry *entry, const void *h, size_t *unconsumed)
 {
-	int err;
+	const struct archive_entry_header_ustar *header;
+	int64_t size;
 
-	err = read_body_to_string(a, tar, &(tar->pax_global), h, unconsumed);
-	if (err != ARCHIVE_OK)
-		return (err);
-	err = tar_read_header(a, tar, entry, unconsumed);
-	return (err);
+	/*
+	 * Global attributes aren't used, so just skip the body.  It
+	 * may hold a member index, which can be arbitrarily large.
+	 */
+	header = (const struct archive_entry_header_ustar *)h;
+	size = tar_atol(header->size, sizeof(header->size));
+	if (size < 0) {
+		archive_set_error(&a->archive, EINVAL,
+		    "Special header has negative size");
+		return (ARCHIVE_FATAL);
+	}
+	tar_flush_unconsumed(a, unconsumed);
+	if (__archive_read_consume(a, (size + 511) & ~511) < 0)
+		return (ARCHIVE_FATAL);
+	return (tar_read_header(a, tar, entry, unconsumed));
 }
 
 static int
@@ -2674,7 +3326,7 @@ tar_atol_base_n(const char *p, size_t char_cnt, int base)
 static int64_t
 tar_atol8(const char *p, size_t char_cnt)
 {
-	return tar_atol_base_n(p, char_cnt, 8);
+	return (__archive_tar_atol8(p, char_cnt));
 }
 
 static int64_t
@@ -73,6 +73,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_read_support_format_zip.c 201102
 #include "archive_rb.h"
 #include "archive_read_private.h"
 #include "archive_ppmd8_private.h"
+#include "archive_thread_private.h"
 
 #ifndef HAVE_ZLIB_H
 #include "archive_crc32.h"
@@ -97,6 +98,7 @@ struct zip_entry {
 	unsigned char		system; /* From "version written by" */
 	unsigned char		flags; /* Our extra markers. */
 	unsigned char		decdat;/* Used for Decryption check */
+	uint32_t		name_hash; /* Of the central directory name */
 
 	/* WinZip AES encryption extra field should be available
 	 * when compression is 99. */
@@ -129,6 +131,7 @@ struct trad_enc_ctx {
 /* Bits used in flags. */
 #define LA_USED_ZIP64	(1 << 0)
 #define LA_FROM_CENTRAL_DIRECTORY (1 << 1)
+#define LA_REPEATED_NAME (1 << 2) /* Not the first entry of its name. */
 
 /*
  * See "WinZip - AES Encryption Information"
@@ -140,6 +143,18 @@ struct trad_enc_ctx {
 #define AUTH_CODE_SIZE	10
 /**/
 #define MAX_DERIVED_KEY_BUF_SIZE	(AES_MAX_KEY_SIZE * 2 + 2)
+/* Number of WinZip AES keys kept for reuse. */
+#define AES_KEY_CACHE_SIZE	256
+/* Number of keys derived per worker thread in one batch. */
+#define AES_KEYS_PER_THREAD	16
+
+/* A WinZip AES key derived from a salt; the salt length gives the
+ * strength.  A salt_len of 0 means the derivation failed. */
+struct aes_derived_key {
+	uint8_t			salt[16];
+	size_t			salt_len;
+	uint8_t			key[MAX_DERIVED_KEY_BUF_SIZE];
+};
 
 struct zip {
 	/* Structural information about the archive. */
@@ -154,6 +169,15 @@ struct zip {
 	struct zip_entry	*zip_entries;
 	struct archive_rb_tree	tree;
 	struct archive_rb_tree	tree_rsrc;
+	/* Position of `entry' in local header offset order; a reader
+	 * partitioned for parallel extraction only returns the entries
+	 * whose number is partition_index modulo partition_count, or,
+	 * with a partition_index of -1, the repeated names. */
+	int64_t			entry_number;
+	int			partition_index;
+	int			partition_count;
+	char			repeats_marked;
+	char			has_repeats;
 
 	/* Bytes read but not yet consumed via __archive_read_consume() */
 	size_t			unconsumed;
@@ -238,6 +262,19 @@ struct zip {
 	char			cctx_valid;
 	archive_hmac_sha1_ctx	hctx;
 	char			hctx_valid;
+	/*
+	 * Deriving a key costs 1000 rounds of PBKDF2, which dominates
+	 * archives of many small entries.  Keys are cached by salt for
+	 * the last passphrase that proved right; on seekable input with
+	 * more than one thread, the keys of the upcoming entries are
+	 * derived in parallel.
+	 */
+	struct archive_string	aes_passphrase;
+	struct aes_derived_key	*aes_keys;
+	int			aes_keys_used;
+	int			aes_keys_next;
+	int			threads;
+	struct archive_thread_pool *pool;
 
 	/* Strong encryption's decryption header information. */
 	unsigned		iv_size;
@@ -2852,6 +2889,164 @@ init_traditional_PKWARE_decryption(struct archive_read *a)
 #undef ENC_HEADER_SIZE
 }
 
+/*
+ * Tell whether the cached keys were derived from this passphrase.
+ */
+static int
+aes_key_cache_matches(struct zip *zip, const char *passphrase)
+{
+	return (zip->aes_keys_used > 0 &&
+	    strcmp(zip->aes_passphrase.s, passphrase) == 0);
+}
+
+static const uint8_t *
+aes_key_lookup(struct zip *zip, const char *passphrase, const void *salt,
+    size_t salt_len)
+{
+	int i;
+
+	if (!aes_key_cache_matches(zip, passphrase))
+		return (NULL);
+	for (i = 0; i < zip->aes_keys_used; i++) {
+		if (zip->aes_keys[i].salt_len == salt_len &&
+		    memcmp(zip->aes_keys[i].salt, salt, salt_len) == 0)
+			return (zip->aes_keys[i].key);
+	}
+	return (NULL);
+}
+
+/*
+ * Add a key to the cache, replacing the oldest one when it is full.
+ * The keys of another passphrase are dropped first.
+ */
+static void
+aes_key_insert(struct zip *zip, const char *passphrase,
+    const struct aes_derived_key *dk)
+{
+	if (zip->aes_keys == NULL) {
+		zip->aes_keys = calloc(AES_KEY_CACHE_SIZE,
+		    sizeof(*zip->aes_keys));
+		if (zip->aes_keys == NULL)
+			return;/* Go on without a cache. */
+	}
+	if (!aes_key_cache_matches(zip, passphrase)) {
+		memset(zip->aes_keys, 0,
+		    AES_KEY_CACHE_SIZE * sizeof(*zip->aes_keys));
+		zip->aes_keys_used = zip->aes_keys_next = 0;
+		archive_strcpy(&zip->aes_passphrase, passphrase);
+	}
+	zip->aes_keys[zip->aes_keys_next] = *dk;
+	zip->aes_keys_next = (zip->aes_keys_next + 1) % AES_KEY_CACHE_SIZE;
+	if (zip->aes_keys_used < AES_KEY_CACHE_SIZE)
+		zip->aes_keys_used++;
+}
+
+struct aes_key_batch {
+	const char		*passphrase;
+	struct aes_derived_key	*keys;
+};
+
+static void
+aes_derive_key_job(void *arg, int job)
+{
+	struct aes_key_batch *batch = (struct aes_key_batch *)arg;
+	struct aes_derived_key *dk = &batch->keys[job];
+
+	/* The key length is twice the salt length. */
+	if (archive_pbkdf2_sha1(batch->passphrase, strlen(batch->passphrase),
+	    dk->salt, dk->salt_len, 1000, dk->key, dk->salt_len * 4 + 2) != 0)
+		dk->salt_len = 0;
+}
+
+/*
+ * Derive on the worker threads the key of the current entry, whose
+ * salt is at the read position, along with the keys of the AES
+ * entries that follow it.  Their salts are read from their local
+ * file headers, after which the read position is restored.
+ */
+static int
+aes_prefetch_keys(struct archive_read *a, const char *passphrase,
+    size_t salt_len)
+{
+	struct zip *zip = (struct zip *)(a->format->data);
+	struct aes_key_batch batch;
+	struct aes_derived_key *keys;
+	struct zip_entry *e;
+	const char *p;
+	int64_t offset;
+	size_t len, n;
+	int count, max, i;
+
+	if (zip->pool == NULL) {
+		zip->pool = __archive_thread_pool_new(zip->threads);
+		if (zip->pool == NULL) {
+			archive_set_error(&a->archive, ENOMEM,
+			    "Can't allocate worker threads");
+			return (ARCHIVE_FATAL);
+		}
+	}
+	max = zip->threads * AES_KEYS_PER_THREAD;
+	if (max > AES_KEY_CACHE_SIZE)
+		max = AES_KEY_CACHE_SIZE;
+	keys = calloc(max, sizeof(*keys));
+	if (keys == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate memory for AES keys");
+		return (ARCHIVE_FATAL);
+	}
+
+	if ((p = __archive_read_ahead(a, salt_len, NULL)) == NULL) {
+		/* Let the caller report the truncation. */
+		free(keys);
+		return (ARCHIVE_OK);
+	}
+	memcpy(keys[0].salt, p, salt_len);
+	keys[0].salt_len = salt_len;
+	count = 1;
+
+	offset = archive_filter_bytes(&a->archive, 0);
+	for (e = zip->entry; count < max;) {
+		e = (struct zip_entry *)__archive_rb_tree_iterate(
+		    &zip->tree, &e->node, ARCHIVE_RB_DIR_RIGHT);
+		if (e == NULL)
+			break;
+		if ((e->zip_flags & ZIP_ENCRYPTED) == 0 ||
+		    e->compression != WINZIP_AES_ENCRYPTION ||
+		    e->aes_extra.strength < 1 || e->aes_extra.strength > 3)
+			continue;
+		n = 4 + 4 * e->aes_extra.strength;
+		if (__archive_read_seek(a, e->local_header_offset,
+		    SEEK_SET) < 0)
+			break;
+		p = __archive_read_ahead(a, 30, NULL);
+		if (p == NULL || memcmp(p, "PK\003\004", 4) != 0)
+			break;
+		len = 30 + archive_le16dec(p + 26) + archive_le16dec(p + 28);
+		if ((p = __archive_read_ahead(a, len + n, NULL)) == NULL)
+			break;
+		if (aes_key_lookup(zip, passphrase, p + len, n) != NULL)
+			continue;
+		memcpy(keys[count].salt, p + len, n);
+		keys[count].salt_len = n;
+		count++;
+	}
+	if (__archive_read_seek(a, offset, SEEK_SET) < 0) {
+		free(keys);
+		return (ARCHIVE_FATAL);
+	}
+
+	batch.passphrase = passphrase;
+	batch.keys = keys;
+	__archive_thread_pool_run(zip->pool, aes_derive_key_job, &batch, count);
+	for (i = 0; i < count; i++) {
+		if (keys[i].salt_len != 0)
+			aes_key_insert(zip, passphrase, &keys[i]);
+	}
+	memset(keys, 0, max * sizeof(*keys));
+	free(keys);
+	return (ARCHIVE_OK);
+}
+
 static int
 init_WinZip_AES_decryption(struct archive_read *a)
 {
@@ -2878,6 +3073,7 @@ init_WinZip_AES_decryption(struct archive_read *a)
 
 	for (retry = 0;; retry++) {
 		const char *passphrase;
+		const uint8_t *cached;
 
 		passphrase = __archive_read_next_passphrase(a);
 		if (passphrase == NULL) {
@@ -2887,21 +3083,49 @@ init_WinZip_AES_decryption(struct archive_read *a)
 				"Passphrase required for this entry");
 			return (ARCHIVE_FAILED);
 		}
+		cached = aes_key_lookup(zip, passphrase, p, salt_len);
+		if (cached == NULL && zip->threads > 1 &&
+		    (zip->entry->flags & LA_FROM_CENTRAL_DIRECTORY) &&
+		    aes_key_cache_matches(zip, passphrase)) {
+			r = aes_prefetch_keys(a, passphrase, salt_len);
+			if (r != ARCHIVE_OK)
+				return (r);
+			p = __archive_read_ahead(a, salt_len + 2, NULL);
+			if (p == NULL)
+				goto truncated;
+			cached = aes_key_lookup(zip, passphrase, p, salt_len);
+		}
 		memset(derived_key, 0, sizeof(derived_key));
-		r = archive_pbkdf2_sha1(passphrase, strlen(passphrase),
-		    p, salt_len, 1000, derived_key, key_len * 2 + 2);
-		if (r != 0) {
-			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
-			    "Decryption is unsupported due to lack of "
-			    "crypto library");
-			return (ARCHIVE_FAILED);
+		if (cached != NULL)
+			memcpy(derived_key, cached, key_len * 2 + 2);
+		else {
+			r = archive_pbkdf2_sha1(passphrase, strlen(passphrase),
+			    p, salt_len, 1000, derived_key, key_len * 2 + 2);
+			if (r != 0) {
+				archive_set_error(&a->archive,
+				    ARCHIVE_ERRNO_MISC,
+				    "Decryption is unsupported due to lack of "
+				    "crypto library");
+				return (ARCHIVE_FAILED);
+			}
 		}
 
 		/* Check password verification value. */
 		pv = ((const uint8_t *)p) + salt_len;
 		if (derived_key[key_len * 2] == pv[0] &&
-		    derived_key[key_len * 2 + 1] == pv[1])
-			break;/* The passphrase is OK. */
+		    derived_key[key_len * 2 + 1] == pv[1]) {
+			/* The passphrase is OK. */
+			if (cached == NULL) {
+				struct aes_derived_key dk;
+
+				memcpy(dk.salt, p, salt_len);
+				dk.salt_len = salt_len;
+				memcpy(dk.key, derived_key, sizeof(dk.key));
+				aes_key_insert(zip, passphrase, &dk);
+				memset(&dk, 0, sizeof(dk));
+			}
+			break;
+		}
 		if (retry > 10000) {
 			/* Avoid infinity loop. */
 			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
@@ -3122,6 +3346,14 @@ archive_read_format_zip_cleanup(struct archive_read *a)
 		archive_decrypto_aes_ctr_release(&zip->cctx);
 	if (zip->hctx_valid)
 		archive_hmac_sha1_cleanup(&zip->hctx);
+	if (zip->aes_keys != NULL) {
+		memset(zip->aes_keys, 0,
+		    AES_KEY_CACHE_SIZE * sizeof(*zip->aes_keys));
+		free(zip->aes_keys);
+	}
+	archive_string_free(&zip->aes_passphrase);
+	if (zip->pool != NULL)
+		__archive_thread_pool_free(zip->pool);
 	free(zip->iv);
 	free(zip->erd);
 	free(zip->v_data);
@@ -3184,6 +3416,20 @@ archive_read_format_zip_options(struct archive_read *a,
 	} else if (strcmp(key, "mac-ext") == 0) {
 		zip->process_mac_extensions = (val != NULL && val[0] != 0);
 		return (ARCHIVE_OK);
+	} else if (strcmp(key, "threads") == 0) {
+		char *endptr;
+
+		if (val == NULL)
+			return (ARCHIVE_WARN);
+		errno = 0;
+		zip->threads = (int)strtoul(val, &endptr, 10);
+		if (errno != 0 || *endptr != '\0') {
+			zip->threads = 1;
+			return (ARCHIVE_WARN);
+		}
+		if (zip->threads == 0)
+			zip->threads = __archive_cpu_count();
+		return (ARCHIVE_OK);
 	}
 
 	/* Note: The "warn" return is just to inform the options
@@ -3712,6 +3958,22 @@ rsrc_basename(const char *name, size_t name_length)
 	return (r);
 }
 
+/*
+ * FNV-1a hash of a name, ignoring trailing slashes so that "dir" and
+ * "dir/" hash alike.
+ */
+static uint32_t
+name_hash(const char *name, size_t name_length)
+{
+	uint32_t h = 2166136261U;
+
+	while (name_length > 0 && name[name_length - 1] == '/')
+		name_length--;
+	while (name_length-- > 0)
+		h = (h ^ (unsigned char)*name++) * 16777619U;
+	return (h);
+}
+
 static void
 expose_parent_dirs(struct zip *zip, const char *name, size_t name_length)
 {
@@ -3895,6 +4157,7 @@ slurp_central_directory(struct archive_read *a, struct archive_entry* entry,
 		    extra_length, zip_entry)) {
 			return ARCHIVE_FATAL;
 		}
+		zip_entry->name_hash = name_hash(p, filename_length);
 
 		/*
 		 * Mac resource fork files are stored under the
@@ -4129,6 +4392,19 @@ exit_mac_metadata:
 	return (ret);
 }
 
+/* Whether `zip->entry' is one for this reader to return. */
+static int
+in_partition(struct zip *zip)
+{
+	if (zip->partition_index < 0)
+		return ((zip->entry->flags & LA_REPEATED_NAME) != 0);
+	if (zip->partition_count <= 1)
+		return (1);
+	return ((zip->entry->flags & LA_REPEATED_NAME) == 0 &&
+	    zip->entry_number % zip->partition_count ==
+	    zip->partition_index);
+}
+
 static int
 archive_read_format_zip_seekable_read_header(struct archive_read *a,
 	struct archive_entry *entry)
@@ -4161,10 +4437,17 @@ archive_read_format_zip_seekable_read_header(struct archive_read *a,
 		 * other entries in the archive file. */
 		zip->entry =
 		    (struct zip_entry *)ARCHIVE_RB_TREE_MIN(&zip->tree);
+		zip->entry_number = 0;
 	} else if (zip->entry != NULL) {
 		/* Get next entry in local header offset order. */
 		zip->entry = (struct zip_entry *)__archive_rb_tree_iterate(
 		    &zip->tree, &zip->entry->node, ARCHIVE_RB_DIR_RIGHT);
+		zip->entry_number++;
+	}
+	while (zip->entry != NULL && !in_partition(zip)) {
+		zip->entry = (struct zip_entry *)__archive_rb_tree_iterate(
+		    &zip->tree, &zip->entry->node, ARCHIVE_RB_DIR_RIGHT);
+		zip->entry_number++;
 	}
 
 	if (zip->entry == NULL)
@@ -4206,6 +4489,83 @@ archive_read_format_zip_seekable_read_header(struct archive_read *a,
 	return (ret);
 }
 
+/*
+ * Flag every entry whose name has come before in local header offset
+ * order.  Names are compared by hash only: an entry whose hash merely
+ * collides with an earlier one is flagged too, which costs nothing
+ * but parallelism.
+ */
+static int
+mark_repeated_names(struct zip *zip)
+{
+	struct zip_entry *e, **table;
+	size_t mask, i;
+
+	for (mask = 15; mask < 2 * zip->central_directory_entries_total;)
+		mask = mask * 2 + 1;
+	table = calloc(mask + 1, sizeof(*table));
+	if (table == NULL)
+		return (ARCHIVE_FATAL);
+	for (e = (struct zip_entry *)ARCHIVE_RB_TREE_MIN(&zip->tree);
+	    e != NULL; e = (struct zip_entry *)ARCHIVE_RB_TREE_NEXT(
+	    &zip->tree, &e->node)) {
+		for (i = e->name_hash & mask; table[i] != NULL;
+		    i = (i + 1) & mask) {
+			if (table[i]->name_hash == e->name_hash)
+				break;
+		}
+		if (table[i] != NULL) {
+			e->flags |= LA_REPEATED_NAME;
+			zip->has_repeats = 1;
+		} else
+			table[i] = e;
+	}
+	free(table);
+	zip->repeats_marked = 1;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Restrict a seekable Zip reader to the entries whose number in local
+ * header offset order is `index' modulo `count', so that `count'
+ * readers of the same file see disjoint sets of entries.  An entry
+ * whose name has come before is left out of every partition, so that
+ * no two readers write the same file; an `index' of -1 returns only
+ * those entries, for extraction in archive order once the partitions
+ * are done.  This takes effect from the next call to
+ * archive_read_next_header(); the first header must already have been
+ * read.  Returns ARCHIVE_WARN if the archive has repeated names.
+ */
+int
+__archive_read_zip_set_partition(struct archive *_a, int index, int count)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+	struct zip *zip;
+
+	if (_a->magic != ARCHIVE_READ_MAGIC || a->format == NULL ||
+	    a->format->read_header !=
+	    archive_read_format_zip_seekable_read_header)
+		return (ARCHIVE_FAILED);
+	zip = (struct zip *)a->format->data;
+	if (zip->zip_entries == NULL || count < 1 || index < -1 ||
+	    index >= count)
+		return (ARCHIVE_FAILED);
+	if (!zip->repeats_marked && mark_repeated_names(zip) != ARCHIVE_OK)
+		return (ARCHIVE_FAILED);
+	zip->partition_index = index;
+	zip->partition_count = count;
+	return (zip->has_repeats ? ARCHIVE_WARN : ARCHIVE_OK);
+}
+
+/* The number of the current entry in local header offset order. */
+int64_t
+__archive_read_zip_entry_number(struct archive *_a)
+{
+	struct archive_read *a = (struct archive_read *)_a;
+
+	return (((struct zip *)a->format->data)->entry_number);
+}
+
 /*
  * We're going to seek for the next header anyway, so we don't
  * need to bother doing anything here.
@@ -0,0 +1,334 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_stats_private.h"
+
+struct archive_stats_stage {
+	char		*name;
+	int64_t		 calls;
+	int64_t		 bytes;
+	int64_t		 wall_nsec;
+	int64_t		 cpu_nsec;
+};
+
+struct archive_stats {
+	struct archive_stats_stage *stages;
+	int		 count;
+	int		 allocated;
+	/* Stage number + 1 of the fixed stages, or 0 if unused yet. */
+	int		 fixed[ARCHIVE_STATS_FIXED];
+	/* Stage number + 1 of the stage being timed; 0 for none. */
+	int		 current;
+	int64_t		 wall_mark;
+	int64_t		 cpu_mark;
+};
+
+static const char *fixed_names[ARCHIVE_STATS_FIXED] = {
+	"client",
+	"format",
+	"charset",
+	"disk:create",
+	"disk:write",
+	"disk:metadata",
+};
+
+/*
+ * Read the wall clock and the CPU time of the calling thread.
+ */
+static void
+stats_clock(int64_t *wall, int64_t *cpu)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	FILETIME c, e, k, u;
+
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	*wall = (int64_t)((double)count.QuadPart * 1e9 / freq.QuadPart);
+	*cpu = 0;
+	if (GetThreadTimes(GetCurrentThread(), &c, &e, &k, &u)) {
+		/* FILETIME counts 100ns units. */
+		*cpu = ((((int64_t)k.dwHighDateTime << 32) | k.dwLowDateTime)
+		    + (((int64_t)u.dwHighDateTime << 32) | u.dwLowDateTime))
+		    * 100;
+	}
+#else
+#if defined(CLOCK_MONOTONIC) || defined(CLOCK_THREAD_CPUTIME_ID)
+	struct timespec ts;
+#endif
+
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	*wall = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	*wall = (int64_t)time(NULL) * 1000000000;
+#endif
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	*cpu = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	*cpu = (int64_t)clock() * (1000000000 / CLOCKS_PER_SEC);
+#endif
+#endif
+}
+
+/*
+ * Charge the time since the last mark to the current stage.
+ */
+static void
+stats_charge(struct archive_stats *st)
+{
+	struct archive_stats_stage *s;
+	int64_t wall, cpu;
+
+	stats_clock(&wall, &cpu);
+	if (st->current > 0) {
+		s = &st->stages[st->current - 1];
+		s->wall_nsec += wall - st->wall_mark;
+		s->cpu_nsec += cpu - st->cpu_mark;
+	}
+	st->wall_mark = wall;
+	st->cpu_mark = cpu;
+}
+
+/*
+ * Add a stage; returns its number + 1, or 0 if out of memory.
+ */
+static int
+stats_add(struct archive_stats *st, const char *prefix, const char *name)
+{
+	struct archive_stats_stage *s;
+	size_t len;
+
+	if (st->count == st->allocated) {
+		int n = st->allocated ? st->allocated * 2 : 8;
+
+		s = realloc(st->stages, n * sizeof(*s));
+		if (s == NULL)
+			return (0);
+		st->stages = s;
+		st->allocated = n;
+	}
+	if (name == NULL)
+		name = "";
+	len = strlen(prefix) + strlen(name) + 1;
+	s = &st->stages[st->count];
+	memset(s, 0, sizeof(*s));
+	if ((s->name = malloc(len)) == NULL)
+		return (0);
+	strcpy(s->name, prefix);
+	strcat(s->name, name);
+	return (++st->count);
+}
+
+static int
+stats_enter(struct archive_stats *st, int stage)
+{
+	int prev;
+
+	stats_charge(st);
+	prev = st->current;
+	st->current = stage;
+	if (stage > 0)
+		st->stages[stage - 1].calls++;
+	return (prev);
+}
+
+int
+__archive_stats_enter(struct archive *a, int stage)
+{
+	struct archive_stats *st = a->stats;
+
+	if (st->fixed[stage] == 0)
+		st->fixed[stage] = stats_add(st, "", fixed_names[stage]);
+	return (stats_enter(st, st->fixed[stage]));
+}
+
+int
+__archive_stats_enter_filter(struct archive *a, int *stage,
+    const char *name)
+{
+	struct archive_stats *st = a->stats;
+
+	if (*stage == 0)
+		*stage = stats_add(st, "filter:", name);
+	return (stats_enter(st, *stage));
+}
+
+void
+__archive_stats_leave(struct archive *a, int prev, int64_t bytes)
+{
+	struct archive_stats *st = a->stats;
+
+	stats_charge(st);
+	if (st->current > 0 && bytes > 0)
+		st->stages[st->current - 1].bytes += bytes;
+	st->current = prev;
+}
+
+void
+__archive_stats_free(struct archive *a)
+{
+	struct archive_stats *st = a->stats;
+	int i;
+
+	if (st == NULL)
+		return;
+	for (i = 0; i < st->count; i++)
+		free(st->stages[i].name);
+	free(st->stages);
+	free(st);
+	a->stats = NULL;
+}
+
+/*
+ * Add the statistics of `src' to those of `dst', matching stages by
+ * name; for stages run on several threads the times add up.
+ */
+void
+__archive_stats_merge(struct archive *dst, struct archive *src)
+{
+	struct archive_stats *st = dst->stats;
+	struct archive_stats_stage *from, *to;
+	int i, j, n;
+
+	if (st == NULL || src->stats == NULL)
+		return;
+	for (i = 0; i < src->stats->count; i++) {
+		from = &src->stats->stages[i];
+		for (j = 0; j < st->count; j++)
+			if (strcmp(st->stages[j].name, from->name) == 0)
+				break;
+		if (j == st->count) {
+			if ((n = stats_add(st, "", from->name)) == 0)
+				return;
+			for (j = 0; j < ARCHIVE_STATS_FIXED; j++)
+				if (strcmp(fixed_names[j], from->name) == 0)
+					st->fixed[j] = n;
+			j = n - 1;
+		}
+		to = &st->stages[j];
+		to->calls += from->calls;
+		to->bytes += from->bytes;
+		to->wall_nsec += from->wall_nsec;
+		to->cpu_nsec += from->cpu_nsec;
+	}
+}
+
+int
+archive_stats_enable(struct archive *a)
+{
+	if (a->magic != ARCHIVE_READ_MAGIC &&
+	    a->magic != ARCHIVE_WRITE_MAGIC &&
+	    a->magic != ARCHIVE_WRITE_DISK_MAGIC) {
+		archive_set_error(a, ARCHIVE_ERRNO_PROGRAMMER,
+		    "Statistics are not supported by this archive object");
+		return (ARCHIVE_FATAL);
+	}
+	if (a->stats != NULL)
+		return (ARCHIVE_OK);
+	a->stats = calloc(1, sizeof(*a->stats));
+	if (a->stats == NULL) {
+		archive_set_error(a, ENOMEM, "Can't allocate statistics");
+		return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
+int
+archive_stats_count(struct archive *a)
+{
+	return (a->stats != NULL ? a->stats->count : 0);
+}
+
+static struct archive_stats_stage *
+stats_lookup(struct archive *a, int n)
+{
+	if (a->stats == NULL || n < 0 || n >= a->stats->count)
+		return (NULL);
+	return (&a->stats->stages[n]);
+}
+
+const char *
+archive_stats_name(struct archive *a, int n)
+{
+	struct archive_stats_stage *s = stats_lookup(a, n);
+
+	return (s != NULL ? s->name : NULL);
+}
+
+la_int64_t
+archive_stats_calls(struct archive *a, int n)
+{
+	struct archive_stats_stage *s = stats_lookup(a, n);
+
+	return (s != NULL ? s->calls : -1);
+}
+
+la_int64_t
+archive_stats_bytes(struct archive *a, int n)
+{
+	struct archive_stats_stage *s = stats_lookup(a, n);
+
+	return (s != NULL ? s->bytes : -1);
+}
+
+la_int64_t
+archive_stats_wall_nsec(struct archive *a, int n)
+{
+	struct archive_stats_stage *s = stats_lookup(a, n);
+
+	return (s != NULL ? s->wall_nsec : -1);
+}
+
+la_int64_t
+archive_stats_cpu_nsec(struct archive *a, int n)
+{
+	struct archive_stats_stage *s = stats_lookup(a, n);
+
+	return (s != NULL ? s->cpu_nsec : -1);
+}
@@ -0,0 +1,71 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ARCHIVE_STATS_PRIVATE_H_INCLUDED
+#define ARCHIVE_STATS_PRIVATE_H_INCLUDED
+
+#ifndef __LIBARCHIVE_BUILD
+#error This header is only to be used internally to libarchive.
+#endif
+
+/*
+ * Per-stage statistics, collected once archive_stats_enable() has
+ * been called.  Code that hands control to a stage brackets the call
+ *
+ *	if (a->stats != NULL)
+ *		prev = __archive_stats_enter(a, ARCHIVE_STATS_CLIENT);
+ *	...
+ *	if (a->stats != NULL)
+ *		__archive_stats_leave(a, prev, bytes);
+ *
+ * so that the cost is a single test when statistics are disabled.
+ * Stages nest; time is charged to the innermost one, so that every
+ * stage reports only its own time.
+ */
+
+/* The stages every archive may have; filters register their own. */
+#define ARCHIVE_STATS_CLIENT		0
+#define ARCHIVE_STATS_FORMAT		1
+#define ARCHIVE_STATS_CHARSET		2
+#define ARCHIVE_STATS_DISK_CREATE	3
+#define ARCHIVE_STATS_DISK_WRITE	4
+#define ARCHIVE_STATS_DISK_METADATA	5
+#define ARCHIVE_STATS_FIXED		6
+
+/* Enter a stage; returns the stage that was current. */
+int	__archive_stats_enter(struct archive *, int stage);
+/* Enter the stage of a filter, which is remembered in *stage; that
+ * must be zero before the first call. */
+int	__archive_stats_enter_filter(struct archive *, int *stage,
+	    const char *name);
+/* Leave the current stage, which has handled `bytes' bytes, and go
+ * back to `prev'. */
+void	__archive_stats_leave(struct archive *, int prev, int64_t bytes);
+void	__archive_stats_free(struct archive *);
+/* Add the statistics of another object, such as a clone used on
+ * another thread. */
+void	__archive_stats_merge(struct archive *dst, struct archive *src);
+
+#endif /* ARCHIVE_STATS_PRIVATE_H_INCLUDED */
@@ -64,6 +64,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_string.c 201095 2009-12-28 02:33
 
 #include "archive_endian.h"
 #include "archive_private.h"
+#include "archive_stats_private.h"
 #include "archive_string.h"
 #include "archive_string_composition.h"
 
@@ -80,6 +81,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_string.c 201095 2009-12-28 02:33
 
 struct archive_string_conv {
 	struct archive_string_conv	*next;
+	struct archive			*archive; /* Owner, for statistics. */
 	char				*from_charset;
 	char				*to_charset;
 	unsigned			 from_cp;
@@ -199,6 +201,8 @@ static int archive_string_normalize_D(struct archive_string *, const void *,
     size_t, struct archive_string_conv *);
 static int archive_string_append_unicode(struct archive_string *,
     const void *, size_t, struct archive_string_conv *);
+static int strncat_l_convert(struct archive_string *, const void *,
+    size_t, struct archive_string_conv *);
 
 static struct archive_string *
 archive_string_append(struct archive_string *as, const char *p, size_t s)
@@ -892,6 +896,7 @@ add_sconv_object(struct archive *a, struct archive_string_conv *sc)
 	while (*psc != NULL)
 		psc = &((*psc)->next);
 	*psc = sc;
+	sc->archive = a;
 }
 
 static void
@@ -1959,9 +1964,8 @@ int
 archive_strncat_l(struct archive_string *as, const void *_p, size_t n,
     struct archive_string_conv *sc)
 {
-	const void *s;
 	size_t length = 0;
-	int i, r = 0, r2;
+	int prev, r;
 
 	if (_p != NULL && n > 0) {
 		if (sc != NULL && (sc->flag & SCONV_FROM_UTF16))
@@ -1993,8 +1997,20 @@ archive_strncat_l(struct archive_string *as, const void *_p, size_t n,
 		return (0);
 	}
 
-	s = _p;
-	i = 0;
+	if (sc->archive == NULL || sc->archive->stats == NULL)
+		return (strncat_l_convert(as, _p, length, sc));
+	prev = __archive_stats_enter(sc->archive, ARCHIVE_STATS_CHARSET);
+	r = strncat_l_convert(as, _p, length, sc);
+	__archive_stats_leave(sc->archive, prev, length);
+	return (r);
+}
+
+static int
+strncat_l_convert(struct archive_string *as, const void *s, size_t length,
+    struct archive_string_conv *sc)
+{
+	int i = 0, r = 0, r2;
+
 	if (sc->nconverter > 1) {
 		sc->utftmp.length = 0;
 		r2 = sc->converter[0](&(sc->utftmp), s, length, sc);
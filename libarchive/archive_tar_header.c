@@ -0,0 +1,353 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+/*
+ * SSE2 is part of x86-64, so it needs no check.  GCC and Clang can
+ * also build functions for later instruction sets, to be chosen once
+ * the processor has been asked what it supports.  NEON is part of
+ * AArch64.
+ */
+#if defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64)
+#define TAR_HEADER_SSE2	1
+#include <emmintrin.h>
+#if (defined(__clang__) && __clang_major__ >= 4) || \
+    (defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 5)
+#define TAR_HEADER_X86_RUNTIME	1
+#include <immintrin.h>
+#endif
+#elif defined(__aarch64__)
+#define TAR_HEADER_NEON	1
+#include <arm_neon.h>
+#endif
+
+#include "archive_endian.h"
+#include "archive_private.h"
+#include "archive_tar_header_private.h"
+
+static void (*header_sum_impl)(const unsigned char *, int *, int *);
+static int64_t (*atol8_impl)(const char *, size_t);
+
+#if defined(TAR_HEADER_X86_RUNTIME) || defined(TAR_HEADER_NEON)
+/*
+ * Shuffle indices that move the first n bytes of a vector to its end,
+ * shifting zeros in: load 16 bytes starting at align_digits[n].
+ */
+static const unsigned char align_digits[32] = {
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+#endif
+
+/*
+ * Portable version: eight bytes at a time, each 64-bit word split
+ * into four 16-bit lanes of even and odd bytes, which cannot overflow
+ * over a single block.
+ */
+static void
+header_sum_generic(const unsigned char *p, int *sum, int *high)
+{
+	const uint64_t lo = ARCHIVE_LITERAL_ULL(0x00ff00ff00ff00ff);
+	const uint64_t msb = ARCHIVE_LITERAL_ULL(0x0101010101010101);
+	uint64_t w, acc = 0, hacc = 0;
+	int i;
+
+	for (i = 0; i < 512; i += 8) {
+		memcpy(&w, p + i, sizeof(w));
+		acc += (w & lo) + ((w >> 8) & lo);
+		hacc += (w >> 7) & msb;
+	}
+	hacc = (hacc & lo) + ((hacc >> 8) & lo);
+	*sum = (int)((acc & 0xffff) + ((acc >> 16) & 0xffff) +
+	    ((acc >> 32) & 0xffff) + (acc >> 48));
+	*high = (int)((hacc & 0xffff) + ((hacc >> 16) & 0xffff) +
+	    ((hacc >> 32) & 0xffff) + (hacc >> 48));
+}
+
+static int64_t
+atol8_generic(const char *p, size_t len)
+{
+	int64_t l = 0;
+
+	while (len-- > 0 && *p >= '0' && *p <= '7')
+		l = (l << 3) | (*p++ - '0');
+	return (l);
+}
+
+#ifdef TAR_HEADER_SSE2
+static void
+header_sum_sse2(const unsigned char *p, int *sum, int *high)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero, hacc = zero, v;
+	int i;
+
+	for (i = 0; i < 512; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(p + i));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+		/* Bytes that are negative when signed count -1. */
+		hacc = _mm_sub_epi8(hacc, _mm_cmplt_epi8(v, zero));
+	}
+	hacc = _mm_sad_epu8(hacc, zero);
+	*sum = _mm_cvtsi128_si32(acc) +
+	    _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+	*high = _mm_cvtsi128_si32(hacc) +
+	    _mm_cvtsi128_si32(_mm_srli_si128(hacc, 8));
+}
+#endif
+
+#ifdef TAR_HEADER_X86_RUNTIME
+__attribute__((target("avx2")))
+static void
+header_sum_avx2(const unsigned char *p, int *sum, int *high)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = zero, hacc = zero, v;
+	__m128i s, h;
+	int i;
+
+	for (i = 0; i < 512; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(p + i));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+		hacc = _mm256_sub_epi8(hacc, _mm256_cmpgt_epi8(zero, v));
+	}
+	hacc = _mm256_sad_epu8(hacc, zero);
+	s = _mm_add_epi64(_mm256_castsi256_si128(acc),
+	    _mm256_extracti128_si256(acc, 1));
+	h = _mm_add_epi64(_mm256_castsi256_si128(hacc),
+	    _mm256_extracti128_si256(hacc, 1));
+	*sum = _mm_cvtsi128_si32(s) + _mm_cvtsi128_si32(_mm_srli_si128(s, 8));
+	*high = _mm_cvtsi128_si32(h) + _mm_cvtsi128_si32(_mm_srli_si128(h, 8));
+}
+
+/*
+ * Find the run of octal digits at the start of the field, move it to
+ * the end of the vector, then combine neighbouring digits with
+ * multiply-adds: pairs into 16-bit lanes, quads into 32-bit lanes.
+ */
+__attribute__((target("ssse3")))
+static int64_t
+atol8_ssse3(const char *p, size_t len)
+{
+	char buff[16];
+	__m128i d;
+	unsigned mask;
+	uint32_t a, b, c, e;
+
+	memset(buff, 0, sizeof(buff));
+	memcpy(buff, p, len);
+	d = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)buff),
+	    _mm_set1_epi8('0'));
+	mask = (unsigned)_mm_movemask_epi8(
+	    _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(7)), d));
+	/* The zero padding isn't a digit, so this stops by len. */
+	d = _mm_shuffle_epi8(d, _mm_loadu_si128(
+	    (const __m128i *)(align_digits + __builtin_ctz(~mask))));
+	d = _mm_maddubs_epi16(d, _mm_set1_epi16(0x0108));
+	d = _mm_madd_epi16(d, _mm_set1_epi32(0x00010040));
+	a = (uint32_t)_mm_cvtsi128_si32(d);
+	b = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(d, 4));
+	c = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(d, 8));
+	e = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(d, 12));
+	return (((int64_t)(a * 4096 + b) << 24) | (c * 4096 + e));
+}
+#endif
+
+#ifdef TAR_HEADER_NEON
+static void
+header_sum_neon(const unsigned char *p, int *sum, int *high)
+{
+	uint32x4_t acc = vdupq_n_u32(0);
+	uint8x16_t hacc = vdupq_n_u8(0), v;
+	int i;
+
+	for (i = 0; i < 512; i += 16) {
+		v = vld1q_u8(p + i);
+		acc = vpadalq_u16(acc, vpaddlq_u8(v));
+		hacc = vsraq_n_u8(hacc, v, 7);
+	}
+	*sum = (int)vaddvq_u32(acc);
+	*high = (int)vaddlvq_u8(hacc);
+}
+
+/* The same steps as atol8_ssse3(). */
+static int64_t
+atol8_neon(const char *p, size_t len)
+{
+	uint8_t buff[16];
+	uint8x16_t d;
+	uint16x8_t w;
+	uint32x4_t x;
+	uint64_t mask;
+	int n;
+
+	memset(buff, 0, sizeof(buff));
+	memcpy(buff, p, len);
+	d = vsubq_u8(vld1q_u8(buff), vdupq_n_u8('0'));
+	/* Four bits of mask for each byte that holds a digit. */
+	mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(
+	    vreinterpretq_u16_u8(vcleq_u8(d, vdupq_n_u8(7))), 4)), 0);
+	n = (~mask == 0) ? 16 : __builtin_ctzll(~mask) / 4;
+	d = vqtbl1q_u8(d, vld1q_u8(align_digits + n));
+	w = vreinterpretq_u16_u8(d);
+	w = vmlaq_n_u16(vshrq_n_u16(w, 8), vandq_u16(w, vdupq_n_u16(0xff)), 8);
+	x = vreinterpretq_u32_u16(w);
+	x = vmlaq_n_u32(vshrq_n_u32(x, 16),
+	    vandq_u32(x, vdupq_n_u32(0xffff)), 64);
+	return (((int64_t)(vgetq_lane_u32(x, 0) * 4096 +
+	    vgetq_lane_u32(x, 1)) << 24) |
+	    (vgetq_lane_u32(x, 2) * 4096 + vgetq_lane_u32(x, 3)));
+}
+#endif
+
+/*
+ * Pick the implementations for this processor.  Every value the
+ * pointers take on the way is usable, so it does no harm if two
+ * threads get here at once.
+ */
+static void
+select_impl(void)
+{
+	atol8_impl = atol8_generic;
+	header_sum_impl = header_sum_generic;
+#ifdef TAR_HEADER_SSE2
+	header_sum_impl = header_sum_sse2;
+#endif
+#ifdef TAR_HEADER_X86_RUNTIME
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		atol8_impl = atol8_ssse3;
+	if (__builtin_cpu_supports("avx2"))
+		header_sum_impl = header_sum_avx2;
+#endif
+#ifdef TAR_HEADER_NEON
+	atol8_impl = atol8_neon;
+	header_sum_impl = header_sum_neon;
+#endif
+}
+
+void
+__archive_tar_header_sum(const void *h, int *sum, int *high)
+{
+	if (header_sum_impl == NULL)
+		select_impl();
+	header_sum_impl((const unsigned char *)h, sum, high);
+}
+
+int64_t
+__archive_tar_atol8(const char *p, size_t char_cnt)
+{
+	int64_t l, limit, last_digit_limit;
+	int digit, sign;
+
+	while (char_cnt != 0 && (*p == ' ' || *p == '\t')) {
+		p++;
+		char_cnt--;
+	}
+
+	/* Sixteen octal digits can't overflow. */
+	if (char_cnt != 0 && char_cnt <= 16 && *p != '-') {
+		if (atol8_impl == NULL)
+			select_impl();
+		return (atol8_impl(p, char_cnt));
+	}
+
+	limit = INT64_MAX / 8;
+	last_digit_limit = INT64_MAX % 8;
+	sign = 1;
+	if (char_cnt != 0 && *p == '-') {
+		sign = -1;
+		p++;
+		char_cnt--;
+		limit = -(INT64_MIN / 8);
+		last_digit_limit = -(INT64_MIN % 8);
+	}
+
+	l = 0;
+	while (char_cnt != 0) {
+		digit = *p - '0';
+		if (digit < 0 || digit > 7)
+			break;
+		if (l > limit || (l == limit && digit >= last_digit_limit))
+			return (sign < 0 ? INT64_MIN : INT64_MAX);
+		l = (l * 8) + digit;
+		p++;
+		char_cnt--;
+	}
+	return (sign < 0 ? -l : l);
+}
+
+/*
+ * Spread the low 24 bits of x into eight octal digits, one per byte,
+ * least significant digit in the lowest byte.
+ */
+static uint64_t
+octal_digits8(uint32_t x)
+{
+	uint64_t w;
+
+	w = (x & 0xfff) | ((uint64_t)((x >> 12) & 0xfff) << 32);
+	w = (w & ARCHIVE_LITERAL_ULL(0x0000003f0000003f)) |
+	    ((w & ARCHIVE_LITERAL_ULL(0x00000fc000000fc0)) << 10);
+	w = (w & ARCHIVE_LITERAL_ULL(0x0007000700070007)) |
+	    ((w & ARCHIVE_LITERAL_ULL(0x0038003800380038)) << 5);
+	return (w + ARCHIVE_LITERAL_ULL(0x3030303030303030));
+}
+
+int
+__archive_tar_format_octal(int64_t v, char *p, int s)
+{
+	unsigned char buff[16];
+	int len = s;
+
+	if (s <= 16) {
+		if ((v >> (3 * s)) == 0) {
+			archive_be64enc(buff, octal_digits8((uint32_t)(v >> 24)));
+			archive_be64enc(buff + 8, octal_digits8((uint32_t)v));
+			memcpy(p, buff + 16 - s, s);
+			return (0);
+		}
+	} else {
+		p += s;		/* Start at the end and work backwards. */
+		while (s-- > 0) {
+			*--p = (char)('0' + (v & 7));
+			v >>= 3;
+		}
+		if (v == 0)
+			return (0);
+	}
+
+	/* If it overflowed, fill field with max value. */
+	while (len-- > 0)
+		*p++ = '7';
+	return (-1);
+}
@@ -0,0 +1,60 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ARCHIVE_TAR_HEADER_PRIVATE_H_INCLUDED
+#define ARCHIVE_TAR_HEADER_PRIVATE_H_INCLUDED
+
+#if !defined(__LIBARCHIVE_BUILD) && !defined(__LIBARCHIVE_TEST)
+#error This header is only to be used internally to libarchive.
+#endif
+
+/*
+ * Numeric work on 512-byte tar header blocks, shared by the tar
+ * readers and writers.  Where the processor has vector instructions
+ * for it, the fastest available implementation is picked the first
+ * time one of these is called.
+ */
+
+/*
+ * Sum the bytes of a 512-byte block as unsigned values, and count the
+ * bytes that have the high bit set, for the signed sum some old tar
+ * programs wrote.
+ */
+void	__archive_tar_header_sum(const void *, int *sum, int *high);
+
+/*
+ * Parse an octal field the way tar does: leading blanks are skipped
+ * and the number ends at the first non-octal character or at the end
+ * of the field.  Overflow returns INT64_MAX (INT64_MIN if negative).
+ */
+int64_t	__archive_tar_atol8(const char *, size_t);
+
+/*
+ * Format a non-negative value as exactly `s' octal digits.  If it
+ * doesn't fit, the field is filled with 7s and -1 is returned.
+ */
+int	__archive_tar_format_octal(int64_t, char *, int s);
+
+#endif /* ARCHIVE_TAR_HEADER_PRIVATE_H_INCLUDED */
@@ -0,0 +1,288 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "archive.h"
+#include "archive_private.h"
+#include "archive_tar_index_private.h"
+
+static int
+cmp_node(const struct archive_rb_node *n1, const struct archive_rb_node *n2)
+{
+	const struct archive_tar_index_entry *e1 =
+	    (const struct archive_tar_index_entry *)n1;
+	const struct archive_tar_index_entry *e2 =
+	    (const struct archive_tar_index_entry *)n2;
+
+	return (strcmp(e2->pathname, e1->pathname));
+}
+
+static int
+cmp_key(const struct archive_rb_node *n, const void *key)
+{
+	const struct archive_tar_index_entry *e =
+	    (const struct archive_tar_index_entry *)n;
+
+	return (strcmp((const char *)key, e->pathname));
+}
+
+void
+__archive_tar_index_init(struct archive_tar_index *idx)
+{
+	static const struct archive_rb_tree_ops rb_ops = {
+		cmp_node, cmp_key
+	};
+
+	memset(idx, 0, sizeof(*idx));
+	__archive_rb_tree_init(&idx->tree, &rb_ops);
+}
+
+void
+__archive_tar_index_free(struct archive_tar_index *idx)
+{
+	size_t i;
+
+	for (i = 0; i < idx->count; i++) {
+		free(idx->entries[i]->pathname);
+		free(idx->entries[i]->sparse);
+		free(idx->entries[i]);
+	}
+	free(idx->entries);
+	archive_string_free(&idx->line);
+	__archive_tar_index_init(idx);
+}
+
+int
+__archive_tar_index_add(struct archive_tar_index *idx, const char *path,
+    int64_t header_offset, int64_t data_offset, int64_t size,
+    int sparse_count, const int64_t *sparse)
+{
+	struct archive_tar_index_entry *e;
+	struct archive_rb_node *old;
+
+	if (idx->count >= idx->allocated) {
+		struct archive_tar_index_entry **p;
+		size_t n = idx->allocated < 64 ? 64 : idx->allocated * 2;
+
+		p = realloc(idx->entries, n * sizeof(*p));
+		if (p == NULL)
+			goto nomem;
+		idx->entries = p;
+		idx->allocated = n;
+	}
+	e = calloc(1, sizeof(*e));
+	if (e == NULL)
+		goto nomem;
+	e->pathname = strdup(path);
+	if (sparse_count > 0)
+		e->sparse = malloc(sparse_count * 2 * sizeof(e->sparse[0]));
+	if (e->pathname == NULL || (sparse_count > 0 && e->sparse == NULL)) {
+		free(e->pathname);
+		free(e);
+		goto nomem;
+	}
+	if (sparse_count > 0)
+		memcpy(e->sparse, sparse,
+		    sparse_count * 2 * sizeof(e->sparse[0]));
+	e->header_offset = header_offset;
+	e->data_offset = data_offset;
+	e->size = size;
+	e->sparse_count = sparse_count;
+
+	old = __archive_rb_tree_find_node(&idx->tree, path);
+	if (old != NULL)
+		__archive_rb_tree_remove_node(&idx->tree, old);
+	__archive_rb_tree_insert_node(&idx->tree, &e->node);
+	idx->entries[idx->count++] = e;
+	return (ARCHIVE_OK);
+nomem:
+	errno = ENOMEM;
+	return (ARCHIVE_FATAL);
+}
+
+const struct archive_tar_index_entry *
+__archive_tar_index_find(struct archive_tar_index *idx, const char *path)
+{
+	return ((const struct archive_tar_index_entry *)
+	    __archive_rb_tree_find_node(&idx->tree, path));
+}
+
+/*
+ * Append the index line for one member to `as'.
+ */
+void
+__archive_tar_index_format(struct archive_string *as,
+    const struct archive_tar_index_entry *e)
+{
+	const char *p;
+	int i;
+
+	archive_string_sprintf(as, "%jd %jd %jd %d",
+	    (intmax_t)e->header_offset, (intmax_t)e->data_offset,
+	    (intmax_t)e->size, e->sparse_count);
+	for (i = 0; i < e->sparse_count; i++)
+		archive_string_sprintf(as, " %jd %jd",
+		    (intmax_t)e->sparse[i * 2], (intmax_t)e->sparse[i * 2 + 1]);
+	archive_strappend_char(as, ' ');
+	for (p = e->pathname; *p != '\0'; p++) {
+		if (*p == '\\')
+			archive_strcat(as, "\\\\");
+		else if (*p == '\n')
+			archive_strcat(as, "\\n");
+		else
+			archive_strappend_char(as, *p);
+	}
+	archive_strappend_char(as, '\n');
+}
+
+/*
+ * Parse a non-negative decimal number followed by a space.
+ */
+static int
+parse_number(const char **pp, const char *end, int64_t *v)
+{
+	const char *p = *pp;
+	int64_t n = 0;
+
+	if (p >= end || *p < '0' || *p > '9')
+		return (-1);
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (n > (INT64_MAX - (*p - '0')) / 10)
+			return (-1);
+		n = n * 10 + (*p++ - '0');
+	}
+	if (p >= end || *p != ' ')
+		return (-1);
+	*pp = p + 1;
+	*v = n;
+	return (0);
+}
+
+static int
+parse_line(struct archive_tar_index *idx, const char *p, const char *end)
+{
+	struct archive_string path;
+	int64_t header_offset, data_offset, size, n;
+	int64_t *sparse = NULL;
+	int i, r;
+
+	/* Skip blank lines and comments such as the magic line. */
+	if (p == end || *p == '#')
+		return (ARCHIVE_OK);
+	if (parse_number(&p, end, &header_offset) != 0 ||
+	    parse_number(&p, end, &data_offset) != 0 ||
+	    parse_number(&p, end, &size) != 0 ||
+	    parse_number(&p, end, &n) != 0 ||
+	    n > (end - p) / 4)
+		return (ARCHIVE_FAILED);
+	if (n > 0) {
+		sparse = malloc((size_t)n * 2 * sizeof(sparse[0]));
+		if (sparse == NULL) {
+			errno = ENOMEM;
+			return (ARCHIVE_FATAL);
+		}
+		for (i = 0; i < n * 2; i++) {
+			if (parse_number(&p, end, &sparse[i]) != 0) {
+				free(sparse);
+				return (ARCHIVE_FAILED);
+			}
+		}
+	}
+	archive_string_init(&path);
+	for (; p < end; p++) {
+		if (*p != '\\')
+			archive_strappend_char(&path, *p);
+		else if (p + 1 < end && p[1] == 'n') {
+			archive_strappend_char(&path, '\n');
+			p++;
+		} else if (p + 1 < end && p[1] == '\\') {
+			archive_strappend_char(&path, '\\');
+			p++;
+		} else {
+			free(sparse);
+			archive_string_free(&path);
+			return (ARCHIVE_FAILED);
+		}
+	}
+	if (archive_strlen(&path) == 0 ||
+	    strlen(path.s) != archive_strlen(&path))
+		r = ARCHIVE_FAILED;
+	else
+		r = __archive_tar_index_add(idx, path.s, header_offset,
+		    data_offset, size, (int)n, sparse);
+	free(sparse);
+	archive_string_free(&path);
+	return (r);
+}
+
+/*
+ * Add the members described by a piece of index text.  The text may
+ * be split anywhere; an incomplete last line is kept until the next
+ * call, or parsed as it is when `final' is set.
+ */
+int
+__archive_tar_index_parse(struct archive_tar_index *idx,
+    const char *p, size_t len, int final)
+{
+	const char *end = p + len, *nl;
+	int r;
+
+	while (p < end) {
+		nl = memchr(p, '\n', end - p);
+		if (nl == NULL) {
+			archive_strncat(&idx->line, p, end - p);
+			break;
+		}
+		if (archive_strlen(&idx->line) > 0) {
+			archive_strncat(&idx->line, p, nl - p);
+			r = parse_line(idx, idx->line.s,
+			    idx->line.s + archive_strlen(&idx->line));
+			archive_string_empty(&idx->line);
+		} else
+			r = parse_line(idx, p, nl);
+		if (r != ARCHIVE_OK)
+			return (r);
+		p = nl + 1;
+	}
+	if (final && archive_strlen(&idx->line) > 0) {
+		r = parse_line(idx, idx->line.s,
+		    idx->line.s + archive_strlen(&idx->line));
+		archive_string_empty(&idx->line);
+		return (r);
+	}
+	return (ARCHIVE_OK);
+}
@@ -0,0 +1,93 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ARCHIVE_TAR_INDEX_PRIVATE_H_INCLUDED
+#define ARCHIVE_TAR_INDEX_PRIVATE_H_INCLUDED
+
+#ifndef __LIBARCHIVE_BUILD
+#error This header is only to be used internally to libarchive.
+#endif
+
+#include "archive_rb.h"
+#include "archive_string.h"
+
+/*
+ * An index of tar members, shared by the tar reader and the pax writer.
+ *
+ * Each member is one line of text:
+ *
+ *   <header offset> <data offset> <size> <n> [<offset> <length>]... <path>
+ *
+ * Offsets are in the uncompressed tar stream.  The header offset is
+ * that of the first header belonging to the member (including any pax
+ * or GNU long-name headers), the data offset is where the body begins
+ * and the size is the size reported for the entry.  Sparse files list
+ * their n data regions; other files have n == 0.  The pathname ends
+ * the line, with backslash and newline escaped as "\\" and "\n".
+ *
+ * A sidecar index file starts with ARCHIVE_TAR_INDEX_MAGIC on a line
+ * of its own.  An index embedded by the pax writer is a trailing
+ * global header holding the lines in a "LIBARCHIVE.index" record,
+ * followed by a "LIBARCHIVE.index.start" record with the offset of
+ * that global header, so it can be found from the end of the archive.
+ */
+#define ARCHIVE_TAR_INDEX_MAGIC		"#libarchive tar index 1"
+#define ARCHIVE_TAR_INDEX_KEY		"LIBARCHIVE.index"
+#define ARCHIVE_TAR_INDEX_START_KEY	"LIBARCHIVE.index.start"
+
+struct archive_tar_index_entry {
+	struct archive_rb_node	 node;
+	char			*pathname;
+	int64_t			 header_offset;
+	int64_t			 data_offset;
+	int64_t			 size;
+	int			 sparse_count;
+	int64_t			*sparse;	/* offset/length pairs */
+};
+
+struct archive_tar_index {
+	/* Lookup by pathname; a later member replaces an earlier one. */
+	struct archive_rb_tree	  tree;
+	/* Every member, in archive order. */
+	struct archive_tar_index_entry **entries;
+	size_t			  count;
+	size_t			  allocated;
+	/* Partial line carried between calls to __archive_tar_index_parse. */
+	struct archive_string	  line;
+};
+
+void	__archive_tar_index_init(struct archive_tar_index *);
+void	__archive_tar_index_free(struct archive_tar_index *);
+int	__archive_tar_index_add(struct archive_tar_index *, const char *path,
+	    int64_t header_offset, int64_t data_offset, int64_t size,
+	    int sparse_count, const int64_t *sparse);
+const struct archive_tar_index_entry *
+	__archive_tar_index_find(struct archive_tar_index *, const char *path);
+void	__archive_tar_index_format(struct archive_string *,
+	    const struct archive_tar_index_entry *);
+int	__archive_tar_index_parse(struct archive_tar_index *,
+	    const char *, size_t, int final);
+
+#endif /* ARCHIVE_TAR_INDEX_PRIVATE_H_INCLUDED */
@@ -0,0 +1,259 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "archive_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#include <pthread.h>
+#define ARCHIVE_HAVE_THREADS	1
+#endif
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <windows.h>
+#endif
+
+#include "archive_thread_private.h"
+
+/* There is no point in more workers than this. */
+#define MAX_THREADS	256
+
+struct archive_thread_pool {
+	int			 nworkers;
+	archive_thread_job_fn	*fn;
+	void			*arg;
+	int			 count;	/* Jobs in the current batch. */
+	int			 next;	/* Next job to hand out. */
+	int			 done;	/* Jobs finished so far. */
+#ifdef ARCHIVE_HAVE_THREADS
+	int			 shutdown;
+	pthread_t		*workers;
+	pthread_mutex_t		 lock;
+	pthread_cond_t		 work_cv;
+	pthread_cond_t		 done_cv;
+#endif
+};
+
+#ifdef ARCHIVE_HAVE_THREADS
+static void *
+worker_main(void *p)
+{
+	struct archive_thread_pool *pool = p;
+	int job;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->shutdown && pool->next >= pool->count)
+			pthread_cond_wait(&pool->work_cv, &pool->lock);
+		if (pool->shutdown)
+			break;
+		job = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		pool->fn(pool->arg, job);
+		pthread_mutex_lock(&pool->lock);
+		if (++pool->done == pool->count)
+			pthread_cond_signal(&pool->done_cv);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return (NULL);
+}
+#endif
+
+/*
+ * Create a pool that runs batches on up to `threads' threads, the
+ * caller included.  Failing to start a worker thread is not an error;
+ * the pool just ends up smaller.
+ */
+struct archive_thread_pool *
+__archive_thread_pool_new(int threads)
+{
+	struct archive_thread_pool *pool;
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		return (NULL);
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+#ifdef ARCHIVE_HAVE_THREADS
+	if (threads <= 1)
+		return (pool);
+	pool->workers = calloc(threads - 1, sizeof(pool->workers[0]));
+	if (pool->workers == NULL) {
+		free(pool);
+		return (NULL);
+	}
+	if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+		free(pool->workers);
+		free(pool);
+		return (NULL);
+	}
+	if (pthread_cond_init(&pool->work_cv, NULL) != 0) {
+		pthread_mutex_destroy(&pool->lock);
+		free(pool->workers);
+		free(pool);
+		return (NULL);
+	}
+	if (pthread_cond_init(&pool->done_cv, NULL) != 0) {
+		pthread_cond_destroy(&pool->work_cv);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool->workers);
+		free(pool);
+		return (NULL);
+	}
+	while (pool->nworkers < threads - 1) {
+		if (pthread_create(&pool->workers[pool->nworkers], NULL,
+		    worker_main, pool) != 0)
+			break;
+		pool->nworkers++;
+	}
+#else
+	(void)threads; /* UNUSED */
+#endif
+	return (pool);
+}
+
+/*
+ * Return how many threads, the caller included, work on a batch.
+ */
+int
+__archive_thread_pool_threads(struct archive_thread_pool *pool)
+{
+	return (pool->nworkers + 1);
+}
+
+/*
+ * Hand a batch of `count' jobs to the workers and return at once.
+ * The caller must call __archive_thread_pool_wait() before starting
+ * another batch or touching the results.
+ */
+void
+__archive_thread_pool_start(struct archive_thread_pool *pool,
+    archive_thread_job_fn *fn, void *arg, int count)
+{
+#ifdef ARCHIVE_HAVE_THREADS
+	if (pool->nworkers > 0)
+		pthread_mutex_lock(&pool->lock);
+#endif
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->count = count;
+	pool->next = 0;
+	pool->done = 0;
+#ifdef ARCHIVE_HAVE_THREADS
+	if (pool->nworkers > 0) {
+		pthread_cond_broadcast(&pool->work_cv);
+		pthread_mutex_unlock(&pool->lock);
+	}
+#endif
+}
+
+/*
+ * Run the jobs nobody has picked up yet on the calling thread, then
+ * wait for the rest of the batch to finish.
+ */
+void
+__archive_thread_pool_wait(struct archive_thread_pool *pool)
+{
+	int job;
+
+#ifdef ARCHIVE_HAVE_THREADS
+	if (pool->nworkers > 0) {
+		pthread_mutex_lock(&pool->lock);
+		while (pool->next < pool->count) {
+			job = pool->next++;
+			pthread_mutex_unlock(&pool->lock);
+			pool->fn(pool->arg, job);
+			pthread_mutex_lock(&pool->lock);
+			pool->done++;
+		}
+		while (pool->done < pool->count)
+			pthread_cond_wait(&pool->done_cv, &pool->lock);
+		pool->count = pool->next = pool->done = 0;
+		pthread_mutex_unlock(&pool->lock);
+		return;
+	}
+#endif
+	while (pool->next < pool->count) {
+		job = pool->next++;
+		pool->fn(pool->arg, job);
+		pool->done++;
+	}
+	pool->count = pool->next = pool->done = 0;
+}
+
+void
+__archive_thread_pool_run(struct archive_thread_pool *pool,
+    archive_thread_job_fn *fn, void *arg, int count)
+{
+	__archive_thread_pool_start(pool, fn, arg, count);
+	__archive_thread_pool_wait(pool);
+}
+
+void
+__archive_thread_pool_free(struct archive_thread_pool *pool)
+{
+	if (pool == NULL)
+		return;
+#ifdef ARCHIVE_HAVE_THREADS
+	if (pool->workers != NULL) {
+		int i;
+
+		pthread_mutex_lock(&pool->lock);
+		pool->shutdown = 1;
+		pthread_cond_broadcast(&pool->work_cv);
+		pthread_mutex_unlock(&pool->lock);
+		for (i = 0; i < pool->nworkers; i++)
+			pthread_join(pool->workers[i], NULL);
+		pthread_cond_destroy(&pool->done_cv);
+		pthread_cond_destroy(&pool->work_cv);
+		pthread_mutex_destroy(&pool->lock);
+		free(pool->workers);
+	}
+#endif
+	free(pool);
+}
+
+int
+__archive_cpu_count(void)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	SYSTEM_INFO si;
+
+	GetSystemInfo(&si);
+	if (si.dwNumberOfProcessors > 0)
+		return ((int)si.dwNumberOfProcessors);
+#elif defined(HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n > 0)
+		return (n > MAX_THREADS ? MAX_THREADS : (int)n);
+#endif
+	return (1);
+}
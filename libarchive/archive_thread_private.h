@@ -0,0 +1,59 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ARCHIVE_THREAD_PRIVATE_H_INCLUDED
+#define ARCHIVE_THREAD_PRIVATE_H_INCLUDED
+
+#ifndef __LIBARCHIVE_BUILD
+#error This header is only to be used internally to libarchive.
+#endif
+
+/*
+ * A minimal worker pool for data-parallel jobs.
+ *
+ * A batch is a set of `count' independent jobs; job number i is run
+ * as fn(arg, i).  The calling thread takes part in the batch while it
+ * waits, so a pool created with one thread (or on a platform without
+ * thread support) simply runs every job serially in
+ * __archive_thread_pool_wait().  Only one batch may be in flight per
+ * pool at a time.
+ */
+struct archive_thread_pool;
+
+typedef void archive_thread_job_fn(void *arg, int job);
+
+struct archive_thread_pool *__archive_thread_pool_new(int threads);
+int	__archive_thread_pool_threads(struct archive_thread_pool *);
+void	__archive_thread_pool_start(struct archive_thread_pool *,
+	    archive_thread_job_fn *, void *, int count);
+void	__archive_thread_pool_wait(struct archive_thread_pool *);
+void	__archive_thread_pool_run(struct archive_thread_pool *,
+	    archive_thread_job_fn *, void *, int count);
+void	__archive_thread_pool_free(struct archive_thread_pool *);
+
+/* Number of online processors, or 1 if that cannot be determined. */
+int	__archive_cpu_count(void);
+
+#endif /* ARCHIVE_THREAD_PRIVATE_H_INCLUDED */
@@ -61,6 +61,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_util.c 201098 2009-12-28 02:58:1
 #include "archive.h"
 #include "archive_private.h"
 #include "archive_random_private.h"
+#include "archive_stats_private.h"
 #include "archive_string.h"
 
 #ifndef O_CLOEXEC
@@ -74,6 +75,7 @@ int
 __archive_clean(struct archive *a)
 {
 	archive_string_conversion_free(a);
+	__archive_stats_free(a);
 	return (ARCHIVE_OK);
 }
 
@@ -58,6 +58,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write.c 201099 2009-12-28 03:03:
 #include "archive.h"
 #include "archive_entry.h"
 #include "archive_private.h"
+#include "archive_stats_private.h"
 #include "archive_write_private.h"
 
 static int	_archive_filter_code(struct archive *, int);
@@ -228,7 +229,14 @@ __archive_write_filter(struct archive_write_filter *f,
 		/* If unset, a fatal error has already occurred, so this filter
 		 * didn't open. We cannot write anything. */
 		return(ARCHIVE_FATAL);
-	r = (f->write)(f, buff, length);
+	/* The client pseudo-filter times the client callback itself. */
+	if (f->archive->stats != NULL && f->next_filter != NULL) {
+		int prev = __archive_stats_enter_filter(f->archive,
+		    &f->stats_stage, f->name);
+		r = (f->write)(f, buff, length);
+		__archive_stats_leave(f->archive, prev, length);
+	} else
+		r = (f->write)(f, buff, length);
 	f->bytes_written += length;
 	return (r);
 }
@@ -363,6 +371,25 @@ archive_write_client_open(struct archive_write_filter *f)
 	return (ret);
 }
 
+/*
+ * Hand a block to the client write callback.
+ */
+static ssize_t
+client_write(struct archive_write *a, const void *buff, size_t length)
+{
+	ssize_t bytes_written;
+	int prev;
+
+	if (a->archive.stats == NULL)
+		return ((a->client_writer)(&a->archive, a->client_data,
+		    buff, length));
+	prev = __archive_stats_enter(&a->archive, ARCHIVE_STATS_CLIENT);
+	bytes_written = (a->client_writer)(&a->archive, a->client_data,
+	    buff, length);
+	__archive_stats_leave(&a->archive, prev, bytes_written);
+	return (bytes_written);
+}
+
 static int
 archive_write_client_write(struct archive_write_filter *f,
     const void *_buff, size_t length)
@@ -383,8 +410,7 @@ archive_write_client_write(struct archive_write_filter *f,
 	 */
 	if (state->buffer_size == 0) {
 		while (remaining > 0) {
-			bytes_written = (a->client_writer)(&a->archive,
-			    a->client_data, buff, remaining);
+			bytes_written = client_write(a, buff, remaining);
 			if (bytes_written <= 0)
 				return (ARCHIVE_FATAL);
 			remaining -= bytes_written;
@@ -409,8 +435,7 @@ archive_write_client_write(struct archive_write_filter *f,
 			char *p = state->buffer;
 			size_t to_write = state->buffer_size;
 			while (to_write > 0) {
-				bytes_written = (a->client_writer)(&a->archive,
-				    a->client_data, p, to_write);
+				bytes_written = client_write(a, p, to_write);
 				if (bytes_written <= 0)
 					return (ARCHIVE_FATAL);
 				if ((size_t)bytes_written > to_write) {
@@ -428,8 +453,7 @@ archive_write_client_write(struct archive_write_filter *f,
 
 	while ((size_t)remaining >= state->buffer_size) {
 		/* Write out full blocks directly to client. */
-		bytes_written = (a->client_writer)(&a->archive,
-		    a->client_data, buff, state->buffer_size);
+		bytes_written = client_write(a, buff, state->buffer_size);
 		if (bytes_written <= 0)
 			return (ARCHIVE_FATAL);
 		buff += bytes_written;
@@ -499,8 +523,7 @@ archive_write_client_close(struct archive_write_filter *f)
 		p = state->buffer;
 		to_write = block_length;
 		while (to_write > 0) {
-			bytes_written = (a->client_writer)(&a->archive,
-			    a->client_data, p, to_write);
+			bytes_written = client_write(a, p, to_write);
 			if (bytes_written <= 0) {
 				ret = ARCHIVE_FATAL;
 				break;
@@ -582,7 +605,7 @@ static int
 _archive_write_close(struct archive *_a)
 {
 	struct archive_write *a = (struct archive_write *)_a;
-	int r = ARCHIVE_OK, r1 = ARCHIVE_OK;
+	int r = ARCHIVE_OK, r1 = ARCHIVE_OK, prev = 0;
 
 	archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
 	    ARCHIVE_STATE_ANY | ARCHIVE_STATE_FATAL,
@@ -593,6 +616,9 @@ _archive_write_close(struct archive *_a)
 
 	archive_clear_error(&a->archive);
 
+	if (a->archive.stats != NULL)
+		prev = __archive_stats_enter(&a->archive, ARCHIVE_STATS_FORMAT);
+
 	/* Finish the last entry if a finish callback is specified */
 	if (a->archive.state == ARCHIVE_STATE_DATA
 	    && a->format_finish_entry != NULL)
@@ -606,6 +632,9 @@ _archive_write_close(struct archive *_a)
 			r = r1;
 	}
 
+	if (a->archive.stats != NULL)
+		__archive_stats_leave(&a->archive, prev, 0);
+
 	/* Finish the compression and close the stream. */
 	r1 = __archive_write_filters_close(a);
 	if (r1 < r)
@@ -700,7 +729,7 @@ static int
 _archive_write_header(struct archive *_a, struct archive_entry *entry)
 {
 	struct archive_write *a = (struct archive_write *)_a;
-	int ret, r2;
+	int ret, r2, prev;
 
 	archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
 	    ARCHIVE_STATE_DATA | ARCHIVE_STATE_HEADER, "archive_write_header");
@@ -733,7 +762,12 @@ _archive_write_header(struct archive *_a, struct archive_entry *entry)
 	}
 
 	/* Format and write header. */
-	r2 = ((a->format_write_header)(a, entry));
+	if (a->archive.stats != NULL) {
+		prev = __archive_stats_enter(&a->archive, ARCHIVE_STATS_FORMAT);
+		r2 = ((a->format_write_header)(a, entry));
+		__archive_stats_leave(&a->archive, prev, 0);
+	} else
+		r2 = ((a->format_write_header)(a, entry));
 	if (r2 == ARCHIVE_FAILED) {
 		return (ARCHIVE_FAILED);
 	}
@@ -752,14 +786,21 @@ static int
 _archive_write_finish_entry(struct archive *_a)
 {
 	struct archive_write *a = (struct archive_write *)_a;
-	int ret = ARCHIVE_OK;
+	int ret = ARCHIVE_OK, prev;
 
 	archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
 	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA,
 	    "archive_write_finish_entry");
 	if (a->archive.state & ARCHIVE_STATE_DATA
-	    && a->format_finish_entry != NULL)
-		ret = (a->format_finish_entry)(a);
+	    && a->format_finish_entry != NULL) {
+		if (a->archive.stats != NULL) {
+			prev = __archive_stats_enter(&a->archive,
+			    ARCHIVE_STATS_FORMAT);
+			ret = (a->format_finish_entry)(a);
+			__archive_stats_leave(&a->archive, prev, 0);
+		} else
+			ret = (a->format_finish_entry)(a);
+	}
 	a->archive.state = ARCHIVE_STATE_HEADER;
 	return (ret);
 }
@@ -772,6 +813,8 @@ _archive_write_data(struct archive *_a, const void *buff, size_t s)
 {
 	struct archive_write *a = (struct archive_write *)_a;
 	const size_t max_write = INT_MAX;
+	ssize_t r;
+	int prev;
 
 	archive_check_magic(&a->archive, ARCHIVE_WRITE_MAGIC,
 	    ARCHIVE_STATE_DATA, "archive_write_data");
@@ -779,7 +822,12 @@ _archive_write_data(struct archive *_a, const void *buff, size_t s)
 	if (s > max_write)
 		s = max_write;
 	archive_clear_error(&a->archive);
-	return ((a->format_write_data)(a, buff, s));
+	if (a->archive.stats == NULL)
+		return ((a->format_write_data)(a, buff, s));
+	prev = __archive_stats_enter(&a->archive, ARCHIVE_STATS_FORMAT);
+	r = (a->format_write_data)(a, buff, s);
+	__archive_stats_leave(&a->archive, prev, r);
+	return (r);
 }
 
 static struct archive_write_filter *
@@ -47,13 +47,25 @@ __FBSDID("$FreeBSD$");
 #include "archive.h"
 #include "archive_endian.h"
 #include "archive_private.h"
+#include "archive_thread_private.h"
 #include "archive_write_private.h"
 #include "archive_xxhash.h"
 
 #define LZ4_MAGICNUMBER	0x184d2204
 
+/*
+ * One block of a batch compressed by the worker threads.
+ */
+struct lz4_block_job {
+	const char	*in;
+	size_t		 in_size;
+	char		*out;
+	size_t		 out_size;
+};
+
 struct private_data {
 	int		 compression_level;
+	int		 threads;
 	unsigned	 header_written:1;
 	unsigned	 version_number:1;
 	unsigned	 block_independence:1;
@@ -76,6 +88,11 @@ struct private_data {
 
 	void		*xxh32_state;
 	void		*lz4_stream;
+
+	/* Multi-threaded compression of independent blocks. */
+	struct archive_thread_pool *pool;
+	struct lz4_block_job *jobs;
+	char		*jobs_out;
 #else
 	struct archive_write_program_data *pdata;
 #endif
@@ -119,6 +136,7 @@ archive_write_add_filter_lz4(struct archive *_a)
 	data->stream_checksum = 1;
 	data->preset_dictionary = 0;
 	data->block_maximum_size = 7;
+	data->threads = 1;
 
 	/*
 	 * Setup a filter setting.
@@ -195,6 +213,21 @@ archive_filter_lz4_options(struct archive_write_filter *f,
 		data->block_independence = value == NULL;
 		return (ARCHIVE_OK);
 	}
+	if (strcmp(key, "threads") == 0) {
+		char *endptr;
+
+		if (value == NULL)
+			return (ARCHIVE_WARN);
+		errno = 0;
+		data->threads = (int)strtoul(value, &endptr, 10);
+		if (errno != 0 || *endptr != '\0') {
+			data->threads = 1;
+			return (ARCHIVE_WARN);
+		}
+		if (data->threads == 0)
+			data->threads = __archive_cpu_count();
+		return (ARCHIVE_OK);
+	}
 
 	/* Note: The "warn" return is just to inform the options
 	 * supervisor that we didn't handle it.  It will generate
@@ -211,6 +244,11 @@ static int drive_compressor_independence(struct archive_write_filter *,
     const char *, size_t);
 static int drive_compressor_dependence(struct archive_write_filter *,
     const char *, size_t);
+static int drive_compressor_parallel(struct archive_write_filter *,
+    const char *, size_t);
+static size_t lz4_compress_block(struct private_data *, const char *,
+    size_t, char *);
+static int lz4_flush_out_block(struct archive_write_filter *);
 static int lz4_write_stream_descriptor(struct archive_write_filter *);
 static ssize_t lz4_write_one_block(struct archive_write_filter *, const char *,
     size_t);
@@ -226,13 +264,43 @@ archive_filter_lz4_open(struct archive_write_filter *f)
 	size_t required_size;
 	static size_t const bkmap[] = { 64 * 1024, 256 * 1024, 1 * 1024 * 1024,
 			   4 * 1024 * 1024 };
-	size_t pre_block_size;
+	size_t pre_block_size, in_size;
 
 	if (data->block_maximum_size < 4)
 		data->block_size = bkmap[0];
 	else
 		data->block_size = bkmap[data->block_maximum_size - 4];
 
+	/*
+	 * Independent blocks can be compressed concurrently; the input
+	 * buffer then holds one block for each thread and the whole
+	 * batch is handed to the workers at once.
+	 */
+	in_size = data->block_size;
+	if (data->block_independence && data->threads > 1) {
+		size_t out_size = 4 + data->block_size + 4;
+		int n;
+
+		if (data->pool == NULL)
+			data->pool = __archive_thread_pool_new(data->threads);
+		if (data->pool == NULL) {
+			archive_set_error(f->archive, ENOMEM,
+			    "Can't allocate data for compression threads");
+			return (ARCHIVE_FATAL);
+		}
+		n = __archive_thread_pool_threads(data->pool);
+		free(data->jobs);
+		free(data->jobs_out);
+		data->jobs = calloc(n, sizeof(data->jobs[0]));
+		data->jobs_out = malloc(n * out_size);
+		if (data->jobs == NULL || data->jobs_out == NULL) {
+			archive_set_error(f->archive, ENOMEM,
+			    "Can't allocate data for compression buffer");
+			return (ARCHIVE_FATAL);
+		}
+		in_size *= n;
+	}
+
 	required_size = 4 + 15 + 4 + data->block_size + 4 + 4;
 	if (data->out_buffer_size < required_size) {
 		size_t bs = required_size, bpb;
@@ -256,16 +324,16 @@ archive_filter_lz4_open(struct archive_write_filter *f)
 	}
 
 	pre_block_size = (data->block_independence)? 0: 64 * 1024;
-	if (data->in_buffer_size < data->block_size + pre_block_size) {
+	if (data->in_buffer_size < in_size + pre_block_size) {
 		free(data->in_buffer_allocated);
-		data->in_buffer_size = data->block_size;
+		data->in_buffer_size = in_size;
 		data->in_buffer_allocated =
 		    malloc(data->in_buffer_size + pre_block_size);
 		data->in_buffer = data->in_buffer_allocated + pre_block_size;
 		if (!data->block_independence && data->compression_level >= 3)
 		    data->in_buffer = data->in_buffer_allocated;
 		data->in = data->in_buffer;
-		data->in_buffer_size = data->block_size;
+		data->in_buffer_size = in_size;
 	}
 
 	if (data->out_buffer == NULL || data->in_buffer_allocated == NULL) {
@@ -308,22 +376,13 @@ archive_filter_lz4_write(struct archive_write_filter *f,
 	p = (const char *)buff;
 	remaining = length;
 	while (remaining) {
-		size_t l;
 		/* Compress input data to output buffer */
 		size = lz4_write_one_block(f, p, remaining);
 		if (size < ARCHIVE_OK)
 			return (ARCHIVE_FATAL);
-		l = data->out - data->out_buffer;
-		if (l >= data->out_block_size) {
-			ret = __archive_write_filter(f->next_filter,
-			    data->out_buffer, data->out_block_size);
-			l -= data->out_block_size;
-			memcpy(data->out_buffer,
-			    data->out_buffer + data->out_block_size, l);
-			data->out = data->out_buffer + l;
-			if (ret < ARCHIVE_WARN)
-				break;
-		}
+		ret = lz4_flush_out_block(f);
+		if (ret < ARCHIVE_WARN)
+			break;
 		p += size;
 		remaining -= size;
 	}
@@ -331,6 +390,29 @@ archive_filter_lz4_write(struct archive_write_filter *f,
 	return (ret);
 }
 
+/*
+ * Pass a full output block down to the next filter once enough
+ * compressed data has accumulated.
+ */
+static int
+lz4_flush_out_block(struct archive_write_filter *f)
+{
+	struct private_data *data = (struct private_data *)f->data;
+	size_t l;
+	int ret;
+
+	l = data->out - data->out_buffer;
+	if (l < data->out_block_size)
+		return (ARCHIVE_OK);
+	ret = __archive_write_filter(f->next_filter,
+	    data->out_buffer, data->out_block_size);
+	l -= data->out_block_size;
+	memcpy(data->out_buffer,
+	    data->out_buffer + data->out_block_size, l);
+	data->out = data->out_buffer + l;
+	return (ret);
+}
+
 /*
  * Finish the compression.
  */
@@ -385,6 +467,9 @@ archive_filter_lz4_free(struct archive_write_filter *f)
 			LZ4_free(data->lz4_stream);
 #endif
 	}
+	__archive_thread_pool_free(data->pool);
+	free(data->jobs);
+	free(data->jobs_out);
 	free(data->out_buffer);
 	free(data->in_buffer_allocated);
 	free(data->xxh32_state);
@@ -438,10 +523,10 @@ lz4_write_one_block(struct archive_write_filter *f, const char *p,
 				r = (ssize_t)l;
 		}
 	} else if ((data->block_independence || data->compression_level < 3) &&
-	    data->in_buffer == data->in && length >= data->block_size) {
-		r = drive_compressor(f, p, data->block_size);
+	    data->in_buffer == data->in && length >= data->in_buffer_size) {
+		r = drive_compressor(f, p, data->in_buffer_size);
 		if (r == ARCHIVE_OK)
-			r = (ssize_t)data->block_size;
+			r = (ssize_t)data->in_buffer_size;
 	} else {
 		size_t remaining_size = data->in_buffer_size -
 			(data->in - data->in_buffer);
@@ -450,7 +535,7 @@ lz4_write_one_block(struct archive_write_filter *f, const char *p,
 		data->in += l;
 		if (l == remaining_size) {
 			r = drive_compressor(f, data->in_buffer,
-			    data->block_size);
+			    data->in_buffer_size);
 			if (r == ARCHIVE_OK)
 				r = (ssize_t)l;
 			data->in = data->in_buffer;
@@ -474,6 +559,8 @@ drive_compressor(struct archive_write_filter *f, const char *p, size_t length)
 {
 	struct private_data *data = (struct private_data *)f->data;
 
+	if (data->pool != NULL)
+		return drive_compressor_parallel(f, p, length);
 	if (data->stream_checksum)
 		__archive_xxhash.XXH32_update(data->xxh32_state,
 			p, (int)length);
@@ -488,47 +575,110 @@ drive_compressor_independence(struct archive_write_filter *f, const char *p,
     size_t length)
 {
 	struct private_data *data = (struct private_data *)f->data;
+
+	data->out += lz4_compress_block(data, p, length, data->out);
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Compress one independent block into `out', framed by its size and
+ * an optional block checksum, and return the number of bytes stored.
+ * This only reads the filter settings, so the worker threads may
+ * call it concurrently.
+ */
+static size_t
+lz4_compress_block(struct private_data *data, const char *p, size_t length,
+    char *out)
+{
 	unsigned int outsize;
 
 #ifdef HAVE_LZ4HC_H
 	if (data->compression_level >= 3)
 #if LZ4_VERSION_MAJOR >= 1 && LZ4_VERSION_MINOR >= 7
-		outsize = LZ4_compress_HC(p, data->out + 4,
+		outsize = LZ4_compress_HC(p, out + 4,
 		     (int)length, (int)data->block_size,
 		    data->compression_level);
 #else
-		outsize = LZ4_compressHC2_limitedOutput(p, data->out + 4,
+		outsize = LZ4_compressHC2_limitedOutput(p, out + 4,
 		    (int)length, (int)data->block_size,
 		    data->compression_level);
 #endif
 	else
 #endif
 #if LZ4_VERSION_MAJOR >= 1 && LZ4_VERSION_MINOR >= 7
-		outsize = LZ4_compress_default(p, data->out + 4,
+		outsize = LZ4_compress_default(p, out + 4,
 		    (int)length, (int)data->block_size);
 #else
-		outsize = LZ4_compress_limitedOutput(p, data->out + 4,
+		outsize = LZ4_compress_limitedOutput(p, out + 4,
 		    (int)length, (int)data->block_size);
 #endif
 
 	if (outsize) {
 		/* The buffer is compressed. */
-		archive_le32enc(data->out, outsize);
-		data->out += 4;
+		archive_le32enc(out, outsize);
 	} else {
 		/* The buffer is not compressed. The compressed size was
 		 * bigger than its uncompressed size. */
-		archive_le32enc(data->out, length | 0x80000000);
-		data->out += 4;
-		memcpy(data->out, p, length);
+		archive_le32enc(out, length | 0x80000000);
+		memcpy(out + 4, p, length);
 		outsize = length;
 	}
-	data->out += outsize;
 	if (data->block_checksum) {
 		unsigned int checksum =
-		    __archive_xxhash.XXH32(data->out - outsize, outsize, 0);
-		archive_le32enc(data->out, checksum);
-		data->out += 4;
+		    __archive_xxhash.XXH32(out + 4, outsize, 0);
+		archive_le32enc(out + 4 + outsize, checksum);
+		return (4 + outsize + 4);
+	}
+	return (4 + outsize);
+}
+
+static void
+lz4_compress_job(void *arg, int i)
+{
+	struct private_data *data = (struct private_data *)arg;
+	struct lz4_block_job *job = &data->jobs[i];
+
+	job->out_size = lz4_compress_block(data, job->in, job->in_size,
+	    job->out);
+}
+
+/*
+ * Split a batch of input into blocks and compress them on the worker
+ * threads.  The stream checksum covers the uncompressed data in order,
+ * so it is computed here while the workers run.  The compressed
+ * blocks are then emitted in their original order.
+ */
+static int
+drive_compressor_parallel(struct archive_write_filter *f, const char *p,
+    size_t length)
+{
+	struct private_data *data = (struct private_data *)f->data;
+	size_t out_size = 4 + data->block_size + 4;
+	int i, n, ret;
+
+	for (n = 0; length > 0; n++) {
+		size_t l = (length > data->block_size)?
+		    data->block_size: length;
+		data->jobs[n].in = p;
+		data->jobs[n].in_size = l;
+		data->jobs[n].out = data->jobs_out + n * out_size;
+		p += l;
+		length -= l;
+	}
+	__archive_thread_pool_start(data->pool, lz4_compress_job, data, n);
+	if (data->stream_checksum) {
+		for (i = 0; i < n; i++)
+			__archive_xxhash.XXH32_update(data->xxh32_state,
+			    data->jobs[i].in, (int)data->jobs[i].in_size);
+	}
+	__archive_thread_pool_wait(data->pool);
+
+	for (i = 0; i < n; i++) {
+		memcpy(data->out, data->jobs[i].out, data->jobs[i].out_size);
+		data->out += data->jobs[i].out_size;
+		ret = lz4_flush_out_block(f);
+		if (ret < ARCHIVE_WARN)
+			return (ARCHIVE_FATAL);
 	}
 	return (ARCHIVE_OK);
 }
@@ -50,6 +50,9 @@ __FBSDID("$FreeBSD$");
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #endif
@@ -109,6 +112,10 @@ __FBSDID("$FreeBSD$");
 #ifdef F_GETTIMES /* Tru64 specific */
 #include <sys/fcntl1.h>
 #endif
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#include <pthread.h>
+#define ARCHIVE_HAVE_THREADS	1
+#endif
 
 /*
  * Macro to cast st_mtime and time_t to an int64 so that 2 numbers can reliably be compared.
@@ -146,6 +153,8 @@ __FBSDID("$FreeBSD$");
 #include "archive_endian.h"
 #include "archive_entry.h"
 #include "archive_private.h"
+#include "archive_rb.h"
+#include "archive_stats_private.h"
 #include "archive_write_disk_private.h"
 
 #ifndef O_BINARY
@@ -168,6 +177,12 @@ __FBSDID("$FreeBSD$");
 #ifndef AT_FDCWD
 #define AT_FDCWD -100
 #endif
+#ifndef AT_SYMLINK_NOFOLLOW
+#define AT_SYMLINK_NOFOLLOW 0x100
+#endif
+#ifndef AT_REMOVEDIR
+#define AT_REMOVEDIR 0x200
+#endif
 
 struct fixup_entry {
 	struct fixup_entry	*next;
@@ -189,6 +204,30 @@ struct fixup_entry {
 	char			*name;
 };
 
+/*
+ * A directory that has been verified to contain no symlinks along
+ * its path; see check_symlinks().
+ */
+struct dir_cache_entry {
+	struct archive_rb_node	 node;
+	struct dir_cache_entry	*next;
+	char			 name[1];
+};
+
+/* Start over rather than let the verified-directory cache grow forever. */
+#define	DIR_CACHE_MAX	16384
+
+/*
+ * Shared by an object and its clones, which run on other threads but
+ * in the same working directory.  See cwd_lock_enter().
+ */
+struct cwd_lock {
+#ifdef ARCHIVE_HAVE_THREADS
+	pthread_rwlock_t	 lock;
+#endif
+	int			 refs;
+};
+
 /*
  * We use a bitmask to track which operations remain to be done for
  * this file.  In particular, this helps us avoid unnecessary
@@ -242,6 +281,39 @@ struct archive_write_disk {
 	 */
 	struct archive_string	path_safe;
 
+	/*
+	 * The working directory that relative names, the directory
+	 * cache and parent_fd below refer to.  See check_cwd().
+	 */
+	int			 cwd_known;
+	dev_t			 cwd_dev;
+	ino_t			 cwd_ino;
+	/* Set once the object has been cloned. */
+	struct cwd_lock		*cwd_lock;
+	/*
+	 * Also set once the object has been cloned: the clones create
+	 * directories before their entries are written here, so the
+	 * times of an existing directory are deferred as for a new one.
+	 */
+	int			 defer_dir_times;
+
+	/*
+	 * Directories known to be real directories with no symlink
+	 * anywhere along their path.  check_symlinks() and
+	 * create_dir() use this to avoid walking the same prefixes
+	 * again for every entry.
+	 */
+	struct archive_rb_tree	 dir_cache;
+	struct dir_cache_entry	*dir_cache_list;
+	int			 dir_cache_count;
+
+	/*
+	 * An open descriptor for the directory parent_path, kept
+	 * from one entry to the next while they share a parent.
+	 */
+	int			 parent_fd;
+	struct archive_string	 parent_path;
+
 	/*
 	 * Cached stat data from disk for the current entry.
 	 * If this is valid, pst points to st.  Otherwise,
@@ -253,6 +325,12 @@ struct archive_write_disk {
 	/* Information about the object being restored right now. */
 	struct archive_entry	*entry; /* Entry being extracted. */
 	char			*name; /* Name of entry, possibly edited. */
+	/*
+	 * The same object for the *at() calls: either parent_fd and
+	 * the last element of name, or AT_FDCWD and name itself.
+	 */
+	int			 dirfd;
+	const char		*base;
 	struct archive_string	 _name_data; /* backing store for 'name' */
 	char			*tmpname; /* Temporary name * */
 	struct archive_string	 _tmpname_data; /* backing store for 'tmpname' */
@@ -270,6 +348,20 @@ struct archive_write_disk {
 	int64_t			 fd_offset;
 	/* Total bytes actually written to files. */
 	int64_t			 total_bytes_written;
+	/*
+	 * ARCHIVE_EXTRACT_PREALLOCATE: data not yet written to disk,
+	 * which belongs at wbuff_offset.  Writes are flushed at
+	 * WRITE_BUFFER_SIZE boundaries of the file.
+	 */
+	unsigned char		*wbuff;
+	size_t			 wbuff_len;
+	int64_t			 wbuff_offset;
+	/* The file was preallocated; skipped ranges must be punched. */
+	int			 punch_holes;
+	/* The data was cloned from the source; drop what is written. */
+	int			 data_cloned;
+	/* Source descriptor of the entry, or -1; not ours. */
+	int			 source_fd;
 	/* Maximum size of file, -1 if unknown. */
 	int64_t			 filesize;
 	/* Dir we were in before this restore; only for deep paths. */
@@ -355,6 +447,9 @@ struct archive_write_disk {
 
 #define HFS_BLOCKS(s)	((s) >> 12)
 
+/* Write size (and alignment) for ARCHIVE_EXTRACT_PREALLOCATE. */
+#define WRITE_BUFFER_SIZE	(1024 * 1024)
+
 
 static int	la_opendirat(int, const char *);
 static int	la_mktemp(struct archive_write_disk *);
@@ -362,8 +457,28 @@ static int	la_verify_filetype(mode_t, __LA_MODE_T);
 static void	fsobj_error(int *, struct archive_string *, int, const char *,
 		    const char *);
 static int	check_symlinks_fsobj(char *, int *, struct archive_string *,
-		    int, int);
+		    int, int, struct archive_write_disk *);
+static int	dir_cache_lookup(struct archive_write_disk *, const char *);
+static void	dir_cache_add(struct archive_write_disk *, const char *);
+static void	dir_cache_flush(struct archive_write_disk *);
+static int	dir_cache_cmp_node(const struct archive_rb_node *,
+		    const struct archive_rb_node *);
+static int	dir_cache_cmp_key(const struct archive_rb_node *,
+		    const void *);
+
+static const struct archive_rb_tree_ops dir_cache_rb_ops = {
+	dir_cache_cmp_node, dir_cache_cmp_key
+};
 static int	check_symlinks(struct archive_write_disk *);
+static void	check_cwd(struct archive_write_disk *);
+static void	open_parent_dir(struct archive_write_disk *);
+static void	close_parent_dir(struct archive_write_disk *);
+static void	forget_path(struct archive_write_disk *, const char *);
+static int	la_fstatat(int, const char *, struct stat *, int);
+static int	la_openat(int, const char *, int, mode_t);
+static int	la_unlinkat(int, const char *, int);
+static void	preallocate(struct archive_write_disk *);
+static void	clone_source(struct archive_write_disk *);
 static int	create_filesystem_object(struct archive_write_disk *);
 static struct fixup_entry *current_fixup(struct archive_write_disk *,
 		    const char *pathname);
@@ -394,6 +509,7 @@ static int	set_time(int, int, const char *, time_t, long, time_t, long);
 static int	set_times(struct archive_write_disk *, int, int, const char *,
 		    time_t, long, time_t, long, time_t, long, time_t, long);
 static int	set_times_from_entry(struct archive_write_disk *);
+static int	finish_entry(struct archive_write_disk *);
 static struct fixup_entry *sort_dir_list(struct fixup_entry *p);
 static ssize_t	write_data_block(struct archive_write_disk *,
 		    const char *, size_t);
@@ -404,6 +520,10 @@ static int	_archive_write_disk_header(struct archive *,
 		    struct archive_entry *);
 static int64_t	_archive_write_disk_filter_bytes(struct archive *, int);
 static int	_archive_write_disk_finish_entry(struct archive *);
+static int	write_disk_header(struct archive *, struct archive_entry *);
+static int	write_disk_finish_entry(struct archive *);
+static void	cwd_lock_enter(struct archive_write_disk *, int exclusive);
+static void	cwd_lock_leave(struct archive_write_disk *);
 static ssize_t	_archive_write_disk_data(struct archive *, const void *,
 		    size_t);
 static ssize_t	_archive_write_disk_data_block(struct archive *, const void *,
@@ -464,6 +584,155 @@ la_opendirat(int fd, const char *path) {
 #endif
 }
 
+static int
+la_openat(int fd, const char *path, int flags, mode_t mode)
+{
+#if !defined(HAVE_OPENAT)
+	if (fd != AT_FDCWD) {
+		errno = ENOTSUP;
+		return (-1);
+	} else
+		return (open(path, flags, mode));
+#else
+	return (openat(fd, path, flags, mode));
+#endif
+}
+
+static int
+la_fstatat(int fd, const char *path, struct stat *st, int flags)
+{
+#if !defined(HAVE_FSTATAT)
+	if (fd != AT_FDCWD) {
+		errno = ENOTSUP;
+		return (-1);
+	}
+#ifdef HAVE_LSTAT
+	if (flags & AT_SYMLINK_NOFOLLOW)
+		return (lstat(path, st));
+#endif
+	return (la_stat(path, st));
+#else
+	return (fstatat(fd, path, st, flags));
+#endif
+}
+
+static int
+la_unlinkat(int fd, const char *path, int flags)
+{
+#if !defined(HAVE_UNLINKAT)
+	if (fd != AT_FDCWD) {
+		errno = ENOTSUP;
+		return (-1);
+	} else if (flags & AT_REMOVEDIR)
+		return (rmdir(path));
+	else
+		return (unlink(path));
+#else
+	return (unlinkat(fd, path, flags));
+#endif
+}
+
+/*
+ * Relative names only mean something for a particular working
+ * directory; if the client has moved us somewhere else since the
+ * last entry, forget everything we learned about the old one.
+ */
+static void
+check_cwd(struct archive_write_disk *a)
+{
+	struct stat st;
+
+	if (la_stat(".", &st) != 0) {
+		dir_cache_flush(a);
+		close_parent_dir(a);
+		a->cwd_known = 0;
+	} else if (!a->cwd_known ||
+	    st.st_dev != a->cwd_dev || st.st_ino != a->cwd_ino) {
+		dir_cache_flush(a);
+		close_parent_dir(a);
+		a->cwd_dev = st.st_dev;
+		a->cwd_ino = st.st_ino;
+		a->cwd_known = 1;
+	}
+}
+
+/*
+ * Point a->dirfd and a->base at the entry, so that the calls that
+ * create, inspect and remove it only have to look up its last
+ * element.  This is only an optimization: if the parent can't be
+ * opened (it usually doesn't exist yet), a->name is used as is.
+ */
+static void
+open_parent_dir(struct archive_write_disk *a)
+{
+#if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT)
+	char *slash;
+	const char *parent;
+	int fd;
+
+	a->dirfd = AT_FDCWD;
+	a->base = a->name;
+	/* Deep paths have chdir()ed; parent_path means nothing there. */
+	if (!a->cwd_known || a->restore_pwd >= 0) {
+		close_parent_dir(a);
+		return;
+	}
+	slash = strrchr(a->name, '/');
+	if (slash == NULL || slash[1] == '\0')
+		return;
+	*slash = '\0';
+	parent = (slash == a->name) ? "/" : a->name;
+	if (a->parent_fd < 0 || strcmp(a->parent_path.s, parent) != 0) {
+		close_parent_dir(a);
+		fd = la_opendirat(AT_FDCWD, parent);
+		if (fd >= 0) {
+			__archive_ensure_cloexec_flag(fd);
+			a->parent_fd = fd;
+			archive_strcpy(&a->parent_path, parent);
+		}
+	}
+	*slash = '/';
+	if (a->parent_fd >= 0) {
+		a->dirfd = a->parent_fd;
+		a->base = slash + 1;
+	}
+#else
+	(void)a; /* UNUSED */
+#endif
+}
+
+static void
+close_parent_dir(struct archive_write_disk *a)
+{
+	if (a->parent_fd >= 0) {
+		close(a->parent_fd);
+		a->parent_fd = -1;
+	}
+	a->dirfd = AT_FDCWD;
+	a->base = a->name;
+}
+
+/*
+ * We are about to remove or replace path.  That can change what
+ * parent_path resolves to, unless path is just an entry in that
+ * directory.
+ */
+static void
+forget_path(struct archive_write_disk *a, const char *path)
+{
+	size_t len;
+
+	if (a->parent_fd < 0)
+		return;
+	len = a->parent_path.length;
+	if (strncmp(path, a->parent_path.s, len) == 0 &&
+	    (len == 1 || path[len] == '/') &&
+	    path[len + (len != 1)] != '\0' &&
+	    strchr(path + len + 1, '/') == NULL)
+		return;
+	close_parent_dir(a);
+}
+
 static int
 la_verify_filetype(mode_t mode, __LA_MODE_T filetype) {
 	int ret = 0;
@@ -567,6 +836,24 @@ archive_write_disk_set_options(struct archive *_a, int flags)
  */
 static int
 _archive_write_disk_header(struct archive *_a, struct archive_entry *entry)
+{
+	struct archive_write_disk *a = (struct archive_write_disk *)_a;
+	int exclusive = 0, ret;
+#if defined(HAVE_FCHDIR) && defined(PATH_MAX)
+	const char *name;
+
+	/* Editing only ever makes the name shorter. */
+	name = archive_entry_pathname(entry);
+	exclusive = name != NULL && strlen(name) >= PATH_MAX;
+#endif
+	cwd_lock_enter(a, exclusive);
+	ret = write_disk_header(_a, entry);
+	cwd_lock_leave(a);
+	return (ret);
+}
+
+static int
+write_disk_header(struct archive *_a, struct archive_entry *entry)
 {
 	struct archive_write_disk *a = (struct archive_write_disk *)_a;
 	struct fixup_entry *fe;
@@ -578,7 +865,7 @@ _archive_write_disk_header(struct archive *_a, struct archive_entry *entry)
 	    "archive_write_disk_header");
 	archive_clear_error(&a->archive);
 	if (a->archive.state & ARCHIVE_STATE_DATA) {
-		r = _archive_write_disk_finish_entry(&a->archive);
+		r = write_disk_finish_entry(&a->archive);
 		if (r == ARCHIVE_FATAL)
 			return (r);
 	}
@@ -592,9 +879,13 @@ _archive_write_disk_header(struct archive *_a, struct archive_entry *entry)
 		a->entry = NULL;
 	}
 	a->entry = archive_entry_clone(entry);
+	a->source_fd = archive_entry_source_fd(entry);
 	a->fd = -1;
 	a->fd_offset = 0;
 	a->offset = 0;
+	a->wbuff_len = 0;
+	a->punch_holes = 0;
+	a->data_cloned = 0;
 	a->restore_pwd = -1;
 	a->uid = a->user_uid;
 	a->mode = archive_entry_mode(a->entry);
@@ -604,6 +895,8 @@ _archive_write_disk_header(struct archive *_a, struct archive_entry *entry)
 		a->filesize = -1;
 	archive_strcpy(&(a->_name_data), archive_entry_pathname(a->entry));
 	a->name = a->_name_data.s;
+	a->dirfd = AT_FDCWD;
+	a->base = a->name;
 	archive_clear_error(&a->archive);
 
 	/*
@@ -781,6 +1074,7 @@ _archive_write_disk_header(struct archive *_a, struct archive_entry *entry)
 	}
 	if (a->flags & ARCHIVE_EXTRACT_FFLAGS)
 		a->todo |= TODO_FFLAGS;
+	check_cwd(a);
 	if (a->flags & ARCHIVE_EXTRACT_SECURE_SYMLINKS) {
 		ret = check_symlinks(a);
 		if (ret != ARCHIVE_OK)
@@ -790,8 +1084,20 @@ _archive_write_disk_header(struct archive *_a, struct archive_entry *entry)
 	/* If path exceeds PATH_MAX, shorten the path. */
 	edit_deep_directories(a);
 #endif
+	open_parent_dir(a);
 
-	ret = restore_entry(a);
+	if (a->archive.stats != NULL) {
+		r = __archive_stats_enter(&a->archive,
+		    ARCHIVE_STATS_DISK_CREATE);
+		ret = restore_entry(a);
+		__archive_stats_leave(&a->archive, r, 0);
+	} else
+		ret = restore_entry(a);
+	if (ret == ARCHIVE_OK && (a->flags & ARCHIVE_EXTRACT_CLONE))
+		clone_source(a);
+	if (ret == ARCHIVE_OK && !a->data_cloned &&
+	    (a->flags & ARCHIVE_EXTRACT_PREALLOCATE))
+		preallocate(a);
 
 #if defined(__APPLE__) && defined(UF_COMPRESSED) && defined(HAVE_ZLIB_H)
 	/*
@@ -951,6 +1257,162 @@ archive_write_disk_set_skip_file(struct archive *_a, la_int64_t d, la_int64_t i)
 	return (ARCHIVE_OK);
 }
 
+/*
+ * Reserve the space for a regular file before any data arrives, so
+ * the filesystem can lay it out in one piece.  Holes in a sparse entry
+ * are left alone.  This is only a hint; failures are ignored.
+ */
+static void
+preallocate(struct archive_write_disk *a)
+{
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE) && \
+    defined(FALLOC_FL_PUNCH_HOLE)
+	la_int64_t offset, length;
+
+	if (a->fd < 0 || a->filesize <= 0 ||
+	    (a->todo & TODO_HFS_COMPRESSION))
+		return;
+	if (archive_entry_sparse_reset(a->entry) == 0) {
+		if (fallocate(a->fd, FALLOC_FL_KEEP_SIZE, 0, a->filesize) == 0)
+			a->punch_holes = 1;
+		return;
+	}
+	while (archive_entry_sparse_next(a->entry, &offset, &length)
+	    == ARCHIVE_OK) {
+		if (offset >= a->filesize)
+			break;
+		if (length > a->filesize - offset)
+			length = a->filesize - offset;
+		if (length == 0)
+			continue;
+		if (fallocate(a->fd, FALLOC_FL_KEEP_SIZE, offset, length) != 0)
+			break;
+		a->punch_holes = 1;
+	}
+#elif defined(HAVE_POSIX_FALLOCATE)
+	/* We can't punch holes, so leave anything sparse alone. */
+	if (a->fd < 0 || a->filesize <= 0 ||
+	    (a->todo & TODO_HFS_COMPRESSION) ||
+	    (a->flags & ARCHIVE_EXTRACT_SPARSE) ||
+	    archive_entry_sparse_reset(a->entry) != 0)
+		return;
+	(void)posix_fallocate(a->fd, 0, a->filesize);
+#else
+	(void)a; /* UNUSED */
+#endif
+}
+
+/*
+ * Give back the space preallocated for a range that was skipped.
+ */
+static void
+punch_hole(struct archive_write_disk *a, int64_t offset, int64_t length)
+{
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_KEEP_SIZE) && \
+    defined(FALLOC_FL_PUNCH_HOLE)
+	if (a->punch_holes && length > 0)
+		(void)fallocate(a->fd,
+		    FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset, length);
+#else
+	(void)a; /* UNUSED */
+	(void)offset; /* UNUSED */
+	(void)length; /* UNUSED */
+#endif
+}
+
+/*
+ * Write at a->offset; returns the number of bytes written, which may
+ * be short, or an ARCHIVE_* status.
+ */
+static ssize_t
+write_at_offset(struct archive_write_disk *a, int64_t offset,
+    const void *buff, size_t size)
+{
+	ssize_t bytes_written;
+
+	/* Seek if necessary to the specified offset. */
+	if (offset != a->fd_offset) {
+		if (offset > a->fd_offset)
+			punch_hole(a, a->fd_offset, offset - a->fd_offset);
+		if (lseek(a->fd, offset, SEEK_SET) < 0) {
+			archive_set_error(&a->archive, errno,
+			    "Seek failed");
+			return (ARCHIVE_FATAL);
+		}
+		a->fd_offset = offset;
+	}
+	bytes_written = write(a->fd, buff, size);
+	if (bytes_written < 0) {
+		archive_set_error(&a->archive, errno, "Write failed");
+		return (ARCHIVE_WARN);
+	}
+	a->fd_offset += bytes_written;
+	return (bytes_written);
+}
+
+static int
+flush_write_buffer(struct archive_write_disk *a)
+{
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < a->wbuff_len) {
+		r = write_at_offset(a, a->wbuff_offset + done,
+		    a->wbuff + done, a->wbuff_len - done);
+		if (r < 0) {
+			a->wbuff_len = 0;
+			return ((int)r);
+		}
+		done += r;
+	}
+	a->wbuff_len = 0;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Collect data for ARCHIVE_EXTRACT_PREALLOCATE, so that the file is
+ * written in large pieces that start and end on WRITE_BUFFER_SIZE
+ * boundaries no matter how the reader chops it up.  Returns how much
+ * of buff was taken, or an ARCHIVE_* status.
+ */
+static ssize_t
+buffered_write(struct archive_write_disk *a, const char *buff, size_t size)
+{
+	size_t room;
+	int r;
+
+	if (a->wbuff_len > 0 &&
+	    a->offset != a->wbuff_offset + (int64_t)a->wbuff_len) {
+		if ((r = flush_write_buffer(a)) != ARCHIVE_OK)
+			return (r);
+	}
+	if (a->wbuff_len == 0) {
+		a->wbuff_offset = a->offset;
+		/* Whole aligned blocks needn't be copied. */
+		if (size >= WRITE_BUFFER_SIZE &&
+		    a->offset % WRITE_BUFFER_SIZE == 0)
+			return (write_at_offset(a, a->offset, buff,
+			    size - size % WRITE_BUFFER_SIZE));
+		if (a->wbuff == NULL) {
+			a->wbuff = malloc(WRITE_BUFFER_SIZE);
+			if (a->wbuff == NULL)
+				return (write_at_offset(a, a->offset, buff,
+				    size));
+		}
+	}
+	room = WRITE_BUFFER_SIZE - (size_t)((a->wbuff_offset + a->wbuff_len)
+	    % WRITE_BUFFER_SIZE);
+	if (size > room)
+		size = room;
+	memcpy(a->wbuff + a->wbuff_len, buff, size);
+	a->wbuff_len += size;
+	if (size == room) {
+		if ((r = flush_write_buffer(a)) != ARCHIVE_OK)
+			return (r);
+	}
+	return (size);
+}
+
 static ssize_t
 write_data_block(struct archive_write_disk *a, const char *buff, size_t size)
 {
@@ -1014,25 +1476,18 @@ write_data_block(struct archive_write_disk *a, const char *buff, size_t size)
 			if (a->offset + bytes_to_write > block_end)
 				bytes_to_write = block_end - a->offset;
 		}
-		/* Seek if necessary to the specified offset. */
-		if (a->offset != a->fd_offset) {
-			if (lseek(a->fd, a->offset, SEEK_SET) < 0) {
-				archive_set_error(&a->archive, errno,
-				    "Seek failed");
-				return (ARCHIVE_FATAL);
-			}
-			a->fd_offset = a->offset;
-		}
-		bytes_written = write(a->fd, buff, bytes_to_write);
-		if (bytes_written < 0) {
-			archive_set_error(&a->archive, errno, "Write failed");
-			return (ARCHIVE_WARN);
-		}
+		if (a->flags & ARCHIVE_EXTRACT_PREALLOCATE)
+			bytes_written = buffered_write(a, buff,
+			    bytes_to_write);
+		else
+			bytes_written = write_at_offset(a, a->offset, buff,
+			    bytes_to_write);
+		if (bytes_written < 0)
+			return (bytes_written);
 		buff += bytes_written;
 		size -= bytes_written;
 		a->total_bytes_written += bytes_written;
 		a->offset += bytes_written;
-		a->fd_offset = a->offset;
 	}
 	return (start_size - size);
 }
@@ -1647,6 +2102,209 @@ hfs_write_data_block(struct archive_write_disk *a, const char *buff,
 }
 #endif
 
+/*
+ * Write entry data, through the HFS+ compressor if that is in use.
+ */
+static ssize_t
+write_entry_data(struct archive_write_disk *a, const char *buff, size_t size)
+{
+	ssize_t r;
+	int prev = 0;
+
+	if (a->data_cloned)
+		return (size);
+	if (a->archive.stats != NULL)
+		prev = __archive_stats_enter(&a->archive,
+		    ARCHIVE_STATS_DISK_WRITE);
+	if (a->todo & TODO_HFS_COMPRESSION)
+		r = hfs_write_data_block(a, buff, size);
+	else
+		r = write_data_block(a, buff, size);
+	if (a->archive.stats != NULL)
+		__archive_stats_leave(&a->archive, prev, r);
+	return (r);
+}
+
+/* Largest piece handed to copy_file_range() or sendfile() at once. */
+#define COPY_CHUNK_SIZE	(1 << 30)
+#define COPY_CHUNK(n)	((n) < COPY_CHUNK_SIZE ? (size_t)(n) : COPY_CHUNK_SIZE)
+
+/*
+ * Move up to `size' bytes from `fd' to the current file without
+ * passing them through user memory: by cloning the whole file, with
+ * copy_file_range() or with sendfile().  The source is read from
+ * `*in_off', which is advanced, or from the position of `fd' if
+ * `in_off' is NULL.  Each method copies what it can; the caller
+ * copies whatever is left by hand, which also reports any error.
+ * Returns the bytes moved or an ARCHIVE_* status.
+ */
+static int64_t
+copy_fd_in_kernel(struct archive_write_disk *a, int fd, off_t *in_off,
+    int64_t size)
+{
+	int64_t total = 0;
+
+	if (a->fd < 0 || size <= 0 || (a->todo & TODO_HFS_COMPRESSION) ||
+	    (a->flags & ARCHIVE_EXTRACT_SPARSE))
+		return (0);
+	if (a->wbuff_len > 0 && flush_write_buffer(a) != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
+	if (a->offset != a->fd_offset) {
+		if (a->offset > a->fd_offset)
+			punch_hole(a, a->fd_offset, a->offset - a->fd_offset);
+		if (lseek(a->fd, a->offset, SEEK_SET) < 0) {
+			archive_set_error(&a->archive, errno, "Seek failed");
+			return (ARCHIVE_FATAL);
+		}
+		a->fd_offset = a->offset;
+	}
+
+#ifdef FICLONE
+	/* A whole file on the same file system can share its blocks. */
+	if (a->offset == 0 && a->filesize == size &&
+	    (in_off != NULL ? *in_off : lseek(fd, 0, SEEK_CUR)) == 0) {
+		struct stat st;
+
+		if (fstat(fd, &st) == 0 && st.st_size == size &&
+		    ioctl(a->fd, FICLONE, fd) == 0 &&
+		    lseek(a->fd, size, SEEK_SET) == size) {
+			if (in_off != NULL)
+				*in_off = size;
+			else if (lseek(fd, size, SEEK_SET) != size)
+				return (ARCHIVE_FATAL);
+			total = size;
+		}
+	}
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+	{
+		ssize_t n;
+
+		while (total < size && (n = copy_file_range(fd, in_off,
+		    a->fd, NULL, COPY_CHUNK(size - total), 0)) > 0)
+			total += n;
+	}
+#endif
+#if defined(__linux__) && defined(HAVE_SYS_SENDFILE_H)
+	{
+		ssize_t n;
+
+		while (total < size && (n = sendfile(a->fd, fd, in_off,
+		    COPY_CHUNK(size - total))) > 0)
+			total += n;
+	}
+#endif
+	a->offset += total;
+	a->fd_offset += total;
+	a->total_bytes_written += total;
+	return (total);
+}
+
+/*
+ * With ARCHIVE_EXTRACT_CLONE, copy the data of a new regular file
+ * from the source file of its entry as soon as the file is created.
+ * The data the client writes afterwards is then dropped.  If the
+ * kernel cannot copy all of it, nothing is kept and the data is
+ * written as usual.  The position of the source file is not moved.
+ *
+ * The descriptor is only a hint and may have been closed and reused
+ * since the entry was read, so it must still be a regular file of
+ * the entry's size and, if the entry has them, device and inode.
+ */
+static void
+clone_source(struct archive_write_disk *a)
+{
+	struct stat st;
+	off_t in_off = 0;
+	int64_t total;
+	int fd;
+
+	fd = a->source_fd;
+	if (fd < 0 || a->fd < 0 || a->filesize <= 0)
+		return;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    st.st_size != a->filesize)
+		return;
+	if (archive_entry_dev_is_set(a->entry) &&
+	    (int64_t)st.st_dev != (int64_t)archive_entry_dev(a->entry))
+		return;
+	if (archive_entry_ino_is_set(a->entry) &&
+	    (int64_t)st.st_ino != archive_entry_ino64(a->entry))
+		return;
+	total = copy_fd_in_kernel(a, fd, &in_off, a->filesize);
+	if (total == a->filesize) {
+		a->data_cloned = 1;
+		return;
+	}
+	if (total > 0) {
+		/* Start over; the client's data overwrites the copy. */
+		a->total_bytes_written -= total;
+		a->offset = 0;
+	}
+}
+
+la_int64_t
+archive_write_disk_data_from_fd(struct archive *_a, int fd)
+{
+	struct archive_write_disk *a = (struct archive_write_disk *)_a;
+	int64_t remaining, total;
+	ssize_t bytes_read, r = 0;
+	char *buff = NULL;
+	int prev = 0;
+
+	archive_check_magic(&a->archive, ARCHIVE_WRITE_DISK_MAGIC,
+	    ARCHIVE_STATE_DATA, "archive_write_disk_data_from_fd");
+
+	if (a->data_cloned)
+		return (0);
+	if (a->archive.stats != NULL)
+		prev = __archive_stats_enter(&a->archive,
+		    ARCHIVE_STATS_DISK_WRITE);
+	if (a->filesize < 0)
+		remaining = INT64_MAX;
+	else
+		remaining = a->filesize - a->offset;
+	total = copy_fd_in_kernel(a, fd, NULL, remaining);
+	if (total < 0) {
+		r = (ssize_t)total;
+		total = 0;
+	}
+	remaining -= total;
+
+	/* Copy what the kernel could not through a buffer. */
+	while (r == 0 && remaining > 0) {
+		if (buff == NULL &&
+		    (buff = malloc(WRITE_BUFFER_SIZE)) == NULL) {
+			archive_set_error(&a->archive, ENOMEM,
+			    "Can't allocate copy buffer");
+			r = ARCHIVE_FATAL;
+			break;
+		}
+		bytes_read = read(fd, buff, remaining < WRITE_BUFFER_SIZE ?
+		    (size_t)remaining : WRITE_BUFFER_SIZE);
+		if (bytes_read < 0) {
+			archive_set_error(&a->archive, errno, "Read failed");
+			r = ARCHIVE_FAILED;
+			break;
+		}
+		if (bytes_read == 0)
+			break;
+		if (a->todo & TODO_HFS_COMPRESSION)
+			r = hfs_write_data_block(a, buff, bytes_read);
+		else
+			r = write_data_block(a, buff, bytes_read);
+		if (r < 0)
+			break;
+		total += r;
+		remaining -= r;
+		r = 0;
+	}
+	free(buff);
+	if (a->archive.stats != NULL)
+		__archive_stats_leave(&a->archive, prev, total);
+	return (r < 0 ? r : total);
+}
+
 static ssize_t
 _archive_write_disk_data_block(struct archive *_a,
     const void *buff, size_t size, int64_t offset)
@@ -1658,10 +2316,7 @@ _archive_write_disk_data_block(struct archive *_a,
 	    ARCHIVE_STATE_DATA, "archive_write_data_block");
 
 	a->offset = offset;
-	if (a->todo & TODO_HFS_COMPRESSION)
-		r = hfs_write_data_block(a, buff, size);
-	else
-		r = write_data_block(a, buff, size);
+	r = write_entry_data(a, buff, size);
 	if (r < ARCHIVE_OK)
 		return (r);
 	if ((size_t)r < size) {
@@ -1685,16 +2340,26 @@ _archive_write_disk_data(struct archive *_a, const void *buff, size_t size)
 	archive_check_magic(&a->archive, ARCHIVE_WRITE_DISK_MAGIC,
 	    ARCHIVE_STATE_DATA, "archive_write_data");
 
-	if (a->todo & TODO_HFS_COMPRESSION)
-		return (hfs_write_data_block(a, buff, size));
-	return (write_data_block(a, buff, size));
+	return (write_entry_data(a, buff, size));
 }
 
 static int
 _archive_write_disk_finish_entry(struct archive *_a)
 {
 	struct archive_write_disk *a = (struct archive_write_disk *)_a;
-	int ret = ARCHIVE_OK;
+	int ret;
+
+	cwd_lock_enter(a, 0);
+	ret = write_disk_finish_entry(_a);
+	cwd_lock_leave(a);
+	return (ret);
+}
+
+static int
+write_disk_finish_entry(struct archive *_a)
+{
+	struct archive_write_disk *a = (struct archive_write_disk *)_a;
+	int prev, ret;
 
 	archive_check_magic(&a->archive, ARCHIVE_WRITE_DISK_MAGIC,
 	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA,
@@ -1703,6 +2368,34 @@ _archive_write_disk_finish_entry(struct archive *_a)
 		return (ARCHIVE_OK);
 	archive_clear_error(&a->archive);
 
+	if (a->archive.stats == NULL)
+		return (finish_entry(a));
+	prev = __archive_stats_enter(&a->archive, ARCHIVE_STATS_DISK_METADATA);
+	ret = finish_entry(a);
+	__archive_stats_leave(&a->archive, prev, 0);
+	return (ret);
+}
+
+/*
+ * Complete the size of the current entry and restore its metadata.
+ */
+static int
+finish_entry(struct archive_write_disk *a)
+{
+	int ret = ARCHIVE_OK;
+
+	if (a->wbuff_len > 0) {
+		if (a->archive.stats != NULL) {
+			int prev = __archive_stats_enter(&a->archive,
+			    ARCHIVE_STATS_DISK_WRITE);
+			ret = flush_write_buffer(a);
+			__archive_stats_leave(&a->archive, prev, 0);
+		} else
+			ret = flush_write_buffer(a);
+		if (ret == ARCHIVE_FATAL)
+			return (ret);
+	}
+
 	/* Pad or truncate file to the right size. */
 	if (a->fd < 0) {
 		/* There's no file. */
@@ -1746,6 +2439,9 @@ _archive_write_disk_finish_entry(struct archive *_a)
 		a->pst = NULL;
 		if ((ret = lazy_stat(a)) != ARCHIVE_OK)
 			return (ret);
+		/* Nothing was written after fd_offset. */
+		if (a->fd_offset < a->filesize)
+			punch_hole(a, a->fd_offset, a->filesize - a->fd_offset);
 		/* We can use lseek()/write() to extend the file if
 		 * ftruncate didn't work or isn't available. */
 		if (a->st.st_size < a->filesize) {
@@ -1895,6 +2591,7 @@ finish_metadata:
 		close(a->fd);
 		a->fd = -1;
 		if (a->tmpname) {
+			forget_path(a, a->name);
 			if (rename(a->tmpname, a->name) == -1) {
 				archive_set_error(&a->archive, errno,
 				    "Failed to rename temporary file");
@@ -1996,12 +2693,98 @@ archive_write_disk_new(void)
 		free(a);
 		return (NULL);
 	}
+	__archive_rb_tree_init(&a->dir_cache, &dir_cache_rb_ops);
+	a->parent_fd = -1;
+	a->source_fd = -1;
+	a->dirfd = AT_FDCWD;
 #ifdef HAVE_ZLIB_H
 	a->decmpfs_compression_level = 5;
 #endif
 	return (&a->archive);
 }
 
+/*
+ * An object and its clones share the working directory, which
+ * edit_deep_directories() changes for the duration of a header.  Once
+ * an object has been cloned, headers and finish_entry() hold the lock
+ * shared, or exclusively for names that may be edited that way.
+ */
+static void
+cwd_lock_enter(struct archive_write_disk *a, int exclusive)
+{
+#ifdef ARCHIVE_HAVE_THREADS
+	if (a->cwd_lock == NULL)
+		return;
+	if (exclusive)
+		pthread_rwlock_wrlock(&a->cwd_lock->lock);
+	else
+		pthread_rwlock_rdlock(&a->cwd_lock->lock);
+#else
+	(void)a; /* UNUSED */
+	(void)exclusive; /* UNUSED */
+#endif
+}
+
+static void
+cwd_lock_leave(struct archive_write_disk *a)
+{
+#ifdef ARCHIVE_HAVE_THREADS
+	if (a->cwd_lock != NULL)
+		pthread_rwlock_unlock(&a->cwd_lock->lock);
+#else
+	(void)a; /* UNUSED */
+#endif
+}
+
+/*
+ * Create a new archive_write_disk object with the options of `_a', for
+ * use on another thread.  Lookup functions and their private data are
+ * not shared; if `_a' has any, the new object uses the standard lookup.
+ * Statistics are enabled if they are on `_a'; see __archive_stats_merge().
+ * Clones must be made and freed on the thread that owns `_a'.  From
+ * then on, `_a' restores the times of a directory that already exists
+ * when it is closed, as it does for one it creates.
+ * Returns NULL if `_a' is not an archive_write_disk object, or if its
+ * options need entries to be written in archive order.
+ */
+struct archive *
+__archive_write_disk_clone(struct archive *_a)
+{
+	struct archive_write_disk *a = (struct archive_write_disk *)_a;
+	struct archive *ad;
+
+	if (_a->magic != ARCHIVE_WRITE_DISK_MAGIC ||
+	    (a->flags & ARCHIVE_EXTRACT_NO_AUTODIR))
+		return (NULL);
+	if (a->cwd_lock == NULL) {
+		a->cwd_lock = calloc(1, sizeof(*a->cwd_lock));
+		if (a->cwd_lock == NULL)
+			return (NULL);
+#ifdef ARCHIVE_HAVE_THREADS
+		if (pthread_rwlock_init(&a->cwd_lock->lock, NULL) != 0) {
+			free(a->cwd_lock);
+			a->cwd_lock = NULL;
+			return (NULL);
+		}
+#endif
+		a->cwd_lock->refs = 1;
+	}
+	if ((ad = archive_write_disk_new()) == NULL)
+		return (NULL);
+	((struct archive_write_disk *)ad)->cwd_lock = a->cwd_lock;
+	a->cwd_lock->refs++;
+	a->defer_dir_times = 1;
+	archive_write_disk_set_options(ad, a->flags);
+	if (a->archive.stats != NULL)
+		archive_stats_enable(ad);
+	if (a->skip_file_set)
+		archive_write_disk_set_skip_file(ad, a->skip_file_dev,
+		    a->skip_file_ino);
+	if (a->lookup_uid != NULL || a->lookup_gid != NULL)
+		archive_write_disk_set_standard_lookup(ad);
+	return (ad);
+}
+
 
 /*
  * If pathname is longer than PATH_MAX, chdir to a suitable
@@ -2072,14 +2855,16 @@ restore_entry(struct archive_write_disk *a)
 		 */
 		if (a->flags & ARCHIVE_EXTRACT_CLEAR_NOCHANGE_FFLAGS)
 			(void)clear_nochange_fflags(a);
-		if (unlink(a->name) == 0) {
+		forget_path(a, a->name);
+		if (la_unlinkat(a->dirfd, a->base, 0) == 0) {
 			/* We removed it, reset cached stat. */
 			a->pst = NULL;
 		} else if (errno == ENOENT) {
 			/* File didn't exist, that's just as good. */
-		} else if (rmdir(a->name) == 0) {
+		} else if (la_unlinkat(a->dirfd, a->base, AT_REMOVEDIR) == 0) {
 			/* It was a dir, but now it's gone. */
 			a->pst = NULL;
+			dir_cache_flush(a);
 		} else {
 			/* We tried, but couldn't get rid of it. */
 			archive_set_error(&a->archive, errno,
@@ -2095,6 +2880,7 @@ restore_entry(struct archive_write_disk *a)
 	    && !(a->flags & ARCHIVE_EXTRACT_NO_AUTODIR)) {
 		/* If the parent dir doesn't exist, try creating it. */
 		create_parent_dir(a, a->name);
+		open_parent_dir(a);
 		/* Now try to create the object again. */
 		en = create_filesystem_object(a);
 	}
@@ -2126,12 +2912,14 @@ restore_entry(struct archive_write_disk *a)
 	 */
 	if (en == EISDIR) {
 		/* A dir is in the way of a non-dir, rmdir it. */
-		if (rmdir(a->name) != 0) {
+		forget_path(a, a->name);
+		if (la_unlinkat(a->dirfd, a->base, AT_REMOVEDIR) != 0) {
 			archive_set_error(&a->archive, errno,
 			    "Can't remove already-existing dir");
 			return (ARCHIVE_FAILED);
 		}
 		a->pst = NULL;
+		dir_cache_flush(a);
 		/* Try again. */
 		en = create_filesystem_object(a);
 	} else if (en == EEXIST) {
@@ -2146,13 +2934,14 @@ restore_entry(struct archive_write_disk *a)
 		 * follow the symlink if we're creating a dir.
 		 */
 		if (S_ISDIR(a->mode))
-			r = la_stat(a->name, &a->st);
+			r = la_fstatat(a->dirfd, a->base, &a->st, 0);
 		/*
 		 * If it's not a dir (or it's a broken symlink),
 		 * then don't follow it.
 		 */
 		if (r != 0 || !S_ISDIR(a->mode))
-			r = lstat(a->name, &a->st);
+			r = la_fstatat(a->dirfd, a->base, &a->st,
+			    AT_SYMLINK_NOFOLLOW);
 		if (r != 0) {
 			archive_set_error(&a->archive, errno,
 			    "Can't stat existing object");
@@ -2195,7 +2984,8 @@ restore_entry(struct archive_write_disk *a)
 				en = 0;
 			} else {
 				/* A non-dir is in the way, unlink it. */
-				if (unlink(a->name) != 0) {
+				forget_path(a, a->name);
+				if (la_unlinkat(a->dirfd, a->base, 0) != 0) {
 					archive_set_error(&a->archive, errno,
 					    "Can't unlink already-existing "
 					    "object");
@@ -2209,11 +2999,13 @@ restore_entry(struct archive_write_disk *a)
 			/* A dir is in the way of a non-dir, rmdir it. */
 			if (a->flags & ARCHIVE_EXTRACT_CLEAR_NOCHANGE_FFLAGS)
 				(void)clear_nochange_fflags(a);
-			if (rmdir(a->name) != 0) {
+			forget_path(a, a->name);
+			if (la_unlinkat(a->dirfd, a->base, AT_REMOVEDIR) != 0) {
 				archive_set_error(&a->archive, errno,
 				    "Can't replace existing directory with non-directory");
 				return (ARCHIVE_FAILED);
 			}
+			dir_cache_flush(a);
 			/* Try again. */
 			en = create_filesystem_object(a);
 		} else {
@@ -2227,6 +3019,14 @@ restore_entry(struct archive_write_disk *a)
 			if ((a->mode != a->st.st_mode)
 			    && (a->todo & TODO_MODE_FORCE))
 				a->deferred |= (a->todo & TODO_MODE);
+			/* Once the object has been cloned, this is
+			 * likely a dir its clones made ahead of its
+			 * entry: as for a new dir, set the times last,
+			 * since more entries may be written into it. */
+			if (a->defer_dir_times) {
+				a->deferred |= (a->todo & TODO_TIMES);
+				a->todo &= ~TODO_TIMES;
+			}
 			/* Ownership doesn't need deferred fixup. */
 			en = 0; /* Forget the EEXIST. */
 		}
@@ -2292,7 +3092,7 @@ create_filesystem_object(struct archive_write_disk *a)
 			return (EPERM);
 		}
 		r = check_symlinks_fsobj(linkname_copy, &error_number,
-		    &error_string, a->flags, 1);
+		    &error_string, a->flags, 1, a);
 		if (r != ARCHIVE_OK) {
 			archive_set_error(&a->archive, error_number, "%s",
 			    error_string.s);
@@ -2311,10 +3111,12 @@ create_filesystem_object(struct archive_write_disk *a)
 		 * but doing it right, would require us to construct
 		 * an mktemplink() function, and then use rename(2).
 		 */
-		if (a->flags & ARCHIVE_EXTRACT_SAFE_WRITES)
-			unlink(a->name);
+		if (a->flags & ARCHIVE_EXTRACT_SAFE_WRITES) {
+			forget_path(a, a->name);
+			la_unlinkat(a->dirfd, a->base, 0);
+		}
 #ifdef HAVE_LINKAT
-		r = linkat(AT_FDCWD, linkname, AT_FDCWD, a->name,
+		r = linkat(AT_FDCWD, linkname, a->dirfd, a->base,
 		    0) ? errno : 0;
 #else
 		r = link(linkname, a->name) ? errno : 0;
@@ -2335,16 +3137,14 @@ create_filesystem_object(struct archive_write_disk *a)
 			a->todo = 0;
 			a->deferred = 0;
 		} else if (r == 0 && a->filesize > 0) {
-#ifdef HAVE_LSTAT
-			r = lstat(a->name, &st);
-#else
-			r = la_stat(a->name, &st);
-#endif
+			r = la_fstatat(a->dirfd, a->base, &st,
+			    AT_SYMLINK_NOFOLLOW);
 			if (r != 0)
 				r = errno;
 			else if ((st.st_mode & AE_IFMT) == AE_IFREG) {
-				a->fd = open(a->name, O_WRONLY | O_TRUNC |
-				    O_BINARY | O_CLOEXEC | O_NOFOLLOW);
+				a->fd = la_openat(a->dirfd, a->base,
+				    O_WRONLY | O_TRUNC | O_BINARY | O_CLOEXEC |
+				    O_NOFOLLOW, 0);
 				__archive_ensure_cloexec_flag(a->fd);
 				if (a->fd < 0)
 					r = errno;
@@ -2361,9 +3161,15 @@ create_filesystem_object(struct archive_write_disk *a)
 		 * but doing it right, would require us to construct
 		 * an mktempsymlink() function, and then use rename(2).
 		 */
-		if (a->flags & ARCHIVE_EXTRACT_SAFE_WRITES)
-			unlink(a->name);
+		if (a->flags & ARCHIVE_EXTRACT_SAFE_WRITES) {
+			forget_path(a, a->name);
+			la_unlinkat(a->dirfd, a->base, 0);
+		}
+#ifdef HAVE_SYMLINKAT
+		return symlinkat(linkname, a->dirfd, a->base) ? errno : 0;
+#else
 		return symlink(linkname, a->name) ? errno : 0;
+#endif
 #else
 		return (EPERM);
 #endif
@@ -2399,7 +3205,7 @@ create_filesystem_object(struct archive_write_disk *a)
 		/* FALLTHROUGH */
 	case AE_IFREG:
 		a->tmpname = NULL;
-		a->fd = open(a->name,
+		a->fd = la_openat(a->dirfd, a->base,
 		    O_WRONLY | O_CREAT | O_EXCL | O_BINARY | O_CLOEXEC, mode);
 		__archive_ensure_cloexec_flag(a->fd);
 		r = (a->fd < 0);
@@ -2408,8 +3214,13 @@ create_filesystem_object(struct archive_write_disk *a)
 #ifdef HAVE_MKNOD
 		/* Note: we use AE_IFCHR for the case label, and
 		 * S_IFCHR for the mknod() call.  This is correct.  */
+#ifdef HAVE_MKNODAT
+		r = mknodat(a->dirfd, a->base, mode | S_IFCHR,
+		    archive_entry_rdev(a->entry));
+#else
 		r = mknod(a->name, mode | S_IFCHR,
 		    archive_entry_rdev(a->entry));
+#endif
 		break;
 #else
 		/* TODO: Find a better way to warn about our inability
@@ -2418,8 +3229,13 @@ create_filesystem_object(struct archive_write_disk *a)
 #endif /* HAVE_MKNOD */
 	case AE_IFBLK:
 #ifdef HAVE_MKNOD
+#ifdef HAVE_MKNODAT
+		r = mknodat(a->dirfd, a->base, mode | S_IFBLK,
+		    archive_entry_rdev(a->entry));
+#else
 		r = mknod(a->name, mode | S_IFBLK,
 		    archive_entry_rdev(a->entry));
+#endif
 		break;
 #else
 		/* TODO: Find a better way to warn about our inability
@@ -2428,7 +3244,11 @@ create_filesystem_object(struct archive_write_disk *a)
 #endif /* HAVE_MKNOD */
 	case AE_IFDIR:
 		mode = (mode | MINIMUM_DIR_MODE) & MAXIMUM_DIR_MODE;
+#ifdef HAVE_MKDIRAT
+		r = mkdirat(a->dirfd, a->base, mode);
+#else
 		r = mkdir(a->name, mode);
+#endif
 		if (r == 0) {
 			/* Defer setting dir times. */
 			a->deferred |= (a->todo & TODO_TIMES);
@@ -2444,7 +3264,11 @@ create_filesystem_object(struct archive_write_disk *a)
 		break;
 	case AE_IFIFO:
 #ifdef HAVE_MKFIFO
+#ifdef HAVE_MKFIFOAT
+		r = mkfifoat(a->dirfd, a->base, mode);
+#else
 		r = mkfifo(a->name, mode);
+#endif
 		break;
 #else
 		/* TODO: Find a better way to warn about our inability
@@ -2492,12 +3316,20 @@ _archive_write_disk_close(struct archive *_a)
 	struct fixup_entry *next, *p;
 	struct stat st;
 	char *c;
-	int fd, ret, openflags;
+	int fd, ret, openflags, prev = 0;
 
 	archive_check_magic(&a->archive, ARCHIVE_WRITE_DISK_MAGIC,
 	    ARCHIVE_STATE_HEADER | ARCHIVE_STATE_DATA,
 	    "archive_write_disk_close");
 	ret = _archive_write_disk_finish_entry(&a->archive);
+	dir_cache_flush(a);
+	close_parent_dir(a);
+	a->cwd_known = 0;
+
+	/* The deferred fixups are metadata, too. */
+	if (a->archive.stats != NULL && a->fixup_list != NULL)
+		prev = __archive_stats_enter(&a->archive,
+		    ARCHIVE_STATS_DISK_METADATA);
 
 	/* Sort dir list so directories are fixed up in depth-first order. */
 	p = sort_dir_list(a->fixup_list);
@@ -2608,6 +3440,8 @@ skip_fixup_entry:
 		free(p);
 		p = next;
 	}
+	if (a->archive.stats != NULL && a->fixup_list != NULL)
+		__archive_stats_leave(&a->archive, prev, 0);
 	a->fixup_list = NULL;
 	return (ret);
 }
@@ -2630,8 +3464,18 @@ _archive_write_disk_free(struct archive *_a)
 	archive_string_free(&a->_tmpname_data);
 	archive_string_free(&a->archive.error_string);
 	archive_string_free(&a->path_safe);
+	dir_cache_flush(a);
+	close_parent_dir(a);
+	archive_string_free(&a->parent_path);
+	if (a->cwd_lock != NULL && --a->cwd_lock->refs == 0) {
+#ifdef ARCHIVE_HAVE_THREADS
+		pthread_rwlock_destroy(&a->cwd_lock->lock);
+#endif
+		free(a->cwd_lock);
+	}
 	a->archive.magic = 0;
 	__archive_clean(&a->archive);
+	free(a->wbuff);
 	free(a->decmpfs_header_p);
 	free(a->resource_fork);
 	free(a->compressed_buffer);
@@ -2771,13 +3615,88 @@ fsobj_error(int *a_eno, struct archive_string *a_estr,
  * scan the path and both can be optimized by comparing against other
  * recent paths.
  */
+/*
+ * The verified-directory cache.  Entries are only ever added for
+ * directories we have just seen (with lstat semantics) or created
+ * ourselves, and the whole cache is dropped whenever we remove a
+ * directory, since that is the only way the archive itself can turn
+ * a verified directory into something else.  Changes made behind our
+ * back by other processes are no more detectable than they were
+ * between the lstat() and the open() before.
+ */
+static int
+dir_cache_cmp_node(const struct archive_rb_node *n1,
+    const struct archive_rb_node *n2)
+{
+	const struct dir_cache_entry *e1 = (const struct dir_cache_entry *)n1;
+	const struct dir_cache_entry *e2 = (const struct dir_cache_entry *)n2;
+
+	return (strcmp(e1->name, e2->name));
+}
+
+static int
+dir_cache_cmp_key(const struct archive_rb_node *n, const void *key)
+{
+	const struct dir_cache_entry *e = (const struct dir_cache_entry *)n;
+
+	return (strcmp(e->name, (const char *)key));
+}
+
+static int
+dir_cache_lookup(struct archive_write_disk *a, const char *path)
+{
+	if (a->dir_cache_count == 0)
+		return (0);
+	return (__archive_rb_tree_find_node(&a->dir_cache, path) != NULL);
+}
+
+static void
+dir_cache_add(struct archive_write_disk *a, const char *path)
+{
+	struct dir_cache_entry *e;
+	size_t len;
+
+	if (a->dir_cache_count >= DIR_CACHE_MAX)
+		dir_cache_flush(a);
+	len = strlen(path);
+	e = malloc(sizeof(*e) + len);
+	if (e == NULL)
+		return;	/* It's only a cache. */
+	memcpy(e->name, path, len + 1);
+	if (!__archive_rb_tree_insert_node(&a->dir_cache, &e->node)) {
+		free(e);
+		return;
+	}
+	e->next = a->dir_cache_list;
+	a->dir_cache_list = e;
+	a->dir_cache_count++;
+}
+
+static void
+dir_cache_flush(struct archive_write_disk *a)
+{
+	struct dir_cache_entry *e;
+
+	while ((e = a->dir_cache_list) != NULL) {
+		a->dir_cache_list = e->next;
+		free(e);
+	}
+	a->dir_cache_count = 0;
+	__archive_rb_tree_init(&a->dir_cache, &dir_cache_rb_ops);
+}
+
 /*
  * Checks the given path to see if any elements along it are symlinks.  Returns
  * ARCHIVE_OK if there are none, otherwise puts an error in errmsg.
+ *
+ * Unless we're checking a link target, directories in the
+ * verified-directory cache of a are not checked again, and directories
+ * found along the way are added.  Anything we remove is reported to
+ * forget_path().
  */
 static int
 check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
-    int flags, int checking_linkname)
+    int flags, int checking_linkname, struct archive_write_disk *a)
 {
 #if !defined(HAVE_LSTAT) && \
     !(defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT))
@@ -2787,11 +3706,14 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 	(void)error_string; /* UNUSED */
 	(void)flags; /* UNUSED */
 	(void)checking_linkname; /* UNUSED */
+	(void)a; /* UNUSED */
 	return (ARCHIVE_OK);
 #else
 	int res = ARCHIVE_OK;
 	char *tail;
 	char *head;
+	char *verified;
+	int use_cache;
 	int last;
 	char c;
 	int r;
@@ -2805,6 +3727,32 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 	if(path[0] == '\0')
 	    return (ARCHIVE_OK);
 
+	/*
+	 * Find the longest leading part of the path that is already
+	 * known to be clean; the walk below can start right after it.
+	 */
+	use_cache = a->cwd_known && !checking_linkname;
+	verified = NULL;
+	if (use_cache && a->dir_cache_count > 0) {
+		tail = path + strlen(path);
+		for (;;) {
+			c = tail[0];
+			tail[0] = '\0';
+			r = dir_cache_lookup(a, path);
+			tail[0] = c;
+			if (r) {
+				verified = tail;
+				break;
+			}
+			while (tail > path && *--tail != '/')
+				continue;
+			if (tail == path)
+				break;
+		}
+		if (verified != NULL && verified[0] == '\0')
+			return (ARCHIVE_OK);
+	}
+
 	/*
 	 * Guard against symlink tricks.  Reject any archive entry whose
 	 * destination would be altered by a symlink.
@@ -2820,17 +3768,48 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 	 *  c holds what used to be in *tail
 	 *  last is 1 if this is the last tail
 	 */
-	chdir_fd = la_opendirat(AT_FDCWD, ".");
-	__archive_ensure_cloexec_flag(chdir_fd);
+	chdir_fd = -1;
+#if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT)
+	if (verified != NULL) {
+		/*
+		 * Look up the rest relative to the verified prefix, so
+		 * no lookup sees more than the unchecked components; the
+		 * whole name may be longer than PATH_MAX.
+		 */
+		c = verified[0];
+		verified[0] = '\0';
+#ifdef PATH_MAX
+		if (verified - path < PATH_MAX)
+#endif
+			chdir_fd = la_opendirat(AT_FDCWD, path);
+		verified[0] = c;
+		if (chdir_fd < 0)
+			verified = NULL;
+	}
+#elif defined(PATH_MAX)
+	/* lstat() below sees the whole name. */
+	if (verified != NULL && strlen(path) >= PATH_MAX)
+		verified = NULL;
+#endif
 	if (chdir_fd < 0) {
-		fsobj_error(a_eno, a_estr, errno,
-		    "Could not open ", path);
-		return (ARCHIVE_FATAL);
+		chdir_fd = la_opendirat(AT_FDCWD, ".");
+		__archive_ensure_cloexec_flag(chdir_fd);
+		if (chdir_fd < 0) {
+			fsobj_error(a_eno, a_estr, errno,
+			    "Could not open ", path);
+			return (ARCHIVE_FATAL);
+		}
 	}
 	head = path;
-	tail = path;
+	tail = (verified != NULL) ? verified : path;
+#if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT)
+	if (verified != NULL) {
+		while (*tail == '/')
+			++tail;
+		head = tail;
+	}
+#endif
 	last = 0;
-	/* TODO: reintroduce a safe cache here? */
 	/* Skip the root directory if the path is absolute. */
 	if(tail == path && tail[0] == '/')
 		++tail;
@@ -2884,6 +3863,9 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 				break;
 			}
 		} else if (S_ISDIR(st.st_mode)) {
+			/* path is truncated to this directory right now. */
+			if (use_cache)
+				dir_cache_add(a, path);
 			if (!last) {
 #if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT)
 				fd = la_opendirat(chdir_fd, head);
@@ -2891,7 +3873,8 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 					r = -1;
 				else {
 					r = 0;
-					close(chdir_fd);
+					if (chdir_fd >= 0)
+						close(chdir_fd);
 					chdir_fd = fd;
 				}
 #else
@@ -2936,6 +3919,7 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 				 * so we can overwrite it with the
 				 * item being extracted.
 				 */
+				forget_path(a, path);
 #if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT)
 				r = unlinkat(chdir_fd, head, 0);
 #else
@@ -2971,6 +3955,7 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 				break;
 			} else if (flags & ARCHIVE_EXTRACT_UNLINK) {
 				/* User asked us to remove problems. */
+				forget_path(a, path);
 #if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT)
 				r = unlinkat(chdir_fd, head, 0);
 #else
@@ -3011,13 +3996,19 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 						break;
 					}
 				} else if (S_ISDIR(st.st_mode)) {
+					/*
+					 * Nothing below a followed symlink
+					 * may go into the cache.
+					 */
+					use_cache = 0;
 #if defined(HAVE_OPENAT) && defined(HAVE_FSTATAT) && defined(HAVE_UNLINKAT)
 					fd = la_opendirat(chdir_fd, head);
 					if (fd < 0)
 						r = -1;
 					else {
 						r = 0;
-						close(chdir_fd);
+						if (chdir_fd >= 0)
+							close(chdir_fd);
 						chdir_fd = fd;
 					}
 #else
@@ -3079,7 +4070,6 @@ check_symlinks_fsobj(char *path, int *a_eno, struct archive_string *a_estr,
 		}
 	}
 #endif
-	/* TODO: reintroduce a safe cache here? */
 	return res;
 #endif
 }
@@ -3094,9 +4084,10 @@ check_symlinks(struct archive_write_disk *a)
 	struct archive_string error_string;
 	int error_number;
 	int rc;
+
 	archive_string_init(&error_string);
 	rc = check_symlinks_fsobj(a->name, &error_number, &error_string,
-	    a->flags, 0);
+	    a->flags, 0, a);
 	if (rc != ARCHIVE_OK) {
 		archive_set_error(&a->archive, error_number, "%s",
 		    error_string.s);
@@ -3328,7 +4319,7 @@ create_dir(struct archive_write_disk *a, char *path)
 	struct fixup_entry *le;
 	char *slash, *base;
 	mode_t mode_final, mode;
-	int r;
+	int r, use_cache;
 
 	/* Check for special names and just skip them. */
 	slash = strrchr(path, '/');
@@ -3350,6 +4341,17 @@ create_dir(struct archive_write_disk *a, char *path)
 		return (ARCHIVE_OK);
 	}
 
+	/*
+	 * check_symlinks() has vetted the verified-directory cache for
+	 * this entry, but it knows nothing of the chdir() done for
+	 * very deep paths.
+	 */
+	use_cache = a->cwd_known &&
+	    (a->flags & ARCHIVE_EXTRACT_SECURE_SYMLINKS) &&
+	    a->restore_pwd < 0;
+	if (use_cache && dir_cache_lookup(a, path))
+		return (ARCHIVE_OK);
+
 	/*
 	 * Yes, this should be stat() and not lstat().  Using lstat()
 	 * here loses the ability to extract through symlinks.  Also note
@@ -3363,6 +4365,7 @@ create_dir(struct archive_write_disk *a, char *path)
 			    "Can't create directory '%s'", path);
 			return (ARCHIVE_FAILED);
 		}
+		forget_path(a, path);
 		if (unlink(path) != 0) {
 			archive_set_error(&a->archive, errno,
 			    "Can't create directory '%s': "
@@ -3404,6 +4407,18 @@ create_dir(struct archive_write_disk *a, char *path)
 			le->fixup |=TODO_MODE_BASE;
 			le->mode = mode_final;
 		}
+		/* A fresh directory is as clean as its parent. */
+		if (use_cache) {
+			if (slash == NULL)
+				r = 1;
+			else {
+				*slash = '\0';
+				r = dir_cache_lookup(a, path);
+				*slash = '/';
+			}
+			if (r)
+				dir_cache_add(a, path);
+		}
 		return (ARCHIVE_OK);
 	}
 
@@ -3459,7 +4474,14 @@ set_ownership(struct archive_write_disk *a)
 
 	/* We prefer lchown() but will use chown() if that's all we have. */
 	/* Of course, if we have neither, this will always fail. */
-#ifdef HAVE_LCHOWN
+#ifdef HAVE_FCHOWNAT
+	if (fchownat(a->dirfd, a->base, a->uid, a->gid,
+	    AT_SYMLINK_NOFOLLOW) == 0) {
+		/* We've set owner and know uid/gid are correct. */
+		a->todo &= ~(TODO_OWNER | TODO_SGID_CHECK | TODO_SUID_CHECK);
+		return (ARCHIVE_OK);
+	}
+#elif HAVE_LCHOWN
 	if (lchown(a->name, a->uid, a->gid) == 0) {
 		/* We've set owner and know uid/gid are correct. */
 		a->todo &= ~(TODO_OWNER | TODO_SGID_CHECK | TODO_SUID_CHECK);
@@ -3790,7 +4812,11 @@ set_mode(struct archive_write_disk *a, int mode)
 #endif
 		/* If this platform lacks fchmod(), then
 		 * we'll just use chmod(). */
+#ifdef HAVE_FCHMODAT
+		r2 = fchmodat(a->dirfd, a->base, mode, 0);
+#else
 		r2 = chmod(a->name, mode);
+#endif
 
 		if (r2 != 0) {
 			archive_set_error(&a->archive, errno,
@@ -41,5 +41,6 @@ struct archive_write_disk;
 
 int archive_write_disk_set_acls(struct archive *, int, const char *,
     struct archive_acl *, __LA_MODE_T);
+struct archive *__archive_write_disk_clone(struct archive *);
 
 #endif
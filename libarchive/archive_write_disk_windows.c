@@ -48,6 +48,7 @@ __FBSDID("$FreeBSD$");
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
+#include <io.h>
 #include <winioctl.h>
 
 /* TODO: Support Mac OS 'quarantine' feature.  This is really just a
@@ -61,6 +62,7 @@ __FBSDID("$FreeBSD$");
 #include "archive_string.h"
 #include "archive_entry.h"
 #include "archive_private.h"
+#include "archive_write_disk_private.h"
 
 #ifndef O_BINARY
 #define O_BINARY 0
@@ -1160,6 +1162,36 @@ _archive_write_disk_data(struct archive *_a, const void *buff, size_t size)
 	return (write_data_block(a, buff, size));
 }
 
+la_int64_t
+archive_write_disk_data_from_fd(struct archive *_a, int fd)
+{
+	struct archive_write_disk *a = (struct archive_write_disk *)_a;
+	char *buff;
+	int64_t total = 0;
+	ssize_t bytes_read, r = 0;
+
+	archive_check_magic(&a->archive, ARCHIVE_WRITE_DISK_MAGIC,
+	    ARCHIVE_STATE_DATA, "archive_write_disk_data_from_fd");
+
+	if ((buff = malloc(64 * 1024)) == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate copy buffer");
+		return (ARCHIVE_FATAL);
+	}
+	while ((bytes_read = _read(fd, buff, 64 * 1024)) > 0) {
+		r = write_data_block(a, buff, bytes_read);
+		if (r <= 0)
+			break;
+		total += r;
+	}
+	if (bytes_read < 0) {
+		archive_set_error(&a->archive, errno, "Read failed");
+		r = ARCHIVE_FAILED;
+	}
+	free(buff);
+	return (r < 0 ? r : total);
+}
+
 static int
 _archive_write_disk_finish_entry(struct archive *_a)
 {
@@ -1373,6 +1405,33 @@ archive_write_disk_new(void)
 	return (&a->archive);
 }
 
+/*
+ * Create a new archive_write_disk object with the options of `_a', for
+ * use on another thread.  Lookup functions and their private data are
+ * not shared; if `_a' has any, the new object uses the standard lookup.
+ * Returns NULL if `_a' is not an archive_write_disk object, or if its
+ * options need entries to be written in archive order.
+ */
+struct archive *
+__archive_write_disk_clone(struct archive *_a)
+{
+	struct archive_write_disk *a = (struct archive_write_disk *)_a;
+	struct archive *ad;
+
+	if (_a->magic != ARCHIVE_WRITE_DISK_MAGIC ||
+	    (a->flags & ARCHIVE_EXTRACT_NO_AUTODIR))
+		return (NULL);
+	if ((ad = archive_write_disk_new()) == NULL)
+		return (NULL);
+	archive_write_disk_set_options(ad, a->flags);
+	if (a->skip_file_set)
+		archive_write_disk_set_skip_file(ad, a->skip_file_dev,
+		    a->skip_file_ino);
+	if (a->lookup_uid != NULL || a->lookup_gid != NULL)
+		archive_write_disk_set_standard_lookup(ad);
+	return (ad);
+}
+
 static int
 disk_unlink(const wchar_t *path)
 {
@@ -61,6 +61,7 @@ struct archive_write_filter {
 	int	  bytes_per_block;
 	int	  bytes_in_last_block;
 	int	  state;
+	int	  stats_stage;	/* See archive_stats_private.h. */
 };
 
 #if ARCHIVE_VERSION < 4000000
@@ -45,6 +45,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_set_format_gnu_tar.c 19157
 #include "archive_entry.h"
 #include "archive_entry_locale.h"
 #include "archive_private.h"
+#include "archive_tar_header_private.h"
 #include "archive_write_private.h"
 #include "archive_write_set_format_private.h"
 
@@ -567,7 +568,8 @@ archive_format_gnutar_header(struct archive_write *a, char h[512],
     struct archive_entry *entry, int tartype)
 {
 	unsigned int checksum;
-	int i, ret;
+	int high, sum;
+	int ret;
 	size_t copy_length;
 	const char *p;
 	struct gnutar *gnutar;
@@ -689,9 +691,8 @@ archive_format_gnutar_header(struct archive_write *a, char h[512],
 
 	h[GNUTAR_typeflag_offset] = tartype;
 
-	checksum = 0;
-	for (i = 0; i < 512; i++)
-		checksum += 255 & (unsigned int)h[i];
+	__archive_tar_header_sum(h, &sum, &high);
+	checksum = (unsigned int)sum;
 	h[GNUTAR_checksum_offset + 6] = '\0'; /* Can't be pre-set in the template. */
 	/* h[GNUTAR_checksum_offset + 7] = ' '; */ /* This is pre-set in the template. */
 	format_octal(checksum, h + GNUTAR_checksum_offset, 6);
@@ -732,24 +733,9 @@ format_256(int64_t v, char *p, int s)
 static int
 format_octal(int64_t v, char *p, int s)
 {
-	int len = s;
-
 	/* Octal values can't be negative, so use 0. */
 	if (v < 0)
 		v = 0;
 
-	p += s;		/* Start at the end and work backwards. */
-	while (s-- > 0) {
-		*--p = (char)('0' + (v & 7));
-		v >>= 3;
-	}
-
-	if (v == 0)
-		return (0);
-
-	/* If it overflowed, fill field with max value. */
-	while (len-- > 0)
-		*p++ = '7';
-
-	return (-1);
+	return (__archive_tar_format_octal(v, p, s));
 }
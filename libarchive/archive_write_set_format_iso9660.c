@@ -28,12 +28,18 @@
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
 #ifdef HAVE_SYS_UTSNAME_H
 #include <sys/utsname.h>
 #endif
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
 #ifdef HAVE_LIMITS_H
 #include <limits.h>
 #endif
@@ -56,6 +62,7 @@
 #include "archive_entry_locale.h"
 #include "archive_private.h"
 #include "archive_rb.h"
+#include "archive_thread_private.h"
 #include "archive_write_private.h"
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
@@ -63,6 +70,13 @@
 #define getgid()			0
 #endif
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC	0
+#endif
+
 /*#define DEBUG 1*/
 #ifdef DEBUG
 /* To compare to the ISO image file made by mkisofs. */
@@ -118,6 +132,8 @@ static const unsigned char zisofs_magic[8] = {
 #define ZF_HEADER_SIZE	16	/* zisofs header size. */
 #define ZF_LOG2_BS	15	/* log2 block size; 32K bytes. */
 #define ZF_BLOCK_SIZE	(1UL << ZF_LOG2_BS)
+/* Blocks per thread in a batch compressed in parallel. */
+#define ZF_BATCH_BLOCKS	8
 
 /*
  * Manage extra records.
@@ -193,6 +209,15 @@ struct isofile {
 		struct content	*next;		/* next content	*/
 	} content, *cur_content;
 	int			 write_content;
+	/*
+	 * The contents are read from source_path at close; the file
+	 * must still be the one that was there at header time.
+	 */
+	int			 from_source;
+	struct archive_string	 source_path;
+	int64_t			 source_dev;
+	int64_t			 source_ino;
+	int64_t			 source_mtime;
 
 	enum {
 		NO = 0,
@@ -639,6 +664,20 @@ struct iso_option {
 #define OPT_RR_USEFUL			2
 #define OPT_RR_DEFAULT			OPT_RR_USEFUL
 
+	/*
+	 * Usage  : stream-from-source
+	 * Type   : boolean
+	 * Default: Disabled
+	 * COMPAT : n/a
+	 *
+	 * Do not copy the contents of regular files which have a
+	 * source path to the temporary file; read them from that
+	 * path when writing the image.  The files must not change
+	 * until the archive is closed.
+	 */
+	unsigned int	 stream_from_source:1;
+#define OPT_STREAM_FROM_SOURCE_DEFAULT	0	/* Disabled */
+
 	/*
 	 * Usage  : volume-id=<value>
 	 * Type   : string, max 32 bytes
@@ -783,6 +822,26 @@ struct iso9660 {
 		int		 stream_valid;
 		int64_t		 remaining;
 		int		 compression_level;
+
+		/*
+		 * Each zisofs block is deflated on its own, so with
+		 * zisofs-threads the blocks of a file are collected
+		 * into batches and compressed by a thread pool.
+		 */
+		int		 threads;
+		struct archive_thread_pool *pool;
+		struct zisofs_job {
+			z_stream stream;
+			int	 ret;
+		}		*jobs;
+		int		 njobs;
+		int		 batch_jobs;
+		unsigned char	*batch;
+		size_t		 batch_size;
+		size_t		 batch_used;
+		unsigned char	*batch_out;
+		size_t		*batch_out_size;
+		size_t		 block_bound;
 #endif
 	} zisofs;
 
@@ -943,6 +1002,8 @@ static int	wb_write_out(struct archive_write *);
 static int	wb_consume(struct archive_write *, size_t);
 #ifdef HAVE_ZLIB_H
 static int	wb_set_offset(struct archive_write *, int64_t);
+static int	wb_write_at(struct archive_write *, int64_t, const void *,
+		    size_t);
 #endif
 static int	write_null(struct archive_write *, size_t);
 static int	write_VD_terminator(struct archive_write *);
@@ -957,6 +1018,8 @@ static int	write_path_table(struct archive_write *, int,
 		    struct vdd *);
 static int	write_directory_descriptors(struct archive_write *,
 		    struct vdd *);
+static int	write_source_contents(struct archive_write *,
+		    struct isofile *);
 static int	write_file_descriptors(struct archive_write *);
 static int	write_rr_ER(struct archive_write *);
 static void	calculate_path_table_size(struct vdd *);
@@ -966,6 +1029,8 @@ static void	isofile_add_entry(struct iso9660 *, struct isofile *);
 static void	isofile_free_all_entries(struct iso9660 *);
 static void	isofile_init_entry_data_file_list(struct iso9660 *);
 static void	isofile_add_data_file(struct iso9660 *, struct isofile *);
+static int	isofile_set_source_content(struct archive_write *,
+		    struct isofile *);
 static struct isofile * isofile_new(struct archive_write *,
 		    struct archive_entry *);
 static void	isofile_free(struct isofile *);
@@ -1041,6 +1106,7 @@ static int	setup_boot_information(struct archive_write *);
 static int	zisofs_init(struct archive_write *, struct isofile *);
 static void	zisofs_detect_magic(struct archive_write *,
 		    const void *, size_t);
+static int	zisofs_init_threads(struct archive_write *);
 static int	zisofs_write_to_temp(struct archive_write *,
 		    const void *, size_t);
 static int	zisofs_finish_entry(struct archive_write *);
@@ -1126,6 +1192,7 @@ archive_write_set_format_iso9660(struct archive *_a)
 	iso9660->zisofs.block_pointers_allocated = 0;
 	iso9660->zisofs.stream_valid = 0;
 	iso9660->zisofs.compression_level = 9;
+	iso9660->zisofs.threads = 1;
 	memset(&(iso9660->zisofs.stream), 0,
 	    sizeof(iso9660->zisofs.stream));
 #endif
@@ -1152,6 +1219,7 @@ archive_write_set_format_iso9660(struct archive *_a)
 	iso9660->opt.pad = OPT_PAD_DEFAULT;
 	iso9660->opt.publisher = OPT_PUBLISHER_DEFAULT;
 	iso9660->opt.rr = OPT_RR_DEFAULT;
+	iso9660->opt.stream_from_source = OPT_STREAM_FROM_SOURCE_DEFAULT;
 	iso9660->opt.volume_id = OPT_VOLUME_ID_DEFAULT;
 	iso9660->opt.zisofs = OPT_ZISOFS_DEFAULT;
 
@@ -1479,6 +1547,12 @@ iso9660_options(struct archive_write *a, const char *key, const char *value)
 			return (ARCHIVE_OK);
 		}
 		break;
+	case 's':
+		if (strcmp(key, "stream-from-source") == 0) {
+			iso9660->opt.stream_from_source = value != NULL;
+			return (ARCHIVE_OK);
+		}
+		break;
 	case 'v':
 		if (strcmp(key, "volume-id") == 0) {
 			r = get_str_opt(a, &(iso9660->volume_identifier),
@@ -1504,6 +1578,30 @@ iso9660_options(struct archive_write *a, const char *key, const char *value)
 			}
 			return (ARCHIVE_OK);
 		}
+		if (strcmp(key, "zisofs-threads") == 0) {
+#ifdef HAVE_ZLIB_H
+			char *endptr;
+
+			if (value == NULL)
+				goto invalid_value;
+			errno = 0;
+			iso9660->zisofs.threads =
+			    (int)strtoul(value, &endptr, 10);
+			if (errno != 0 || *endptr != '\0') {
+				iso9660->zisofs.threads = 1;
+				goto invalid_value;
+			}
+			if (iso9660->zisofs.threads == 0)
+				iso9660->zisofs.threads = __archive_cpu_count();
+			return (ARCHIVE_OK);
+#else
+			archive_set_error(&a->archive,
+			    ARCHIVE_ERRNO_MISC,
+			    "Option ``%s'' "
+			    "is not supported on this platform.", key);
+			return (ARCHIVE_FATAL);
+#endif
+		}
 		break;
 	}
 
@@ -1633,6 +1731,19 @@ iso9660_write_header(struct archive_write *a, struct archive_entry *entry)
 		ret = r;
 	iso9660->bytes_remaining =  archive_entry_size(file->entry);
 
+	/*
+	 * A file stored as it is can be read again from its source,
+	 * so its extents are laid out from the size in its header.
+	 */
+	if (iso9660->opt.stream_from_source &&
+	    archive_entry_sourcepath(file->entry) != NULL &&
+	    archive_entry_size(file->entry) > 0 &&
+	    !iso9660->zisofs.making && !iso9660->zisofs.detect_magic) {
+		r = isofile_set_source_content(a, file);
+		if (r < ret)
+			ret = r;
+	}
+
 	return (ret);
 }
 
@@ -1799,6 +1910,11 @@ iso9660_write_data(struct archive_write *a, const void *buff, size_t s)
 		s = (size_t)iso9660->bytes_remaining;
 	if (s == 0)
 		return (0);
+	if (iso9660->cur_file->from_source) {
+		/* The contents will be read from the source. */
+		iso9660->bytes_remaining -= s;
+		return (s);
+	}
 
 	r = write_iso9660_data(a, buff, s);
 	if (r > 0)
@@ -1817,6 +1933,10 @@ iso9660_finish_entry(struct archive_write *a)
 		return (ARCHIVE_OK);
 	if (iso9660->cur_file->content.size == 0)
 		return (ARCHIVE_OK);
+	if (iso9660->cur_file->from_source) {
+		isofile_add_data_file(iso9660, iso9660->cur_file);
+		return (ARCHIVE_OK);
+	}
 
 	/* If there are unwritten data, write null data instead. */
 	while (iso9660->bytes_remaining > 0) {
@@ -1852,6 +1972,7 @@ static int
 iso9660_close(struct archive_write *a)
 {
 	struct iso9660 *iso9660;
+	struct isofile *file;
 	int ret, blocks;
 
 	iso9660 = a->format_data;
@@ -1881,6 +2002,16 @@ iso9660_close(struct archive_write *a)
 		ret = isoent_find_out_boot_file(a, iso9660->primary.rootent);
 		if (ret < 0)
 			return (ret);
+		/* The boot information table is set up in the temporary
+		 * file, so the boot file has to be there. */
+		file = iso9660->el_torito.boot->file;
+		if (file->from_source) {
+			file->content.offset_of_temp = wb_offset(a);
+			ret = write_source_contents(a, file);
+			if (ret < 0)
+				return (ret);
+			file->from_source = 0;
+		}
 		/* Reconvert the boot file from zisofs'ed form to
 		 * plain form. */
 		ret = zisofs_rewind_boot_file(a);
@@ -3720,6 +3851,35 @@ wb_set_offset(struct archive_write *a, int64_t off)
 	return (ARCHIVE_OK);
 }
 
+/*
+ * Overwrite s bytes at off, which were already given to wbuff,
+ * without moving the current offset: the part that has been written
+ * out goes straight to the temporary file, the rest into wbuff.
+ */
+static int
+wb_write_at(struct archive_write *a, int64_t off, const void *buff, size_t s)
+{
+	struct iso9660 *iso9660 = (struct iso9660 *)a->format_data;
+	const unsigned char *p = buff;
+	size_t ns;
+
+	if (off < iso9660->wbuff_offset) {
+		ns = s;
+		if (off + (int64_t)ns > iso9660->wbuff_offset)
+			ns = (size_t)(iso9660->wbuff_offset - off);
+		lseek(iso9660->temp_fd, off, SEEK_SET);
+		if (write_to_temp(a, p, ns) != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+		lseek(iso9660->temp_fd, iso9660->wbuff_offset, SEEK_SET);
+		off += ns;
+		p += ns;
+		s -= ns;
+	}
+	if (s > 0)
+		memcpy(iso9660->wbuff + (off - iso9660->wbuff_offset), p, s);
+	return (ARCHIVE_OK);
+}
+
 #endif /* HAVE_ZLIB_H */
 
 static int
@@ -4508,6 +4668,82 @@ write_file_contents(struct archive_write *a, int64_t offset, int64_t size)
 	return (ARCHIVE_OK);
 }
 
+/*
+ * Read file contents from the source path of the file, and write
+ * them with the padding of each extent.
+ */
+static int
+write_source_contents(struct archive_write *a, struct isofile *file)
+{
+	const char *path;
+	struct content *con;
+	struct stat st;
+	int64_t size;
+	int fd, r;
+
+	path = file->source_path.s;
+	fd = open(path, O_RDONLY | O_BINARY | O_CLOEXEC);
+	if (fd < 0) {
+		archive_set_error(&a->archive, errno,
+		    "Couldn't open %s", path);
+		return (ARCHIVE_FATAL);
+	}
+	__archive_ensure_cloexec_flag(fd);
+	if (fstat(fd, &st) != 0) {
+		archive_set_error(&a->archive, errno,
+		    "Couldn't stat %s", path);
+		close(fd);
+		return (ARCHIVE_FATAL);
+	}
+	if ((int64_t)st.st_dev != file->source_dev ||
+	    (int64_t)st.st_ino != file->source_ino ||
+	    (int64_t)st.st_mtime != file->source_mtime ||
+	    (int64_t)st.st_size != archive_entry_size(file->entry)) {
+		archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+		    "%s: File changed since it was added", path);
+		close(fd);
+		return (ARCHIVE_FATAL);
+	}
+
+	r = ARCHIVE_OK;
+	for (con = &(file->content); con != NULL && r == ARCHIVE_OK;
+	    con = con->next) {
+		size = con->size;
+		while (size) {
+			size_t rsize;
+			ssize_t rs;
+			unsigned char *wb;
+
+			wb = wb_buffptr(a);
+			rsize = wb_remaining(a);
+			if (rsize > (size_t)size)
+				rsize = (size_t)size;
+			rs = read(fd, wb, rsize);
+			if (rs < 0) {
+				archive_set_error(&a->archive, errno,
+				    "Can't read %s", path);
+				r = ARCHIVE_FATAL;
+				break;
+			}
+			if (rs == 0) {
+				archive_set_error(&a->archive,
+				    ARCHIVE_ERRNO_MISC,
+				    "%s: File changed since it was added", path);
+				r = ARCHIVE_FATAL;
+				break;
+			}
+			size -= rs;
+			r = wb_consume(a, rs);
+			if (r < 0)
+				break;
+		}
+		if (r == ARCHIVE_OK)
+			r = wb_write_padding_to_temp(a, con->size);
+	}
+	close(fd);
+	return (r);
+}
+
 static int
 write_file_descriptors(struct archive_write *a)
 {
@@ -4548,6 +4784,22 @@ write_file_descriptors(struct archive_write *a)
 		if (!file->write_content)
 			continue;
 
+		if (file->from_source) {
+			/* Flush out the blocks before this file. */
+			if (blocks > 0) {
+				r = write_file_contents(a, offset,
+				    blocks << LOGICAL_BLOCK_BITS);
+				if (r < 0)
+					return (r);
+			}
+			blocks = 0;
+			offset = 0;
+			r = write_source_contents(a, file);
+			if (r < 0)
+				return (r);
+			continue;
+		}
+
 		if ((offset + (blocks << LOGICAL_BLOCK_BITS)) <
 		     file->content.offset_of_temp) {
 			if (blocks > 0) {
@@ -4623,6 +4875,76 @@ isofile_add_data_file(struct iso9660 *iso9660, struct isofile *file)
 }
 
 
+/*
+ * Lay out the extents of a file whose contents will be read from
+ * its source path, the way write_iso9660_data() would split them.
+ * The path is made absolute now, since the working directory may
+ * change before the archive is closed.  If the source cannot be
+ * found, or does not match the entry, the file goes through the
+ * temporary file as usual.
+ */
+static int
+isofile_set_source_content(struct archive_write *a, struct isofile *file)
+{
+	struct iso9660 *iso9660 = a->format_data;
+	struct content *con;
+	struct stat st;
+	const char *path;
+	int64_t size;
+
+	path = archive_entry_sourcepath(file->entry);
+	archive_string_empty(&(file->source_path));
+	if (path[0] != '/') {
+#if defined(_WIN32) && !defined(__CYGWIN__)
+		/* Only absolute names are used as they are. */
+		if (path[0] != '\\' && (path[0] == '\0' || path[1] != ':'))
+			return (ARCHIVE_OK);
+#else
+		char *cwd;
+
+#if defined(PATH_MAX) && !defined(__GLIBC__)
+		cwd = getcwd(NULL, PATH_MAX);/* Solaris getcwd needs the size. */
+#else
+		cwd = getcwd(NULL, 0);
+#endif
+		if (cwd == NULL)
+			return (ARCHIVE_OK);
+		archive_strcpy(&(file->source_path), cwd);
+		archive_strappend_char(&(file->source_path), '/');
+		free(cwd);
+#endif
+	}
+	archive_strcat(&(file->source_path), path);
+	if (stat(file->source_path.s, &st) != 0 || !S_ISREG(st.st_mode) ||
+	    (int64_t)st.st_size != archive_entry_size(file->entry))
+		return (ARCHIVE_OK);
+	file->source_dev = (int64_t)st.st_dev;
+	file->source_ino = (int64_t)st.st_ino;
+	file->source_mtime = (int64_t)st.st_mtime;
+
+	con = &(file->content);
+	size = archive_entry_size(file->entry);
+	while (iso9660->need_multi_extent &&
+	    size >= MULTI_EXTENT_SIZE - LOGICAL_BLOCK_SIZE) {
+		con->size = MULTI_EXTENT_SIZE - LOGICAL_BLOCK_SIZE;
+		con->blocks = (int)(con->size >> LOGICAL_BLOCK_BITS);
+		size -= con->size;
+		con->next = calloc(1, sizeof(*con));
+		if (con->next == NULL) {
+			archive_set_error(&a->archive, ENOMEM,
+			    "Can't allocate content data");
+			return (ARCHIVE_FATAL);
+		}
+		con = con->next;
+	}
+	con->size = size;
+	con->blocks = (int)((size + LOGICAL_BLOCK_SIZE -1)
+	    >> LOGICAL_BLOCK_BITS);
+	file->cur_content = con;
+	file->from_source = 1;
+	return (ARCHIVE_OK);
+}
+
 static struct isofile *
 isofile_new(struct archive_write *a, struct archive_entry *entry)
 {
@@ -4665,6 +4987,7 @@ isofile_free(struct isofile *file)
 	archive_string_free(&(file->basename));
 	archive_string_free(&(file->basename_utf16));
 	archive_string_free(&(file->symlink));
+	archive_string_free(&(file->source_path));
 	free(file);
 }
 
@@ -7450,6 +7773,12 @@ zisofs_init(struct archive_write *a,  struct isofile *file)
 	r = zisofs_init_zstream(a);
 	if (r != ARCHIVE_OK)
 		return (ARCHIVE_FATAL);
+	if (iso9660->zisofs.threads > 1 && iso9660->zisofs.pool == NULL) {
+		r = zisofs_init_threads(a);
+		if (r != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+	}
+	iso9660->zisofs.batch_used = 0;
 
 	/* Mark file->zisofs to create RRIP 'ZF' Use Entry. */
 	file->zisofs.header_size = ZF_HEADER_SIZE >> 2;
@@ -7591,6 +7920,183 @@ zisofs_detect_magic(struct archive_write *a, const void *buff, size_t s)
 
 #ifdef HAVE_ZLIB_H
 
+/*
+ * Set up the thread pool and one deflate stream for each of its
+ * threads.  A batch holds ZF_BATCH_BLOCKS blocks for each thread.
+ */
+static int
+zisofs_init_threads(struct archive_write *a)
+{
+	struct iso9660 *iso9660 = a->format_data;
+	size_t nblocks;
+	int i, r;
+
+	iso9660->zisofs.pool = __archive_thread_pool_new(
+	    iso9660->zisofs.threads);
+	if (iso9660->zisofs.pool == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression threads");
+		return (ARCHIVE_FATAL);
+	}
+	iso9660->zisofs.njobs =
+	    __archive_thread_pool_threads(iso9660->zisofs.pool);
+	nblocks = (size_t)iso9660->zisofs.njobs * ZF_BATCH_BLOCKS;
+	iso9660->zisofs.block_bound = compressBound(ZF_BLOCK_SIZE);
+	iso9660->zisofs.batch_size = nblocks * ZF_BLOCK_SIZE;
+	iso9660->zisofs.jobs = calloc(iso9660->zisofs.njobs,
+	    sizeof(iso9660->zisofs.jobs[0]));
+	iso9660->zisofs.batch = malloc(iso9660->zisofs.batch_size);
+	iso9660->zisofs.batch_out =
+	    malloc(nblocks * iso9660->zisofs.block_bound);
+	iso9660->zisofs.batch_out_size =
+	    calloc(nblocks, sizeof(iso9660->zisofs.batch_out_size[0]));
+	if (iso9660->zisofs.jobs == NULL || iso9660->zisofs.batch == NULL ||
+	    iso9660->zisofs.batch_out == NULL ||
+	    iso9660->zisofs.batch_out_size == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate data for compression threads");
+		return (ARCHIVE_FATAL);
+	}
+	for (i = 0; i < iso9660->zisofs.njobs; i++) {
+		r = deflateInit(&(iso9660->zisofs.jobs[i].stream),
+		    iso9660->zisofs.compression_level);
+		if (r != Z_OK) {
+			/* Keep deflateEnd() off the streams not set up. */
+			iso9660->zisofs.njobs = i;
+			archive_set_error(&a->archive,
+			    r == Z_MEM_ERROR ? ENOMEM : ARCHIVE_ERRNO_MISC,
+			    "Internal error initializing "
+			    "compression library");
+			return (ARCHIVE_FATAL);
+		}
+	}
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Deflate every batch_jobs'th block of the batch, starting at block
+ * `job', each into its own zlib stream.  A full block of zeros is
+ * stored as an empty block, as zisofs_write_to_temp() does.
+ */
+static void
+zisofs_compress_job(void *arg, int job)
+{
+	struct iso9660 *iso9660 = (struct iso9660 *)arg;
+	z_stream *zstrm = &(iso9660->zisofs.jobs[job].stream);
+	const unsigned char *in, *p, *end;
+	size_t b, nblocks, len;
+	int r;
+
+	nblocks = (iso9660->zisofs.batch_used + ZF_BLOCK_SIZE - 1)
+	    / ZF_BLOCK_SIZE;
+	iso9660->zisofs.jobs[job].ret = Z_OK;
+	for (b = job; b < nblocks; b += iso9660->zisofs.batch_jobs) {
+		in = iso9660->zisofs.batch + b * ZF_BLOCK_SIZE;
+		len = iso9660->zisofs.batch_used - b * ZF_BLOCK_SIZE;
+		if (len > ZF_BLOCK_SIZE)
+			len = ZF_BLOCK_SIZE;
+		if (len == ZF_BLOCK_SIZE) {
+			for (p = in, end = in + len; p < end && *p == 0; p++)
+				;
+			if (p == end) {
+				iso9660->zisofs.batch_out_size[b] = 0;
+				continue;
+			}
+		}
+		deflateReset(zstrm);
+		zstrm->next_in = (Bytef *)(uintptr_t)(const void *)in;
+		zstrm->avail_in = (uInt)len;
+		zstrm->next_out = iso9660->zisofs.batch_out +
+		    b * iso9660->zisofs.block_bound;
+		zstrm->avail_out = (uInt)iso9660->zisofs.block_bound;
+		r = deflate(zstrm, Z_FINISH);
+		if (r != Z_STREAM_END) {
+			iso9660->zisofs.jobs[job].ret = r;
+			return;
+		}
+		iso9660->zisofs.batch_out_size[b] = zstrm->total_out;
+	}
+}
+
+/*
+ * Compress the collected blocks on the thread pool, then append
+ * them to the temporary file in order and record their pointers.
+ */
+static int
+zisofs_flush_batch(struct archive_write *a)
+{
+	struct iso9660 *iso9660 = a->format_data;
+	struct isofile *file = iso9660->cur_file;
+	size_t b, nblocks;
+	int i;
+
+	if (iso9660->zisofs.batch_used == 0)
+		return (ARCHIVE_OK);
+	nblocks = (iso9660->zisofs.batch_used + ZF_BLOCK_SIZE - 1)
+	    / ZF_BLOCK_SIZE;
+	iso9660->zisofs.batch_jobs = iso9660->zisofs.njobs;
+	if ((size_t)iso9660->zisofs.batch_jobs > nblocks)
+		iso9660->zisofs.batch_jobs = (int)nblocks;
+	__archive_thread_pool_run(iso9660->zisofs.pool, zisofs_compress_job,
+	    iso9660, iso9660->zisofs.batch_jobs);
+	for (i = 0; i < iso9660->zisofs.batch_jobs; i++) {
+		if (iso9660->zisofs.jobs[i].ret != Z_OK) {
+			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+			    "Compression failed:"
+			    " deflate() call returned status %d",
+			    iso9660->zisofs.jobs[i].ret);
+			return (ARCHIVE_FATAL);
+		}
+	}
+
+	for (b = 0; b < nblocks; b++) {
+		size_t csize = iso9660->zisofs.batch_out_size[b];
+
+		if (csize > 0 && wb_write_to_temp(a,
+		    iso9660->zisofs.batch_out +
+		    b * iso9660->zisofs.block_bound, csize) != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+		iso9660->zisofs.total_size += csize;
+		file->cur_content->size += csize;
+		iso9660->zisofs.block_pointers_idx ++;
+		archive_le32enc(&(iso9660->zisofs.block_pointers[
+		    iso9660->zisofs.block_pointers_idx]),
+			(uint32_t)iso9660->zisofs.total_size);
+	}
+	iso9660->zisofs.block_offset = file->cur_content->size;
+	iso9660->zisofs.batch_used = 0;
+	return (ARCHIVE_OK);
+}
+
+/*
+ * Collect data into the batch, compressing it whenever the batch is
+ * full or the file is complete.
+ */
+static int
+zisofs_write_to_batch(struct archive_write *a, const void *buff, size_t s)
+{
+	struct iso9660 *iso9660 = a->format_data;
+	const unsigned char *b = (const unsigned char *)buff;
+	size_t avail;
+
+	while (s > 0) {
+		avail = iso9660->zisofs.batch_size - iso9660->zisofs.batch_used;
+		if (avail > s)
+			avail = s;
+		memcpy(iso9660->zisofs.batch + iso9660->zisofs.batch_used,
+		    b, avail);
+		iso9660->zisofs.batch_used += avail;
+		iso9660->zisofs.remaining -= avail;
+		b += avail;
+		s -= avail;
+		if ((iso9660->zisofs.batch_used == iso9660->zisofs.batch_size
+		    || iso9660->zisofs.remaining <= 0) &&
+		    zisofs_flush_batch(a) != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
 /*
  * Compress data and write it to a temporary file.
  */
@@ -7602,7 +8108,10 @@ zisofs_write_to_temp(struct archive_write *a, const void *buff, size_t s)
 	const unsigned char *b;
 	z_stream *zstrm;
 	size_t avail, csize;
-	int flush, r;
+	int flush, r, zero_block;
+
+	if (iso9660->zisofs.pool != NULL)
+		return (zisofs_write_to_batch(a, buff, s));
 
 	zstrm = &(iso9660->zisofs.stream);
 	zstrm->next_out = wb_buffptr(a);
@@ -7642,6 +8151,7 @@ zisofs_write_to_temp(struct archive_write *a, const void *buff, size_t s)
 		 * If current data block are all zero, we do not use
 		 * compressed data.
 		 */
+		zero_block = 0;
 		if (flush == Z_FINISH && iso9660->zisofs.allzero &&
 		    avail + zstrm->total_in == ZF_BLOCK_SIZE) {
 			if (iso9660->zisofs.block_offset !=
@@ -7659,12 +8169,18 @@ zisofs_write_to_temp(struct archive_write *a, const void *buff, size_t s)
 				iso9660->zisofs.total_size -= diff;
 			}
 			zstrm->avail_in = 0;
+			zero_block = 1;
 		}
 
 		/*
-		 * Compress file data.
+		 * Compress file data.  When finishing a block, keep
+		 * going until deflate() has flushed all of its output;
+		 * a block that does not compress may not fit in the
+		 * write buffer at once.
 		 */
-		while (zstrm->avail_in > 0) {
+		r = Z_OK;
+		while (zstrm->avail_in > 0 ||
+		    (flush == Z_FINISH && !zero_block && r != Z_STREAM_END)) {
 			csize = zstrm->total_out;
 			r = deflate(zstrm, flush);
 			switch (r) {
@@ -7714,16 +8230,14 @@ zisofs_finish_entry(struct archive_write *a)
 	struct isofile *file = iso9660->cur_file;
 	unsigned char buff[16];
 	size_t s;
-	int64_t tail;
+
+	if (iso9660->zisofs.pool != NULL &&
+	    zisofs_flush_batch(a) != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
 
 	/* Direct temp file stream to zisofs temp file stream. */
 	archive_entry_set_size(file->entry, iso9660->zisofs.total_size);
 
-	/*
-	 * Save a file pointer which points the end of current zisofs data.
-	 */
-	tail = wb_offset(a);
-
 	/*
 	 * Make a header.
 	 *
@@ -7757,11 +8271,12 @@ zisofs_finish_entry(struct archive_write *a)
 	buff[13] = file->zisofs.log2_bs;
 	buff[14] = buff[15] = 0;/* Reserved */
 
-	/* Move to the right position to write the header. */
-	wb_set_offset(a, file->content.offset_of_temp);
-
-	/* Write the header. */
-	if (wb_write_to_temp(a, buff, 16) != ARCHIVE_OK)
+	/*
+	 * Write the header over the space zisofs_init() skipped; the
+	 * data before the end of wbuff may have been written out already.
+	 */
+	if (wb_write_at(a, file->content.offset_of_temp, buff, 16)
+	    != ARCHIVE_OK)
 		return (ARCHIVE_FATAL);
 
 	/*
@@ -7769,13 +8284,10 @@ zisofs_finish_entry(struct archive_write *a)
 	 */
 	s = iso9660->zisofs.block_pointers_cnt *
 	    sizeof(iso9660->zisofs.block_pointers[0]);
-	if (wb_write_to_temp(a, iso9660->zisofs.block_pointers, s)
-	    != ARCHIVE_OK)
+	if (wb_write_at(a, file->content.offset_of_temp + 16,
+	    iso9660->zisofs.block_pointers, s) != ARCHIVE_OK)
 		return (ARCHIVE_FATAL);
 
-	/* Set a file pointer back to the end of the temporary file. */
-	wb_set_offset(a, tail);
-
 	return (ARCHIVE_OK);
 }
 
@@ -7784,6 +8296,7 @@ zisofs_free(struct archive_write *a)
 {
 	struct iso9660 *iso9660 = a->format_data;
 	int ret = ARCHIVE_OK;
+	int i;
 
 	free(iso9660->zisofs.block_pointers);
 	if (iso9660->zisofs.stream_valid &&
@@ -7792,6 +8305,19 @@ zisofs_free(struct archive_write *a)
 		    "Failed to clean up compressor");
 		ret = ARCHIVE_FATAL;
 	}
+	__archive_thread_pool_free(iso9660->zisofs.pool);
+	iso9660->zisofs.pool = NULL;
+	for (i = 0; iso9660->zisofs.jobs != NULL &&
+	    i < iso9660->zisofs.njobs; i++)
+		deflateEnd(&(iso9660->zisofs.jobs[i].stream));
+	free(iso9660->zisofs.jobs);
+	free(iso9660->zisofs.batch);
+	free(iso9660->zisofs.batch_out);
+	free(iso9660->zisofs.batch_out_size);
+	iso9660->zisofs.jobs = NULL;
+	iso9660->zisofs.batch = NULL;
+	iso9660->zisofs.batch_out = NULL;
+	iso9660->zisofs.batch_out_size = NULL;
 	iso9660->zisofs.block_pointers = NULL;
 	iso9660->zisofs.stream_valid = 0;
 	return (ret);
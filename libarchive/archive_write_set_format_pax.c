@@ -42,6 +42,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_set_format_pax.c 201162 20
 #include "archive_entry.h"
 #include "archive_entry_locale.h"
 #include "archive_private.h"
+#include "archive_tar_index_private.h"
 #include "archive_write_private.h"
 #include "archive_write_set_format_private.h"
 
@@ -63,6 +64,8 @@ struct pax {
 	struct sparse_block	*sparse_tail;
 	struct archive_string_conv *sconv_utf8;
 	int			 opt_binary;
+	int			 opt_index;
+	struct archive_tar_index index;
 
 	unsigned flags;
 #define WRITE_SCHILY_XATTR       (1 << 0)
@@ -97,6 +100,9 @@ static char		*build_ustar_entry_name(char *dest, const char *src,
 			     size_t src_length, const char *insert);
 static char		*format_int(char *dest, int64_t);
 static int		 has_non_ASCII(const char *);
+static int		 index_add_entry(struct archive_write *, struct pax *,
+			     struct archive_entry *, int64_t);
+static int		 archive_write_pax_index(struct archive_write *);
 static void		 sparse_list_clear(struct pax *);
 static int		 sparse_list_add(struct pax *, int64_t, int64_t);
 static char		*url_encode(const char *in);
@@ -145,6 +151,7 @@ archive_write_set_format_pax(struct archive *_a)
 		return (ARCHIVE_FATAL);
 	}
 	pax->flags = WRITE_LIBARCHIVE_XATTR | WRITE_SCHILY_XATTR;
+	__archive_tar_index_init(&pax->index);
 
 	a->format_data = pax;
 	a->format_name = "pax";
@@ -222,6 +229,9 @@ archive_write_pax_options(struct archive_write *a, const char *key,
 			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
 			    "pax: invalid xattr header name");
 		return (ret);
+	} else if (strcmp(key, "index") == 0) {
+		pax->opt_index = (val != NULL && val[0] != 0);
+		return (ARCHIVE_OK);
 	}
 
 	/* Note: The "warn" return is just to inform the options
@@ -583,6 +593,7 @@ archive_write_pax_header(struct archive_write *a,
 	struct archive_string_conv *sconv;
 	size_t hardlink_length, path_length, linkpath_length;
 	size_t uname_length, gname_length;
+	int64_t header_offset;
 
 	char paxbuff[512];
 	char ustarbuff[512];
@@ -594,6 +605,7 @@ archive_write_pax_header(struct archive_write *a,
 	ret = ARCHIVE_OK;
 	need_extension = 0;
 	pax = (struct pax *)a->format_data;
+	header_offset = a->filter_first->bytes_written;
 
 	/* Sanity check. */
 	if (archive_entry_pathname(entry_original) == NULL) {
@@ -1509,9 +1521,106 @@ archive_write_pax_header(struct archive_write *a,
 	archive_entry_free(entry_main);
 	archive_string_free(&entry_name);
 
+	if (pax->opt_index &&
+	    index_add_entry(a, pax, entry_original, header_offset)
+	    != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
 	return (ret);
 }
 
+/*
+ * Record the entry whose header was just written in the member index.
+ */
+static int
+index_add_entry(struct archive_write *a, struct pax *pax,
+    struct archive_entry *entry, int64_t header_offset)
+{
+	struct sparse_block *sb;
+	int64_t data_offset, *sparse = NULL;
+	int n = 0;
+
+	/* A sparse map is written ahead of the data. */
+	data_offset = a->filter_first->bytes_written;
+	if (archive_strlen(&(pax->sparse_map)) > 0) {
+		data_offset += archive_strlen(&(pax->sparse_map)) +
+		    pax->sparse_map_padding;
+		for (sb = pax->sparse_list; sb != NULL; sb = sb->next)
+			if (!sb->is_hole)
+				n++;
+		sparse = malloc(n * 2 * sizeof(sparse[0]));
+		if (sparse == NULL)
+			goto nomem;
+		n = 0;
+		for (sb = pax->sparse_list; sb != NULL; sb = sb->next) {
+			if (sb->is_hole)
+				continue;
+			sparse[n * 2] = sb->offset;
+			sparse[n * 2 + 1] = sb->remaining;
+			n++;
+		}
+	}
+	if (__archive_tar_index_add(&pax->index,
+	    archive_entry_pathname(entry), header_offset, data_offset,
+	    archive_entry_size(entry), n, sparse) != ARCHIVE_OK)
+		goto nomem;
+	free(sparse);
+	return (ARCHIVE_OK);
+nomem:
+	free(sparse);
+	archive_set_error(&a->archive, ENOMEM, "Can't allocate pax index");
+	return (ARCHIVE_FATAL);
+}
+
+/*
+ * Write the member index as a global header, ending with a record
+ * that points back at that header so readers can find it from the end
+ * of the archive.
+ */
+static int
+archive_write_pax_index(struct archive_write *a)
+{
+	struct pax *pax = (struct pax *)a->format_data;
+	struct archive_entry *entry;
+	struct archive_string lines, body;
+	char buff[512];
+	int64_t start;
+	size_t i;
+	int r;
+
+	start = a->filter_first->bytes_written;
+	archive_string_init(&lines);
+	archive_string_init(&body);
+	for (i = 0; i < pax->index.count; i++)
+		__archive_tar_index_format(&lines, pax->index.entries[i]);
+	if (archive_strlen(&lines) > 0)
+		add_pax_attr_binary(&body, ARCHIVE_TAR_INDEX_KEY,
+		    lines.s, archive_strlen(&lines));
+	add_pax_attr_int(&body, ARCHIVE_TAR_INDEX_START_KEY, start);
+	archive_string_free(&lines);
+
+	entry = archive_entry_new2(&a->archive);
+	if (entry == NULL) {
+		archive_string_free(&body);
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate pax index");
+		return (ARCHIVE_FATAL);
+	}
+	archive_entry_set_pathname(entry, "pax_global_header");
+	archive_entry_set_mode(entry, AE_IFREG | 0644);
+	archive_entry_set_size(entry, archive_strlen(&body));
+	r = __archive_write_format_header_ustar(a, buff, entry, 'g', 1, NULL);
+	archive_entry_free(entry);
+	if (r == ARCHIVE_OK)
+		r = __archive_write_output(a, buff, 512);
+	if (r == ARCHIVE_OK)
+		r = __archive_write_output(a, body.s, archive_strlen(&body));
+	if (r == ARCHIVE_OK)
+		r = __archive_write_nulls(a,
+		    0x1ff & (-(int64_t)archive_strlen(&body)));
+	archive_string_free(&body);
+	return (r == ARCHIVE_OK ? r : ARCHIVE_FATAL);
+}
+
 /*
  * We need a valid name for the regular 'ustar' entry.  This routine
  * tries to hack something more-or-less reasonable.
@@ -1777,6 +1886,10 @@ build_gnu_sparse_name(char *dest, const char *src)
 static int
 archive_write_pax_close(struct archive_write *a)
 {
+	struct pax *pax = (struct pax *)a->format_data;
+
+	if (pax->opt_index && archive_write_pax_index(a) != ARCHIVE_OK)
+		return (ARCHIVE_FATAL);
 	return (__archive_write_nulls(a, 512 * 2));
 }
 
@@ -1793,6 +1906,7 @@ archive_write_pax_free(struct archive_write *a)
 	archive_string_free(&pax->sparse_map);
 	archive_string_free(&pax->l_url_encoded_name);
 	sparse_list_clear(pax);
+	__archive_tar_index_free(&pax->index);
 	free(pax);
 	a->format_data = NULL;
 	return (ARCHIVE_OK);
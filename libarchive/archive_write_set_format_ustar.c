@@ -43,6 +43,7 @@ __FBSDID("$FreeBSD: head/lib/libarchive/archive_write_set_format_ustar.c 191579
 #include "archive_entry.h"
 #include "archive_entry_locale.h"
 #include "archive_private.h"
+#include "archive_tar_header_private.h"
 #include "archive_write_private.h"
 #include "archive_write_set_format_private.h"
 
@@ -386,7 +387,8 @@ __archive_write_format_header_ustar(struct archive_write *a, char h[512],
     struct archive_string_conv *sconv)
 {
 	unsigned int checksum;
-	int i, r, ret;
+	int high, sum;
+	int r, ret;
 	size_t copy_length;
 	const char *p, *pp;
 	int mytartype;
@@ -621,9 +623,8 @@ __archive_write_format_header_ustar(struct archive_write *a, char h[512],
 		}
 	}
 
-	checksum = 0;
-	for (i = 0; i < 512; i++)
-		checksum += 255 & (unsigned int)h[i];
+	__archive_tar_header_sum(h, &sum, &high);
+	checksum = (unsigned int)sum;
 	h[USTAR_checksum_offset + 6] = '\0'; /* Can't be pre-set in the template. */
 	/* h[USTAR_checksum_offset + 7] = ' '; */ /* This is pre-set in the template. */
 	format_octal(checksum, h + USTAR_checksum_offset, 6);
@@ -684,31 +685,14 @@ format_256(int64_t v, char *p, int s)
 static int
 format_octal(int64_t v, char *p, int s)
 {
-	int len;
-
-	len = s;
-
 	/* Octal values can't be negative, so use 0. */
 	if (v < 0) {
-		while (len-- > 0)
+		while (s-- > 0)
 			*p++ = '0';
 		return (-1);
 	}
 
-	p += s;		/* Start at the end and work backwards. */
-	while (s-- > 0) {
-		*--p = (char)('0' + (v & 7));
-		v >>= 3;
-	}
-
-	if (v == 0)
-		return (0);
-
-	/* If it overflowed, fill field with max value. */
-	while (len-- > 0)
-		*p++ = '7';
-
-	return (-1);
+	return (__archive_tar_format_octal(v, p, s));
 }
 
 static int
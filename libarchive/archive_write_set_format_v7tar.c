@@ -43,6 +43,7 @@ __FBSDID("$FreeBSD$");
 #include "archive_entry.h"
 #include "archive_entry_locale.h"
 #include "archive_private.h"
+#include "archive_tar_header_private.h"
 #include "archive_write_private.h"
 #include "archive_write_set_format_private.h"
 
@@ -363,7 +364,8 @@ format_header_v7tar(struct archive_write *a, char h[512],
     struct archive_string_conv *sconv)
 {
 	unsigned int checksum;
-	int i, r, ret;
+	int high, sum;
+	int r, ret;
 	size_t copy_length;
 	const char *p, *pp;
 	int mytartype;
@@ -501,9 +503,8 @@ format_header_v7tar(struct archive_write *a, char h[512],
 		}
 	}
 
-	checksum = 0;
-	for (i = 0; i < 512; i++)
-		checksum += 255 & (unsigned int)h[i];
+	__archive_tar_header_sum(h, &sum, &high);
+	checksum = (unsigned int)sum;
 	format_octal(checksum, h + V7TAR_checksum_offset, 6);
 	/* Can't be pre-set in the template. */
 	h[V7TAR_checksum_offset + 6] = '\0';
@@ -564,31 +565,14 @@ format_256(int64_t v, char *p, int s)
 static int
 format_octal(int64_t v, char *p, int s)
 {
-	int len;
-
-	len = s;
-
 	/* Octal values can't be negative, so use 0. */
 	if (v < 0) {
-		while (len-- > 0)
+		while (s-- > 0)
 			*p++ = '0';
 		return (-1);
 	}
 
-	p += s;		/* Start at the end and work backwards. */
-	while (s-- > 0) {
-		*--p = (char)('0' + (v & 7));
-		v >>= 3;
-	}
-
-	if (v == 0)
-		return (0);
-
-	/* If it overflowed, fill field with max value. */
-	while (len-- > 0)
-		*p++ = '7';
-
-	return (-1);
+	return (__archive_tar_format_octal(v, p, s));
 }
 
 static int
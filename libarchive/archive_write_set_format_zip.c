@@ -133,6 +133,14 @@ struct zip {
 	enum encryption  entry_encryption;
 	int entry_flags;
 	int entry_uses_zip64;
+	/*
+	 * Small entries of known size are compressed into entry_buffer,
+	 * local header first, so that the header can be given the exact
+	 * sizes and CRC instead of a trailing data descriptor.
+	 */
+	int entry_buffered;
+	size_t entry_zip64_offset; /* Of the local Zip64 extra, or 0. */
+	struct archive_string entry_buffer;
 	int experiments;
 	struct trad_enc_ctx tctx;
 	char tctx_valid;
@@ -158,6 +166,7 @@ struct zip {
 	struct archive_string_conv *sconv_default;
 	enum compression requested_compression;
 	int deflate_compression_level;
+	int64_t buffer_threshold;
 	int init_default_conversion;
 	enum encryption  encryption_type;
 
@@ -256,7 +265,28 @@ archive_write_zip_options(struct archive_write *a, const char *key,
 	struct zip *zip = a->format_data;
 	int ret = ARCHIVE_FAILED;
 
-	if (strcmp(key, "compression") == 0) {
+	if (strcmp(key, "buffer-threshold") == 0) {
+		/*
+		 * Buffer regular files of at most this many bytes, so
+		 * that they need no data descriptor.
+		 */
+		int64_t threshold = 0;
+		const char *p;
+
+		for (p = val; p != NULL && *p >= '0' && *p <= '9'; p++) {
+			threshold = threshold * 10 + (*p - '0');
+			if (threshold > ZIP_4GB_MAX_UNCOMPRESSED)
+				break;
+		}
+		if (val != NULL && (*p != '\0' || p == val)) {
+			archive_set_error(&a->archive, ARCHIVE_ERRNO_MISC,
+			    "%s: buffer-threshold must be a number of bytes "
+			    "below 4 GiB", a->format_name);
+			return (ARCHIVE_FAILED);
+		}
+		zip->buffer_threshold = threshold;
+		return (ARCHIVE_OK);
+	} else if (strcmp(key, "compression") == 0) {
 		/*
 		 * Set compression to use on all future entries.
 		 * This only affects regular files.
@@ -508,6 +538,24 @@ is_all_ascii(const char *p)
 	return (1);
 }
 
+/*
+ * Write the data of the current entry, or add it to the entry buffer.
+ */
+static int
+zip_output(struct archive_write *a, const void *buff, size_t length)
+{
+	struct zip *zip = a->format_data;
+
+	if (!zip->entry_buffered)
+		return (__archive_write_output(a, buff, length));
+	if (archive_array_append(&zip->entry_buffer, buff, length) == NULL) {
+		archive_set_error(&a->archive, ENOMEM,
+		    "Can't allocate zip data");
+		return (ARCHIVE_FATAL);
+	}
+	return (ARCHIVE_OK);
+}
+
 static int
 archive_write_zip_header(struct archive_write *a, struct archive_entry *entry)
 {
@@ -563,6 +611,9 @@ archive_write_zip_header(struct archive_write *a, struct archive_entry *entry)
 	zip->entry_uncompressed_written = 0;
 	zip->entry_flags = 0;
 	zip->entry_uses_zip64 = 0;
+	zip->entry_buffered = 0;
+	zip->entry_zip64_offset = 0;
+	archive_string_empty(&zip->entry_buffer);
 	zip->entry_crc32 = zip->crc32func(0, NULL, 0);
 	zip->entry_encryption = 0;
 	archive_entry_free(zip->entry);
@@ -737,8 +788,15 @@ archive_write_zip_header(struct archive_write *a, struct archive_entry *entry)
 			version_needed = 45;
 		}
 
-		/* We may know the size, but never the CRC. */
-		zip->entry_flags |= ZIP_ENTRY_FLAG_LENGTH_AT_END;
+		/* We may know the size, but never the CRC; unless the
+		 * entry is small enough to be buffered, it goes in a
+		 * data descriptor. */
+		if (zip->buffer_threshold > 0 &&
+		    size <= zip->buffer_threshold &&
+		    (zip->entry_flags & ZIP_ENTRY_FLAG_ENCRYPTED) == 0)
+			zip->entry_buffered = 1;
+		else
+			zip->entry_flags |= ZIP_ENTRY_FLAG_LENGTH_AT_END;
 	} else {
 		/* We don't know the size. Use the default
 		 * compression unless specified otherwise.
@@ -927,6 +985,8 @@ archive_write_zip_header(struct archive_write *a, struct archive_entry *entry)
 		archive_le64enc(e, zip->entry_compressed_size);
 		e += 8;
 		archive_le16enc(zip64_start + 2, (uint16_t)(e - (zip64_start + 4)));
+		zip->entry_zip64_offset = 30 + filename_length +
+		    (zip64_start - local_extra);
 	}
 
 	if (zip->flags & ZIP_FLAG_EXPERIMENT_xl) {
@@ -960,7 +1020,7 @@ archive_write_zip_header(struct archive_write *a, struct archive_entry *entry)
 	/* Update local header with size of extra data and write it all out: */
 	archive_le16enc(local_header + 28, (uint16_t)(e - local_extra));
 
-	ret = __archive_write_output(a, local_header, 30);
+	ret = zip_output(a, local_header, 30);
 	if (ret != ARCHIVE_OK)
 		return (ARCHIVE_FATAL);
 	zip->written_bytes += 30;
@@ -970,7 +1030,7 @@ archive_write_zip_header(struct archive_write *a, struct archive_entry *entry)
 		return (ARCHIVE_FATAL);
 	zip->written_bytes += ret;
 
-	ret = __archive_write_output(a, local_extra, e - local_extra);
+	ret = zip_output(a, local_extra, e - local_extra);
 	if (ret != ARCHIVE_OK)
 		return (ARCHIVE_FATAL);
 	zip->written_bytes += e - local_extra;
@@ -1069,7 +1129,7 @@ archive_write_zip_data(struct archive_write *a, const void *buff, size_t s)
 					archive_hmac_sha1_update(&zip->hctx,
 					    zip->buf, l);
 				}
-				ret = __archive_write_output(a, zip->buf, l);
+				ret = zip_output(a, zip->buf, l);
 				if (ret != ARCHIVE_OK)
 					return (ret);
 				zip->entry_compressed_written += l;
@@ -1077,7 +1137,7 @@ archive_write_zip_data(struct archive_write *a, const void *buff, size_t s)
 				rb += l;
 			}
 		} else {
-			ret = __archive_write_output(a, buff, s);
+			ret = zip_output(a, buff, s);
 			if (ret != ARCHIVE_OK)
 				return (ret);
 			zip->written_bytes += s;
@@ -1112,8 +1172,7 @@ archive_write_zip_data(struct archive_write *a, const void *buff, size_t s)
 					archive_hmac_sha1_update(&zip->hctx,
 					    zip->buf, zip->len_buf);
 				}
-				ret = __archive_write_output(a, zip->buf,
-					zip->len_buf);
+				ret = zip_output(a, zip->buf, zip->len_buf);
 				if (ret != ARCHIVE_OK)
 					return (ret);
 				zip->entry_compressed_written += zip->len_buf;
@@ -1172,7 +1231,7 @@ archive_write_zip_finish_entry(struct archive_write *a)
 				archive_hmac_sha1_update(&zip->hctx,
 				    zip->buf, remainder);
 			}
-			ret = __archive_write_output(a, zip->buf, remainder);
+			ret = zip_output(a, zip->buf, remainder);
 			if (ret != ARCHIVE_OK)
 				return (ret);
 			zip->entry_compressed_written += remainder;
@@ -1197,6 +1256,30 @@ archive_write_zip_finish_entry(struct archive_write *a)
 		zip->written_bytes += AUTH_CODE_SIZE;
 	}
 
+	/* Fill in the sizes and CRC of a buffered entry and write it. */
+	if (zip->entry_buffered) {
+		unsigned char *h = (unsigned char *)zip->entry_buffer.s;
+
+		archive_le32enc(h + 14, zip->entry_crc32);
+		if (zip->entry_zip64_offset != 0) {
+			h += zip->entry_zip64_offset;
+			archive_le64enc(h + 4,
+			    (uint64_t)zip->entry_uncompressed_written);
+			archive_le64enc(h + 12,
+			    (uint64_t)zip->entry_compressed_written);
+		} else {
+			archive_le32enc(h + 18,
+			    (uint32_t)zip->entry_compressed_written);
+			archive_le32enc(h + 22,
+			    (uint32_t)zip->entry_uncompressed_written);
+		}
+		zip->entry_buffered = 0;
+		ret = __archive_write_output(a, zip->entry_buffer.s,
+		    zip->entry_buffer.length);
+		if (ret != ARCHIVE_OK)
+			return (ARCHIVE_FATAL);
+	}
+
 	/* Write trailing data descriptor. */
 	if ((zip->entry_flags & ZIP_ENTRY_FLAG_LENGTH_AT_END) != 0) {
 		char d[24];
@@ -1364,6 +1447,7 @@ archive_write_zip_free(struct archive_write *a)
 		free(segment);
 	}
 	free(zip->buf);
+	archive_string_free(&zip->entry_buffer);
 	archive_entry_free(zip->entry);
 	if (zip->cctx_valid)
 		archive_encrypto_aes_ctr_release(&zip->cctx);
@@ -1458,14 +1542,14 @@ write_path(struct archive_entry *entry, struct archive_write *archive)
 	if (path == NULL)
 		return (ARCHIVE_FATAL);
 
-	ret = __archive_write_output(archive, path, strlen(path));
+	ret = zip_output(archive, path, strlen(path));
 	if (ret != ARCHIVE_OK)
 		return (ARCHIVE_FATAL);
 	written_bytes += strlen(path);
 
 	/* Folders are recognized by a trailing slash. */
 	if ((type == AE_IFDIR) & (path[strlen(path) - 1] != '/')) {
-		ret = __archive_write_output(archive, "/", 1);
+		ret = zip_output(archive, "/", 1);
 		if (ret != ARCHIVE_OK)
 			return (ARCHIVE_FATAL);
 		written_bytes += 1;
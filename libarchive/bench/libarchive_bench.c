@@ -0,0 +1,1115 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * libarchive_bench measures the throughput of libarchive on synthetic
+ * corpora, so that the results can be compared across commits.
+ *
+ * The corpora are generated from fixed seeds and never touch the disk
+ * except when extracting: every run of the same version with the same
+ * options processes the same bytes.  For each corpus, format and
+ * filter, an archive is created in memory, then listed, read,
+ * extracted and converted to a pax archive.  The results are written
+ * as JSON.
+ *
+ * Existing archives can be given as well, for the formats libarchive
+ * only reads, such as CAB or LHA: each is loaded into memory, then
+ * listed and read.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#define getpid	_getpid
+#define rmdir	_rmdir
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include "archive.h"
+#include "archive_entry.h"
+
+#define CHUNK		(64 * 1024)
+
+/* Kinds of generated data. */
+#define DATA_TEXT	0	/* Low entropy: words from a short list. */
+#define DATA_RANDOM	1	/* High entropy. */
+#define DATA_SPARSE	2	/* Text, then a hole, in every MiB. */
+#define SPARSE_BLOCK	(1024 * 1024)
+
+struct bench_entry {
+	char		*path;
+	int		 dir;
+	int64_t		 size;
+	int		 kind;
+	uint32_t	 seed;
+};
+
+struct corpus {
+	const char	*name;
+	const char	*description;
+	struct bench_entry *entries;
+	int		 count;
+	int		 alloc;
+	int64_t		 bytes;
+};
+
+/* The formats which compress by themselves are not filtered. */
+static const struct {
+	const char	*name;
+	int		 compresses;
+} formats[] = {
+	{ "pax",	0 },
+	{ "gnutar",	0 },
+	{ "newc",	0 },
+	{ "zip",	1 },
+	{ "7zip",	1 },
+	{ "xar",	1 },
+	{ NULL,		0 }
+};
+
+static const char *operations[] = {
+	"create", "list", "read", "extract", "convert", NULL
+};
+
+struct membuf {
+	unsigned char	*buff;
+	size_t		 used;
+	size_t		 alloc;
+};
+
+static const char *corpus_list = "tiny,huge,sparse,deep,random,text";
+static int corpora_given;
+static const char **archive_files;
+static int archive_count;
+static const char *format_list = "pax,newc,zip";
+static const char *filter_list = "none,gzip,zstd";
+static int filters_given;
+static const char *operation_list = "create,list,read,extract,convert";
+static double scale = 1.0;
+static int runs = 3;
+static int quiet;
+static const char *tmpdir;
+static FILE *out;
+static int results;
+
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "Usage: libarchive_bench [-q] [-c corpora] [-f formats]"
+	    " [-F filters]\n"
+	    "           [-O operations] [-n runs] [-o file] [-s scale]"
+	    " [-t tmpdir]\n"
+	    "           [-a archive ...]\n"
+	    "Lists are separated by commas; the defaults are shown.\n"
+	    "  -c  corpora (%s)\n"
+	    "  -f  formats (%s),\n"
+	    "      or others that archive_write_set_format_by_name()"
+	    " accepts\n"
+	    "  -F  filters (%s),\n"
+	    "      or others that archive_write_add_filter_by_name()"
+	    " accepts\n"
+	    "  -O  operations (%s)\n",
+	    corpus_list, format_list, filter_list, operation_list);
+	fprintf(stderr,
+	    "  -a  also list and read this archive; the corpora are"
+	    " only\n"
+	    "      used if -c is given too\n"
+	    "  -n  keep the best of this many runs (%d)\n"
+	    "  -o  write the JSON results to this file (stdout)\n"
+	    "  -q  do not report progress on stderr\n"
+	    "  -s  scale the corpora by this factor (%.1f)\n"
+	    "  -t  extract below this directory (the current one)\n",
+	    runs, scale);
+	exit(2);
+}
+
+static void
+fatal(const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "libarchive_bench: ");
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void *
+xmalloc(size_t size)
+{
+	void *p;
+
+	if ((p = malloc(size)) == NULL)
+		fatal("out of memory");
+	return (p);
+}
+
+/* Return whether `name' is in the comma-separated `list'. */
+static int
+in_list(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p;
+
+	for (p = list; p != NULL; p = strchr(p, ',')) {
+		if (*p == ',')
+			p++;
+		if (strncmp(p, name, len) == 0 &&
+		    (p[len] == ',' || p[len] == '\0'))
+			return (1);
+	}
+	return (0);
+}
+
+static const char *
+errstr(struct archive *a)
+{
+	const char *s = archive_error_string(a);
+
+	return (s != NULL ? s : "unknown error");
+}
+
+static double
+now(void)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	LARGE_INTEGER freq, count;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return ((double)count.QuadPart / freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec + tv.tv_usec / 1e6);
+#endif
+}
+
+/* Peak resident set size of the process in KiB, or -1 if unknown. */
+static long
+peak_rss(void)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	return (-1);
+#else
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0)
+		return (-1);
+#if defined(__APPLE__)
+	return ((long)(ru.ru_maxrss / 1024));
+#else
+	return ((long)ru.ru_maxrss);
+#endif
+#endif
+}
+
+/*
+ * Data generation.  Every chunk of CHUNK bytes depends only on the
+ * seed of its entry and its index, so entries can be generated
+ * piecewise.
+ */
+static uint64_t
+next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return (x * 0x2545F4914F6CDD1DULL);
+}
+
+static void
+generate(unsigned char *buff, size_t size, int kind, uint32_t seed,
+    int64_t chunk)
+{
+	static const char *words[] = {
+		"archive", "entry", "header", "block", "filter", "format",
+		"read", "write", "data", "file", "the", "of", "and", "a",
+		"to", "in", "is", "with", "libarchive", "tar", "cpio", "zip",
+		"compress", "stream", "buffer", "offset", "size", "name",
+	};
+	const char *w;
+	uint64_t state, r;
+	size_t i, n;
+
+	state = ((uint64_t)seed << 32 | (uint32_t)chunk) ^
+	    0x9E3779B97F4A7C15ULL;
+	if (state == 0)
+		state = 1;
+	if (kind == DATA_SPARSE) {
+		if ((chunk * CHUNK) % SPARSE_BLOCK != 0) {
+			memset(buff, 0, size);
+			return;
+		}
+		kind = DATA_TEXT;
+	}
+	if (kind == DATA_RANDOM) {
+		for (i = 0; i + 8 <= size; i += 8) {
+			r = next_random(&state);
+			memcpy(buff + i, &r, 8);
+		}
+		r = next_random(&state);
+		memcpy(buff + i, &r, size - i);
+		return;
+	}
+	for (i = 0; i < size;) {
+		r = next_random(&state);
+		w = words[r % (sizeof(words) / sizeof(words[0]))];
+		n = strlen(w);
+		if (n > size - i)
+			n = size - i;
+		memcpy(buff + i, w, n);
+		i += n;
+		if (i < size)
+			buff[i++] = (r >> 32) % 12 == 0 ? '\n' : ' ';
+	}
+}
+
+/*
+ * Corpora.
+ */
+static void
+add_entry(struct corpus *c, int dir, int64_t size, int kind,
+    const char *fmt, ...)
+{
+	struct bench_entry *e;
+	char path[1024];
+	va_list ap;
+
+	if (c->count == c->alloc) {
+		c->alloc = c->alloc ? c->alloc * 2 : 64;
+		c->entries = realloc(c->entries,
+		    c->alloc * sizeof(*c->entries));
+		if (c->entries == NULL)
+			fatal("out of memory");
+	}
+	va_start(ap, fmt);
+	vsnprintf(path, sizeof(path), fmt, ap);
+	va_end(ap);
+	e = &c->entries[c->count++];
+	e->path = strdup(path);
+	if (e->path == NULL)
+		fatal("out of memory");
+	e->dir = dir;
+	e->size = dir ? 0 : size;
+	e->kind = kind;
+	e->seed = (uint32_t)c->count * 2654435761U;
+	c->bytes += e->size;
+}
+
+static int
+scaled(double n)
+{
+	n *= scale;
+	return (n < 1 ? 1 : (int)n);
+}
+
+static void
+make_corpus(struct corpus *c)
+{
+	uint64_t state = 1;
+	char path[1024];
+	int i, j, n;
+
+	if (strcmp(c->name, "tiny") == 0) {
+		c->description = "many tiny text files";
+		n = scaled(10000);
+		add_entry(c, 1, 0, 0, "tiny");
+		for (i = 0; i < n; i++) {
+			if (i % 100 == 0)
+				add_entry(c, 1, 0, 0, "tiny/%03d", i / 100);
+			add_entry(c, 0, 16 + next_random(&state) % 1008,
+			    DATA_TEXT, "tiny/%03d/file%05d", i / 100, i);
+		}
+	} else if (strcmp(c->name, "huge") == 0) {
+		c->description = "few huge files, text and random";
+		add_entry(c, 1, 0, 0, "huge");
+		add_entry(c, 0, (int64_t)scaled(32) * 1024 * 1024,
+		    DATA_TEXT, "huge/text");
+		add_entry(c, 0, (int64_t)scaled(32) * 1024 * 1024,
+		    DATA_RANDOM, "huge/random");
+	} else if (strcmp(c->name, "sparse") == 0) {
+		c->description = "sparse files, 64 KiB of data per MiB";
+		add_entry(c, 1, 0, 0, "sparse");
+		for (i = 0; i < 4; i++)
+			add_entry(c, 0, (int64_t)scaled(16) * 1024 * 1024,
+			    DATA_SPARSE, "sparse/file%d", i);
+	} else if (strcmp(c->name, "deep") == 0) {
+		c->description = "deep directory tree";
+		n = scaled(4);
+		strcpy(path, "deep");
+		add_entry(c, 1, 0, 0, "%s", path);
+		for (i = 0; i < 32; i++) {
+			snprintf(path + strlen(path),
+			    sizeof(path) - strlen(path), "/dir%02d", i);
+			add_entry(c, 1, 0, 0, "%s", path);
+			for (j = 0; j < n; j++)
+				add_entry(c, 0, 4096, DATA_TEXT,
+				    "%s/file%d", path, j);
+		}
+	} else if (strcmp(c->name, "random") == 0) {
+		c->description = "high-entropy files";
+		add_entry(c, 1, 0, 0, "random");
+		n = scaled(64);
+		for (i = 0; i < n; i++)
+			add_entry(c, 0, 256 * 1024, DATA_RANDOM,
+			    "random/file%03d", i);
+	} else if (strcmp(c->name, "text") == 0) {
+		c->description = "low-entropy files";
+		add_entry(c, 1, 0, 0, "text");
+		n = scaled(64);
+		for (i = 0; i < n; i++)
+			add_entry(c, 0, 256 * 1024, DATA_TEXT,
+			    "text/file%03d", i);
+	} else
+		fatal("unknown corpus: %s", c->name);
+}
+
+static void
+free_corpus(struct corpus *c)
+{
+	int i;
+
+	for (i = 0; i < c->count; i++)
+		free(c->entries[i].path);
+	free(c->entries);
+}
+
+static void
+set_entry(struct archive_entry *ae, const struct bench_entry *e,
+    const char *prefix)
+{
+	int64_t offset, len;
+
+	archive_entry_clear(ae);
+	if (prefix != NULL) {
+		char path[2048];
+
+		snprintf(path, sizeof(path), "%s/%s", prefix, e->path);
+		archive_entry_copy_pathname(ae, path);
+	} else
+		archive_entry_copy_pathname(ae, e->path);
+	archive_entry_set_mtime(ae, 1700000000, 0);
+	archive_entry_set_uid(ae, 1000);
+	archive_entry_set_gid(ae, 1000);
+	if (e->dir) {
+		archive_entry_set_mode(ae, AE_IFDIR | 0755);
+		/* cpio needs a size even for directories. */
+		archive_entry_set_size(ae, 0);
+		return;
+	}
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_set_size(ae, e->size);
+	if (e->kind == DATA_SPARSE) {
+		for (offset = 0; offset < e->size; offset += SPARSE_BLOCK) {
+			len = e->size - offset;
+			if (len > CHUNK)
+				len = CHUNK;
+			archive_entry_sparse_add_entry(ae, offset, len);
+		}
+	}
+}
+
+/*
+ * Archives are written to memory.
+ */
+static la_ssize_t
+membuf_write(struct archive *a, void *client_data, const void *buff,
+    size_t size)
+{
+	struct membuf *m = (struct membuf *)client_data;
+	unsigned char *p;
+
+	(void)a;
+	if (m->used + size > m->alloc) {
+		size_t alloc = m->alloc ? m->alloc : 1024 * 1024;
+
+		while (alloc < m->used + size)
+			alloc *= 2;
+		if ((p = realloc(m->buff, alloc)) == NULL) {
+			archive_set_error(a, ENOMEM, "out of memory");
+			return (-1);
+		}
+		m->buff = p;
+		m->alloc = alloc;
+	}
+	memcpy(m->buff + m->used, buff, size);
+	m->used += size;
+	return (size);
+}
+
+static struct archive *
+new_writer(const char *format, const char *filter, struct membuf *m,
+    char *error, size_t errsize)
+{
+	struct archive *a;
+	int r;
+
+	a = archive_write_new();
+	if (a == NULL)
+		fatal("out of memory");
+	r = archive_write_set_format_by_name(a, format);
+	if (r == ARCHIVE_OK) {
+		if (strcmp(filter, "none") == 0)
+			r = archive_write_add_filter_none(a);
+		else
+			r = archive_write_add_filter_by_name(a, filter);
+	}
+	/* Filters that run an external program do not count. */
+	if (r != ARCHIVE_OK) {
+		snprintf(error, errsize, "%s", errstr(a));
+		archive_write_free(a);
+		return (NULL);
+	}
+	m->used = 0;
+	if (archive_write_open2(a, m, NULL, membuf_write, NULL, NULL)
+	    != ARCHIVE_OK) {
+		snprintf(error, errsize, "%s", errstr(a));
+		archive_write_free(a);
+		return (NULL);
+	}
+	return (a);
+}
+
+static struct archive *
+new_reader(const struct membuf *m, char *error, size_t errsize)
+{
+	struct archive *a;
+
+	a = archive_read_new();
+	if (a == NULL)
+		fatal("out of memory");
+	archive_read_support_format_all(a);
+	archive_read_support_filter_all(a);
+	if (archive_read_open_memory(a, m->buff, m->used) != ARCHIVE_OK) {
+		snprintf(error, errsize, "%s", errstr(a));
+		archive_read_free(a);
+		return (NULL);
+	}
+	return (a);
+}
+
+/*
+ * The operations.  Each returns 0, or -1 with a message in `error'.
+ */
+static int
+op_create(const struct corpus *c, const char *format, const char *filter,
+    struct membuf *m, char *error, size_t errsize)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	unsigned char *buff;
+	int64_t offset;
+	size_t n;
+	int i, ret = 0;
+
+	if ((a = new_writer(format, filter, m, error, errsize)) == NULL)
+		return (-1);
+	buff = xmalloc(CHUNK);
+	ae = archive_entry_new();
+	for (i = 0; i < c->count && ret == 0; i++) {
+		const struct bench_entry *e = &c->entries[i];
+
+		set_entry(ae, e, NULL);
+		if (archive_write_header(a, ae) < ARCHIVE_WARN) {
+			ret = -1;
+			break;
+		}
+		for (offset = 0; offset < e->size; offset += n) {
+			n = CHUNK;
+			if ((int64_t)n > e->size - offset)
+				n = (size_t)(e->size - offset);
+			generate(buff, n, e->kind, e->seed, offset / CHUNK);
+			if (archive_write_data(a, buff, n) != (la_ssize_t)n) {
+				ret = -1;
+				break;
+			}
+		}
+	}
+	if (ret == 0 && archive_write_close(a) != ARCHIVE_OK)
+		ret = -1;
+	if (ret != 0)
+		snprintf(error, errsize, "%s", errstr(a));
+	archive_entry_free(ae);
+	archive_write_free(a);
+	free(buff);
+	return (ret);
+}
+
+static int
+op_list(const struct membuf *m, char *error, size_t errsize)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	int r;
+
+	if ((a = new_reader(m, error, errsize)) == NULL)
+		return (-1);
+	while ((r = archive_read_next_header(a, &ae)) == ARCHIVE_OK)
+		;
+	if (r != ARCHIVE_EOF)
+		snprintf(error, errsize, "%s", errstr(a));
+	archive_read_free(a);
+	return (r == ARCHIVE_EOF ? 0 : -1);
+}
+
+static int
+op_read(const struct membuf *m, char *error, size_t errsize)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	const void *buff;
+	size_t size;
+	int64_t offset;
+	int r;
+
+	if ((a = new_reader(m, error, errsize)) == NULL)
+		return (-1);
+	while ((r = archive_read_next_header(a, &ae)) == ARCHIVE_OK) {
+		while ((r = archive_read_data_block(a, &buff, &size,
+		    &offset)) == ARCHIVE_OK)
+			;
+		if (r != ARCHIVE_EOF)
+			break;
+	}
+	if (r != ARCHIVE_EOF)
+		snprintf(error, errsize, "%s", errstr(a));
+	archive_read_free(a);
+	return (r == ARCHIVE_EOF ? 0 : -1);
+}
+
+static int
+op_extract(const struct membuf *m, const char *dir, char *error,
+    size_t errsize)
+{
+	struct archive *a, *disk;
+	struct archive_entry *ae;
+	const void *buff;
+	char path[2048];
+	size_t size;
+	int64_t offset;
+	int r;
+
+	if ((a = new_reader(m, error, errsize)) == NULL)
+		return (-1);
+	disk = archive_write_disk_new();
+	if (disk == NULL)
+		fatal("out of memory");
+	archive_write_disk_set_options(disk, ARCHIVE_EXTRACT_TIME);
+	while ((r = archive_read_next_header(a, &ae)) == ARCHIVE_OK) {
+		snprintf(path, sizeof(path), "%s/%s", dir,
+		    archive_entry_pathname(ae));
+		archive_entry_copy_pathname(ae, path);
+		if ((r = archive_write_header(disk, ae)) < ARCHIVE_WARN) {
+			snprintf(error, errsize, "%s", errstr(disk));
+			break;
+		}
+		while ((r = archive_read_data_block(a, &buff, &size,
+		    &offset)) == ARCHIVE_OK) {
+			if (archive_write_data_block(disk, buff, size,
+			    offset) < ARCHIVE_WARN) {
+				r = ARCHIVE_FATAL;
+				snprintf(error, errsize, "%s",
+				    errstr(disk));
+				break;
+			}
+		}
+		if (r != ARCHIVE_EOF)
+			break;
+		if (archive_write_finish_entry(disk) < ARCHIVE_WARN) {
+			r = ARCHIVE_FATAL;
+			snprintf(error, errsize, "%s", errstr(disk));
+			break;
+		}
+	}
+	if (r == ARCHIVE_EOF && archive_write_close(disk) != ARCHIVE_OK) {
+		r = ARCHIVE_FATAL;
+		snprintf(error, errsize, "%s", errstr(disk));
+	} else if (r != ARCHIVE_EOF && error[0] == '\0')
+		snprintf(error, errsize, "%s", errstr(a));
+	archive_write_free(disk);
+	archive_read_free(a);
+	return (r == ARCHIVE_EOF ? 0 : -1);
+}
+
+/* Remove what op_extract() made, deepest entries first. */
+static void
+remove_extracted(const struct corpus *c, const char *dir)
+{
+	char path[2048];
+	int i;
+
+	for (i = c->count - 1; i >= 0; i--) {
+		snprintf(path, sizeof(path), "%s/%s", dir,
+		    c->entries[i].path);
+		if (c->entries[i].dir)
+			rmdir(path);
+		else
+			remove(path);
+	}
+	rmdir(dir);
+}
+
+static int
+op_convert(const struct membuf *m, struct membuf *conv, char *error,
+    size_t errsize)
+{
+	struct archive *a, *w;
+	struct archive_entry *ae;
+	char buff[CHUNK];
+	la_ssize_t n;
+	int r;
+
+	if ((w = new_writer("pax", "none", conv, error, errsize)) == NULL)
+		return (-1);
+	if ((a = new_reader(m, error, errsize)) == NULL) {
+		archive_write_free(w);
+		return (-1);
+	}
+	while ((r = archive_read_next_header(a, &ae)) == ARCHIVE_OK) {
+		if (archive_write_header(w, ae) < ARCHIVE_WARN) {
+			r = ARCHIVE_FATAL;
+			snprintf(error, errsize, "%s", errstr(w));
+			break;
+		}
+		while ((n = archive_read_data(a, buff, sizeof(buff))) > 0) {
+			if (archive_write_data(w, buff, n) != n) {
+				n = -1;
+				snprintf(error, errsize, "%s",
+				    errstr(w));
+				break;
+			}
+		}
+		if (n < 0) {
+			r = ARCHIVE_FATAL;
+			break;
+		}
+	}
+	if (r == ARCHIVE_EOF && archive_write_close(w) != ARCHIVE_OK) {
+		r = ARCHIVE_FATAL;
+		snprintf(error, errsize, "%s", errstr(w));
+	} else if (r != ARCHIVE_EOF && error[0] == '\0')
+		snprintf(error, errsize, "%s", errstr(a));
+	archive_write_free(w);
+	archive_read_free(a);
+	return (r == ARCHIVE_EOF ? 0 : -1);
+}
+
+/*
+ * Results.
+ */
+static void
+json_string(const char *s)
+{
+	fputc('"', out);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(out, "\\u%04x", *s);
+		else
+			fputc(*s, out);
+	}
+	fputc('"', out);
+}
+
+static void
+report(const struct corpus *c, const char *format, const char *filter,
+    const char *op, size_t archive_bytes, double seconds, const char *error)
+{
+	long rss = peak_rss();
+
+	fprintf(out, "%s\n    {\"corpus\": ", results++ ? "," : "");
+	json_string(c->name);
+	fprintf(out, ", \"format\": ");
+	json_string(format);
+	fprintf(out, ", \"filter\": ");
+	json_string(filter);
+	fprintf(out, ", \"operation\": ");
+	json_string(op);
+	fprintf(out, ",\n     \"entries\": %d, \"bytes\": %lld",
+	    c->count, (long long)c->bytes);
+	if (error != NULL) {
+		fprintf(out, ", \"error\": ");
+		json_string(error);
+		fprintf(out, "}");
+		if (!quiet)
+			fprintf(stderr, "%-7s %-7s %-6s %-8s error: %s\n",
+			    c->name, format, filter, op, error);
+		return;
+	}
+	if (seconds <= 0)
+		seconds = 1e-9;
+	fprintf(out, ", \"archive_bytes\": %lld, \"seconds\": %.6f,\n"
+	    "     \"mb_per_s\": %.2f, \"entries_per_s\": %.1f",
+	    (long long)archive_bytes, seconds, c->bytes / seconds / 1e6,
+	    c->count / seconds);
+	if (rss >= 0)
+		fprintf(out, ", \"peak_rss_kb\": %ld}", rss);
+	else
+		fprintf(out, ", \"peak_rss_kb\": null}");
+	if (!quiet)
+		fprintf(stderr, "%-7s %-7s %-6s %-8s %10.2f MB/s %12.1f"
+		    " entries/s\n", c->name, format, filter, op,
+		    c->bytes / seconds / 1e6, c->count / seconds);
+}
+
+static void
+bench(const struct corpus *c, const char *format, const char *filter)
+{
+	struct membuf m, conv;
+	char error[512], dir[1024];
+	double best, t;
+	int i, j, n, r, wanted;
+
+	memset(&m, 0, sizeof(m));
+	memset(&conv, 0, sizeof(conv));
+	for (j = 0; operations[j] != NULL; j++) {
+		const char *op = operations[j];
+
+		/* The archive is created for the other operations even
+		 * if its creation is not measured. */
+		wanted = in_list(operation_list, op);
+		if (!wanted && j > 0)
+			continue;
+		n = wanted ? runs : 1;
+		best = 0;
+		r = 0;
+		error[0] = '\0';
+		snprintf(dir, sizeof(dir), "%s/libarchive_bench.%d",
+		    tmpdir ? tmpdir : ".", (int)getpid());
+		for (i = 0; i < n && r == 0; i++) {
+			t = now();
+			if (strcmp(op, "create") == 0)
+				r = op_create(c, format, filter, &m, error,
+				    sizeof(error));
+			else if (strcmp(op, "list") == 0)
+				r = op_list(&m, error, sizeof(error));
+			else if (strcmp(op, "read") == 0)
+				r = op_read(&m, error, sizeof(error));
+			else if (strcmp(op, "extract") == 0)
+				r = op_extract(&m, dir, error, sizeof(error));
+			else
+				r = op_convert(&m, &conv, error,
+				    sizeof(error));
+			t = now() - t;
+			if (strcmp(op, "extract") == 0)
+				remove_extracted(c, dir);
+			if (i == 0 || t < best)
+				best = t;
+		}
+		if (wanted || r != 0)
+			report(c, format, filter, op, m.used, best,
+			    r == 0 ? NULL : error);
+		/* Nothing to read without the archive. */
+		if (j == 0 && r != 0)
+			break;
+	}
+	free(m.buff);
+	free(conv.buff);
+}
+
+/*
+ * Existing archives.
+ */
+static void
+load_archive(const char *path, struct membuf *m)
+{
+	FILE *f;
+	size_t n;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		fatal("%s: %s", path, strerror(errno));
+	for (;;) {
+		if (m->used == m->alloc) {
+			m->alloc = m->alloc ? m->alloc * 2 : 1024 * 1024;
+			m->buff = realloc(m->buff, m->alloc);
+			if (m->buff == NULL)
+				fatal("out of memory");
+		}
+		n = fread(m->buff + m->used, 1, m->alloc - m->used, f);
+		if (n == 0)
+			break;
+		m->used += n;
+	}
+	if (ferror(f))
+		fatal("%s: %s", path, strerror(errno));
+	fclose(f);
+}
+
+/*
+ * Count the entries and bytes of data of the archive in `m', and
+ * get the names of its format and first filter.
+ */
+static int
+scan_archive(const struct membuf *m, struct corpus *c, char *format,
+    char *filter, size_t namesize, char *error, size_t errsize)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	const void *buff;
+	size_t size;
+	int64_t offset;
+	int r;
+
+	if ((a = new_reader(m, error, errsize)) == NULL)
+		return (-1);
+	while ((r = archive_read_next_header(a, &ae)) == ARCHIVE_OK) {
+		c->count++;
+		while ((r = archive_read_data_block(a, &buff, &size,
+		    &offset)) == ARCHIVE_OK)
+			c->bytes += size;
+		if (r != ARCHIVE_EOF)
+			break;
+	}
+	snprintf(format, namesize, "%s", archive_format_name(a) ?
+	    archive_format_name(a) : "unknown");
+	snprintf(filter, namesize, "%s", archive_filter_name(a, 0) ?
+	    archive_filter_name(a, 0) : "none");
+	if (r != ARCHIVE_EOF)
+		snprintf(error, errsize, "%s", errstr(a));
+	archive_read_free(a);
+	return (r == ARCHIVE_EOF ? 0 : -1);
+}
+
+static void
+bench_archive(const char *path)
+{
+	static const char *ops[] = { "list", "read", NULL };
+	struct corpus c;
+	struct membuf m;
+	char error[512], format[64], filter[64];
+	double best, t;
+	int i, j, r;
+
+	memset(&c, 0, sizeof(c));
+	memset(&m, 0, sizeof(m));
+	c.name = path;
+	load_archive(path, &m);
+	strcpy(format, "unknown");
+	strcpy(filter, "none");
+	error[0] = '\0';
+	if (scan_archive(&m, &c, format, filter, sizeof(format), error,
+	    sizeof(error)) != 0) {
+		report(&c, format, filter, "read", m.used, 0, error);
+		free(m.buff);
+		return;
+	}
+	for (j = 0; ops[j] != NULL; j++) {
+		if (!in_list(operation_list, ops[j]))
+			continue;
+		best = 0;
+		r = 0;
+		for (i = 0; i < runs && r == 0; i++) {
+			t = now();
+			if (j == 0)
+				r = op_list(&m, error, sizeof(error));
+			else
+				r = op_read(&m, error, sizeof(error));
+			t = now() - t;
+			if (i == 0 || t < best)
+				best = t;
+		}
+		report(&c, format, filter, ops[j], m.used, best,
+		    r == 0 ? NULL : error);
+	}
+	free(m.buff);
+}
+
+/* Call fn for every name in the comma-separated list. */
+static void
+each(const char *list, void (*fn)(const char *, void *), void *arg)
+{
+	char name[64];
+	const char *p, *q;
+
+	for (p = list; *p != '\0'; p = *q ? q + 1 : q) {
+		q = strchr(p, ',');
+		if (q == NULL)
+			q = p + strlen(p);
+		if (q - p == 0 || q - p >= (int)sizeof(name))
+			continue;
+		memcpy(name, p, q - p);
+		name[q - p] = '\0';
+		fn(name, arg);
+	}
+}
+
+struct combination {
+	struct corpus	*corpus;
+	const char	*format;
+};
+
+static void
+bench_filter(const char *filter, void *arg)
+{
+	struct combination *comb = (struct combination *)arg;
+	int i;
+
+	/* Formats that compress by themselves are only used unfiltered,
+	 * unless filters were asked for. */
+	if (strcmp(filter, "none") != 0 && !filters_given) {
+		for (i = 0; formats[i].name != NULL; i++) {
+			if (strcmp(formats[i].name, comb->format) == 0 &&
+			    formats[i].compresses)
+				return;
+		}
+	}
+	bench(comb->corpus, comb->format, filter);
+}
+
+static void
+bench_format(const char *format, void *arg)
+{
+	struct combination comb;
+
+	comb.corpus = (struct corpus *)arg;
+	comb.format = format;
+	each(filter_list, bench_filter, &comb);
+}
+
+static void
+bench_corpus(const char *name, void *arg)
+{
+	struct corpus c;
+	int *first = (int *)arg;
+
+	memset(&c, 0, sizeof(c));
+	c.name = name;
+	make_corpus(&c);
+	fprintf(out, "%s\n    {\"name\": ", *first ? "" : ",");
+	*first = 0;
+	json_string(c.name);
+	fprintf(out, ", \"description\": ");
+	json_string(c.description);
+	fprintf(out, ", \"entries\": %d, \"bytes\": %lld}", c.count,
+	    (long long)c.bytes);
+	free_corpus(&c);
+}
+
+static void
+run_corpus(const char *name, void *arg)
+{
+	struct corpus c;
+
+	(void)arg;
+	memset(&c, 0, sizeof(c));
+	c.name = name;
+	make_corpus(&c);
+	each(format_list, bench_format, &c);
+	free_corpus(&c);
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *output = NULL;
+	int first = 1, i;
+
+	for (i = 1; i < argc; i++) {
+		const char *opt = argv[i];
+
+		if (opt[0] != '-' || opt[1] == '\0' || opt[2] != '\0')
+			usage();
+		if (opt[1] == 'q') {
+			quiet = 1;
+			continue;
+		}
+		if (opt[1] == 'h' || i + 1 >= argc)
+			usage();
+		switch (opt[1]) {
+		case 'a':
+			archive_files = realloc(archive_files,
+			    (archive_count + 1) * sizeof(*archive_files));
+			if (archive_files == NULL)
+				fatal("out of memory");
+			archive_files[archive_count++] = argv[++i];
+			break;
+		case 'c':
+			corpus_list = argv[++i];
+			corpora_given = 1;
+			break;
+		case 'f': format_list = argv[++i]; break;
+		case 'F': filter_list = argv[++i]; filters_given = 1; break;
+		case 'O': operation_list = argv[++i]; break;
+		case 'n': runs = atoi(argv[++i]); break;
+		case 'o': output = argv[++i]; break;
+		case 's': scale = atof(argv[++i]); break;
+		case 't': tmpdir = argv[++i]; break;
+		default: usage();
+		}
+	}
+	if (runs < 1)
+		runs = 1;
+	if (scale <= 0)
+		usage();
+	if (archive_count > 0 && !corpora_given)
+		corpus_list = "";
+
+	if (output == NULL)
+		out = stdout;
+	else if ((out = fopen(output, "w")) == NULL)
+		fatal("%s: %s", output, strerror(errno));
+
+	fprintf(out, "{\n  \"libarchive\": ");
+	json_string(archive_version_details());
+	fprintf(out, ",\n  \"scale\": %g,\n  \"runs\": %d,\n"
+	    "  \"corpora\": [", scale, runs);
+	each(corpus_list, bench_corpus, &first);
+	fprintf(out, "\n  ],\n  \"results\": [");
+	each(corpus_list, run_corpus, NULL);
+	for (i = 0; i < archive_count; i++)
+		bench_archive(archive_files[i]);
+	fprintf(out, "\n  ],\n  \"peak_rss_kb\": ");
+	if (peak_rss() >= 0)
+		fprintf(out, "%ld\n}\n", peak_rss());
+	else
+		fprintf(out, "null\n}\n");
+	if (out != stdout && fclose(out) != 0)
+		fatal("%s: %s", output, strerror(errno));
+	return (0);
+}
@@ -107,7 +107,9 @@
 #define HAVE_FCHDIR 1
 #define HAVE_FCHFLAGS 1
 #define HAVE_FCHMOD 1
+#define HAVE_FCHMODAT 1
 #define HAVE_FCHOWN 1
+#define HAVE_FCHOWNAT 1
 #define HAVE_FCNTL 1
 #define HAVE_FCNTL_H 1
 #define HAVE_FDOPENDIR 1
@@ -121,9 +123,11 @@
 #define HAVE_FUTIMES 1
 #define HAVE_FUTIMESAT 1
 #define HAVE_GETEUID 1
+#define HAVE_GETGRENT 1
 #define HAVE_GETGRGID_R 1
 #define HAVE_GETGRNAM_R 1
 #define HAVE_GETPID 1
+#define HAVE_GETPWENT 1
 #define HAVE_GETPWNAM_R 1
 #define HAVE_GETPWUID_R 1
 #define HAVE_GETVFSBYNAME 1
@@ -149,8 +153,11 @@
 #define HAVE_MEMORY_H 1
 #define HAVE_MEMSET 1
 #define HAVE_MKDIR 1
+#define HAVE_MKDIRAT 1
 #define HAVE_MKFIFO 1
+#define HAVE_MKFIFOAT 1
 #define HAVE_MKNOD 1
+#define HAVE_MKNODAT 1
 #define HAVE_MKSTEMP 1
 #define HAVE_NL_LANGINFO 1
 #define HAVE_OPENAT 1
@@ -158,6 +165,7 @@
 #define HAVE_PIPE 1
 #define HAVE_POLL 1
 #define HAVE_POLL_H 1
+#define HAVE_POSIX_FALLOCATE 1
 #define HAVE_POSIX_SPAWNP 1
 #define HAVE_PTHREAD_H 1
 #define HAVE_PWD_H 1
@@ -196,6 +204,7 @@
 #define HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC 1
 #define HAVE_STRUCT_TM_TM_GMTOFF 1
 #define HAVE_SYMLINK 1
+#define HAVE_SYMLINKAT 1
 #define HAVE_SYS_CDEFS_H 1
 #define HAVE_SYS_IOCTL_H 1
 #define HAVE_SYS_MOUNT_H 1
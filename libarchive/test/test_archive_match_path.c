@@ -26,6 +26,9 @@
 #include "test.h"
 __FBSDID("$FreeBSD$");
 
+#define __LIBARCHIVE_TEST
+#include "archive_pathmatch.h"
+
 static void
 test_exclusion_mbs(void)
 {
@@ -429,6 +432,111 @@ test_exclusion_and_inclusion(void)
 	archive_match_free(m);
 }
 
+/*
+ * Check the pattern index against trying every pattern in turn, for
+ * random patterns and paths built from a few awkward pieces.
+ */
+#define NPATTERNS	40
+
+static const char *pieces[] = {
+	"a", "b", "ab", ".", "..", "", "a*", "?", "[ab]", "*", "b$", "\\a",
+	".a"
+};
+#define NPIECES	((int)(sizeof(pieces) / sizeof(pieces[0])))
+
+static void
+random_path(char *buff, int pattern)
+{
+	int i, n;
+
+	buff[0] = '\0';
+	switch (rand() % 8) {
+	case 0: strcat(buff, "/"); break;
+	case 1: strcat(buff, "./"); break;
+	case 2: if (pattern) strcat(buff, "^"); break;
+	}
+	n = 1 + rand() % 4;
+	for (i = 0; i < n; i++) {
+		if (i > 0)
+			strcat(buff, rand() % 6 ? "/" : "//");
+		strcat(buff, pieces[rand() % (pattern ? NPIECES : 6)]);
+	}
+	if (rand() % 6 == 0)
+		strcat(buff, "/");
+}
+
+static void
+test_pattern_index(int recursive)
+{
+	char inc[NPATTERNS][64], exc[NPATTERNS][64], path[64];
+	int inc_matches[NPATTERNS];
+	int i, n, ninc, nexc, expect, flags, matched, unmatched;
+	size_t len;
+	struct archive_entry *ae;
+	struct archive *m;
+
+	assert((m = archive_match_new()) != NULL);
+	assert((ae = archive_entry_new()) != NULL);
+	assertEqualIntA(m, ARCHIVE_OK,
+	    archive_match_set_inclusion_recursion(m, recursive));
+	flags = recursive ? PATHMATCH_NO_ANCHOR_END : 0;
+	ninc = rand() % NPATTERNS;
+	nexc = rand() % NPATTERNS;
+	for (i = 0; i < ninc + nexc; i++) {
+		char *p = (i < ninc) ? inc[i] : exc[i - ninc];
+
+		do {
+			random_path(p, 1);
+		} while (strcmp(p, "") == 0 || strcmp(p, "/") == 0);
+		if (i < ninc)
+			assertEqualIntA(m, ARCHIVE_OK,
+			    archive_match_include_pattern(m, p));
+		else
+			assertEqualIntA(m, ARCHIVE_OK,
+			    archive_match_exclude_pattern(m, p));
+		/* archive_match drops a trailing slash. */
+		len = strlen(p);
+		if (p[len - 1] == '/')
+			p[len - 1] = '\0';
+	}
+	memset(inc_matches, 0, sizeof(inc_matches));
+	unmatched = ninc;
+
+	for (n = 0; n < 300; n++) {
+		random_path(path, 0);
+		matched = 0;
+		for (i = 0; i < ninc; i++) {
+			if (inc_matches[i] == 0 &&
+			    archive_pathmatch(inc[i], path, flags)) {
+				inc_matches[i]++;
+				unmatched--;
+				matched = 1;
+			}
+		}
+		expect = -1;
+		for (i = 0; i < nexc && expect < 0; i++)
+			if (archive_pathmatch(exc[i], path,
+			    PATHMATCH_NO_ANCHOR_START | PATHMATCH_NO_ANCHOR_END))
+				expect = 1;
+		if (expect < 0 && matched)
+			expect = 0;
+		for (i = 0; i < ninc && expect < 0; i++)
+			if (inc_matches[i] > 0 &&
+			    archive_pathmatch(inc[i], path, flags))
+				expect = 0;
+		if (expect < 0)
+			expect = (ninc > 0);
+
+		archive_entry_copy_pathname(ae, path);
+		failure("path \"%s\"", path);
+		assertEqualInt(expect, archive_match_path_excluded(m, ae));
+		assertEqualInt(unmatched,
+		    archive_match_path_unmatched_inclusions(m));
+	}
+	archive_entry_free(ae);
+	archive_match_free(m);
+}
+
 DEFINE_TEST(test_archive_match_path)
 {
 	/* Make exclusion sample files which contain exclusion patterns. */
@@ -448,3 +556,12 @@ DEFINE_TEST(test_archive_match_path)
 	test_inclusion_from_file_wcs();
 	test_exclusion_and_inclusion();
 }
+
+DEFINE_TEST(test_archive_match_path_index)
+{
+	int i;
+
+	srand(31);
+	for (i = 0; i < 200; i++)
+		test_pattern_index(i % 2);
+}
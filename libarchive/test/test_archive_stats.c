@@ -0,0 +1,157 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+/* Return the number of the stage with the given name, or -1. */
+static int
+find_stage(struct archive *a, const char *name)
+{
+	int i;
+
+	for (i = 0; i < archive_stats_count(a); i++)
+		if (strcmp(archive_stats_name(a, i), name) == 0)
+			return (i);
+	return (-1);
+}
+
+static void
+verify_times(struct archive *a)
+{
+	int i;
+
+	for (i = 0; i < archive_stats_count(a); i++) {
+		failure("stage %s", archive_stats_name(a, i));
+		assert(archive_stats_calls(a, i) > 0);
+		assert(archive_stats_wall_nsec(a, i) >= 0);
+		assert(archive_stats_cpu_nsec(a, i) >= 0);
+	}
+}
+
+DEFINE_TEST(test_archive_stats)
+{
+	static char data[64 * 1024];
+	char buff[256 * 1024];
+	struct archive *a;
+	struct archive_entry *ae;
+	const void *p;
+	size_t used, size;
+	int64_t offset, total;
+	int i, s;
+
+	for (i = 0; i < (int)sizeof(data); i++)
+		data[i] = "0123456789abcdef"[(i * 7 + i / 100) & 15];
+
+	/* Nothing is collected unless it was asked for. */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualInt(0, archive_stats_count(a));
+	assertEqualString(NULL, archive_stats_name(a, 0));
+	assertEqualInt(-1, archive_stats_bytes(a, 0));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+
+	/* Write a gzipped tar archive. */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_stats_enable(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_ustar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_add_filter_gzip(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, sizeof(buff), &used));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_set_pathname(ae, "file");
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_set_size(ae, sizeof(data));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualIntA(a, sizeof(data),
+	    archive_write_data(a, data, sizeof(data)));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+
+	assert((s = find_stage(a, "format")) >= 0);
+	assertEqualInt(sizeof(data), archive_stats_bytes(a, s));
+	assert((s = find_stage(a, "filter:gzip")) >= 0);
+	assertEqualInt(archive_filter_bytes(a, 0), archive_stats_bytes(a, s));
+	assert((s = find_stage(a, "client")) >= 0);
+	assertEqualInt(used, archive_stats_bytes(a, s));
+	assertEqualInt(3, archive_stats_count(a));
+	verify_times(a);
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+
+	/* Read it back, converting the names from UTF-8. */
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_stats_enable(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_filter_gzip(a));
+	if (archive_read_set_options(a, "hdrcharset=UTF-8") != ARCHIVE_OK) {
+		skipping("This system cannot convert character-set"
+		    " from UTF-8.");
+		archive_read_free(a);
+		return;
+	}
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_memory(a, buff, used));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("file", archive_entry_pathname(ae));
+	total = 0;
+	while (archive_read_data_block(a, &p, &size, &offset) == ARCHIVE_OK)
+		total += size;
+	assertEqualInt(sizeof(data), total);
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+
+	assert((s = find_stage(a, "format")) >= 0);
+	assertEqualInt(sizeof(data), archive_stats_bytes(a, s));
+	assert((s = find_stage(a, "filter:gzip")) >= 0);
+	assert(archive_stats_bytes(a, s) >= (int64_t)sizeof(data));
+	assert((s = find_stage(a, "client")) >= 0);
+	assertEqualInt(used, archive_stats_bytes(a, s));
+	assert((s = find_stage(a, "charset")) >= 0);
+	assert(archive_stats_bytes(a, s) >= 4);
+	verify_times(a);
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	/* Extract a file. */
+	assert((a = archive_write_disk_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_stats_enable(a));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_set_pathname(ae, "file");
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_set_size(ae, sizeof(data));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualIntA(a, sizeof(data),
+	    archive_write_data(a, data, sizeof(data)));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertFileSize("file", sizeof(data));
+
+	assert((s = find_stage(a, "disk:create")) >= 0);
+	assert((s = find_stage(a, "disk:write")) >= 0);
+	assertEqualInt(sizeof(data), archive_stats_bytes(a, s));
+	assert((s = find_stage(a, "disk:metadata")) >= 0);
+	verify_times(a);
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+
+	/* Other kinds of archive objects have no statistics. */
+	assert((a = archive_read_disk_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_FATAL, archive_stats_enable(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+}
@@ -0,0 +1,141 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+#define __LIBARCHIVE_TEST
+#include "archive_tar_header_private.h"
+
+/*
+ * The tar header helpers may use vector instructions; check whichever
+ * implementation this machine picks against plain byte-at-a-time code.
+ */
+
+static int64_t
+ref_atol8(const char *p, size_t len)
+{
+	int64_t l = 0;
+	int neg = 0;
+
+	while (len > 0 && (*p == ' ' || *p == '\t')) {
+		p++;
+		len--;
+	}
+	if (len > 0 && *p == '-') {
+		neg = 1;
+		p++;
+		len--;
+	}
+	while (len > 0 && *p >= '0' && *p <= '7') {
+		if (l > INT64_MAX / 8 || (l == INT64_MAX / 8 && *p >= '7'))
+			return (neg ? INT64_MIN : INT64_MAX);
+		l = l * 8 + (*p++ - '0');
+		len--;
+	}
+	return (neg ? -l : l);
+}
+
+DEFINE_TEST(test_archive_tar_header_sum)
+{
+	unsigned char block[512];
+	int high, i, n, ref_high, ref_sum, sum;
+
+	srand(7);
+	for (n = 0; n < 200; n++) {
+		for (i = 0; i < 512; i++) {
+			if (n == 0)
+				block[i] = 0xff;
+			else if (n == 1)
+				block[i] = 0;
+			else
+				block[i] = (unsigned char)(rand() >>
+				    (n % 2 ? 3 : 4));
+		}
+		ref_sum = ref_high = 0;
+		for (i = 0; i < 512; i++) {
+			ref_sum += block[i];
+			ref_high += block[i] >> 7;
+		}
+		__archive_tar_header_sum(block, &sum, &high);
+		failure("block %d", n);
+		assertEqualInt(ref_sum, sum);
+		failure("block %d", n);
+		assertEqualInt(ref_high, high);
+	}
+}
+
+DEFINE_TEST(test_archive_tar_header_octal)
+{
+	static const char *fields[] = {
+		"0000644", "0000644 ", " 644 ", "\t 17", "00000001234\0",
+		"777777777777", "7777777777777777", "17777777777777777",
+		"777777777777777777777", "1777777777777777777777",
+		"7777777777777777777777", "-12", " -777", "12389", "8",
+		"", " ", "0", "07x7", "00000000000000000000000000001",
+		NULL
+	};
+	char field[32], out[32];
+	int64_t v;
+	size_t len, i;
+	int n, s;
+
+	/* Every prefix of every field, as tar would see it. */
+	for (n = 0; fields[n] != NULL; n++) {
+		len = strlen(fields[n]) + 1;
+		for (i = 0; i <= len; i++) {
+			memcpy(field, fields[n], len);
+			failure("field \"%s\", length %d", fields[n], (int)i);
+			assertEqualInt(ref_atol8(field, i),
+			    __archive_tar_atol8(field, i));
+		}
+	}
+
+	/* Formatting round-trips, and overflow fills with 7s. */
+	srand(11);
+	for (s = 1; s <= 22; s++) {
+		for (n = 0; n < 100; n++) {
+			v = ((int64_t)rand() << 31 ^ rand()) &
+			    (((int64_t)1 << (s * 3 > 62 ? 62 : s * 3)) - 1);
+			if (n == 0)
+				v = 0;
+			memset(out, 'x', sizeof(out));
+			assertEqualInt(0, __archive_tar_format_octal(v, out, s));
+			assertEqualInt('x', out[s]);
+			failure("value %jd, %d digits", (intmax_t)v, s);
+			assertEqualInt(v, __archive_tar_atol8(out, s));
+		}
+		if (s >= 21)
+			continue;
+		memset(out, 'x', sizeof(out));
+		assertEqualInt(-1, __archive_tar_format_octal(
+		    (int64_t)1 << (s * 3), out, s));
+		memset(field, '7', s);
+		assertEqualMem(field, out, s);
+		assertEqualInt('x', out[s]);
+	}
+	memset(out, 'x', sizeof(out));
+	assertEqualInt(0, __archive_tar_format_octal(0644, out, 7));
+	assertEqualMem("0000644x", out, 8);
+}
@@ -197,9 +197,189 @@ static void test_linkify_new_cpio(void)
 	archive_entry_linkresolver_free(resolver);
 }
 
+/*
+ * Many files with several links each, with and without a memory limit
+ * small enough that the table and the cached names have to go to
+ * temporary files, or that new cpio can't hold back every entry.
+ */
+#define	MANY	20000
+
+static struct archive_entry *
+many_entry(int i, int link, int nlink)
+{
+	struct archive_entry *entry;
+	char name[64];
+
+	assert(NULL != (entry = archive_entry_new()));
+	snprintf(name, sizeof(name), "dir%d/file%d-%d", i % 7, i, link);
+	archive_entry_copy_pathname(entry, name);
+	archive_entry_set_filetype(entry, AE_IFREG);
+	archive_entry_set_ino(entry, 1000 + i);
+	archive_entry_set_dev(entry, i % 3);
+	archive_entry_set_nlink(entry, nlink);
+	archive_entry_set_size(entry, 10);
+	return (entry);
+}
+
+static void test_linkify_many_tar(size_t limit)
+{
+	struct archive_entry *entry, *e2;
+	struct archive_entry_linkresolver *resolver;
+	char name[64];
+	unsigned int links;
+	int i, link, n;
+
+	assert(NULL != (resolver = archive_entry_linkresolver_new()));
+	archive_entry_linkresolver_set_strategy(resolver,
+	    ARCHIVE_FORMAT_TAR_USTAR);
+	assertEqualInt(ARCHIVE_OK,
+	    archive_entry_linkresolver_set_memory_limit(resolver, limit));
+
+	/*
+	 * Three links each, seen in different orders.  Every fourth
+	 * file is missing its last link.
+	 */
+	for (link = 0; link < 3; link++) {
+		for (n = 0; n < MANY; n++) {
+			i = (link == 1) ? MANY - 1 - n : n;
+			if (link == 2 && i % 4 == 0)
+				continue;
+			entry = many_entry(i, link, 3);
+			archive_entry_linkify(resolver, &entry, &e2);
+			assert(e2 == NULL);
+			if (link == 0) {
+				failure("file %d", i);
+				assertEqualString(NULL,
+				    archive_entry_hardlink(entry));
+				assertEqualInt(10, archive_entry_size(entry));
+			} else {
+				snprintf(name, sizeof(name),
+				    "dir%d/file%d-0", i % 7, i);
+				failure("file %d, link %d", i, link);
+				assertEqualString(name,
+				    archive_entry_hardlink(entry));
+				assertEqualInt(0, archive_entry_size(entry));
+			}
+			archive_entry_free(entry);
+		}
+	}
+
+	/* The files missing a link are reported. */
+	for (n = 0; (entry = archive_entry_partial_links(resolver, &links))
+	    != NULL; n++) {
+		i = (int)archive_entry_ino64(entry) - 1000;
+		snprintf(name, sizeof(name), "dir%d/file%d-0", i % 7, i);
+		failure("file %d", i);
+		assertEqualInt(0, i % 4);
+		assertEqualString(name, archive_entry_pathname(entry));
+		assertEqualInt(i % 3, archive_entry_dev(entry));
+		assertEqualInt(1, links);
+		archive_entry_free(entry);
+	}
+	assertEqualInt(MANY / 4, n);
+	archive_entry_linkresolver_free(resolver);
+}
+
+static void test_linkify_many_new_cpio(size_t limit)
+{
+	static char deferred[MANY];
+	struct archive_entry *entry, *e2;
+	struct archive_entry_linkresolver *resolver;
+	char name[64];
+	int i, n, expected;
+
+	assert(NULL != (resolver = archive_entry_linkresolver_new()));
+	archive_entry_linkresolver_set_strategy(resolver,
+	    ARCHIVE_FORMAT_CPIO_SVR4_NOCRC);
+	assertEqualInt(ARCHIVE_OK,
+	    archive_entry_linkresolver_set_memory_limit(resolver, limit));
+
+	/*
+	 * The first link of each file is held back, unless that would
+	 * go past the memory limit; then it comes back with its body.
+	 */
+	memset(deferred, 0, sizeof(deferred));
+	for (i = 0; i < MANY; i++) {
+		entry = many_entry(i, 0, 2);
+		archive_entry_linkify(resolver, &entry, &e2);
+		assert(e2 == NULL);
+		if (entry == NULL) {
+			deferred[i] = 1;
+			continue;
+		}
+		failure("file %d", i);
+		assert(limit != 0);
+		assertEqualString(NULL, archive_entry_hardlink(entry));
+		assertEqualInt(10, archive_entry_size(entry));
+		archive_entry_free(entry);
+	}
+	for (i = n = 0; i < MANY; i++)
+		n += deferred[i];
+	if (limit == 0)
+		assertEqualInt(MANY, n);
+	else {
+		/* Some were held back, not all. */
+		assert(n > 0);
+		assert(n < MANY);
+	}
+	/* The second link of every other file releases both. */
+	for (i = 0; i < MANY; i += 2) {
+		entry = many_entry(i, 1, 2);
+		archive_entry_linkify(resolver, &entry, &e2);
+		failure("file %d", i);
+		if (!deferred[i]) {
+			/* Now it may be held back in turn. */
+			assert(e2 == NULL);
+			if (entry == NULL) {
+				deferred[i] = 1;
+				continue;
+			}
+			snprintf(name, sizeof(name), "dir%d/file%d-1",
+			    i % 7, i);
+			assertEqualString(name, archive_entry_pathname(entry));
+			assertEqualInt(10, archive_entry_size(entry));
+			archive_entry_free(entry);
+			continue;
+		}
+		deferred[i] = 0;
+		snprintf(name, sizeof(name), "dir%d/file%d-0", i % 7, i);
+		assertEqualString(name, archive_entry_pathname(entry));
+		assertEqualString(name, archive_entry_hardlink(entry));
+		assertEqualInt(0, archive_entry_size(entry));
+		snprintf(name, sizeof(name), "dir%d/file%d-1", i % 7, i);
+		assertEqualString(name, archive_entry_pathname(e2));
+		assertEqualInt(10, archive_entry_size(e2));
+		archive_entry_free(entry);
+		archive_entry_free(e2);
+	}
+	/* The rest come out when flushed, with their bodies. */
+	for (i = expected = 0; i < MANY; i++)
+		expected += deferred[i];
+	for (n = 0;; n++) {
+		entry = NULL;
+		archive_entry_linkify(resolver, &entry, &e2);
+		if (entry == NULL)
+			break;
+		i = (int)archive_entry_ino64(entry) - 1000;
+		failure("file %d", i);
+		assertEqualInt(1, deferred[i]);
+		assertEqualString(NULL, archive_entry_hardlink(entry));
+		assertEqualInt(10, archive_entry_size(entry));
+		deferred[i] = 0;
+		archive_entry_free(entry);
+	}
+	assertEqualInt(expected, n);
+	archive_entry_linkresolver_free(resolver);
+}
+
 DEFINE_TEST(test_link_resolver)
 {
 	test_linkify_tar();
 	test_linkify_old_cpio();
 	test_linkify_new_cpio();
+	test_linkify_many_tar(0);
+	test_linkify_many_tar(64 * 1024);
+	test_linkify_many_tar(1);
+	test_linkify_many_new_cpio(0);
+	test_linkify_many_new_cpio(256 * 1024);
 }
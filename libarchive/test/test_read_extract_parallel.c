@@ -0,0 +1,352 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+#define	FILES	30
+
+static int opened;
+
+static int
+open_archive(struct archive *a, void *client_data)
+{
+	opened++;
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	return (archive_read_open_filename(a, (const char *)client_data,
+	    10240));
+}
+
+/*
+ * Write an archive holding a tree whose directories come before,
+ * between and after the files in them.
+ */
+static void
+make_archive(const char *name, int zip)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	char path[32], data[64];
+	int i;
+
+	assert((a = archive_write_new()) != NULL);
+	if (zip)
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+	else
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_write_set_format_pax_restricted(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_open_filename(a, name));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_set_mtime(ae, 86400, 0);
+	archive_entry_copy_pathname(ae, "d");
+	archive_entry_set_mode(ae, AE_IFDIR | 0755);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	for (i = 0; i < FILES; i++) {
+		if (i == FILES / 2) {
+			archive_entry_copy_pathname(ae, "d/sub");
+			archive_entry_set_mode(ae, AE_IFDIR | 0700);
+			archive_entry_set_size(ae, 0);
+			assertEqualIntA(a, ARCHIVE_OK,
+			    archive_write_header(a, ae));
+		}
+		snprintf(path, sizeof(path), "d/%sf%d",
+		    i < FILES / 2 ? "" : "sub/", i);
+		snprintf(data, sizeof(data), "contents of file %d\n", i);
+		archive_entry_copy_pathname(ae, path);
+		archive_entry_set_mode(ae, AE_IFREG | 0644);
+		archive_entry_set_size(ae, strlen(data));
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		assertEqualInt(strlen(data),
+		    archive_write_data(a, data, strlen(data)));
+	}
+	archive_entry_copy_pathname(ae, "d/link");
+	archive_entry_set_mode(ae, AE_IFLNK | 0755);
+	archive_entry_set_size(ae, 0);
+	archive_entry_copy_symlink(ae, "f0");
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_free(a));
+}
+
+static void
+extract(char *name, const char *dir, int threads)
+{
+	struct archive *a, *ad;
+
+	assertMakeDir(dir, 0755);
+	assertChdir(dir);
+	assert((a = archive_read_new()) != NULL);
+	assert((ad = archive_write_disk_new()) != NULL);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_disk_set_options(ad,
+	    ARCHIVE_EXTRACT_TIME | ARCHIVE_EXTRACT_PERM));
+	assertEqualIntA(a, ARCHIVE_OK, open_archive(a, name));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_extract_parallel(a, ad,
+	    threads, open_archive, NULL, name));
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_free(ad));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_free(a));
+	assertChdir("..");
+}
+
+static void
+verify(const char *dir)
+{
+	char path[64], data[64];
+	int i;
+
+	assertChdir(dir);
+	for (i = 0; i < FILES; i++) {
+		snprintf(path, sizeof(path), "d/%sf%d",
+		    i < FILES / 2 ? "" : "sub/", i);
+		snprintf(data, sizeof(data), "contents of file %d\n", i);
+		assertTextFileContents(data, path);
+	}
+	assertIsDir("d/sub", 0700);
+	if (canSymlink())
+		assertIsSymlink("d/link", "f0", 0);
+	/* Directory times are restored after everything inside. */
+	assertFileMtime("d", 86400, 0);
+	assertFileMtime("d/sub", 86400, 0);
+	assertChdir("..");
+}
+
+DEFINE_TEST(test_read_extract_parallel)
+{
+	char zip[] = "../test.zip", tar[] = "../test.tar";
+
+	/* A Zip archive is read by one reader per thread. */
+	make_archive("test.zip", 1);
+	opened = 0;
+	extract(zip, "zip3", 3);
+	assertEqualInt(3, opened);
+	verify("zip3");
+
+	/* So is the archive over more threads than entries. */
+	opened = 0;
+	extract(zip, "zip40", 40);
+	assertEqualInt(40, opened);
+	verify("zip40");
+
+	/* Other archives, and one thread, are extracted serially. */
+	make_archive("test.tar", 0);
+	opened = 0;
+	extract(tar, "tar", 3);
+	assertEqualInt(1, opened);
+	verify("tar");
+	opened = 0;
+	extract(zip, "zip1", 1);
+	assertEqualInt(1, opened);
+	verify("zip1");
+}
+
+#define	DEEP_LEVELS	80
+static const char deep_component[] =
+    "/abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefg";
+
+/*
+ * Names longer than PATH_MAX make archive_write_disk change the
+ * working directory, which every thread shares; the other entries
+ * must still land where they belong.
+ */
+DEFINE_TEST(test_read_extract_parallel_deep)
+{
+	char zip[] = "../deep.zip";
+	struct archive *a, *ad;
+	struct archive_entry *ae;
+	char *name, path[32], data[64];
+	size_t len;
+	int creates, i, n;
+
+	name = malloc(sizeof("deep") +
+	    DEEP_LEVELS * (sizeof(deep_component) - 1) + sizeof(path));
+	if (!assert(name != NULL))
+		return;
+	strcpy(name, "deep");
+	for (i = 0; i < DEEP_LEVELS; i++)
+		strcat(name, deep_component);
+	len = strlen(name);
+
+	/* Every fourth file is deep in the tree. */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_filename(a, "deep.zip"));
+	assert((ae = archive_entry_new()) != NULL);
+	for (i = 0; i < 4 * FILES; i++) {
+		if (i % 4 == 3) {
+			snprintf(name + len, sizeof(path), "/x%d", i);
+			archive_entry_copy_pathname(ae, name);
+		} else {
+			snprintf(path, sizeof(path), "s%d/g%d", i % 7, i);
+			archive_entry_copy_pathname(ae, path);
+		}
+		snprintf(data, sizeof(data), "contents of file %d\n", i);
+		archive_entry_set_mode(ae, AE_IFREG | 0644);
+		archive_entry_set_size(ae, strlen(data));
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		assertEqualInt(strlen(data),
+		    archive_write_data(a, data, strlen(data)));
+	}
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_free(a));
+	free(name);
+
+	assertMakeDir("out", 0755);
+	assertChdir("out");
+	assert((a = archive_read_new()) != NULL);
+	assert((ad = archive_write_disk_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_stats_enable(a));
+	assertEqualIntA(ad, ARCHIVE_OK, archive_stats_enable(ad));
+	assertEqualIntA(a, ARCHIVE_OK, open_archive(a, zip));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_extract_parallel(a, ad,
+	    8, open_archive, NULL, zip));
+
+	/* The statistics of every thread are added up. */
+	creates = 0;
+	n = archive_stats_count(ad);
+	for (i = 0; i < n; i++)
+		if (strcmp(archive_stats_name(ad, i), "disk:create") == 0)
+			creates = (int)archive_stats_calls(ad, i);
+	assertEqualInt(4 * FILES, creates);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_free(ad));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_free(a));
+
+	for (i = 0; i < 4 * FILES; i++) {
+		if (i % 4 == 3)
+			continue;
+		snprintf(path, sizeof(path), "s%d/g%d", i % 7, i);
+		snprintf(data, sizeof(data), "contents of file %d\n", i);
+		assertTextFileContents(data, path);
+	}
+	assertChdir("deep");
+	for (i = 0; i < DEEP_LEVELS; i++)
+		assertChdir(deep_component + 1);
+	for (i = 3; i < 4 * FILES; i += 4) {
+		snprintf(path, sizeof(path), "x%d", i);
+		snprintf(data, sizeof(data), "contents of file %d\n", i);
+		assertTextFileContents(data, path);
+	}
+	for (i = 0; i < DEEP_LEVELS + 2; i++)
+		assertChdir("..");
+}
+
+static void
+extract_repeats(char *name, const char *dir, int flags)
+{
+	struct archive *a, *ad;
+
+	assertMakeDir(dir, 0755);
+	assertChdir(dir);
+	assert((a = archive_read_new()) != NULL);
+	assert((ad = archive_write_disk_new()) != NULL);
+	assertEqualIntA(ad, ARCHIVE_OK,
+	    archive_write_disk_set_options(ad, flags));
+	assertEqualIntA(a, ARCHIVE_OK, open_archive(a, name));
+	opened = 0;
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_extract_parallel(a, ad,
+	    4, open_archive, NULL, name));
+	/* One more reader for the repeated names. */
+	assertEqualInt(4, opened);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_write_free(ad));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_free(a));
+	assertChdir("..");
+}
+
+/*
+ * A name that the archive holds more than once ends up as a serial
+ * extraction would leave it, whichever thread reads its entries.
+ */
+DEFINE_TEST(test_read_extract_parallel_repeats)
+{
+	char zip[] = "../repeats.zip";
+	struct archive *a;
+	struct archive_entry *ae;
+	char path[32], data[64];
+	int i;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_filename(a, "repeats.zip"));
+	assert((ae = archive_entry_new()) != NULL);
+	for (i = 0; i < 4 * FILES; i++) {
+		/* Most fifth entries are "same"; "link" and "dir" also
+		 * change kind. */
+		if (i == FILES || i == 3 * FILES)
+			strcpy(path, "link");
+		else if (i == 2 * FILES + 1)
+			strcpy(path, "dir");
+		else if (i % 5 == 0)
+			strcpy(path, "same");
+		else
+			snprintf(path, sizeof(path), "u%d", i);
+		archive_entry_copy_pathname(ae, path);
+		archive_entry_set_size(ae, 0);
+		if (i == FILES) {
+			archive_entry_set_mode(ae, AE_IFLNK | 0755);
+			archive_entry_copy_symlink(ae, "same");
+			assertEqualIntA(a, ARCHIVE_OK,
+			    archive_write_header(a, ae));
+			archive_entry_copy_symlink(ae, NULL);
+			continue;
+		}
+		if (i == 2 * FILES + 1) {
+			archive_entry_set_mode(ae, AE_IFDIR | 0755);
+			assertEqualIntA(a, ARCHIVE_OK,
+			    archive_write_header(a, ae));
+			continue;
+		}
+		snprintf(data, sizeof(data), "contents of file %d\n", i);
+		archive_entry_set_mode(ae, AE_IFREG | 0644);
+		archive_entry_set_size(ae, strlen(data));
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		assertEqualInt(strlen(data),
+		    archive_write_data(a, data, strlen(data)));
+	}
+	/* A directory given again after a file inside it. */
+	archive_entry_copy_pathname(ae, "dir/");
+	archive_entry_set_mode(ae, AE_IFDIR | 0700);
+	archive_entry_set_size(ae, 0);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_free(a));
+
+	/* The last copy of each name wins. */
+	extract_repeats(zip, "last", ARCHIVE_EXTRACT_PERM);
+	assertChdir("last");
+	snprintf(data, sizeof(data), "contents of file %d\n",
+	    4 * FILES - 5);
+	assertTextFileContents(data, "same");
+	snprintf(data, sizeof(data), "contents of file %d\n", 3 * FILES);
+	assertTextFileContents(data, "link");
+	assertIsDir("dir", 0700);
+	assertChdir("..");
+
+	/* Without overwriting, the first copy does. */
+	extract_repeats(zip, "first", ARCHIVE_EXTRACT_NO_OVERWRITE);
+	assertChdir("first");
+	assertTextFileContents("contents of file 0\n", "same");
+	if (canSymlink())
+		assertIsSymlink("link", "same", 0);
+	assertIsDir("dir", 0755);
+	assertChdir("..");
+}
@@ -0,0 +1,89 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+/*
+ * test_read_filter_xz_seek.tar.xz holds 30 entries of 70000 bytes and
+ * more, compressed with "xz --block-size=150000", so that many reads
+ * of decompressed data cross a block boundary.  Skipping an entry
+ * right after such a read is done by decoding and discarding the rest
+ * of the new block, which must start counting at the boundary.
+ */
+DEFINE_TEST(test_read_filter_xz_seek)
+{
+	const char *refname = "test_read_filter_xz_seek.tar.xz";
+	struct archive_entry *ae;
+	struct archive *a;
+	char *data, *rbuff;
+	size_t size;
+	char path[16];
+	int i, j, r;
+
+	data = malloc(200000);
+	rbuff = malloc(200000);
+	if (!assert(data != NULL && rbuff != NULL)) {
+		free(data);
+		free(rbuff);
+		return;
+	}
+	extract_reference_file(refname);
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	r = archive_read_support_filter_xz(a);
+	if (r == ARCHIVE_WARN) {
+		skipping("xz reading not fully supported on this platform");
+		assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+		free(data);
+		free(rbuff);
+		return;
+	}
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_filename(a, refname, 10240));
+	for (i = 0; i < 30; i++) {
+		sprintf(path, "file%d", i);
+		failure("Could not read entry %d", i);
+		if (!assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae)))
+			break;
+		assertEqualString(path, archive_entry_pathname(ae));
+		size = 70000 + i * 3001;
+		assertEqualInt(size, archive_entry_size(ae));
+		/* Only read back every fourth entry; skip the rest. */
+		if (i % 4 != 3)
+			continue;
+		for (j = 0; j < (int)size; j++)
+			data[j] = (char)((j * (i + 3)) >> 5);
+		assertEqualIntA(a, (la_ssize_t)size,
+		    archive_read_data(a, rbuff, 200000));
+		assertEqualMem(rbuff, data, size);
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	free(data);
+	free(rbuff);
+}
@@ -0,0 +1,242 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+#define __LIBARCHIVE_BUILD
+#include <archive_endian.h>
+
+/*
+ * A cabinet of several folders is decoded ahead on worker threads
+ * with the threads option; its entries must read the same as they
+ * do without it.  The cabinet is built here with one folder of each
+ * compression type: the MSZIP folder holds stored deflate blocks and
+ * the LZX folder holds uncompressed LZX blocks.
+ */
+
+#define FOLDERS		3
+#define FILES		3
+#define FOLDER_SIZE	(0x8000 + 10000)
+
+static const int file_sizes[FILES] = { 20000, 20000, FOLDER_SIZE - 40000 };
+static unsigned char contents[FOLDERS][FOLDER_SIZE];
+
+static uint32_t
+checksum(const unsigned char *p, size_t bytes, uint32_t sum)
+{
+	uint32_t t = 0;
+
+	for (; bytes >= 4; bytes -= 4, p += 4)
+		sum ^= archive_le32dec(p);
+	switch (bytes) {
+	case 3: t |= (uint32_t)*p++ << 16;	/* FALL THROUGH */
+	case 2: t |= (uint32_t)*p++ << 8;	/* FALL THROUGH */
+	case 1: t |= *p;
+	}
+	return (sum ^ t);
+}
+
+/* Compress one CFDATA; returns the compressed size. */
+static size_t
+compress_cfdata(unsigned char *out, const unsigned char *in, size_t size,
+    int comptype, int first)
+{
+	unsigned char *p = out;
+
+	switch (comptype) {
+	case 1: /* MSZIP: a final stored deflate block. */
+		*p++ = 'C';
+		*p++ = 'K';
+		*p++ = 0x01;
+		archive_le16enc(p, (uint16_t)size);
+		archive_le16enc(p + 2, (uint16_t)~size);
+		p += 4;
+		break;
+	case 3: /* LZX: an uncompressed block. */
+		/*
+		 * The first CFDATA starts with a zero bit (no E8
+		 * translation); then three bits of the block type and
+		 * 24 bits of the block size, padded to 16 bits, and
+		 * the repeated offsets R0, R1 and R2.
+		 */
+		if (first) {
+			archive_le16enc(p, (uint16_t)(0x3000 | size >> 12));
+			archive_le16enc(p + 2, (uint16_t)((size & 0xfff) << 4));
+		} else {
+			archive_le16enc(p, (uint16_t)(0x6000 | size >> 11));
+			archive_le16enc(p + 2, (uint16_t)((size & 0x7ff) << 5));
+		}
+		p += 4;
+		archive_le32enc(p, 1);
+		archive_le32enc(p + 4, 1);
+		archive_le32enc(p + 8, 1);
+		p += 12;
+		break;
+	}
+	memcpy(p, in, size);
+	p += size;
+	if (comptype == 3 && (size & 1))
+		*p++ = 0;
+	return (p - out);
+}
+
+static size_t
+make_cab(unsigned char *buff)
+{
+	unsigned char *p, *folder, *data;
+	size_t hdr_size, csize, usize;
+	uint32_t sum;
+	int f, i, n;
+
+	hdr_size = 36 + FOLDERS * 8;
+	p = buff + hdr_size;
+	for (f = 0; f < FOLDERS; f++) {
+		int offset = 0;
+
+		for (i = 0; i < FILES; i++) {
+			archive_le32enc(p, file_sizes[i]);
+			archive_le32enc(p + 4, offset);
+			archive_le16enc(p + 8, f);
+			archive_le16enc(p + 10, 0x5821);
+			archive_le16enc(p + 12, 0);
+			archive_le16enc(p + 14, 0x20);
+			p += 16;
+			p += sprintf((char *)p, "folder%d/file%d", f, i) + 1;
+			offset += file_sizes[i];
+		}
+	}
+
+	for (f = 0; f < FOLDERS; f++) {
+		folder = buff + 36 + f * 8;
+		archive_le32enc(folder, (uint32_t)(p - buff));
+		archive_le16enc(folder + 4, 2);
+		archive_le16enc(folder + 6, f == 2 ? 3 | (15 << 8) : f);
+		for (n = 0; n < 2; n++) {
+			usize = n == 0 ? 0x8000 : FOLDER_SIZE - 0x8000;
+			data = p + 8;
+			csize = compress_cfdata(data, contents[f] + n * 0x8000,
+			    usize, f == 2 ? 3 : f, n == 0);
+			archive_le16enc(p + 4, (uint16_t)csize);
+			archive_le16enc(p + 6, (uint16_t)usize);
+			sum = checksum(data, csize, 0);
+			sum = checksum(p + 4, 4, sum);
+			archive_le32enc(p, sum);
+			p += 8 + csize;
+		}
+	}
+
+	memset(buff, 0, 36);
+	memcpy(buff, "MSCF", 4);
+	archive_le32enc(buff + 8, (uint32_t)(p - buff));
+	archive_le32enc(buff + 16, (uint32_t)hdr_size);
+	buff[24] = 3;
+	buff[25] = 1;
+	archive_le16enc(buff + 26, FOLDERS);
+	archive_le16enc(buff + 28, FOLDERS * FILES);
+	return (p - buff);
+}
+
+/*
+ * Read the cabinet, skipping the data of the entries whose bit is set
+ * in `skip'; return the number of entries read well, after checking
+ * their contents.
+ */
+static int
+read_cab(const unsigned char *buff, size_t size, const char *threads,
+    int skip)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	static unsigned char rbuff[FOLDER_SIZE];
+	char name[32];
+	int f, i, offset, ok = 0;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_cab(a));
+	if (threads != NULL)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_set_format_option(a, "cab", "threads",
+		    threads));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, size));
+	for (f = 0; f < FOLDERS; f++) {
+		offset = 0;
+		for (i = 0; i < FILES; i++) {
+			if (archive_read_next_header(a, &ae) != ARCHIVE_OK)
+				goto done;
+			sprintf(name, "folder%d/file%d", f, i);
+			assertEqualString(name, archive_entry_pathname(ae));
+			assertEqualInt(file_sizes[i], archive_entry_size(ae));
+			if ((skip & (1 << (f * FILES + i))) == 0) {
+				if (archive_read_data(a, rbuff, sizeof(rbuff))
+				    != file_sizes[i])
+					goto done;
+				failure("%s", name);
+				assertEqualMem(rbuff, contents[f] + offset,
+				    file_sizes[i]);
+			}
+			offset += file_sizes[i];
+			ok++;
+		}
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+done:
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+	return (ok);
+}
+
+DEFINE_TEST(test_read_format_cab_threads)
+{
+	static const char *threads[] = { NULL, "1", "2", "4", "0" };
+	unsigned char *buff;
+	size_t size;
+	int f, i, t;
+
+	for (f = 0; f < FOLDERS; f++)
+		for (i = 0; i < FOLDER_SIZE; i++)
+			contents[f][i] = (unsigned char)((i * (f + 3)) ^
+			    (i >> 9));
+
+	buff = malloc(1024 + FOLDERS * (FOLDER_SIZE + 100));
+	if (!assert(buff != NULL))
+		return;
+	size = make_cab(buff);
+
+	for (t = 0; t < (int)(sizeof(threads) / sizeof(threads[0])); t++) {
+		failure("threads=%s", threads[t] ? threads[t] : "(none)");
+		assertEqualInt(FOLDERS * FILES, read_cab(buff, size,
+		    threads[t], 0));
+		/* Skip the first folder, then every other entry. */
+		failure("threads=%s", threads[t] ? threads[t] : "(none)");
+		assertEqualInt(FOLDERS * FILES, read_cab(buff, size,
+		    threads[t], 0x007 | 0x0a8));
+	}
+
+	/* A bad checksum in the second CFDATA of the second folder
+	 * stops reading at its second entry, with or without threads. */
+	buff[archive_le32dec(buff + 36 + 8) + 2 * 8 + 0x8007 + 10] ^= 1;
+	assertEqualInt(FILES + 1, read_cab(buff, size, NULL, 0));
+	assertEqualInt(FILES + 1, read_cab(buff, size, "4", 0));
+
+	free(buff);
+}
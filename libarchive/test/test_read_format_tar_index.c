@@ -0,0 +1,220 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * Tar member index: embedded by the pax writer, or built while reading
+ * and kept in a sidecar file, then used to jump straight to a member.
+ */
+
+#define NFILES	20
+
+static void
+file_contents(char *buff, size_t size, int i)
+{
+	size_t j;
+
+	for (j = 0; j < size; j++)
+		buff[j] = (char)('a' + (i + j) % 26);
+}
+
+static size_t
+make_archive(char *buff, size_t buffsize, int index)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char path[64], data[3000];
+	size_t used;
+	int i;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_pax(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_add_filter_none(a));
+	if (index)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_write_set_format_option(a, "pax", "index", "1"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+	for (i = 0; i < NFILES; i++) {
+		/* Some names need a pax header; one has a newline. */
+		if (i == 7)
+			sprintf(path, "dir/with\nnewline%d", i);
+		else
+			sprintf(path, "%sfile%d", i % 3 ? "" :
+			    "a/rather/long/directory/name/that/needs/pax/"
+			    "headers/", i);
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_copy_pathname(ae, path);
+		archive_entry_set_mode(ae, AE_IFREG | 0644);
+		archive_entry_set_size(ae, 100 * i + 1);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		archive_entry_free(ae);
+		file_contents(data, 100 * i + 1, i);
+		assertEqualIntA(a, 100 * i + 1,
+		    archive_write_data(a, data, 100 * i + 1));
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	return (used);
+}
+
+static void
+verify_entry(struct archive *a, const char *path, int i)
+{
+	struct archive_entry *ae;
+	char data[3000], expect[3000];
+
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString(path, archive_entry_pathname(ae));
+	assertEqualInt(100 * i + 1, archive_entry_size(ae));
+	file_contents(expect, 100 * i + 1, i);
+	assertEqualIntA(a, 100 * i + 1,
+	    archive_read_data(a, data, sizeof(data)));
+	assertEqualMem(data, expect, 100 * i + 1);
+}
+
+DEFINE_TEST(test_read_format_tar_index_embedded)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char *buff;
+	size_t used;
+	int i;
+
+	assert((buff = malloc(200000)) != NULL);
+	used = make_archive(buff, 200000, 1);
+
+	/* The index doesn't get in the way of ordinary reading. */
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	for (i = 0; i < NFILES; i++)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	/* Load it and jump around. */
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_tar_index_load(a, NULL));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_seek_entry(a, "file17"));
+	verify_entry(a, "file17", 17);
+	/* Reading carries on with the following member. */
+	verify_entry(a, "a/rather/long/directory/name/that/needs/pax/"
+	    "headers/file18", 18);
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_seek_entry(a, "dir/with\nnewline7"));
+	verify_entry(a, "dir/with\nnewline7", 7);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_tar_seek_entry(a,
+	    "a/rather/long/directory/name/that/needs/pax/headers/file0"));
+	verify_entry(a, "a/rather/long/directory/name/that/needs/pax/"
+	    "headers/file0", 0);
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_seek_entry(a, "nonexistent"));
+	/* Seeking works after hitting the end of the archive, too. */
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_seek_entry(a, "file19"));
+	verify_entry(a, "file19", 19);
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_seek_entry(a, "file4"));
+	verify_entry(a, "file4", 4);
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	/* No index in an archive written without one. */
+	used = make_archive(buff, 200000, 0);
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_index_load(a, NULL));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_seek_entry(a, "file4"));
+	/* The failed lookup left the reader where it was. */
+	for (i = 0; i < NFILES; i++)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	free(buff);
+}
+
+DEFINE_TEST(test_read_format_tar_index_sidecar)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char *buff;
+	size_t used;
+	int i;
+
+	assert((buff = malloc(200000)) != NULL);
+	used = make_archive(buff, 200000, 0);
+
+	/* Build the index while listing the archive, then save it. */
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_set_format_option(a, "tar", "index", "1"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	for (i = 0; i < NFILES; i++)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_index_save(a, "test.idx"));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	/* Use the saved index with a fresh reader. */
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_index_load(a, "test.idx"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_seek_entry(a, "file11"));
+	verify_entry(a, "file11", 11);
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_tar_seek_entry(a, "dir/with\nnewline7"));
+	verify_entry(a, "dir/with\nnewline7", 7);
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_index_load(a, "nonexistent.idx"));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	/* A file that isn't an index is rejected. */
+	assertMakeFile("bad.idx", 0644, "12 34\n");
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_read_tar_index_load(a, "bad.idx"));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	free(buff);
+}
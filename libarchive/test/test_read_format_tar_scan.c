@@ -0,0 +1,192 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+/*
+ * The "scan" option reads plain headers through a fast path; it must
+ * report the same names, sizes and types as the full parser, and fall
+ * back to it for anything the fast path doesn't handle.
+ */
+
+static const char longname[] =
+    "a/rather/long/directory/name/that/does/not/fit/in/the/"
+    "hundred/bytes/of/a/plain/tar/header/name/field/so/it/needs/"
+    "an/extension/file";
+
+static size_t
+make_archive(char *buff, size_t buffsize, int format)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	size_t used;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format(a, format));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_add_filter_none(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "dir/");
+	archive_entry_set_mode(ae, AE_IFDIR | 0755);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+
+	archive_entry_clear(ae);
+	archive_entry_copy_pathname(ae, "dir/file");
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_set_size(ae, 1000);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertEqualIntA(a, 1000, archive_write_data(a, buff + buffsize / 2,
+	    1000));
+
+	archive_entry_clear(ae);
+	archive_entry_copy_pathname(ae, "dir/hardlink");
+	archive_entry_copy_hardlink(ae, "dir/file");
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+
+	archive_entry_clear(ae);
+	archive_entry_copy_pathname(ae, "dir/symlink");
+	archive_entry_copy_symlink(ae, "file");
+	archive_entry_set_mode(ae, AE_IFLNK | 0777);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+
+	archive_entry_clear(ae);
+	archive_entry_copy_pathname(ae, "fifo");
+	archive_entry_set_mode(ae, AE_IFIFO | 0644);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+
+	if (format != ARCHIVE_FORMAT_TAR_USTAR &&
+	    format != ARCHIVE_FORMAT_TAR) {
+		archive_entry_clear(ae);
+		archive_entry_copy_pathname(ae, longname);
+		archive_entry_set_mode(ae, AE_IFREG | 0644);
+		archive_entry_set_size(ae, 600);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		assertEqualIntA(a, 600, archive_write_data(a,
+		    buff + buffsize / 2, 600));
+	}
+
+	if (format == ARCHIVE_FORMAT_TAR_PAX_INTERCHANGE) {
+		/* Sparse entries go through the full parser. */
+		archive_entry_clear(ae);
+		archive_entry_copy_pathname(ae, "sparse");
+		archive_entry_set_mode(ae, AE_IFREG | 0644);
+		archive_entry_set_size(ae, 100000);
+		archive_entry_sparse_add_entry(ae, 0, 512);
+		archive_entry_sparse_add_entry(ae, 99488, 512);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		assertEqualIntA(a, 100000, archive_write_data(a,
+		    buff + buffsize / 2, 100000));
+	}
+
+	archive_entry_clear(ae);
+	archive_entry_copy_pathname(ae, "last");
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_set_size(ae, 12);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertEqualIntA(a, 12, archive_write_data(a, "hello, world", 12));
+	archive_entry_free(ae);
+
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	return (used);
+}
+
+static void
+compare_scan(int format, const char *name)
+{
+	struct archive_entry *ae, *full;
+	struct archive *a, *b;
+	char *buff, data[20];
+	size_t used;
+	int r;
+
+	assert((buff = calloc(1, 400000)) != NULL);
+	used = make_archive(buff, 200000, format);
+	failure("%s", name);
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_set_format_option(a, "tar", "scan", "1"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_memory(a, buff, used));
+	assert((b = archive_read_new()) != NULL);
+	assertEqualIntA(b, ARCHIVE_OK, archive_read_support_format_tar(b));
+	assertEqualIntA(b, ARCHIVE_OK,
+	    archive_read_open_memory(b, buff, used));
+	assert((full = archive_entry_new()) != NULL);
+
+	for (;;) {
+		r = archive_read_next_header2(b, full);
+		assertEqualIntA(a, r, archive_read_next_header(a, &ae));
+		if (r != ARCHIVE_OK)
+			break;
+		failure("%s: %s", name, archive_entry_pathname(full));
+		assertEqualString(archive_entry_pathname(full),
+		    archive_entry_pathname(ae));
+		assertEqualInt(archive_entry_size(full),
+		    archive_entry_size(ae));
+		assertEqualInt(archive_entry_filetype(full),
+		    archive_entry_filetype(ae));
+		assertEqualString(archive_entry_hardlink(full),
+		    archive_entry_hardlink(ae));
+		assertEqualString(archive_entry_symlink(full),
+		    archive_entry_symlink(ae));
+		assertEqualInt(archive_format(b), archive_format(a));
+	}
+	assertEqualInt(ARCHIVE_EOF, r);
+	archive_entry_free(full);
+	assertEqualInt(ARCHIVE_OK, archive_read_free(b));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	/* Entry bodies are still where they should be. */
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_tar(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_set_format_option(a, "tar", "scan", "1"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_open_memory(a, buff, used));
+	do {
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae));
+	} while (strcmp(archive_entry_pathname(ae), "last") != 0);
+	assertEqualIntA(a, 12, archive_read_data(a, data, sizeof(data)));
+	assertEqualMem(data, "hello, world", 12);
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+	free(buff);
+}
+
+DEFINE_TEST(test_read_format_tar_scan)
+{
+	compare_scan(ARCHIVE_FORMAT_TAR, "v7");
+	compare_scan(ARCHIVE_FORMAT_TAR_USTAR, "ustar");
+	compare_scan(ARCHIVE_FORMAT_TAR_GNUTAR, "gnutar");
+	compare_scan(ARCHIVE_FORMAT_TAR_PAX_RESTRICTED, "pax restricted");
+	compare_scan(ARCHIVE_FORMAT_TAR_PAX_INTERCHANGE, "pax");
+}
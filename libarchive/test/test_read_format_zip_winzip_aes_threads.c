@@ -0,0 +1,154 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+/*
+ * With the threads option, the keys of the WinZip AES entries of a
+ * seekable archive are derived on worker threads ahead of reading
+ * them; the entries must read back the same as without it.
+ */
+
+#define ENTRIES	200
+
+static size_t
+make_archive(unsigned char *buff, size_t buffsize)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	char name[32], data[64];
+	size_t used = 0;
+	int i;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_add_filter_none(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_options(a,
+	    "zip:encryption=aes256,zip:compression=store"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_passphrase(a, "pw"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+	for (i = 0; i < ENTRIES; i++) {
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_set_mtime(ae, 1, 0);
+		if (i % 50 == 0) {
+			/* Directories are not encrypted. */
+			snprintf(name, sizeof(name), "dir%d/", i);
+			archive_entry_copy_pathname(ae, name);
+			archive_entry_set_mode(ae, AE_IFDIR | 0755);
+			assertEqualIntA(a, ARCHIVE_OK,
+			    archive_write_header(a, ae));
+		} else {
+			snprintf(name, sizeof(name), "file%d", i);
+			snprintf(data, sizeof(data), "contents of file %d", i);
+			archive_entry_copy_pathname(ae, name);
+			archive_entry_set_mode(ae, AE_IFREG | 0644);
+			archive_entry_set_size(ae, strlen(data));
+			assertEqualIntA(a, ARCHIVE_OK,
+			    archive_write_header(a, ae));
+			assertEqualIntA(a, (int)strlen(data),
+			    archive_write_data(a, data, strlen(data)));
+		}
+		archive_entry_free(ae);
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	return (used);
+}
+
+/*
+ * Read the archive back, reading the data of one entry in `step'.
+ */
+static void
+verify_archive(const unsigned char *buff, size_t used, const char *threads,
+    int step)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	char name[32], data[64], rbuff[64];
+	int i;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_zip_seekable(a));
+	if (threads != NULL)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_set_option(a, "zip", "threads", threads));
+	/* The wrong passphrase is tried first for every entry. */
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_add_passphrase(a, "bad"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_add_passphrase(a, "pw"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	for (i = 0; i < ENTRIES; i++) {
+		assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+		if (i % 50 == 0) {
+			snprintf(name, sizeof(name), "dir%d/", i);
+			assertEqualString(name, archive_entry_pathname(ae));
+			continue;
+		}
+		snprintf(name, sizeof(name), "file%d", i);
+		assertEqualString(name, archive_entry_pathname(ae));
+		assertEqualInt(1, archive_entry_is_data_encrypted(ae));
+		if (i % step != 0)
+			continue;
+		snprintf(data, sizeof(data), "contents of file %d", i);
+		failure("%s", name);
+		assertEqualIntA(a, (int)strlen(data),
+		    archive_read_data(a, rbuff, sizeof(rbuff)));
+		failure("%s", name);
+		assertEqualMem(rbuff, data, strlen(data));
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+}
+
+DEFINE_TEST(test_read_format_zip_winzip_aes_threads)
+{
+	struct archive *a;
+	unsigned char *buff;
+	size_t buffsize = 256 * 1024, used;
+
+	/* Check if running system has cryptographic functionality. */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_add_filter_none(a));
+	if (ARCHIVE_OK != archive_write_set_options(a,
+				"zip:encryption=aes256")) {
+		skipping("This system does not have cryptographic liberary");
+		archive_write_free(a);
+		return;
+	}
+	archive_write_free(a);
+
+	buff = malloc(buffsize);
+	if (!assert(buff != NULL))
+		return;
+	used = make_archive(buff, buffsize);
+
+	verify_archive(buff, used, NULL, 1);
+	verify_archive(buff, used, "4", 1);
+	/* Entries whose data is skipped use no key. */
+	verify_archive(buff, used, "4", 7);
+	verify_archive(buff, used, "0", 1);
+
+	free(buff);
+}
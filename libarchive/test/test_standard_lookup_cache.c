@@ -0,0 +1,137 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+#include <grp.h>
+#include <pwd.h>
+#endif
+
+/*
+ * The standard uname/gname lookups of archive_read_disk and
+ * archive_write_disk share one cache.  Whatever it has seen before,
+ * it must keep giving the answers the system databases give.
+ */
+
+DEFINE_TEST(test_standard_lookup_cache)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	skipping("Standard lookups not available on Windows");
+#else
+	struct archive *r, *w;
+	struct passwd *pw;
+	struct group *gr;
+	const char *p;
+	char name[64];
+	int pass, i;
+	int64_t id;
+
+	assert((r = archive_read_disk_new()) != NULL);
+	assert((w = archive_write_disk_new()) != NULL);
+	assertEqualIntA(r, ARCHIVE_OK,
+	    archive_read_disk_set_standard_lookup(r));
+	assertEqualIntA(w, ARCHIVE_OK,
+	    archive_write_disk_set_standard_lookup(w));
+
+	/*
+	 * Many different ids, most of them unknown, looked up one by
+	 * one, then again after the cache was filled from the databases.
+	 */
+	for (pass = 0; pass < 3; pass++) {
+		if (pass == 1)
+			assertEqualIntA(r, ARCHIVE_OK,
+			    archive_read_disk_preload_standard_lookup(r));
+		for (i = 0; i < 300; i++) {
+			id = (i < 150) ? i : 1999999000 + i;
+			/* Copy the answer; a lookup may overwrite it. */
+			pw = getpwuid((uid_t)id);
+			if (pw != NULL)
+				snprintf(name, sizeof(name), "%s",
+				    pw->pw_name);
+			p = archive_read_disk_uname(r, id);
+			failure("uid %d, pass %d", (int)id, pass);
+			if (pw == NULL)
+				assert(p == NULL);
+			else
+				assertEqualString(name, p);
+			gr = getgrgid((gid_t)id);
+			if (gr != NULL)
+				snprintf(name, sizeof(name), "%s",
+				    gr->gr_name);
+			p = archive_read_disk_gname(r, id);
+			failure("gid %d, pass %d", (int)id, pass);
+			if (gr == NULL)
+				assert(p == NULL);
+			else
+				assertEqualString(name, p);
+		}
+	}
+
+	/* Names map back to ids, and unknown names keep the given id. */
+	assertEqualIntA(w, ARCHIVE_OK,
+	    archive_write_disk_preload_standard_lookup(w));
+	pw = getpwuid(0);
+	if (pw != NULL) {
+		snprintf(name, sizeof(name), "%s", pw->pw_name);
+		assertEqualInt(0, archive_write_disk_uid(w, name, 99));
+	}
+	gr = getgrgid(0);
+	if (gr != NULL) {
+		snprintf(name, sizeof(name), "%s", gr->gr_name);
+		assertEqualInt(0, archive_write_disk_gid(w, name, 99));
+	}
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < 100; i++) {
+			snprintf(name, sizeof(name), "no-such-name-%d", i);
+			failure("%s, pass %d", name, pass);
+			assertEqualInt(1000 + i + pass,
+			    archive_write_disk_uid(w, name, 1000 + i + pass));
+			failure("%s, pass %d", name, pass);
+			assertEqualInt(2000 + i + pass,
+			    archive_write_disk_gid(w, name, 2000 + i + pass));
+		}
+	}
+
+	/* Freeing one object leaves the cache to the other. */
+	assertEqualInt(ARCHIVE_OK, archive_read_free(r));
+	pw = getpwuid(0);
+	if (pw != NULL) {
+		snprintf(name, sizeof(name), "%s", pw->pw_name);
+		assertEqualInt(0, archive_write_disk_uid(w, name, 99));
+	}
+	assertEqualInt(ARCHIVE_OK, archive_write_free(w));
+
+	/* A new object after the last one is gone starts over. */
+	assert((r = archive_read_disk_new()) != NULL);
+	assertEqualIntA(r, ARCHIVE_OK,
+	    archive_read_disk_set_standard_lookup(r));
+	pw = getpwuid(0);
+	if (pw != NULL) {
+		snprintf(name, sizeof(name), "%s", pw->pw_name);
+		assertEqualString(name, archive_read_disk_uname(r, 0));
+	}
+	assertEqualInt(ARCHIVE_OK, archive_read_free(r));
+#endif
+}
@@ -0,0 +1,177 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+#define	SRC_SIZE	(1024 * 1024 + 77)
+
+/*
+ * Write the header of `name' from `ae' and then `size' bytes of
+ * `buff', or none if `size' is zero.
+ */
+static void
+write_file(struct archive *a, struct archive_entry *ae, const char *name,
+    const char *buff, size_t size)
+{
+	archive_entry_copy_pathname(ae, name);
+	failure("%s", name);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	if (size > 0)
+		assertEqualInt(size, archive_write_data(a, buff, size));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_finish_entry(a));
+}
+
+DEFINE_TEST(test_write_disk_clone)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	skipping("Source file descriptors are not used on Windows");
+#else
+	struct archive *a, *ad;
+	struct archive_entry *ae, *ae2;
+	struct stat st;
+	char *buff, *junk, *p;
+	size_t i, s;
+	int fd, files, r;
+
+	buff = malloc(SRC_SIZE);
+	junk = malloc(SRC_SIZE);
+	assert(buff != NULL && junk != NULL);
+	if (buff == NULL || junk == NULL) {
+		free(buff);
+		free(junk);
+		return;
+	}
+	for (i = 0; i < SRC_SIZE; i++) {
+		buff[i] = (char)(i * 11 + i / 1000);
+		junk[i] = 'x';
+	}
+	assertMakeDir("in", 0755);
+	assertMakeBinFile("in/src", 0644, SRC_SIZE, buff);
+
+	/* The hint is not owned by the entry, so a clone leaves it out. */
+	assert((ae = archive_entry_new()) != NULL);
+	assertEqualInt(-1, archive_entry_source_fd(ae));
+	fd = open("in/src", O_RDONLY | O_BINARY);
+	assert(fd >= 0);
+	archive_entry_set_source_fd(ae, fd);
+	assertEqualInt(fd, archive_entry_source_fd(ae));
+	assert((ae2 = archive_entry_clone(ae)) != NULL);
+	assertEqualInt(-1, archive_entry_source_fd(ae2));
+	archive_entry_free(ae2);
+	archive_entry_set_source_fd(ae, -1);
+	assertEqualInt(-1, archive_entry_source_fd(ae));
+	archive_entry_set_source_fd(ae, fd);
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_set_size(ae, SRC_SIZE);
+
+	/* Without ARCHIVE_EXTRACT_CLONE, the data written is used. */
+	assert((a = archive_write_disk_new()) != NULL);
+	write_file(a, ae, "plain", junk, SRC_SIZE);
+	p = slurpfile(&s, "plain");
+	assertEqualInt(SRC_SIZE, s);
+	assertEqualMem(p, junk, SRC_SIZE);
+	free(p);
+
+	/* With it, the source is copied and the data written dropped. */
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_disk_set_options(a, ARCHIVE_EXTRACT_CLONE));
+	write_file(a, ae, "cloned", junk, SRC_SIZE);
+	assertEqualFile("cloned", "in/src");
+	assertEqualInt(0, lseek(fd, 0, SEEK_CUR));
+	write_file(a, ae, "cloned2", NULL, 0);
+	assertEqualFile("cloned2", "in/src");
+
+	/* A source of another size than the entry is not used. */
+	archive_entry_set_size(ae, SRC_SIZE + 10);
+	write_file(a, ae, "longer", junk, SRC_SIZE);
+	p = slurpfile(&s, "longer");
+	assertEqualInt(SRC_SIZE + 10, s);
+	assertEqualMem(p, junk, SRC_SIZE);
+	free(p);
+
+	/*
+	 * Nor is a descriptor that now refers to another file of the
+	 * same size, as after the source was closed and the number
+	 * reused.
+	 */
+	assertEqualInt(0, fstat(fd, &st));
+	close(fd);
+	assertMakeBinFile("in/other", 0644, SRC_SIZE, junk);
+	fd = open("in/other", O_RDONLY | O_BINARY);
+	assert(fd >= 0);
+	archive_entry_set_source_fd(ae, fd);
+	archive_entry_set_size(ae, SRC_SIZE);
+	archive_entry_set_dev(ae, st.st_dev);
+	archive_entry_set_ino(ae, st.st_ino);
+	write_file(a, ae, "reused", buff, SRC_SIZE);
+	assertEqualFile("reused", "in/src");
+	/* With the right device and inode, it is. */
+	assertEqualInt(0, fstat(fd, &st));
+	archive_entry_set_dev(ae, st.st_dev);
+	archive_entry_set_ino(ae, st.st_ino);
+	write_file(a, ae, "matched", buff, SRC_SIZE);
+	assertEqualFile("matched", "in/other");
+	archive_entry_free(ae);
+	close(fd);
+	assertEqualInt(0, unlink("in/other"));
+
+	/* archive_read_disk hands out the descriptors of regular files. */
+	assertMakeFile("in/small", 0644, "small");
+	assert((ad = archive_read_disk_new()) != NULL);
+	assertEqualIntA(ad, ARCHIVE_OK,
+	    archive_read_disk_set_behavior(ad, ARCHIVE_READDISK_SOURCE_FD));
+	assertEqualIntA(ad, ARCHIVE_OK, archive_read_disk_open(ad, "in"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_disk_set_options(a,
+	    ARCHIVE_EXTRACT_CLONE | ARCHIVE_EXTRACT_PERM));
+	files = 0;
+	while ((r = archive_read_next_header(ad, &ae)) == ARCHIVE_OK) {
+		if (archive_entry_filetype(ae) != AE_IFREG) {
+			assertEqualInt(-1, archive_entry_source_fd(ae));
+			if (archive_read_disk_can_descend(ad))
+				archive_read_disk_descend(ad);
+			archive_entry_set_pathname(ae, "out");
+			assertEqualIntA(a, ARCHIVE_OK,
+			    archive_write_header(a, ae));
+			continue;
+		}
+		assert(archive_entry_source_fd(ae) >= 0);
+		if (strcmp(archive_entry_pathname(ae), "in/src") == 0)
+			archive_entry_set_pathname(ae, "out/src");
+		else
+			archive_entry_set_pathname(ae, "out/small");
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		/* Nothing needs to be written; the data is there. */
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_finish_entry(a));
+		files++;
+	}
+	assertEqualIntA(ad, ARCHIVE_EOF, r);
+	assertEqualInt(2, files);
+	assertEqualIntA(ad, ARCHIVE_OK, archive_read_free(ad));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_free(a));
+	assertEqualFile("out/src", "in/src");
+	assertTextFileContents("small", "out/small");
+	free(buff);
+	free(junk);
+#endif
+}
@@ -0,0 +1,108 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+#define	SRC_SIZE	(3 * 1024 * 1024 + 123)
+
+/*
+ * Copy `src' into `name' with archive_write_disk_data_from_fd(),
+ * after writing `prefix' bytes with archive_write_data().  A
+ * negative `size' leaves the size of the entry unset.
+ */
+static void
+copy_from_fd(struct archive *a, const char *name, const char *buff,
+    int64_t size, size_t prefix, int64_t expect)
+{
+	struct archive_entry *ae;
+	int fd;
+
+	fd = open("src", O_RDONLY | O_BINARY);
+	assert(fd >= 0);
+	if (fd < 0)
+		return;
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, name);
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	if (size >= 0)
+		archive_entry_set_size(ae, size);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	if (prefix > 0) {
+		assertEqualInt(prefix, archive_write_data(a, buff, prefix));
+		assertEqualInt(prefix, lseek(fd, prefix, SEEK_SET));
+	}
+	failure("%s", name);
+	assertEqualInt(expect, archive_write_disk_data_from_fd(a, fd));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_finish_entry(a));
+	close(fd);
+}
+
+DEFINE_TEST(test_write_disk_data_from_fd)
+{
+	struct archive *a;
+	char *buff, *p;
+	size_t i, s;
+
+	buff = malloc(SRC_SIZE);
+	assert(buff != NULL);
+	if (buff == NULL)
+		return;
+	for (i = 0; i < SRC_SIZE; i++)
+		buff[i] = (char)(i * 13 + i / 4096);
+	assertMakeBinFile("src", 0644, SRC_SIZE, buff);
+
+	assert((a = archive_write_disk_new()) != NULL);
+
+	/* The whole file. */
+	copy_from_fd(a, "whole", buff, SRC_SIZE, 0, SRC_SIZE);
+	assertEqualFile("whole", "src");
+
+	/* The rest of a file whose start was written by hand. */
+	copy_from_fd(a, "rest", buff, SRC_SIZE, 1000, SRC_SIZE - 1000);
+	assertEqualFile("rest", "src");
+
+	/* No more than the size of the entry is copied. */
+	copy_from_fd(a, "short", buff, 70000, 0, 70000);
+	p = slurpfile(&s, "short");
+	assertEqualInt(70000, s);
+	assertEqualMem(p, buff, 70000);
+	free(p);
+
+	/* Without a size, the file is copied to its end. */
+	copy_from_fd(a, "nosize", buff, -1, 0, SRC_SIZE);
+	assertEqualFile("nosize", "src");
+
+	/* Sparse files are copied by hand so holes can be made. */
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_disk_set_options(a, ARCHIVE_EXTRACT_SPARSE));
+	copy_from_fd(a, "sparse", buff, SRC_SIZE, 0, SRC_SIZE);
+	assertEqualFile("sparse", "src");
+
+	/* Only valid while writing the data of an entry. */
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_FATAL, archive_write_disk_data_from_fd(a, 0));
+	archive_write_free(a);
+	free(buff);
+}
@@ -0,0 +1,122 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+#define UMASK 022
+
+/*
+ * archive_write_disk keeps the parent directory of the last entry
+ * open and creates the next entry relative to it.  Check that every
+ * name still ends up where a fresh path lookup would have put it.
+ */
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+static void
+write_entry(struct archive *a, const char *path, int type, int perm,
+    const char *link)
+{
+	struct archive_entry *ae;
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, path);
+	archive_entry_set_mode(ae, type | perm);
+	if (link != NULL)
+		archive_entry_set_symlink(ae, link);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_finish_entry(a));
+}
+#endif
+
+DEFINE_TEST(test_write_disk_parent_dir)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	skipping("archive_write_disk parent directories not tested on Windows");
+#else
+	struct archive *a;
+	char name[64];
+	int i;
+
+	if (!canSymlink()) {
+		skipping("Symlinks not supported");
+		return;
+	}
+	assertUmask(UMASK);
+	assertMakeDir("d1", 0755);
+	assertMakeDir("d2", 0755);
+
+	assert((a = archive_write_disk_new()) != NULL);
+	archive_write_disk_set_options(a, ARCHIVE_EXTRACT_PERM);
+
+	/* A run of entries in one directory, some without an fd. */
+	for (i = 0; i < 16; i++) {
+		snprintf(name, sizeof(name), "t/f%d", i);
+		write_entry(a, name, AE_IFREG, 0640, NULL);
+	}
+	write_entry(a, "t/s", AE_IFLNK, 0755, "f0");
+	write_entry(a, "t/d", AE_IFDIR, 0750, NULL);
+	write_entry(a, "t/fifo", AE_IFIFO, 0604, NULL);
+	for (i = 0; i < 16; i++) {
+		snprintf(name, sizeof(name), "t/f%d", i);
+		assertIsReg(name, 0640);
+	}
+	assertIsSymlink("t/s", "f0", 0);
+	assertIsDir("t/d", 0750);
+	assertFileMode("t/fifo", 0604);
+
+	/* The parent is a symlink that the archive then replaces. */
+	write_entry(a, "l", AE_IFLNK, 0755, "d1");
+	write_entry(a, "l/f1", AE_IFREG, 0644, NULL);
+	write_entry(a, "l", AE_IFLNK, 0755, "d2");
+	write_entry(a, "l/f2", AE_IFREG, 0644, NULL);
+	assertIsReg("d1/f1", 0644);
+	assertFileNotExists("d1/f2");
+	assertIsReg("d2/f2", 0644);
+
+	/* As above, but the symlink replaced is not the parent itself. */
+	write_entry(a, "n", AE_IFLNK, 0755, "d1");
+	write_entry(a, "m", AE_IFLNK, 0755, "n");
+	write_entry(a, "m/g1", AE_IFREG, 0644, NULL);
+	write_entry(a, "n", AE_IFLNK, 0755, "d2");
+	write_entry(a, "m/g2", AE_IFREG, 0644, NULL);
+	assertIsReg("d1/g1", 0644);
+	assertFileNotExists("d1/g2");
+	assertIsReg("d2/g2", 0644);
+
+	/* The same names mean something else after a chdir(). */
+	write_entry(a, "c/a/f1", AE_IFREG, 0644, NULL);
+	assertMakeDir("other", 0755);
+	assertMakeDir("other/c", 0755);
+	assertMakeDir("other/c/a", 0755);
+	assertChdir("other");
+	write_entry(a, "c/a/f2", AE_IFREG, 0644, NULL);
+	assertChdir("..");
+	assertIsReg("c/a/f1", 0644);
+	assertFileNotExists("c/a/f2");
+	assertIsReg("other/c/a/f2", 0644);
+
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+#endif
+}
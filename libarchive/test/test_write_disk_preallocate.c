@@ -0,0 +1,184 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+/*
+ * With ARCHIVE_EXTRACT_PREALLOCATE, archive_write_disk reserves the
+ * space for a file up front and collects the data into large writes.
+ * Whatever order and size the data comes in, the file on disk must
+ * hold exactly what was written, with zeros everywhere else.
+ */
+
+#define MB	(1024 * 1024)
+
+static char *
+pattern(size_t size)
+{
+	char *p;
+	size_t i;
+
+	p = malloc(size);
+	if (p != NULL)
+		for (i = 0; i < size; i++)
+			p[i] = (char)(i % 251 + 1);
+	return (p);
+}
+
+/* Write `count' pieces: data[i] of length len[i] at offset off[i]. */
+static void
+extract(struct archive *a, const char *name, int64_t size,
+    const char *data, const int64_t *off, const size_t *len, int count,
+    int sparse)
+{
+	struct archive_entry *ae;
+	int i;
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, name);
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_set_size(ae, size);
+	if (sparse)
+		for (i = 0; i < count; i++)
+			archive_entry_sparse_add_entry(ae, off[i], len[i]);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	for (i = 0; i < count; i++)
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_write_data_block(a, data + off[i], len[i], off[i]));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_finish_entry(a));
+}
+
+/* The file must match data where it was written and be zero elsewhere. */
+static void
+verify(const char *name, int64_t size, const char *data,
+    const int64_t *off, const size_t *len, int count)
+{
+	char *buff;
+	size_t s;
+	int64_t o, n;
+	int i;
+
+	buff = slurpfile(&s, "%s", name);
+	if (!assert(buff != NULL))
+		return;
+	assertEqualInt(size, s);
+	for (o = 0, i = 0; o < size && i <= count; i++) {
+		n = (i < count ? off[i] : size) - o;
+		while (n > 0 && buff[o] == 0) {
+			o++;
+			n--;
+		}
+		failure("%s: byte %d should be zero", name, (int)o);
+		assertEqualInt(0, n);
+		if (i == count)
+			break;
+		failure("%s: piece %d", name, i);
+		assertEqualMem(buff + o, data + o, len[i]);
+		o += len[i];
+	}
+	free(buff);
+}
+
+DEFINE_TEST(test_write_disk_preallocate)
+{
+	struct archive *a;
+	char *data;
+	int64_t off[64];
+	size_t len[64];
+#if !defined(_WIN32) || defined(__CYGWIN__)
+	struct stat st;
+	int fd;
+#endif
+	int i;
+
+	if (!assert((data = pattern(8 * MB)) != NULL))
+		return;
+	assert((a = archive_write_disk_new()) != NULL);
+	archive_write_disk_set_options(a, ARCHIVE_EXTRACT_PREALLOCATE);
+
+	/* Small pieces, none of them lined up with the write size. */
+	for (i = 0; i < 40; i++) {
+		off[i] = i * 80000;
+		len[i] = 80000;
+	}
+	extract(a, "small", 40 * 80000, data, off, len, 40, 0);
+	verify("small", 40 * 80000, data, off, len, 40);
+
+	/* One large piece that starts aligned, then a short one. */
+	off[0] = 0;
+	len[0] = 5 * MB / 2;
+	off[1] = len[0];
+	len[1] = 1000;
+	extract(a, "large", off[1] + len[1], data, off, len, 2, 0);
+	verify("large", off[1] + len[1], data, off, len, 2);
+
+	/* A sparse entry whose data starts and ends at odd offsets. */
+	off[0] = 100;
+	len[0] = 500000;
+	off[1] = 2 * MB + 5;
+	len[1] = 3 * MB / 2;
+	off[2] = 5 * MB;
+	len[2] = 70000;
+	extract(a, "sparse", 7 * MB, data, off, len, 3, 1);
+	verify("sparse", 7 * MB, data, off, len, 3);
+
+	/* An entry with less data than its size. */
+	off[0] = 0;
+	len[0] = 10;
+	extract(a, "short", 3 * MB, data, off, len, 1, 0);
+	verify("short", 3 * MB, data, off, len, 1);
+
+	/* Without the option, nothing changes. */
+	archive_write_disk_set_options(a, 0);
+	for (i = 0; i < 40; i++) {
+		off[i] = i * 80000;
+		len[i] = 80000;
+	}
+	extract(a, "plain", 40 * 80000, data, off, len, 40, 0);
+	verify("plain", 40 * 80000, data, off, len, 40);
+
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	free(data);
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+	/*
+	 * If this filesystem leaves holes in a file extended by
+	 * ftruncate(), space reserved for data that never arrived should
+	 * not stay allocated either.
+	 */
+	fd = open("probe", O_WRONLY | O_CREAT | O_BINARY, 0644);
+	if (!assert(fd >= 0))
+		return;
+	assertEqualInt(0, ftruncate(fd, 3 * MB));
+	close(fd);
+	assertEqualInt(0, stat("probe", &st));
+	if (st.st_blocks >= MB / 512) {
+		skipping("Filesystem does not support holes");
+		return;
+	}
+	assertEqualInt(0, stat("short", &st));
+	assert(st.st_blocks < MB / 512);
+#endif
+}
@@ -0,0 +1,179 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+/*
+ * archive_write_disk remembers which directories it has already
+ * checked for ARCHIVE_EXTRACT_SECURE_SYMLINKS.  Make sure that memory
+ * never lets an entry through a symlink.
+ */
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+static int
+write_entry(struct archive *a, const char *path, int type, const char *link)
+{
+	struct archive_entry *ae;
+	int r;
+
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, path);
+	archive_entry_set_mode(ae, type | 0755);
+	if (link != NULL)
+		archive_entry_set_symlink(ae, link);
+	r = archive_write_header(a, ae);
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_finish_entry(a));
+	return (r);
+}
+#endif
+
+DEFINE_TEST(test_write_disk_secure_dircache)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	skipping("archive_write_disk security checks not supported on Windows");
+#else
+	struct archive *a;
+	char name[64];
+	int i, j;
+
+	if (!canSymlink()) {
+		skipping("Symlinks not supported");
+		return;
+	}
+
+	assert((a = archive_write_disk_new()) != NULL);
+	archive_write_disk_set_options(a, ARCHIVE_EXTRACT_SECURE_SYMLINKS);
+
+	/* Plenty of entries sharing prefixes, some of them implied. */
+	for (i = 0; i < 8; i++) {
+		for (j = 0; j < 8; j++) {
+			snprintf(name, sizeof(name), "t/d%d/e%d/f", i, j);
+			assertEqualIntA(a, ARCHIVE_OK,
+			    write_entry(a, name, AE_IFREG, NULL));
+		}
+	}
+	for (i = 0; i < 8; i++)
+		for (j = 0; j < 8; j++) {
+			snprintf(name, sizeof(name), "t/d%d/e%d/f", i, j);
+			assertIsReg(name, -1);
+		}
+
+	/*
+	 * The archive replaces a directory the cache knows about with
+	 * a symlink; anything below it must be refused from then on.
+	 */
+	assertMakeDir("outside", 0755);
+	assertEqualIntA(a, ARCHIVE_OK,
+	    write_entry(a, "t/x", AE_IFDIR, NULL));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    write_entry(a, "t/x/y", AE_IFDIR, NULL));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    write_entry(a, "t/x/y", AE_IFLNK, "../../outside"));
+	assertIsSymlink("t/x/y", "../../outside", 1);
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    write_entry(a, "t/x/y/f", AE_IFREG, NULL));
+	assertFileNotExists("outside/f");
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    write_entry(a, "t/x/y/z/f", AE_IFREG, NULL));
+	assertFileNotExists("outside/z");
+
+	/* Same again one level up, with a directory created implicitly. */
+	assertEqualIntA(a, ARCHIVE_OK,
+	    write_entry(a, "t/p/q/f", AE_IFREG, NULL));
+	assertEqualInt(0, unlink("t/p/q/f"));
+	assertEqualInt(0, rmdir("t/p/q"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    write_entry(a, "t/p", AE_IFLNK, "../outside"));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    write_entry(a, "t/p/q/f", AE_IFREG, NULL));
+	assertFileNotExists("outside/q");
+
+	/*
+	 * The cache belongs to the working directory it was filled
+	 * in; here "t/d0" is a symlink.
+	 */
+	assertEqualIntA(a, ARCHIVE_OK,
+	    write_entry(a, "t/d0/e0/f", AE_IFREG, NULL));
+	assertMakeDir("other", 0755);
+	assertMakeDir("other/t", 0755);
+	assertMakeSymlink("other/t/d0", "../../outside", 1);
+	assertMakeDir("outside/e0", 0755);
+	assertChdir("other");
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    write_entry(a, "t/d0/e0/f", AE_IFREG, NULL));
+	assertChdir("..");
+	assertFileNotExists("outside/e0/f");
+
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+#endif
+}
+
+/*
+ * Entries whose names are longer than PATH_MAX, below directories the
+ * cache already knows about, are still extracted.
+ */
+DEFINE_TEST(test_write_disk_secure_dircache_deep)
+{
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	skipping("archive_write_disk security checks not supported on Windows");
+#else
+	static const char component[] =
+	    "/abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghij";
+	struct archive *a;
+	char *name;
+	size_t len;
+	int i, levels = 90;
+
+	name = malloc(sizeof("deep") + levels * (sizeof(component) - 1) + 2);
+	if (!assert(name != NULL))
+		return;
+	assert((a = archive_write_disk_new()) != NULL);
+	archive_write_disk_set_options(a, ARCHIVE_EXTRACT_SECURE_SYMLINKS);
+
+	strcpy(name, "deep");
+	for (i = 0; i < levels; i++) {
+		strcat(name, component);
+		assertEqualIntA(a, ARCHIVE_OK,
+		    write_entry(a, name, AE_IFDIR, NULL));
+		len = strlen(name);
+		strcat(name, "/f");
+		failure("%d levels deep", i + 1);
+		assertEqualIntA(a, ARCHIVE_OK,
+		    write_entry(a, name, AE_IFREG, NULL));
+		name[len] = '\0';
+	}
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	free(name);
+
+	/* Every level holds its file. */
+	assertChdir("deep");
+	for (i = 0; i < levels; i++) {
+		assertChdir(component + 1);
+		assertIsReg("f", -1);
+	}
+	for (i = 0; i <= levels; i++)
+		assertChdir("..");
+#endif
+}
@@ -409,3 +409,82 @@ XXXDEFINE_TEST(test_write_filter_lz4_block_dependence_hc)
 	test_options("lz4:block-dependence,lz4:compression-level=9");
 }
 */
+
+/*
+ * Compress independent blocks on several threads and verify that
+ * the frame reads back correctly, both on one thread and on several.
+ */
+DEFINE_TEST(test_write_filter_lz4_threads)
+{
+	struct archive_entry *ae;
+	struct archive* a;
+	char *buff, *data, *rbuff;
+	size_t buffsize, datasize;
+	size_t used;
+	const char *read_options[] = { NULL, "lz4:threads=3" };
+	unsigned i;
+
+	if (archive_liblz4_version() == NULL) {
+		skipping("lz4 multi-threaded compression requires liblz4");
+		return;
+	}
+
+	buffsize = 2000000;
+	assert(NULL != (buff = (char *)malloc(buffsize)));
+	datasize = 1000000;
+	assert(NULL != (data = (char *)malloc(datasize)));
+	assert(NULL != (rbuff = (char *)malloc(datasize)));
+	for (i = 0; i < datasize; i++)
+		data[i] = (char)("abcdefgh"[(i * 7 + i / 5000) % 8] ^ (i >> 11));
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_ustar(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_add_filter_lz4(a));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_write_set_options(a, "lz4:threads=abc"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_options(a,
+		"lz4:threads=4,lz4:block-size=4,lz4:block-checksum"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_set_filetype(ae, AE_IFREG);
+	archive_entry_set_size(ae, datasize);
+	archive_entry_copy_pathname(ae, "file");
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	/* Odd-sized writes so batches straddle the write calls. */
+	assertEqualIntA(a, 123457,
+	    (int)archive_write_data(a, data, 123457));
+	assertEqualIntA(a, (int)(datasize - 123457),
+	    (int)archive_write_data(a, data + 123457, datasize - 123457));
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+
+	for (i = 0; i < sizeof(read_options)/sizeof(read_options[0]); i++) {
+		assert((a = archive_read_new()) != NULL);
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_support_format_all(a));
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_support_filter_lz4(a));
+		if (read_options[i] != NULL)
+			assertEqualIntA(a, ARCHIVE_OK,
+			    archive_read_set_options(a, read_options[i]));
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_open_memory(a, buff, used));
+		assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae));
+		assertEqualString("file", archive_entry_pathname(ae));
+		assertEqualInt((int)datasize,
+		    archive_read_data(a, rbuff, datasize));
+		assertEqualMem(data, rbuff, datasize);
+		assertEqualIntA(a, ARCHIVE_EOF,
+		    archive_read_next_header(a, &ae));
+		assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+		assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+	}
+
+	free(rbuff);
+	free(data);
+	free(buff);
+}
@@ -263,3 +263,99 @@ DEFINE_TEST(test_write_filter_xz)
 	free(data);
 	free(buff);
 }
+
+/*
+ * Skipping over entries in multi-block xz data should land on the
+ * right bytes whether the reader decodes everything or jumps
+ * straight to the block holding the next header.
+ */
+DEFINE_TEST(test_write_filter_xz_seek)
+{
+	struct archive_entry *ae;
+	struct archive *a;
+	char *buff, *data, *rbuff;
+	size_t buffsize, datasize, used;
+	char path[16];
+	int i, j, r;
+
+	buffsize = 8000000;
+	datasize = 700000;
+	buff = malloc(buffsize);
+	data = malloc(datasize);
+	rbuff = malloc(datasize);
+	if (!assert(buff != NULL && data != NULL && rbuff != NULL)) {
+		free(buff);
+		free(data);
+		free(rbuff);
+		return;
+	}
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_ustar(a));
+	r = archive_write_add_filter_xz(a);
+	if (r == ARCHIVE_FATAL) {
+		skipping("xz writing not supported on this platform");
+		assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+		free(buff);
+		free(data);
+		free(rbuff);
+		return;
+	}
+	/* Threaded compression splits the data into blocks. */
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_filter_option(a, NULL, "compression-level", "0"));
+	r = archive_write_set_filter_option(a, NULL, "threads", "4");
+	assert(r == ARCHIVE_OK || r == ARCHIVE_WARN);
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_set_filetype(ae, AE_IFREG);
+	archive_entry_set_size(ae, datasize);
+	for (i = 0; i < 8; i++) {
+		for (j = 0; j < (int)datasize; j++)
+			data[j] = (char)((j * (i + 3)) >> 5);
+		sprintf(path, "file%d", i);
+		archive_entry_copy_pathname(ae, path);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		assertA(datasize
+		    == (size_t)archive_write_data(a, data, datasize));
+	}
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	r = archive_read_support_filter_xz(a);
+	if (r == ARCHIVE_WARN) {
+		skipping("xz reading not fully supported on this platform");
+		assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+		free(buff);
+		free(data);
+		free(rbuff);
+		return;
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	for (i = 0; i < 8; i++) {
+		sprintf(path, "file%d", i);
+		if (!assertEqualIntA(a, ARCHIVE_OK,
+		    archive_read_next_header(a, &ae)))
+			break;
+		assertEqualString(path, archive_entry_pathname(ae));
+		/* Only read back every third entry; skip the rest. */
+		if (i % 3 != 2)
+			continue;
+		for (j = 0; j < (int)datasize; j++)
+			data[j] = (char)((j * (i + 3)) >> 5);
+		assertEqualIntA(a, (la_ssize_t)datasize,
+		    archive_read_data(a, rbuff, datasize));
+		assertEqualMem(rbuff, data, datasize);
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	free(buff);
+	free(data);
+	free(rbuff);
+}
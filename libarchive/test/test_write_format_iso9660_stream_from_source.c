@@ -0,0 +1,298 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+/*
+ * With the stream-from-source option, the contents of files that
+ * have a source path are read from it when the image is written;
+ * the image must read back the same as one made the usual way.
+ */
+
+#define SIZE1	100000
+#define SIZE2	5000
+#define SIZEB	(10 * 1024)
+
+static char data1[SIZE1], data2[SIZE2], datab[SIZEB];
+
+/*
+ * Write the test entries.  file2 has no source path, so its data
+ * always goes through archive_write_data().
+ */
+static size_t
+make_image(unsigned char *buff, size_t buffsize, int stream, int write_data)
+{
+	static const struct {
+		const char *path;
+		const char *source;
+		const char *data;
+		int size;
+	} files[] = {
+		{ "boot.img", "boot.img", datab, SIZEB },
+		{ "dir", NULL, NULL, -1 },
+		{ "dir/file1", "file1", data1, SIZE1 },
+		{ "file2", NULL, data2, SIZE2 },
+		{ "empty", "empty", NULL, 0 },
+		{ NULL, NULL, NULL, 0 }
+	};
+	struct archive *a;
+	struct archive_entry *ae;
+	size_t used = 0;
+	int i;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, 0, archive_write_set_format_iso9660(a));
+	assertEqualIntA(a, 0, archive_write_add_filter_none(a));
+	assertEqualIntA(a, 0,
+	    archive_write_set_option(a, NULL, "boot", "boot.img"));
+	if (stream)
+		assertEqualIntA(a, 0, archive_write_set_option(a, NULL,
+		    "stream-from-source", "1"));
+	assertEqualIntA(a, 0,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+
+	for (i = 0; files[i].path != NULL; i++) {
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_set_mtime(ae, 2, 20);
+		archive_entry_copy_pathname(ae, files[i].path);
+		if (files[i].source != NULL)
+			archive_entry_copy_sourcepath(ae, files[i].source);
+		if (files[i].size < 0) {
+			archive_entry_set_mode(ae, S_IFDIR | 0755);
+		} else {
+			archive_entry_set_mode(ae, S_IFREG | 0644);
+			archive_entry_set_size(ae, files[i].size);
+		}
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		archive_entry_free(ae);
+		if (files[i].size > 0 &&
+		    (write_data || files[i].source == NULL))
+			assertEqualIntA(a, files[i].size, archive_write_data(a,
+			    files[i].data, files[i].size));
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	return (used);
+}
+
+static void
+verify_image(const unsigned char *buff, size_t used)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	char rbuff[SIZE1];
+	const char *name, *data;
+	int64_t size;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, 0, archive_read_support_format_all(a));
+	assertEqualIntA(a, 0, archive_read_support_filter_all(a));
+	assertEqualIntA(a, 0, archive_read_open_memory(a, buff, used));
+	while (archive_read_next_header(a, &ae) == ARCHIVE_OK) {
+		if (archive_entry_filetype(ae) != AE_IFREG)
+			continue;
+		name = archive_entry_pathname(ae);
+		size = archive_entry_size(ae);
+		if (strcmp(name, "boot.catalog") == 0)
+			continue;
+		else if (strcmp(name, "boot.img") == 0)
+			data = datab;
+		else if (strcmp(name, "dir/file1") == 0)
+			data = data1;
+		else if (strcmp(name, "file2") == 0)
+			data = data2;
+		else {
+			assertEqualString("empty", name);
+			assertEqualInt(0, size);
+			continue;
+		}
+		failure("%s", name);
+		assertEqualIntA(a, size, archive_read_data(a, rbuff,
+		    sizeof(rbuff)));
+		failure("%s", name);
+		assertEqualMem(rbuff, data, (size_t)size);
+	}
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+}
+
+/*
+ * Check the contents of one file in an image.
+ */
+static void
+verify_file(const unsigned char *buff, size_t used, const char *name,
+    const char *data, int size)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	char rbuff[SIZE1];
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, 0, archive_read_support_format_all(a));
+	assertEqualIntA(a, 0, archive_read_open_memory(a, buff, used));
+	while (archive_read_next_header(a, &ae) == ARCHIVE_OK) {
+		if (strcmp(archive_entry_pathname(ae), name) != 0)
+			continue;
+		failure("%s", name);
+		assertEqualIntA(a, size, archive_read_data(a, rbuff,
+		    sizeof(rbuff)));
+		failure("%s", name);
+		assertEqualMem(rbuff, data, size);
+		assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+		return;
+	}
+	failure("%s", name);
+	assert(0);
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+}
+
+DEFINE_TEST(test_write_format_iso9660_stream_from_source)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	unsigned char *buff0, *buff1, *buff2;
+	size_t buffsize = 1024 * 1024, used0, used1, used2;
+	size_t used = 0;
+	int i;
+
+	for (i = 0; i < SIZE1; i++)
+		data1[i] = "0123456789abcdefghijklmnopqrstuvwxyz"[
+		    (i * 7 + i / 1000) % 36];
+	for (i = 0; i < SIZE2; i++)
+		data2[i] = (char)(i % 251);
+	memset(datab, 0, sizeof(datab));
+	memcpy(datab + 100, "boot image", 10);
+	assertMakeBinFile("file1", 0644, SIZE1, data1);
+	assertMakeBinFile("boot.img", 0644, SIZEB, datab);
+	assertMakeFile("empty", 0644, "");
+	assertMakeBinFile("short", 0644, SIZE1 / 2, data1);
+
+	buff0 = malloc(buffsize);
+	buff1 = malloc(buffsize);
+	buff2 = malloc(buffsize);
+	if (!assert(buff0 != NULL && buff1 != NULL && buff2 != NULL)) {
+		free(buff0);
+		free(buff1);
+		free(buff2);
+		return;
+	}
+
+	/* The usual way, through the temporary file. */
+	used0 = make_image(buff0, buffsize, 0, 1);
+	/* The data given to archive_write_data() is not used. */
+	used1 = make_image(buff1, buffsize, 1, 1);
+	/* Nor needed. */
+	used2 = make_image(buff2, buffsize, 1, 0);
+	assertEqualInt(used0, used1);
+	assertEqualInt(used0, used2);
+	verify_image(buff0, used0);
+	verify_image(buff1, used1);
+	verify_image(buff2, used2);
+
+	/*
+	 * A source that does not match its entry goes through the
+	 * temporary file; one that changes before the archive is
+	 * closed is an error.
+	 */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, 0, archive_write_set_format_iso9660(a));
+	assertEqualIntA(a, 0, archive_write_add_filter_none(a));
+	assertEqualIntA(a, 0, archive_write_set_option(a, NULL,
+	    "stream-from-source", "1"));
+	assertEqualIntA(a, 0,
+	    archive_write_open_memory(a, buff0, buffsize, &used));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "short");
+	archive_entry_copy_sourcepath(ae, "short");
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	archive_entry_set_size(ae, SIZE1);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertEqualIntA(a, SIZE1, archive_write_data(a, data1, SIZE1));
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	verify_file(buff0, used, "short", data1, SIZE1);
+
+	assertMakeBinFile("grows", 0644, SIZE2, data2);
+	assertMakeBinFile("touched", 0644, SIZE2, data2);
+	for (i = 0; i < 2; i++) {
+		const char *name = i == 0 ? "grows" : "touched";
+
+		assert((a = archive_write_new()) != NULL);
+		assertEqualIntA(a, 0, archive_write_set_format_iso9660(a));
+		assertEqualIntA(a, 0, archive_write_add_filter_none(a));
+		assertEqualIntA(a, 0, archive_write_set_option(a, NULL,
+		    "stream-from-source", "1"));
+		assertEqualIntA(a, 0,
+		    archive_write_open_memory(a, buff0, buffsize, &used));
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_copy_pathname(ae, name);
+		archive_entry_copy_sourcepath(ae, name);
+		archive_entry_set_mode(ae, S_IFREG | 0644);
+		archive_entry_set_size(ae, SIZE2);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		archive_entry_free(ae);
+		if (i == 0)
+			assertMakeBinFile("grows", 0644, SIZE1, data1);
+		else
+			assertUtimes("touched", 86400, 0, 86400, 0);
+		failure("%s", name);
+		assertEqualIntA(a, ARCHIVE_FATAL, archive_write_close(a));
+		assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	}
+
+	/* Relative source paths are resolved when the header is written. */
+	assertMakeDir("a", 0755);
+	assertMakeDir("b", 0755);
+	assertMakeBinFile("a/x", 0644, SIZE1, data1);
+	assertMakeBinFile("b/y", 0644, SIZE2, data2);
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, 0, archive_write_set_format_iso9660(a));
+	assertEqualIntA(a, 0, archive_write_add_filter_none(a));
+	assertEqualIntA(a, 0, archive_write_set_option(a, NULL,
+	    "stream-from-source", "1"));
+	assertEqualIntA(a, 0,
+	    archive_write_open_memory(a, buff0, buffsize, &used));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_set_mode(ae, S_IFREG | 0644);
+	assertChdir("a");
+	archive_entry_copy_pathname(ae, "x");
+	archive_entry_copy_sourcepath(ae, "x");
+	archive_entry_set_size(ae, SIZE1);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertChdir("../b");
+	archive_entry_copy_pathname(ae, "y");
+	archive_entry_copy_sourcepath(ae, "y");
+	archive_entry_set_size(ae, SIZE2);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	assertChdir("..");
+	verify_file(buff0, used, "x", data1, SIZE1);
+	verify_file(buff0, used, "y", data2, SIZE2);
+
+	free(buff0);
+	free(buff1);
+	free(buff2);
+}
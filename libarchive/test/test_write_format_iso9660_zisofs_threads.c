@@ -0,0 +1,179 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+/*
+ * With zisofs-threads, the blocks of each file are compressed on
+ * several threads.  The image must come out the same size and read
+ * back the same as one made on a single thread.
+ */
+
+#define FILE_SIZE	(40 * 32768 + 1234)
+
+static unsigned char *
+make_data(void)
+{
+	unsigned char *p;
+	uint32_t seed = 1;
+	size_t i;
+
+	p = malloc(FILE_SIZE);
+	if (p == NULL)
+		return (NULL);
+	for (i = 0; i < FILE_SIZE; i++) {
+		switch ((i / 32768) % 4) {
+		case 0:		/* Text-like, compresses well. */
+			p[i] = "zisofs block "[i % 13];
+			break;
+		case 1:		/* Zeros, stored as an empty block. */
+			p[i] = 0;
+			break;
+		default:	/* Noise, hardly compresses. */
+			seed = seed * 1103515245 + 12345;
+			p[i] = (unsigned char)(seed >> 16);
+			break;
+		}
+	}
+	return (p);
+}
+
+static size_t
+make_image(unsigned char *buff, size_t buffsize, const unsigned char *data,
+    const char *threads)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	size_t used = 0, off, n;
+	int i;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, 0, archive_write_set_format_iso9660(a));
+	assertEqualIntA(a, 0, archive_write_add_filter_none(a));
+	assertEqualIntA(a, 0, archive_write_set_option(a, NULL, "zisofs", "1"));
+	if (threads != NULL)
+		assertEqualIntA(a, 0, archive_write_set_option(a, NULL,
+		    "zisofs-threads", threads));
+	assertEqualIntA(a, 0,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+
+	for (i = 0; i < 3; i++) {
+		assert((ae = archive_entry_new()) != NULL);
+		archive_entry_set_mtime(ae, 5, 50);
+		archive_entry_copy_pathname(ae,
+		    i == 0 ? "file1" : i == 1 ? "file2" : "file3");
+		archive_entry_set_mode(ae, S_IFREG | 0644);
+		/* The second file is a single short block. */
+		archive_entry_set_size(ae, i == 1 ? 5000 : FILE_SIZE);
+		assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+		archive_entry_free(ae);
+		/* Odd-sized writes that straddle block boundaries. */
+		for (off = 0; off < (size_t)(i == 1 ? 5000 : FILE_SIZE);
+		    off += n) {
+			n = (i == 1 ? 5000 : FILE_SIZE) - off;
+			if (n > 10007)
+				n = 10007;
+			assertEqualIntA(a, (int)n,
+			    archive_write_data(a, data + off, n));
+		}
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+	return (used);
+}
+
+static void
+verify_image(const unsigned char *buff, size_t used,
+    const unsigned char *data)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	unsigned char *rbuff;
+	int64_t size;
+	int i;
+
+	rbuff = malloc(FILE_SIZE);
+	if (!assert(rbuff != NULL))
+		return;
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, 0, archive_read_support_format_all(a));
+	assertEqualIntA(a, 0, archive_read_support_filter_all(a));
+	assertEqualIntA(a, 0, archive_read_open_memory(a, buff, used));
+	for (i = 0; i < 4; i++) {
+		assertEqualIntA(a, 0, archive_read_next_header(a, &ae));
+		if (archive_entry_filetype(ae) != AE_IFREG)
+			continue;
+		size = archive_entry_size(ae);
+		failure("%s", archive_entry_pathname(ae));
+		assertEqualInt(strcmp(archive_entry_pathname(ae), "file2")
+		    == 0 ? 5000 : FILE_SIZE, size);
+		assertEqualIntA(a, size,
+		    archive_read_data(a, rbuff, (size_t)size));
+		failure("%s", archive_entry_pathname(ae));
+		assertEqualMem(rbuff, data, (size_t)size);
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+	free(rbuff);
+}
+
+DEFINE_TEST(test_write_format_iso9660_zisofs_threads)
+{
+	struct archive *a;
+	unsigned char *data, *buff1, *buff4;
+	size_t buffsize = 8 * 1024 * 1024, used1, used4;
+
+	/* Check for zisofs support. */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, 0, archive_write_set_format_iso9660(a));
+	if (archive_write_set_option(a, NULL, "zisofs", "1") ==
+	    ARCHIVE_FATAL) {
+		skipping("zisofs option not supported on this platform");
+		assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+		return;
+	}
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+
+	data = make_data();
+	buff1 = malloc(buffsize);
+	buff4 = malloc(buffsize);
+	if (!assert(data != NULL && buff1 != NULL && buff4 != NULL)) {
+		free(data);
+		free(buff1);
+		free(buff4);
+		return;
+	}
+
+	used1 = make_image(buff1, buffsize, data, NULL);
+	used4 = make_image(buff4, buffsize, data, "4");
+	/* The files were compressed: the image is smaller than them. */
+	assert(used1 < 2 * FILE_SIZE);
+	assertEqualInt(used1, used4);
+	verify_image(buff1, used1, data);
+	verify_image(buff4, used4, data);
+
+	free(data);
+	free(buff1);
+	free(buff4);
+}
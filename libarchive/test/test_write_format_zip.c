@@ -907,3 +907,94 @@ DEFINE_TEST(test_write_format_zip_winzip_aes256_encryption)
 
 	free(buff);
 }
+
+/*
+ * The AES key stream is made several kilobytes at a time; write and
+ * read a stored entry in pieces that fall on and off those batches.
+ */
+DEFINE_TEST(test_write_format_zip_winzip_aes256_pieces)
+{
+	static const size_t pieces[] = { 1, 15, 16, 17, 4095, 4096, 4097,
+	    10000 };
+	struct archive *a;
+	struct archive_entry *ae;
+	size_t used, off, n, buffsize = 100000, datasize = 40000;
+	char *buff, *data, *rbuff;
+	ssize_t r;
+	int i;
+
+	buff = malloc(buffsize);
+	data = malloc(datasize);
+	rbuff = malloc(datasize);
+	if (!assert(buff != NULL && data != NULL && rbuff != NULL)) {
+		free(buff);
+		free(data);
+		free(rbuff);
+		return;
+	}
+	for (off = 0; off < datasize; off++)
+		data[off] = (char)(off * 13 + off / 251);
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_add_filter_none(a));
+	if (ARCHIVE_OK != archive_write_set_options(a, "zip:encryption=aes256"))
+	{
+		skipping("This system does not have cryptographic liberary");
+		archive_write_free(a);
+		free(buff);
+		free(data);
+		free(rbuff);
+		return;
+	}
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_options(a, "zip:compression=store"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_set_passphrase(a, "password1234"));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_copy_pathname(ae, "file");
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_set_size(ae, datasize);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_free(ae);
+	for (off = 0, i = 0; off < datasize; off += n, i++) {
+		n = pieces[i % (sizeof(pieces) / sizeof(pieces[0]))];
+		if (n > datasize - off)
+			n = datasize - off;
+		assertEqualIntA(a, (int)n, archive_write_data(a, data + off, n));
+	}
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_close(a));
+	assertEqualInt(ARCHIVE_OK, archive_write_free(a));
+
+	/* Stored and encrypted: the data does not appear as it is. */
+	assert(used > datasize);
+	for (off = 0; off + 64 <= used; off++)
+		if (memcmp(buff + off, data + 1000, 64) == 0)
+			break;
+	assert(off + 64 > used);
+
+	/* Read it back through 7-byte blocks, in other pieces. */
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_support_format_all(a));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_add_passphrase(a, "password1234"));
+	assertEqualIntA(a, ARCHIVE_OK, read_open_memory(a, buff, used, 7));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+	assertEqualString("file", archive_entry_pathname(ae));
+	for (off = 0, i = 3; off < datasize; off += r, i++) {
+		n = pieces[i % (sizeof(pieces) / sizeof(pieces[0]))];
+		r = archive_read_data(a, rbuff + off, n);
+		if (!assert(r > 0))
+			break;
+	}
+	assertEqualInt(datasize, off);
+	assertEqualMem(rbuff, data, datasize);
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualInt(ARCHIVE_OK, archive_read_free(a));
+
+	free(buff);
+	free(data);
+	free(rbuff);
+}
@@ -0,0 +1,195 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+#define	ZIP_ENTRY_FLAG_LENGTH_AT_END	(1 << 3)
+
+/* Read 2-, 4- and 8-byte integers from a Zip file. */
+static unsigned i2(const char *p) { return ((p[0] & 0xff) | ((p[1] & 0xff) << 8)); }
+static unsigned i4(const char *p) { return (i2(p) | (i2(p + 2) << 16)); }
+static uint64_t i8(const char *p) { return (i4(p) | ((uint64_t)i4(p + 4) << 32)); }
+
+static char data[3000];
+
+/*
+ * Write a small and a large file, an empty one and one of unknown
+ * size, with the given options; return the size of the archive.
+ */
+static size_t
+write_archive(char *buff, size_t buffsize, const char *options)
+{
+	struct archive *a;
+	struct archive_entry *ae;
+	size_t used;
+
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_add_filter_none(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_options(a, options));
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_write_open_memory(a, buff, buffsize, &used));
+	assert((ae = archive_entry_new()) != NULL);
+	archive_entry_set_mode(ae, AE_IFREG | 0644);
+	archive_entry_copy_pathname(ae, "small");
+	archive_entry_set_size(ae, 600);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertEqualInt(600, archive_write_data(a, data, 600));
+	archive_entry_copy_pathname(ae, "large");
+	archive_entry_set_size(ae, sizeof(data));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertEqualInt(sizeof(data), archive_write_data(a, data, sizeof(data)));
+	archive_entry_copy_pathname(ae, "empty");
+	archive_entry_set_size(ae, 0);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	archive_entry_copy_pathname(ae, "unknown");
+	archive_entry_unset_size(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_header(a, ae));
+	assertEqualInt(50, archive_write_data(a, data, 50));
+	archive_entry_free(ae);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_free(a));
+	return (used);
+}
+
+/*
+ * Check every local header against the central directory: the
+ * buffered entries carry their exact sizes and CRC, with no data
+ * descriptor.
+ */
+static void
+verify_headers(const char *buff, size_t used, int zip64)
+{
+	const char *cd, *eocd, *lh;
+	int buffered, i;
+
+	eocd = buff + used - 22;
+	assertEqualMem(eocd, "PK\005\006", 4);
+	assertEqualInt(4, i2(eocd + 10));
+	cd = buff + i4(eocd + 16);
+	for (i = 0; i < 4; i++) {
+		assertEqualMem(cd, "PK\001\002", 4);
+		lh = buff + i4(cd + 42);
+		assertEqualMem(lh, "PK\003\004", 4);
+		/* Only "large" and "unknown" are over the threshold. */
+		buffered = (i != 1 && i != 3);
+		failure("entry %d", i);
+		assertEqualInt(buffered ? 0 : ZIP_ENTRY_FLAG_LENGTH_AT_END,
+		    i2(lh + 6) & ZIP_ENTRY_FLAG_LENGTH_AT_END);
+		assertEqualInt(i2(cd + 8), i2(lh + 6));
+		if (buffered) {
+			assertEqualInt(i4(cd + 16), i4(lh + 14));
+			if (zip64) {
+				const char *extra = lh + 30 + i2(lh + 26);
+
+				assertEqualInt(0xffffffff, i4(lh + 18));
+				assertEqualInt(0xffffffff, i4(lh + 22));
+				while (i2(extra) != 1)
+					extra += 4 + i2(extra + 2);
+				assertEqualInt(i4(cd + 24), i8(extra + 4));
+				assertEqualInt(i4(cd + 20), i8(extra + 12));
+			} else {
+				assertEqualInt(i4(cd + 20), i4(lh + 18));
+				assertEqualInt(i4(cd + 24), i4(lh + 22));
+			}
+			/* The next entry follows the data directly. */
+			if (i < 3)
+				assertEqualInt(i4(cd + 42 + 46 + i2(cd + 28) +
+				    i2(cd + 30) + i2(cd + 32)),
+				    (lh - buff) + 30 + i2(lh + 26) +
+				    i2(lh + 28) + i4(cd + 20));
+		}
+		cd += 46 + i2(cd + 28) + i2(cd + 30) + i2(cd + 32);
+	}
+}
+
+/*
+ * A streaming reader knows the size of each buffered entry from its
+ * local header, and checks its CRC.
+ */
+static void
+verify_read(const char *buff, size_t used)
+{
+	static const char *names[] = { "small", "large", "empty", "unknown" };
+	static const int sizes[] = { 600, sizeof(data), 0, 50 };
+	struct archive *a;
+	struct archive_entry *ae;
+	char out[sizeof(data)];
+	int i;
+
+	assert((a = archive_read_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK,
+	    archive_read_support_format_zip_streamable(a));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_open_memory(a, buff, used));
+	for (i = 0; i < 4; i++) {
+		assertEqualIntA(a, ARCHIVE_OK, archive_read_next_header(a, &ae));
+		assertEqualString(names[i], archive_entry_pathname(ae));
+		if (i == 0 || i == 2) {
+			assert(archive_entry_size_is_set(ae));
+			assertEqualInt(sizes[i], archive_entry_size(ae));
+		}
+		assertEqualInt(sizes[i], archive_read_data(a, out, sizeof(out)));
+		assertEqualMem(out, data, sizes[i]);
+	}
+	assertEqualIntA(a, ARCHIVE_EOF, archive_read_next_header(a, &ae));
+	assertEqualIntA(a, ARCHIVE_OK, archive_read_free(a));
+}
+
+DEFINE_TEST(test_write_format_zip_buffered)
+{
+	struct archive *a;
+	size_t buffsize = 100000, used;
+	char *buff;
+	size_t i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = "0123456789abcdef"[(i * 7 + i / 100) % 16];
+	buff = malloc(buffsize);
+	assert(buff != NULL);
+	if (buff == NULL)
+		return;
+
+	used = write_archive(buff, buffsize, "zip:buffer-threshold=1000");
+	verify_headers(buff, used, 0);
+	verify_read(buff, used);
+
+	used = write_archive(buff, buffsize,
+	    "zip:buffer-threshold=1000,zip:compression=store");
+	verify_headers(buff, used, 0);
+	verify_read(buff, used);
+
+	used = write_archive(buff, buffsize,
+	    "zip:buffer-threshold=1000,zip:zip64");
+	verify_headers(buff, used, 1);
+	verify_read(buff, used);
+
+	/* The threshold is a number of bytes below 4 GiB. */
+	assert((a = archive_write_new()) != NULL);
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_set_format_zip(a));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_write_set_options(a, "zip:buffer-threshold=1k"));
+	assertEqualIntA(a, ARCHIVE_FAILED,
+	    archive_write_set_options(a, "zip:buffer-threshold=5000000000"));
+	assertEqualIntA(a, ARCHIVE_OK, archive_write_free(a));
+	free(buff);
+}
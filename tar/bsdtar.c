@@ -168,6 +168,7 @@ main(int argc, char **argv)
 	bsdtar->fd = -1; /* Mark as "unused" */
 	bsdtar->gid = -1;
 	bsdtar->uid = -1;
+	bsdtar->threads = 1;
 	bsdtar->flags = 0;
 	compression = compression2 = '\0';
 	compression_name = compression2_name = NULL;
@@ -336,6 +337,9 @@ main(int argc, char **argv)
 		case OPTION_CHECK_LINKS: /* GNU tar */
 			bsdtar->flags |= OPTFLAG_WARN_LINKS;
 			break;
+		case OPTION_LISTED_INCREMENTAL: /* GNU tar */
+			bsdtar->snapshot_file = bsdtar->argument;
+			break;
 		case OPTION_CHROOT: /* NetBSD */
 			bsdtar->flags |= OPTFLAG_CHROOT;
 			break;
@@ -463,6 +467,19 @@ main(int argc, char **argv)
 			/* GNU tar 1.13  used -l for --one-file-system */
 			bsdtar->flags |= OPTFLAG_WARN_LINKS;
 			break;
+		case OPTION_LINK_MEMORY_LIMIT:
+			errno = 0;
+			tptr = NULL;
+			t = (int)strtol(bsdtar->argument, &tptr, 10);
+			if (errno || t < 0 || *(bsdtar->argument) == '\0' ||
+			    tptr == NULL || *tptr != '\0' ||
+			    (size_t)t > ((size_t)-1) >> 20) {
+				lafe_errc(1, 0, "Invalid argument to "
+				    "--link-memory-limit");
+			}
+			/* Given in megabytes. */
+			bsdtar->link_memory_limit = (size_t)t << 20;
+			break;
 		case OPTION_LRZIP:
 		case OPTION_LZ4:
 		case OPTION_LZIP: /* GNU tar beginning with 1.23 */
@@ -656,6 +673,9 @@ main(int argc, char **argv)
 		case OPTION_POSIX: /* GNU tar */
 			cset_set_format(bsdtar->cset, "pax");
 			break;
+		case OPTION_PREALLOCATE:
+			bsdtar->extract_flags |= ARCHIVE_EXTRACT_PREALLOCATE;
+			break;
 		case 'q': /* FreeBSD GNU tar --fast-read, NetBSD -q */
 			bsdtar->flags |= OPTFLAG_FAST_READ;
 			break;
@@ -684,6 +704,9 @@ main(int argc, char **argv)
 		case OPTION_SAME_OWNER: /* GNU tar */
 			bsdtar->extract_flags |= ARCHIVE_EXTRACT_OWNER;
 			break;
+		case OPTION_STATS:
+			bsdtar->flags |= OPTFLAG_STATS;
+			break;
 		case OPTION_STRIP_COMPONENTS: /* GNU tar 1.15 */
 			errno = 0;
 			tptr = NULL;
@@ -702,6 +725,17 @@ main(int argc, char **argv)
 			set_mode(bsdtar, opt);
 			bsdtar->verbose++;
 			break;
+		case OPTION_THREADS:
+			errno = 0;
+			tptr = NULL;
+			t = (int)strtol(bsdtar->argument, &tptr, 10);
+			if (errno || t < 0 || *(bsdtar->argument) == '\0' ||
+			    tptr == NULL || *tptr != '\0') {
+				lafe_errc(1, 0, "Invalid argument to "
+				    "--threads");
+			}
+			bsdtar->threads = t;
+			break;
 		case OPTION_TOTALS: /* GNU tar */
 			bsdtar->flags |= OPTFLAG_TOTALS;
 			break;
@@ -831,6 +865,8 @@ main(int argc, char **argv)
 		only_mode(bsdtar, "--nopreserveHFSCompression", "x");
 	if (bsdtar->readdisk_flags & ARCHIVE_READDISK_HONOR_NODUMP)
 		only_mode(bsdtar, "--nodump", "cru");
+	if (bsdtar->snapshot_file != NULL)
+		only_mode(bsdtar, "--listed-incremental", "cx");
 	if (bsdtar->flags & OPTFLAG_ACLS)
 		only_mode(bsdtar, "--acls", "crux");
 	if (bsdtar->flags & OPTFLAG_NO_ACLS)
@@ -870,6 +906,10 @@ main(int argc, char **argv)
 	}
 	if (bsdtar->flags & OPTFLAG_STDOUT)
 		only_mode(bsdtar, "-O", "xt");
+	if (bsdtar->threads != 1)
+		only_mode(bsdtar, "--threads", "x");
+	if (bsdtar->link_memory_limit != 0)
+		only_mode(bsdtar, "--link-memory-limit", "cru");
 	if (bsdtar->flags & OPTFLAG_UNLINK_FIRST)
 		only_mode(bsdtar, "-U", "x");
 	if (bsdtar->flags & OPTFLAG_WARN_LINKS)
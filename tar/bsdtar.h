@@ -37,6 +37,7 @@
 #define IGNORE_WRONG_MODULE_NAME "__ignore_wrong_module_name__,"
 
 struct creation_set;
+struct snapshot;
 /*
  * The internal state for the "bsdtar" program.
  *
@@ -57,11 +58,14 @@ struct bsdtar {
 	int		  extract_flags; /* Flags for extract operation */
 	int		  readdisk_flags; /* Flags for read disk operation */
 	int		  strip_components; /* Remove this many leading dirs */
+	int		  threads; /* --threads */
+	size_t		  link_memory_limit; /* --link-memory-limit */
 	int		  gid;  /* --gid */
 	const char	 *gname; /* --gname */
 	int		  uid;  /* --uid */
 	const char	 *uname; /* --uname */
 	const char	 *passphrase; /* --passphrase */
+	const char	 *snapshot_file; /* --listed-incremental */
 	char		  mode; /* Program mode: 'c', 't', 'r', 'u', 'x' */
 	char		  symlink_mode; /* H or L, per BSD conventions */
 	const char	 *option_options; /* --options */
@@ -100,6 +104,7 @@ struct bsdtar {
 	struct archive		*matching;	/* for matching.c */
 	struct security		*security;	/* for read.c */
 	struct name_cache	*uname_cache;	/* for write.c */
+	struct snapshot		*snapshot;	/* for write.c */
 	struct siginfo_data	*siginfo;	/* for siginfo.c */
 	struct substitution	*substitution;	/* for subst.c */
 	char			*ppbuff;	/* for util.c */
@@ -131,6 +136,7 @@ struct bsdtar {
 #define	OPTFLAG_MAC_METADATA	(0x00400000)	/* --mac-metadata */
 #define	OPTFLAG_NO_READ_SPARSE	(0x00800000)    /* --no-read-sparse */
 #define	OPTFLAG_READ_SPARSE		(0x01000000)    /* --read-sparse */
+#define	OPTFLAG_STATS		(0x02000000)	/* --stats */
 
 /* Fake short equivalents for long options that otherwise lack them. */
 enum {
@@ -151,6 +157,8 @@ enum {
 	OPTION_IGNORE_ZEROS,
 	OPTION_INCLUDE,
 	OPTION_KEEP_NEWER_FILES,
+	OPTION_LINK_MEMORY_LIMIT,
+	OPTION_LISTED_INCREMENTAL,
 	OPTION_LRZIP,
 	OPTION_LZ4,
 	OPTION_LZIP,
@@ -181,10 +189,13 @@ enum {
 	OPTION_OPTIONS,
 	OPTION_PASSPHRASE,
 	OPTION_POSIX,
+	OPTION_PREALLOCATE,
 	OPTION_READ_SPARSE,
 	OPTION_SAFE_WRITES,
 	OPTION_SAME_OWNER,
+	OPTION_STATS,
 	OPTION_STRIP_COMPONENTS,
+	OPTION_THREADS,
 	OPTION_TOTALS,
 	OPTION_UID,
 	OPTION_UNAME,
@@ -203,6 +214,7 @@ int	pathcmp(const char *a, const char *b);
 void	safe_fprintf(FILE *, const char *fmt, ...) __LA_PRINTF(2, 3);
 void	set_chdir(struct bsdtar *, const char *newdir);
 const char *tar_i64toa(int64_t);
+void	tar_print_stats(struct archive *, const char *);
 void	tar_mode_c(struct bsdtar *bsdtar);
 void	tar_mode_r(struct bsdtar *bsdtar);
 void	tar_mode_t(struct bsdtar *bsdtar);
@@ -229,6 +241,21 @@ void		cset_set_format(struct creation_set *, const char *);
 int		cset_write_add_filters(struct creation_set *,
 		    struct archive *, const void **);
 
+/*
+ * Extended attribute that tells the deletion markers written by
+ * --listed-incremental from ordinary files; its value is the name of
+ * the file that was deleted.
+ */
+#define	WHITEOUT_XATTR	"user.bsdtar.whiteout"
+
+int		snapshot_check(struct snapshot *, struct archive_entry *);
+void		snapshot_commit(struct snapshot *, const char *);
+void		snapshot_exclude(struct snapshot *, struct archive_entry *);
+void		snapshot_free(struct snapshot *);
+const char *	snapshot_next_deleted(struct snapshot *);
+struct snapshot *snapshot_read(const char *);
+int		snapshot_write(struct snapshot *, const char *);
+
 const char * passphrase_callback(struct archive *, void *);
 void	     passphrase_free(char *);
 void	list_item_verbose(struct bsdtar *, FILE *,
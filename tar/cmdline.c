@@ -105,7 +105,9 @@ static const struct bsdtar_option {
 	{ "interactive",          0, 'w' },
 	{ "keep-newer-files",     0, OPTION_KEEP_NEWER_FILES },
 	{ "keep-old-files",       0, 'k' },
+	{ "link-memory-limit",    1, OPTION_LINK_MEMORY_LIMIT },
 	{ "list",                 0, 't' },
+	{ "listed-incremental",   1, OPTION_LISTED_INCREMENTAL },
 	{ "lrzip",                0, OPTION_LRZIP },
 	{ "lz4",                  0, OPTION_LZ4 },
 	{ "lzip",                 0, OPTION_LZIP },
@@ -144,13 +146,16 @@ static const struct bsdtar_option {
 	{ "options",              1, OPTION_OPTIONS },
 	{ "passphrase",		  1, OPTION_PASSPHRASE },
 	{ "posix",		  0, OPTION_POSIX },
+	{ "preallocate",	  0, OPTION_PREALLOCATE },
 	{ "preserve-permissions", 0, 'p' },
 	{ "read-full-blocks",	  0, 'B' },
 	{ "read-sparse",	  0, OPTION_READ_SPARSE },
 	{ "safe-writes",	  0, OPTION_SAFE_WRITES },
 	{ "same-owner",	          0, OPTION_SAME_OWNER },
 	{ "same-permissions",     0, 'p' },
+	{ "stats",		  0, OPTION_STATS },
 	{ "strip-components",	  1, OPTION_STRIP_COMPONENTS },
+	{ "threads",		  1, OPTION_THREADS },
 	{ "to-stdout",            0, 'O' },
 	{ "totals",		  0, OPTION_TOTALS },
 	{ "uid",		  1, OPTION_UID },
@@ -55,6 +55,10 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/read.c,v 1.40 2008/08/21 06:41:14 kientzle E
 #ifdef HAVE_LIMITS_H
 #include <limits.h>
 #endif
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_PTHREAD_CREATE)
+#include <pthread.h>
+#define	BSDTAR_THREADS
+#endif
 #ifdef HAVE_PWD_H
 #include <pwd.h>
 #endif
@@ -84,7 +88,33 @@ struct progress_data {
 	struct archive_entry *entry;
 };
 
+/* State shared by the threads of a parallel extraction. */
+struct parallel_data {
+	struct bsdtar *bsdtar;
+	char *filename;		/* Still valid after -C. */
+	int fatal;		/* An entry failed fatally. */
+#ifdef BSDTAR_THREADS
+	pthread_mutex_t lock;
+#endif
+};
+
+#ifdef BSDTAR_THREADS
+#define	lock_parallel(pd)	pthread_mutex_lock(&(pd)->lock)
+#define	unlock_parallel(pd)	pthread_mutex_unlock(&(pd)->lock)
+#else
+#define	lock_parallel(pd)	do {} while (0)
+#define	unlock_parallel(pd)	do {} while (0)
+#endif
+
+static void	add_inclusions(struct bsdtar *);
+static void	configure_reader(struct bsdtar *, struct archive *,
+		    archive_passphrase_callback *, void *);
+static int	extract_parallel(struct bsdtar *, struct archive *);
+static void	override_owner(struct bsdtar *, struct archive_entry *);
 static void	read_archive(struct bsdtar *bsdtar, char mode, struct archive *);
+static int	remove_whiteout(struct bsdtar *, struct archive *,
+		    struct archive_entry *, const char *);
+static char	*whiteout_name(struct archive_entry *);
 static int unmatched_inclusions_warn(struct archive *matching, const char *);
 
 
@@ -108,12 +138,21 @@ tar_mode_x(struct bsdtar *bsdtar)
 	if ((bsdtar->flags & OPTFLAG_NUMERIC_OWNER) == 0)
 		archive_write_disk_set_standard_lookup(writer);
 	archive_write_disk_set_options(writer, bsdtar->extract_flags);
+	if ((bsdtar->flags & OPTFLAG_STATS) &&
+	    archive_stats_enable(writer) != ARCHIVE_OK)
+		lafe_errc(1, 0, "%s", archive_error_string(writer));
 
-	read_archive(bsdtar, 'x', writer);
+	if (!extract_parallel(bsdtar, writer))
+		read_archive(bsdtar, 'x', writer);
 
 	if (unmatched_inclusions_warn(bsdtar->matching,
 	    "Not found in archive") != 0)
 		bsdtar->return_value = 1;
+	if (bsdtar->flags & OPTFLAG_STATS) {
+		/* Count the deferred directory fixups, too. */
+		archive_write_close(writer);
+		tar_print_stats(writer, "disk");
+	}
 	archive_write_free(writer);
 }
 
@@ -163,62 +202,13 @@ read_archive(struct bsdtar *bsdtar, char mode, struct archive *writer)
 	FILE			 *out;
 	struct archive		 *a;
 	struct archive_entry	 *entry;
-	const char		 *reader_options;
+	char			 *name;
 	int			  r;
 
-	while (*bsdtar->argv) {
-		if (archive_match_include_pattern(bsdtar->matching,
-		    *bsdtar->argv) != ARCHIVE_OK)
-			lafe_errc(1, 0, "Error inclusion pattern: %s",
-			    archive_error_string(bsdtar->matching));
-		bsdtar->argv++;
-	}
-
-	if (bsdtar->names_from_file != NULL)
-		if (archive_match_include_pattern_from_file(
-		    bsdtar->matching, bsdtar->names_from_file,
-		    (bsdtar->flags & OPTFLAG_NULL)) != ARCHIVE_OK)
-			lafe_errc(1, 0, "Error inclusion pattern: %s",
-			    archive_error_string(bsdtar->matching));
+	add_inclusions(bsdtar);
 
 	a = archive_read_new();
-	if (cset_read_support_filter_program(bsdtar->cset, a) == 0)
-		archive_read_support_filter_all(a);
-	archive_read_support_format_all(a);
-
-	reader_options = getenv(ENV_READER_OPTIONS);
-	if (reader_options != NULL) {
-		size_t module_len = sizeof(IGNORE_WRONG_MODULE_NAME) - 1;
-		size_t opt_len = strlen(reader_options) + 1;
-		char *p;
-		/* Set default read options. */
-		if ((p = malloc(module_len + opt_len)) == NULL)
-			lafe_errc(1, errno, "Out of memory");
-		/* Prepend magic code to ignore options for
-		 * a format or  modules which are not added to
-		 *  the archive read object. */
-		memcpy(p, IGNORE_WRONG_MODULE_NAME, module_len);
-		memcpy(p + module_len, reader_options, opt_len);
-		r = archive_read_set_options(a, p);
-		free(p);
-		if (r == ARCHIVE_FATAL)
-			lafe_errc(1, 0, "%s", archive_error_string(a));
-		else
-			archive_clear_error(a);
-	}
-	if (ARCHIVE_OK != archive_read_set_options(a, bsdtar->option_options))
-		lafe_errc(1, 0, "%s", archive_error_string(a));
-	if (bsdtar->flags & OPTFLAG_IGNORE_ZEROS)
-		if (archive_read_set_options(a,
-		    "read_concatenated_archives") != ARCHIVE_OK)
-			lafe_errc(1, 0, "%s", archive_error_string(a));
-	if (bsdtar->passphrase != NULL)
-		r = archive_read_add_passphrase(a, bsdtar->passphrase);
-	else
-		r = archive_read_set_passphrase_callback(a, bsdtar,
-			&passphrase_callback);
-	if (r != ARCHIVE_OK)
-		lafe_errc(1, 0, "%s", archive_error_string(a));
+	configure_reader(bsdtar, a, &passphrase_callback, bsdtar);
 	if (archive_read_open_filename(a, bsdtar->filename,
 					bsdtar->bytes_per_block))
 		lafe_errc(1, 0, "Error opening archive: %s",
@@ -279,18 +269,7 @@ read_archive(struct bsdtar *bsdtar, char mode, struct archive *writer)
 			continue;
 		}
 
-		if (bsdtar->uid >= 0) {
-			archive_entry_set_uid(entry, bsdtar->uid);
-			archive_entry_set_uname(entry, NULL);
-		}
-		if (bsdtar->gid >= 0) {
-			archive_entry_set_gid(entry, bsdtar->gid);
-			archive_entry_set_gname(entry, NULL);
-		}
-		if (bsdtar->uname)
-			archive_entry_set_uname(entry, bsdtar->uname);
-		if (bsdtar->gname)
-			archive_entry_set_gname(entry, bsdtar->gname);
+		override_owner(bsdtar, entry);
 
 		/*
 		 * Note that pattern exclusions are checked before
@@ -367,7 +346,11 @@ read_archive(struct bsdtar *bsdtar, char mode, struct archive *writer)
 
 			if (bsdtar->flags & OPTFLAG_STDOUT)
 				r = archive_read_data_into_fd(a, 1);
-			else
+			else if (bsdtar->snapshot_file != NULL &&
+			    (name = whiteout_name(entry)) != NULL) {
+				r = remove_whiteout(bsdtar, a, entry, name);
+				free(name);
+			} else
 				r = archive_read_extract2(a, entry, writer);
 			if (r != ARCHIVE_OK) {
 				if (!bsdtar->verbose)
@@ -396,7 +379,408 @@ read_archive(struct bsdtar *bsdtar, char mode, struct archive *writer)
 		fprintf(stdout, "Archive Format: %s,  Compression: %s\n",
 		    archive_format_name(a), archive_filter_name(a, 0));
 
+	if (bsdtar->flags & OPTFLAG_STATS)
+		tar_print_stats(a, "archive");
+	archive_read_free(a);
+}
+
+
+static void
+add_inclusions(struct bsdtar *bsdtar)
+{
+	while (*bsdtar->argv) {
+		if (archive_match_include_pattern(bsdtar->matching,
+		    *bsdtar->argv) != ARCHIVE_OK)
+			lafe_errc(1, 0, "Error inclusion pattern: %s",
+			    archive_error_string(bsdtar->matching));
+		bsdtar->argv++;
+	}
+
+	if (bsdtar->names_from_file != NULL)
+		if (archive_match_include_pattern_from_file(
+		    bsdtar->matching, bsdtar->names_from_file,
+		    (bsdtar->flags & OPTFLAG_NULL)) != ARCHIVE_OK)
+			lafe_errc(1, 0, "Error inclusion pattern: %s",
+			    archive_error_string(bsdtar->matching));
+}
+
+/*
+ * Set up the formats, filters, options and passphrase of a reader.
+ */
+static void
+configure_reader(struct bsdtar *bsdtar, struct archive *a,
+    archive_passphrase_callback *callback, void *client_data)
+{
+	const char *reader_options;
+	int r;
+
+	if (cset_read_support_filter_program(bsdtar->cset, a) == 0)
+		archive_read_support_filter_all(a);
+	archive_read_support_format_all(a);
+	if ((bsdtar->flags & OPTFLAG_STATS) &&
+	    archive_stats_enable(a) != ARCHIVE_OK)
+		lafe_errc(1, 0, "%s", archive_error_string(a));
+
+	reader_options = getenv(ENV_READER_OPTIONS);
+
+	if (reader_options != NULL) {
+		size_t module_len = sizeof(IGNORE_WRONG_MODULE_NAME) - 1;
+		size_t opt_len = strlen(reader_options) + 1;
+		char *p;
+		/* Set default read options. */
+		if ((p = malloc(module_len + opt_len)) == NULL)
+			lafe_errc(1, errno, "Out of memory");
+		/* Prepend magic code to ignore options for
+		 * a format or  modules which are not added to
+		 *  the archive read object. */
+		memcpy(p, IGNORE_WRONG_MODULE_NAME, module_len);
+		memcpy(p + module_len, reader_options, opt_len);
+		r = archive_read_set_options(a, p);
+		free(p);
+		if (r == ARCHIVE_FATAL)
+			lafe_errc(1, 0, "%s", archive_error_string(a));
+		else
+			archive_clear_error(a);
+	}
+	if (ARCHIVE_OK != archive_read_set_options(a, bsdtar->option_options))
+		lafe_errc(1, 0, "%s", archive_error_string(a));
+	if (bsdtar->flags & OPTFLAG_IGNORE_ZEROS)
+		if (archive_read_set_options(a,
+		    "read_concatenated_archives") != ARCHIVE_OK)
+			lafe_errc(1, 0, "%s", archive_error_string(a));
+	if (bsdtar->passphrase != NULL)
+		r = archive_read_add_passphrase(a, bsdtar->passphrase);
+	else
+		r = archive_read_set_passphrase_callback(a, client_data,
+			callback);
+	if (r != ARCHIVE_OK)
+		lafe_errc(1, 0, "%s", archive_error_string(a));
+}
+
+static void
+override_owner(struct bsdtar *bsdtar, struct archive_entry *entry)
+{
+	if (bsdtar->uid >= 0) {
+		archive_entry_set_uid(entry, bsdtar->uid);
+		archive_entry_set_uname(entry, NULL);
+	}
+	if (bsdtar->gid >= 0) {
+		archive_entry_set_gid(entry, bsdtar->gid);
+		archive_entry_set_gname(entry, NULL);
+	}
+	if (bsdtar->uname)
+		archive_entry_set_uname(entry, bsdtar->uname);
+	if (bsdtar->gname)
+		archive_entry_set_gname(entry, bsdtar->gname);
+}
+
+/*
+ * If `entry' is a deletion marker written by --listed-incremental,
+ * return the name of the file it stands for, which the caller frees.
+ */
+static char *
+whiteout_name(struct archive_entry *entry)
+{
+	const char *xname;
+	const void *value;
+	char *name;
+	size_t size;
+
+	archive_entry_xattr_reset(entry);
+	while (archive_entry_xattr_next(entry, &xname, &value, &size)
+	    == ARCHIVE_OK) {
+		if (strcmp(xname, WHITEOUT_XATTR) != 0)
+			continue;
+		/* A name in the marker's own directory, nothing else. */
+		if (size == 0 || memchr(value, '/', size) != NULL ||
+		    memchr(value, '\0', size) != NULL ||
+		    (size == 1 && memcmp(value, ".", 1) == 0) ||
+		    (size == 2 && memcmp(value, "..", 2) == 0))
+			return (NULL);
+		if ((name = malloc(size + 1)) == NULL)
+			lafe_errc(1, ENOMEM, "Can't allocate memory");
+		memcpy(name, value, size);
+		name[size] = '\0';
+		return (name);
+	}
+	return (NULL);
+}
+
+/*
+ * Remove the file that the deletion marker `entry' stands for, and
+ * everything below it if it is a directory, with the same safeguards
+ * that extraction applies to the marker itself.
+ */
+static int
+remove_whiteout(struct bsdtar *bsdtar, struct archive *a,
+    struct archive_entry *entry, const char *name)
+{
+	struct archive *disk;
+	struct archive_entry *e;
+	const char *marker, *p;
+	char *path, **paths;
+	size_t dirlen, i, n, size;
+	int r;
+
+	marker = archive_entry_pathname(entry);
+	p = strrchr(marker, '/');
+	dirlen = (p == NULL) ? 0 : p + 1 - marker;
+	path = malloc(dirlen + strlen(name) + 1);
+	if (path == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate memory");
+	memcpy(path, marker, dirlen);
+	strcpy(path + dirlen, name);
+
+	disk = archive_read_disk_new();
+	if (disk == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate memory");
+	archive_read_disk_set_symlink_physical(disk);
+	archive_read_disk_set_behavior(disk, ARCHIVE_READDISK_NO_ACL |
+	    ARCHIVE_READDISK_NO_FFLAGS | ARCHIVE_READDISK_NO_SPARSE |
+	    ARCHIVE_READDISK_NO_XATTR);
+	e = archive_entry_new();
+	r = ARCHIVE_OK;
+
+	/* Refuse what extracting to `path' would have refused. */
+	if ((bsdtar->extract_flags & ARCHIVE_EXTRACT_SECURE_NOABSOLUTEPATHS)
+	    && path[0] == '/') {
+		archive_set_error(a, EINVAL, "Path is absolute");
+		r = ARCHIVE_FAILED;
+	}
+	for (p = path; r == ARCHIVE_OK && *p != '\0'; p++) {
+		if (p != path && p[-1] != '/')
+			continue;
+		if ((bsdtar->extract_flags & ARCHIVE_EXTRACT_SECURE_NODOTDOT)
+		    && p[0] == '.' && p[1] == '.' &&
+		    (p[2] == '/' || p[2] == '\0')) {
+			archive_set_error(a, EINVAL, "Path contains '..'");
+			r = ARCHIVE_FAILED;
+		}
+	}
+	for (p = strchr(path + 1, '/'); r == ARCHIVE_OK && p != NULL;
+	    p = strchr(p + 1, '/')) {
+		if (!(bsdtar->extract_flags & ARCHIVE_EXTRACT_SECURE_SYMLINKS))
+			break;
+		path[p - path] = '\0';
+		archive_entry_clear(e);
+		archive_entry_copy_sourcepath(e, path);
+		if (archive_read_disk_entry_from_file(disk, e, -1, NULL)
+		    == ARCHIVE_OK &&
+		    archive_entry_filetype(e) == AE_IFLNK) {
+			archive_set_error(a, EINVAL,
+			    "Cannot remove through symlink %s", path);
+			r = ARCHIVE_FAILED;
+		}
+		path[p - path] = '/';
+	}
+
+	/*
+	 * Collect the tree first and remove it from the bottom up.  A
+	 * file that is already gone is not an error.
+	 */
+	paths = NULL;
+	n = size = 0;
+	if (r == ARCHIVE_OK && archive_read_disk_open(disk, path)
+	    == ARCHIVE_OK) {
+		archive_entry_clear(e);
+		while (archive_read_next_header2(disk, e) == ARCHIVE_OK) {
+			if (n == size) {
+				size = size ? size * 2 : 16;
+				paths = realloc(paths, size * sizeof(*paths));
+				if (paths == NULL)
+					lafe_errc(1, ENOMEM,
+					    "Can't allocate memory");
+			}
+			if ((paths[n++] = strdup(archive_entry_pathname(e)))
+			    == NULL)
+				lafe_errc(1, ENOMEM, "Can't allocate memory");
+			if (archive_entry_filetype(e) == AE_IFDIR)
+				archive_read_disk_descend(disk);
+			archive_entry_clear(e);
+		}
+	}
+	for (i = n; i-- > 0;) {
+		if (r == ARCHIVE_OK && remove(paths[i]) != 0) {
+			archive_set_error(a, errno, "Can't remove %s",
+			    paths[i]);
+			r = ARCHIVE_FAILED;
+		}
+		free(paths[i]);
+	}
+	free(paths);
+	archive_entry_free(e);
+	archive_read_free(disk);
+	free(path);
+	/* The caller reports strerror(errno) as well. */
+	if (r != ARCHIVE_OK)
+		errno = archive_errno(a);
+	return (r);
+}
+
+/*
+ * The threads of a parallel extraction share the matching and
+ * rewriting state, the passphrase prompt and stderr, so all of those
+ * are used under the lock; only the extraction itself runs unlocked.
+ */
+static const char *
+parallel_passphrase(struct archive *a, void *_client_data)
+{
+	struct parallel_data *pd = (struct parallel_data *)_client_data;
+	const char *passphrase;
+
+	lock_parallel(pd);
+	passphrase = passphrase_callback(a, pd->bsdtar);
+	unlock_parallel(pd);
+	return (passphrase);
+}
+
+static int
+parallel_open(struct archive *a, void *_client_data)
+{
+	struct parallel_data *pd = (struct parallel_data *)_client_data;
+	struct bsdtar *bsdtar = pd->bsdtar;
+
+	configure_reader(bsdtar, a, &parallel_passphrase, pd);
+	return (archive_read_open_filename(a, pd->filename,
+	    bsdtar->bytes_per_block));
+}
+
+static int
+parallel_extract(struct archive *a, void *_client_data,
+    struct archive_entry *entry, struct archive *writer)
+{
+	struct parallel_data *pd = (struct parallel_data *)_client_data;
+	struct bsdtar *bsdtar = pd->bsdtar;
+	const char *p;
+	int err, r;
+
+	lock_parallel(pd);
+	p = archive_entry_pathname(entry);
+	if (p == NULL || p[0] == '\0') {
+		lafe_warnc(0, "Archive entry has empty or unreadable filename ... skipping.");
+		bsdtar->return_value = 1;
+		unlock_parallel(pd);
+		return (ARCHIVE_OK);
+	}
+	override_owner(bsdtar, entry);
+	/* Note: some rewrite failures prevent extraction. */
+	if (archive_match_excluded(bsdtar->matching, entry) ||
+	    edit_pathname(bsdtar, entry)) {
+		unlock_parallel(pd);
+		return (ARCHIVE_OK);
+	}
+	unlock_parallel(pd);
+
+	r = archive_read_extract2(a, entry, writer);
+	err = errno;
+
+	/* Print whole lines, so that those of other threads don't
+	 * end up in the middle. */
+	lock_parallel(pd);
+	if (bsdtar->verbose > 1) {
+		safe_fprintf(stderr, "x ");
+		list_item_verbose(bsdtar, stderr, entry);
+	} else if (bsdtar->verbose > 0)
+		safe_fprintf(stderr, "x %s", archive_entry_pathname(entry));
+	if (r != ARCHIVE_OK) {
+		if (!bsdtar->verbose)
+			safe_fprintf(stderr, "%s", archive_entry_pathname(entry));
+		fprintf(stderr, ": %s: ", archive_error_string(a));
+		fprintf(stderr, "%s", strerror(err));
+		if (!bsdtar->verbose)
+			fprintf(stderr, "\n");
+		bsdtar->return_value = 1;
+	}
+	if (bsdtar->verbose)
+		fprintf(stderr, "\n");
+	fflush(stderr);
+	if (r == ARCHIVE_FATAL)
+		pd->fatal = 1;
+	unlock_parallel(pd);
+	/* The error has been reported; only a fatal one stops the rest. */
+	return (r == ARCHIVE_FATAL ? ARCHIVE_FATAL : ARCHIVE_OK);
+}
+
+/*
+ * Handle 'x' mode with --threads, which extracts the regular files of
+ * a Zip archive on several threads.  Returns zero if the options ask
+ * for something only the serial path in read_archive() can do.
+ */
+static int
+extract_parallel(struct bsdtar *bsdtar, struct archive *writer)
+{
+	struct parallel_data pd;
+	struct archive *a;
+	char *cwd;
+	int r;
+
+	/* Deletion markers are only handled in read_archive(). */
+	if (bsdtar->threads == 1 || bsdtar->filename == NULL ||
+	    bsdtar->snapshot_file != NULL ||
+	    strcmp(bsdtar->filename, "-") == 0 ||
+	    (bsdtar->flags & (OPTFLAG_CHROOT | OPTFLAG_FAST_READ |
+	    OPTFLAG_INTERACTIVE | OPTFLAG_STDOUT)))
+		return (0);
+
+	memset(&pd, 0, sizeof(pd));
+	pd.bsdtar = bsdtar;
+	/* The other readers are opened after -C has taken effect. */
+	if (bsdtar->pending_chdir != NULL && bsdtar->filename[0] != '/') {
+#if defined(PATH_MAX) && !defined(__GLIBC__)
+		cwd = getcwd(NULL, PATH_MAX);/* Solaris getcwd needs the size. */
+#else
+		cwd = getcwd(NULL, 0);
+#endif
+		if (cwd == NULL)
+			return (0);
+		pd.filename = malloc(strlen(cwd) + strlen(bsdtar->filename) + 2);
+		if (pd.filename == NULL)
+			lafe_errc(1, errno, "Out of memory");
+		sprintf(pd.filename, "%s/%s", cwd, bsdtar->filename);
+		free(cwd);
+	} else if ((pd.filename = strdup(bsdtar->filename)) == NULL)
+		lafe_errc(1, errno, "Out of memory");
+#ifdef BSDTAR_THREADS
+	if (pthread_mutex_init(&pd.lock, NULL) != 0)
+		lafe_errc(1, errno, "Cannot initialize lock");
+#endif
+
+	add_inclusions(bsdtar);
+
+	a = archive_read_new();
+	configure_reader(bsdtar, a, &parallel_passphrase, &pd);
+	if (archive_read_open_filename(a, bsdtar->filename,
+					bsdtar->bytes_per_block))
+		lafe_errc(1, 0, "Error opening archive: %s",
+		    archive_error_string(a));
+
+	do_chdir(bsdtar);
+
+	r = archive_read_extract_parallel(a, writer, bsdtar->threads,
+	    parallel_open, parallel_extract, &pd);
+	if (r != ARCHIVE_OK && !pd.fatal)
+		lafe_warnc(0, "%s", archive_error_string(a));
+	if (r <= ARCHIVE_WARN)
+		bsdtar->return_value = 1;
+
+	r = archive_read_close(a);
+	if (r != ARCHIVE_OK)
+		lafe_warnc(0, "%s", archive_error_string(a));
+	if (r <= ARCHIVE_WARN)
+		bsdtar->return_value = 1;
+
+	if (bsdtar->verbose > 2)
+		fprintf(stdout, "Archive Format: %s,  Compression: %s\n",
+		    archive_format_name(a), archive_filter_name(a, 0));
+
+	if (bsdtar->flags & OPTFLAG_STATS)
+		tar_print_stats(a, "archive");
 	archive_read_free(a);
+#ifdef BSDTAR_THREADS
+	pthread_mutex_destroy(&pd.lock);
+#endif
+	free(pd.filename);
+	return (1);
 }
 
 
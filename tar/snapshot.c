@@ -0,0 +1,502 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "bsdtar_platform.h"
+__FBSDID("$FreeBSD$");
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#include <stdio.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "bsdtar.h"
+#include "err.h"
+
+/*
+ * The file-state snapshot behind --listed-incremental.
+ *
+ * For every path archived, the snapshot remembers enough of its
+ * stat() data to tell later whether the file has changed.  Files
+ * that have not can be skipped without being opened, and paths
+ * that have gone away since the last run can be reported.
+ *
+ * The snapshot file is a header line followed by one record per
+ * path: eight decimal numbers separated by spaces, a space, then
+ * the path terminated by a NUL.
+ */
+
+#define SNAPSHOT_MAGIC		"bsdtar-snapshot 1\n"
+
+/* Set if `saved' holds the state of the file when it was archived. */
+#define SNAPSHOT_SAVED		1
+/* Set if `current' holds the state of the file seen by this run. */
+#define SNAPSHOT_CURRENT	2
+/* The path was visited by this run. */
+#define SNAPSHOT_VISITED	4
+/* The path was excluded by this run. */
+#define SNAPSHOT_EXCLUDED	8
+
+struct file_state {
+	int64_t		 filetype;
+	int64_t		 dev;
+	int64_t		 ino;
+	int64_t		 size;
+	int64_t		 mtime;
+	int64_t		 mtime_nsec;
+	int64_t		 ctime;
+	int64_t		 ctime_nsec;
+};
+
+struct snapshot_entry {
+	struct snapshot_entry	*next;
+	struct file_state	 saved;
+	struct file_state	 current;
+	unsigned		 hash;
+	int			 flags;
+	char			 path[1];
+};
+
+struct snapshot {
+	struct snapshot_entry	**buckets;
+	size_t			  nbuckets;
+	size_t			  count;
+	/* Paths to report as deleted, built on first use. */
+	struct snapshot_entry	**deleted;
+	size_t			  deleted_count;
+	size_t			  deleted_next;
+};
+
+static unsigned
+hash_path(const char *path)
+{
+	/* FNV-1a */
+	unsigned h = 2166136261U;
+
+	while (*path != '\0')
+		h = (h ^ (unsigned char)*path++) * 16777619U;
+	return (h);
+}
+
+static struct snapshot_entry *
+lookup(struct snapshot *snapshot, const char *path, unsigned hash)
+{
+	struct snapshot_entry *e;
+
+	for (e = snapshot->buckets[hash & (snapshot->nbuckets - 1)];
+	    e != NULL; e = e->next)
+		if (e->hash == hash && strcmp(e->path, path) == 0)
+			return (e);
+	return (NULL);
+}
+
+static struct snapshot_entry *
+insert(struct snapshot *snapshot, const char *path, size_t len,
+    unsigned hash)
+{
+	struct snapshot_entry *e, **buckets, *next;
+	size_t i, n;
+
+	/* Keep the chains short by doubling the table as it fills. */
+	if (snapshot->count >= snapshot->nbuckets) {
+		n = snapshot->nbuckets * 2;
+		buckets = calloc(n, sizeof(*buckets));
+		if (buckets == NULL)
+			lafe_errc(1, ENOMEM, "Can't allocate snapshot");
+		for (i = 0; i < snapshot->nbuckets; i++) {
+			for (e = snapshot->buckets[i]; e != NULL; e = next) {
+				next = e->next;
+				e->next = buckets[e->hash & (n - 1)];
+				buckets[e->hash & (n - 1)] = e;
+			}
+		}
+		free(snapshot->buckets);
+		snapshot->buckets = buckets;
+		snapshot->nbuckets = n;
+	}
+
+	e = calloc(1, sizeof(*e) + len);
+	if (e == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate snapshot");
+	memcpy(e->path, path, len);
+	e->path[len] = '\0';
+	e->hash = hash;
+	e->next = snapshot->buckets[hash & (snapshot->nbuckets - 1)];
+	snapshot->buckets[hash & (snapshot->nbuckets - 1)] = e;
+	snapshot->count++;
+	return (e);
+}
+
+static struct snapshot_entry *
+find_or_insert(struct snapshot *snapshot, const char *path)
+{
+	struct snapshot_entry *e;
+	unsigned hash;
+
+	hash = hash_path(path);
+	e = lookup(snapshot, path, hash);
+	if (e == NULL)
+		e = insert(snapshot, path, strlen(path), hash);
+	return (e);
+}
+
+static void
+get_state(struct archive_entry *entry, struct file_state *st)
+{
+	st->filetype = archive_entry_filetype(entry);
+	st->dev = (int64_t)archive_entry_dev(entry);
+	st->ino = archive_entry_ino64(entry);
+	st->size = archive_entry_size(entry);
+	st->mtime = archive_entry_mtime(entry);
+	st->mtime_nsec = archive_entry_mtime_nsec(entry);
+	st->ctime = archive_entry_ctime(entry);
+	st->ctime_nsec = archive_entry_ctime_nsec(entry);
+}
+
+static int
+parse_number(const char **pp, const char *end, int64_t *v)
+{
+	const char *p = *pp;
+	uint64_t n = 0;
+	int neg = 0;
+
+	if (p < end && *p == '-') {
+		neg = 1;
+		p++;
+	}
+	if (p >= end || *p < '0' || *p > '9')
+		return (-1);
+	while (p < end && *p >= '0' && *p <= '9')
+		n = n * 10 + (*p++ - '0');
+	if (p >= end || *p != ' ')
+		return (-1);
+	*pp = p + 1;
+	*v = neg ? -(int64_t)n : (int64_t)n;
+	return (0);
+}
+
+static struct snapshot *
+snapshot_new(void)
+{
+	struct snapshot *snapshot;
+
+	snapshot = calloc(1, sizeof(*snapshot));
+	if (snapshot == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate snapshot");
+	snapshot->nbuckets = 256;
+	snapshot->buckets = calloc(snapshot->nbuckets,
+	    sizeof(*snapshot->buckets));
+	if (snapshot->buckets == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate snapshot");
+	return (snapshot);
+}
+
+/*
+ * Load the snapshot left by the previous run.  A missing file is an
+ * empty snapshot; the first run archives everything.
+ */
+struct snapshot *
+snapshot_read(const char *filename)
+{
+	struct snapshot *snapshot;
+	struct snapshot_entry *e;
+	struct file_state st;
+	FILE *f;
+	char *buff, *p;
+	const char *q, *end, *path;
+	size_t size, used, n;
+
+	snapshot = snapshot_new();
+	f = fopen(filename, "rb");
+	if (f == NULL) {
+		if (errno == ENOENT)
+			return (snapshot);
+		lafe_errc(1, errno, "Couldn't open %s", filename);
+	}
+	size = 65536;
+	used = 0;
+	buff = malloc(size);
+	if (buff == NULL)
+		lafe_errc(1, ENOMEM, "Can't read snapshot");
+	while ((n = fread(buff + used, 1, size - used, f)) > 0) {
+		used += n;
+		if (used == size) {
+			size *= 2;
+			p = realloc(buff, size);
+			if (p == NULL)
+				lafe_errc(1, ENOMEM, "Can't read snapshot");
+			buff = p;
+		}
+	}
+	if (ferror(f))
+		lafe_errc(1, errno, "Couldn't read %s", filename);
+	fclose(f);
+
+	n = sizeof(SNAPSHOT_MAGIC) - 1;
+	if (used < n || memcmp(buff, SNAPSHOT_MAGIC, n) != 0)
+		lafe_errc(1, 0, "%s: Not a snapshot file", filename);
+	q = buff + n;
+	end = buff + used;
+	while (q < end) {
+		if (parse_number(&q, end, &st.filetype) ||
+		    parse_number(&q, end, &st.dev) ||
+		    parse_number(&q, end, &st.ino) ||
+		    parse_number(&q, end, &st.size) ||
+		    parse_number(&q, end, &st.mtime) ||
+		    parse_number(&q, end, &st.mtime_nsec) ||
+		    parse_number(&q, end, &st.ctime) ||
+		    parse_number(&q, end, &st.ctime_nsec))
+			lafe_errc(1, 0, "%s: Damaged snapshot file", filename);
+		path = q;
+		while (q < end && *q != '\0')
+			q++;
+		if (q >= end || q == path)
+			lafe_errc(1, 0, "%s: Damaged snapshot file", filename);
+		e = find_or_insert(snapshot, path);
+		e->saved = st;
+		e->flags = SNAPSHOT_SAVED;
+		q++;
+	}
+	free(buff);
+	return (snapshot);
+}
+
+/*
+ * Note that the disk reader has visited this entry.  Returns
+ * non-zero if it has not changed since it was last archived, in
+ * which case it need not be archived again.  Directories are always
+ * archived, so that their contents are visited.
+ */
+int
+snapshot_check(struct snapshot *snapshot, struct archive_entry *entry)
+{
+	struct snapshot_entry *e;
+
+	e = find_or_insert(snapshot, archive_entry_pathname(entry));
+	get_state(entry, &e->current);
+	e->flags |= SNAPSHOT_CURRENT | SNAPSHOT_VISITED;
+	if ((e->flags & SNAPSHOT_SAVED) == 0 ||
+	    e->current.filetype == AE_IFDIR)
+		return (0);
+	return (memcmp(&e->saved, &e->current, sizeof(e->saved)) == 0);
+}
+
+/*
+ * Note that the disk reader has excluded this entry.  It is neither
+ * remembered nor reported as deleted, and neither is anything below
+ * it that was not visited.
+ */
+void
+snapshot_exclude(struct snapshot *snapshot, struct archive_entry *entry)
+{
+	struct snapshot_entry *e;
+
+	e = find_or_insert(snapshot, archive_entry_pathname(entry));
+	e->flags |= SNAPSHOT_EXCLUDED;
+}
+
+/* Remember the state of a visited path once it has been archived. */
+void
+snapshot_commit(struct snapshot *snapshot, const char *path)
+{
+	struct snapshot_entry *e;
+
+	e = lookup(snapshot, path, hash_path(path));
+	if (e == NULL || (e->flags & SNAPSHOT_CURRENT) == 0)
+		return;
+	e->saved = e->current;
+	e->flags |= SNAPSHOT_SAVED;
+}
+
+static int
+is_deleted(const struct snapshot_entry *e)
+{
+	return ((e->flags & (SNAPSHOT_SAVED | SNAPSHOT_VISITED |
+	    SNAPSHOT_EXCLUDED)) == SNAPSHOT_SAVED);
+}
+
+/*
+ * A deleted path is only reported if none of its parents was
+ * deleted or excluded as well.
+ */
+static int
+parent_is_gone(struct snapshot *snapshot, const char *path)
+{
+	struct snapshot_entry *e;
+	char *p, *buff;
+	int gone = 0;
+
+	buff = strdup(path);
+	if (buff == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate snapshot");
+	while (!gone && (p = strrchr(buff, '/')) != NULL) {
+		/* Drop the last component and any trailing slashes. */
+		while (p > buff && p[-1] == '/')
+			p--;
+		*p = '\0';
+		if (p == buff)
+			break;
+		e = lookup(snapshot, buff, hash_path(buff));
+		if (e != NULL && (is_deleted(e) ||
+		    (e->flags & SNAPSHOT_EXCLUDED) != 0))
+			gone = 1;
+	}
+	free(buff);
+	return (gone);
+}
+
+static int
+cmp_entry(const void *a, const void *b)
+{
+	const struct snapshot_entry * const *ea = a;
+	const struct snapshot_entry * const *eb = b;
+
+	return (strcmp((*ea)->path, (*eb)->path));
+}
+
+/*
+ * Return the next path that was archived last time but not visited
+ * by this run, in sorted order, or NULL when there are no more.
+ */
+const char *
+snapshot_next_deleted(struct snapshot *snapshot)
+{
+	struct snapshot_entry *e;
+	size_t i;
+
+	if (snapshot->deleted == NULL) {
+		snapshot->deleted = calloc(snapshot->count + 1,
+		    sizeof(*snapshot->deleted));
+		if (snapshot->deleted == NULL)
+			lafe_errc(1, ENOMEM, "Can't allocate snapshot");
+		for (i = 0; i < snapshot->nbuckets; i++)
+			for (e = snapshot->buckets[i]; e != NULL; e = e->next)
+				if (is_deleted(e) &&
+				    !parent_is_gone(snapshot, e->path))
+					snapshot->deleted[
+					    snapshot->deleted_count++] = e;
+		qsort(snapshot->deleted, snapshot->deleted_count,
+		    sizeof(*snapshot->deleted), cmp_entry);
+	}
+	if (snapshot->deleted_next >= snapshot->deleted_count)
+		return (NULL);
+	return (snapshot->deleted[snapshot->deleted_next++]->path);
+}
+
+static void
+write_number(FILE *f, int64_t n)
+{
+	fputs(tar_i64toa(n), f);
+	fputc(' ', f);
+}
+
+/*
+ * Save the state of every path this run visited and archived, now or
+ * before.  The new snapshot replaces the old one only once it has
+ * been completely written.
+ */
+int
+snapshot_write(struct snapshot *snapshot, const char *filename)
+{
+	struct snapshot_entry *e;
+	FILE *f;
+	char *tmp;
+	size_t i, len;
+	int r;
+
+	len = strlen(filename);
+	tmp = malloc(len + 5);
+	if (tmp == NULL)
+		lafe_errc(1, ENOMEM, "Can't allocate snapshot");
+	memcpy(tmp, filename, len);
+	memcpy(tmp + len, ".tmp", 5);
+	f = fopen(tmp, "wb");
+	if (f == NULL) {
+		lafe_warnc(errno, "Couldn't create %s", tmp);
+		free(tmp);
+		return (-1);
+	}
+	fputs(SNAPSHOT_MAGIC, f);
+	for (i = 0; i < snapshot->nbuckets; i++) {
+		for (e = snapshot->buckets[i]; e != NULL; e = e->next) {
+			if ((e->flags & (SNAPSHOT_SAVED | SNAPSHOT_VISITED)) !=
+			    (SNAPSHOT_SAVED | SNAPSHOT_VISITED))
+				continue;
+			write_number(f, e->saved.filetype);
+			write_number(f, e->saved.dev);
+			write_number(f, e->saved.ino);
+			write_number(f, e->saved.size);
+			write_number(f, e->saved.mtime);
+			write_number(f, e->saved.mtime_nsec);
+			write_number(f, e->saved.ctime);
+			write_number(f, e->saved.ctime_nsec);
+			fputs(e->path, f);
+			fputc('\0', f);
+		}
+	}
+	r = ferror(f);
+	if (fclose(f) != 0 || r != 0) {
+		lafe_warnc(errno, "Couldn't write %s", tmp);
+		remove(tmp);
+		free(tmp);
+		return (-1);
+	}
+#if defined(_WIN32) && !defined(__CYGWIN__)
+	/* rename() does not replace an existing file on Windows. */
+	remove(filename);
+#endif
+	if (rename(tmp, filename) != 0) {
+		lafe_warnc(errno, "Couldn't rename %s to %s", tmp, filename);
+		remove(tmp);
+		free(tmp);
+		return (-1);
+	}
+	free(tmp);
+	return (0);
+}
+
+void
+snapshot_free(struct snapshot *snapshot)
+{
+	struct snapshot_entry *e, *next;
+	size_t i;
+
+	if (snapshot == NULL)
+		return;
+	for (i = 0; i < snapshot->nbuckets; i++) {
+		for (e = snapshot->buckets[i]; e != NULL; e = next) {
+			next = e->next;
+			free(e);
+		}
+	}
+	free(snapshot->buckets);
+	free(snapshot->deleted);
+	free(snapshot);
+}
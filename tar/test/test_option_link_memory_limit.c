@@ -0,0 +1,65 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+DEFINE_TEST(test_option_link_memory_limit)
+{
+	assertMakeDir("in", 0755);
+	assertMakeFile("in/a", 0644, "aaa");
+	assertMakeHardlink("in/b", "in/a");
+	assertMakeHardlink("in/c", "in/a");
+	assertMakeFile("in/d", 0644, "d");
+
+	/* Links are still matched up with a limit. */
+	assertEqualInt(0, systemf("%s -cf t.tar --link-memory-limit 1 "
+	    "-C in a b c d >t.out 2>t.err", testprog));
+	assertEmptyFile("t.err");
+	assertMakeDir("out", 0755);
+	assertEqualInt(0, systemf("%s -xf t.tar -C out >x.out 2>x.err",
+	    testprog));
+	assertEmptyFile("x.err");
+	assertTextFileContents("aaa", "out/a");
+	assertIsHardlink("out/a", "out/b");
+	assertIsHardlink("out/a", "out/c");
+	assertTextFileContents("d", "out/d");
+
+	/* And for formats that store the body with the last link. */
+	assertEqualInt(0, systemf("%s -cf t.cpio --format newc "
+	    "--link-memory-limit 1 -C in a b c d >c.out 2>c.err", testprog));
+	assertEmptyFile("c.err");
+	assertMakeDir("cout", 0755);
+	assertEqualInt(0, systemf("%s -xf t.cpio -C cout >cx.out 2>cx.err",
+	    testprog));
+	assertEmptyFile("cx.err");
+	assertTextFileContents("aaa", "cout/a");
+	assertIsHardlink("cout/a", "cout/b");
+	assertIsHardlink("cout/a", "cout/c");
+
+	/* The option is only valid when writing. */
+	assert(0 != systemf("%s -xf t.tar --link-memory-limit 1 "
+	    ">e.out 2>e.err", testprog));
+	assert(0 != systemf("%s -cf u.tar --link-memory-limit x -C in a "
+	    ">e.out 2>e.err", testprog));
+}
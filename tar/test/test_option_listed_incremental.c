@@ -0,0 +1,112 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+__FBSDID("$FreeBSD$");
+
+DEFINE_TEST(test_option_listed_incremental)
+{
+	const char *full[] = { "d/", "d/f1", "d/f2", "d/sub/", "d/sub/f3",
+	    NULL };
+	const char *incr[] = { "d/", "d/f1", "d/f4", "d/.wh.f2",
+	    "d/.wh.sub", "d/.wh.f1", NULL };
+	const char *none[] = { "d/", NULL };
+
+	assertMakeDir("d", 0755);
+	assertMakeFile("d/f1", 0644, "f1");
+	assertMakeFile("d/f2", 0644, "f2");
+	assertMakeDir("d/sub", 0755);
+	assertMakeFile("d/sub/f3", 0644, "f3");
+
+	/* The first run has no snapshot to go by and archives everything. */
+	assertEqualInt(0, systemf("%s -cf full.tar --listed-incremental snap "
+	    "d >full.out 2>full.err", testprog));
+	assertEmptyFile("full.err");
+	assertFileExists("snap");
+	assertEqualInt(0, systemf("%s -tf full.tar >full.list", testprog));
+	assertFileContainsLinesAnyOrder("full.list", full);
+
+	/*
+	 * Change one file, add one, delete one file and a directory.  A
+	 * new file that looks like a marker is just a file.
+	 */
+	assertMakeFile("d/f1", 0644, "f1 changed");
+	assertMakeFile("d/f4", 0644, "f4");
+	assertMakeFile("d/.wh.f1", 0644, "not a marker");
+	assertEqualInt(0, unlink("d/f2"));
+	assertEqualInt(0, unlink("d/sub/f3"));
+	assertEqualInt(0, rmdir("d/sub"));
+
+	/*
+	 * The second run archives only what changed, and marks what went
+	 * away.  Nothing is marked below a deleted directory.
+	 */
+	assertEqualInt(0, systemf("%s -cf incr.tar --listed-incremental snap "
+	    "d >incr.out 2>incr.err", testprog));
+	assertEmptyFile("incr.err");
+	assertEqualInt(0, systemf("%s -tf incr.tar >incr.list", testprog));
+	assertFileContainsLinesAnyOrder("incr.list", incr);
+
+	/* With nothing changed, only the directory is archived. */
+	assertEqualInt(0, systemf("%s -cf none.tar --listed-incremental snap "
+	    "d >none.out 2>none.err", testprog));
+	assertEmptyFile("none.err");
+	assertEqualInt(0, systemf("%s -tf none.tar >none.list", testprog));
+	assertFileContainsLinesAnyOrder("none.list", none);
+
+	/*
+	 * Extracting the archives in order with the option removes what
+	 * the markers name, and only that.
+	 */
+	assertMakeDir("restore", 0755);
+	assertEqualInt(0, systemf("%s -xf full.tar -C restore "
+	    "--listed-incremental /dev/null >xfull.out 2>xfull.err",
+	    testprog));
+	assertEmptyFile("xfull.err");
+	assertFileExists("restore/d/f2");
+	assertIsDir("restore/d/sub", 0755);
+	assertEqualInt(0, systemf("%s -xf incr.tar -C restore "
+	    "--listed-incremental /dev/null >xincr.out 2>xincr.err",
+	    testprog));
+	assertEmptyFile("xincr.err");
+	assertFileNotExists("restore/d/f2");
+	assertFileNotExists("restore/d/.wh.f2");
+	assertFileNotExists("restore/d/sub");
+	assertFileNotExists("restore/d/.wh.sub");
+	assertTextFileContents("f1 changed", "restore/d/f1");
+	assertTextFileContents("f4", "restore/d/f4");
+	assertTextFileContents("not a marker", "restore/d/.wh.f1");
+
+	/* Without it, the markers are extracted as they are. */
+	assertMakeDir("plain", 0755);
+	assertEqualInt(0, systemf("%s -xf incr.tar -C plain --no-xattrs "
+	    ">xplain.out 2>xplain.err", testprog));
+	assertEmptyFile("xplain.err");
+	assertFileExists("plain/d/.wh.f2");
+	assertFileExists("plain/d/.wh.sub");
+
+	/* The option makes no sense when listing an archive. */
+	assert(0 != systemf("%s -tf none.tar --listed-incremental snap "
+	    ">bad.out 2>bad.err", testprog));
+}
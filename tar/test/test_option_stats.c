@@ -0,0 +1,60 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+DEFINE_TEST(test_option_stats)
+{
+	char *p;
+	size_t s;
+
+	assertMakeFile("f", 0644, "abcdefghij");
+
+	/* Every stage of creating the archive is reported. */
+	assertEqualInt(0,
+	    systemf("%s -czf t.tgz --stats f >c.out 2>c.err", testprog));
+	assertEmptyFile("c.out");
+	p = slurpfile(&s, "c.err");
+	assert(strstr(p, "stats: archive client calls=") != NULL);
+	assert(strstr(p, "stats: archive filter:gzip calls=") != NULL);
+	assert(strstr(p, "stats: archive format calls=") != NULL);
+	free(p);
+
+	/* So is extracting it, with the file system operations. */
+	assertMakeDir("out", 0755);
+	assertEqualInt(0,
+	    systemf("%s -xf t.tgz -C out --stats >x.out 2>x.err", testprog));
+	assertEmptyFile("x.out");
+	assertTextFileContents("abcdefghij", "out/f");
+	p = slurpfile(&s, "x.err");
+	assert(strstr(p, "stats: archive format calls=") != NULL);
+	assert(strstr(p, "stats: disk disk:create calls=1 ") != NULL);
+	assert(strstr(p, "stats: disk disk:write calls=1 bytes=10 ") != NULL);
+	free(p);
+
+	/* Nothing is printed without the option. */
+	assertEqualInt(0,
+	    systemf("%s -tf t.tgz >t.out 2>t.err", testprog));
+	assertEmptyFile("t.err");
+}
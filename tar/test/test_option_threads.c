@@ -0,0 +1,82 @@
+/*-
+ * Copyright (c) 2026 libarchive contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "test.h"
+
+DEFINE_TEST(test_option_threads)
+{
+	char name[16], *p;
+	size_t s;
+	int i;
+
+	assertMakeDir("in", 0755);
+	assertMakeDir("in/d", 0755);
+	for (i = 0; i < 20; i++) {
+		snprintf(name, sizeof(name), "in/d/f%d", i);
+		assertMakeFile(name, 0644, name + 3);
+	}
+	assertMakeFile("in/a", 0644, "a");
+	assertMakeFile("in/d/b", 0644, "bb");
+	assertMakeFile("in/d/c", 0644, "ccc");
+	assertMakeDir("in/d/e", 0700);
+	assertMakeFile("in/d/e/f", 0644, "ffff");
+	assertEqualInt(0, systemf("%s -cf t.zip --format zip -C in a d",
+	    testprog));
+
+	/* The files of a Zip archive are extracted on several threads,
+	 * into a directory given with -C. */
+	assertMakeDir("out", 0755);
+	assertEqualInt(0, systemf("%s -xvf t.zip --threads 3 -C out "
+	    ">x.out 2>x.err", testprog));
+	assertEmptyFile("x.out");
+	assertTextFileContents("a", "out/a");
+	assertTextFileContents("bb", "out/d/b");
+	assertTextFileContents("ccc", "out/d/c");
+	assertTextFileContents("ffff", "out/d/e/f");
+	assertIsDir("out/d/e", 0700);
+	for (i = 0; i < 20; i++) {
+		snprintf(name, sizeof(name), "out/d/f%d", i);
+		assertTextFileContents(name + 4, name);
+	}
+	/* Every entry is reported on a line of its own. */
+	p = slurpfile(&s, "x.err");
+	assert(strstr(p, "x d/b\n") != NULL);
+	assert(strstr(p, "x d/e/f\n") != NULL);
+	free(p);
+
+	/* Patterns still select the entries. */
+	assertMakeDir("sel", 0755);
+	assertEqualInt(0, systemf("%s -xf t.zip --threads 0 -C sel d/c "
+	    ">s.out 2>s.err", testprog));
+	assertEmptyFile("s.err");
+	assertTextFileContents("ccc", "sel/d/c");
+	assertFileNotExists("sel/a");
+	assertFileNotExists("sel/d/b");
+
+	/* The option is only valid when extracting. */
+	assert(0 != systemf("%s -tf t.zip --threads 2 >t.out 2>t.err",
+	    testprog));
+	assert(0 != systemf("%s -xf t.zip --threads x >t.out 2>t.err",
+	    testprog));
+}
@@ -582,6 +582,29 @@ tar_i64toa(int64_t n0)
 	return p;
 }
 
+/*
+ * Print the statistics of an archive object, one line per stage,
+ * for --stats.
+ */
+void
+tar_print_stats(struct archive *a, const char *what)
+{
+	int i;
+
+	fflush(stdout);
+	for (i = 0; i < archive_stats_count(a); i++) {
+		fprintf(stderr, "stats: %s %s", what, archive_stats_name(a, i));
+		fprintf(stderr, " calls=%s",
+		    tar_i64toa(archive_stats_calls(a, i)));
+		fprintf(stderr, " bytes=%s",
+		    tar_i64toa(archive_stats_bytes(a, i)));
+		fprintf(stderr, " wall_us=%s",
+		    tar_i64toa(archive_stats_wall_nsec(a, i) / 1000));
+		fprintf(stderr, " cpu_us=%s\n",
+		    tar_i64toa(archive_stats_cpu_nsec(a, i) / 1000));
+	}
+}
+
 /*
  * Like strcmp(), but try to be a little more aware of the fact that
  * we're comparing two paths.  Right now, it just handles leading
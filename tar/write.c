@@ -70,6 +70,9 @@ __FBSDID("$FreeBSD: src/usr.bin/tar/write.c,v 1.79 2008/11/27 05:49:52 kientzle
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -110,6 +113,7 @@ static void		 test_for_append(struct bsdtar *);
 static int		 metadata_filter(struct archive *, void *,
 			     struct archive_entry *);
 static void		 write_archive(struct archive *, struct bsdtar *);
+static void		 write_deletions(struct bsdtar *, struct archive *);
 static void		 write_entry(struct bsdtar *, struct archive *,
 			     struct archive_entry *);
 static void		 write_file(struct bsdtar *, struct archive *,
@@ -165,6 +169,9 @@ set_writer_options(struct bsdtar *bsdtar, struct archive *a)
 	}
 	if (ARCHIVE_OK != archive_write_set_options(a, bsdtar->option_options))
 		lafe_errc(1, 0, "%s", archive_error_string(a));
+	if ((bsdtar->flags & OPTFLAG_STATS) &&
+	    archive_stats_enable(a) != ARCHIVE_OK)
+		lafe_errc(1, 0, "%s", archive_error_string(a));
 }
 
 static void
@@ -248,7 +255,17 @@ tar_mode_c(struct bsdtar *bsdtar)
 		lafe_errc(1, 0, "%s", archive_error_string(a));
 	if (ARCHIVE_OK != archive_write_open_filename(a, bsdtar->filename))
 		lafe_errc(1, 0, "%s", archive_error_string(a));
+	if (bsdtar->snapshot_file != NULL)
+		bsdtar->snapshot = snapshot_read(bsdtar->snapshot_file);
 	write_archive(a, bsdtar);
+	if (bsdtar->snapshot != NULL) {
+		/* Only a complete archive may stand for the new state. */
+		if (bsdtar->return_value == 0 &&
+		    snapshot_write(bsdtar->snapshot, bsdtar->snapshot_file))
+			bsdtar->return_value = 1;
+		snapshot_free(bsdtar->snapshot);
+		bsdtar->snapshot = NULL;
+	}
 }
 
 /*
@@ -456,6 +473,8 @@ write_archive(struct archive *a, struct bsdtar *bsdtar)
 		lafe_errc(1, 0, "cannot create link resolver");
 	archive_entry_linkresolver_set_strategy(bsdtar->resolver,
 	    archive_format(a));
+	archive_entry_linkresolver_set_memory_limit(bsdtar->resolver,
+	    bsdtar->link_memory_limit);
 
 	/* Create a read_disk object. */
 	if ((bsdtar->diskreader = archive_read_disk_new()) == NULL)
@@ -519,6 +538,9 @@ write_archive(struct archive *a, struct bsdtar *bsdtar)
 		bsdtar->argv++;
 	}
 
+	if (bsdtar->snapshot != NULL)
+		write_deletions(bsdtar, a);
+
 	archive_read_disk_set_matching(bsdtar->diskreader, NULL, NULL, NULL);
 	archive_read_disk_set_metadata_filter_callback(
 	    bsdtar->diskreader, NULL, NULL);
@@ -589,6 +611,8 @@ cleanup:
 		fprintf(stderr, "Total bytes written: %s\n",
 		    tar_i64toa(archive_filter_bytes(a, -1)));
 	}
+	if (bsdtar->flags & OPTFLAG_STATS)
+		tar_print_stats(a, "archive");
 
 	archive_write_free(a);
 }
@@ -813,6 +837,8 @@ excluded_callback(struct archive *a, void *_data, struct archive_entry *entry)
 {
 	struct bsdtar *bsdtar = (struct bsdtar *)_data;
 
+	if (bsdtar->snapshot != NULL)
+		snapshot_exclude(bsdtar->snapshot, entry);
 	if (bsdtar->flags & OPTFLAG_NO_SUBDIRS)
 		return;
 	if (!archive_read_disk_can_descend(a))
@@ -842,6 +868,15 @@ metadata_filter(struct archive *a, void *_data, struct archive_entry *entry)
 	 * Use archive_read_disk_current_filesystem_is_remote().
 	 */
 
+	/*
+	 * With --listed-incremental, skip files that have not
+	 * changed since they were last archived.  Nothing has to
+	 * be opened to find out.
+	 */
+	if (bsdtar->snapshot != NULL &&
+	    snapshot_check(bsdtar->snapshot, entry))
+		return (0);
+
 	/*
 	 * If the user vetoes this file/directory, skip it.
 	 * We want this to be fairly late; if some other
@@ -953,6 +988,58 @@ write_hierarchy(struct bsdtar *bsdtar, struct archive *a, const char *path)
 	archive_read_close(disk);
 }
 
+/*
+ * Record each path that was archived by the last --listed-incremental
+ * run but has since disappeared.  Following the OCI image layer
+ * convention, a deleted "dir/name" is marked by an empty file
+ * "dir/.wh.name"; the marker also carries WHITEOUT_XATTR, so that it
+ * can be told from a file that merely has such a name.  Extracting
+ * with --listed-incremental removes the named file instead.
+ */
+static void
+write_deletions(struct bsdtar *bsdtar, struct archive *a)
+{
+	struct archive_entry *entry;
+	const char *path, *base;
+	char *name;
+	size_t dirlen;
+
+	while ((path = snapshot_next_deleted(bsdtar->snapshot)) != NULL) {
+		base = strrchr(path, '/');
+		base = (base == NULL) ? path : base + 1;
+		dirlen = base - path;
+		name = malloc(dirlen + strlen(base) + 5);
+		if (name == NULL)
+			lafe_errc(1, ENOMEM, "Can't allocate memory");
+		memcpy(name, path, dirlen);
+		strcpy(name + dirlen, ".wh.");
+		strcat(name + dirlen, base);
+
+		entry = archive_entry_new();
+		archive_entry_copy_pathname(entry, name);
+		archive_entry_set_filetype(entry, AE_IFREG);
+		archive_entry_set_perm(entry, 0644);
+		archive_entry_set_size(entry, 0);
+		archive_entry_set_mtime(entry, time(NULL), 0);
+		archive_entry_xattr_add_entry(entry, WHITEOUT_XATTR,
+		    base, strlen(base));
+		free(name);
+
+		if (edit_pathname(bsdtar, entry) == 0) {
+			if (bsdtar->verbose > 1) {
+				safe_fprintf(stderr, "a ");
+				list_item_verbose(bsdtar, stderr, entry);
+			} else if (bsdtar->verbose > 0)
+				safe_fprintf(stderr, "a %s",
+				    archive_entry_pathname(entry));
+			write_entry(bsdtar, a, entry);
+			if (bsdtar->verbose)
+				fprintf(stderr, "\n");
+		}
+		archive_entry_free(entry);
+	}
+}
+
 /*
  * Write a single file (or directory or other filesystem object) to
  * the archive.
@@ -990,6 +1077,12 @@ write_entry(struct bsdtar *bsdtar, struct archive *a,
 	if (e == ARCHIVE_FATAL)
 		exit(1);
 
+	/* Remember what was archived for the next incremental run. */
+	if (e >= ARCHIVE_WARN && bsdtar->snapshot != NULL &&
+	    archive_entry_sourcepath(entry) != NULL)
+		snapshot_commit(bsdtar->snapshot,
+		    archive_entry_sourcepath(entry));
+
 	/*
 	 * If we opened a file earlier, write it out now.  Note that
 	 * the format handler might have reset the size field to zero